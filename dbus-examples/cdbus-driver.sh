@@ -38,6 +38,9 @@ else
   echo "Cannot find focused window."
 fi
 
+# Get statistics of the outgoing message queue
+dbus-send --print-reply --dest="$service" "$object" "${interface}.stats_get" string:max_pending_signals
+
 # Reset compton
 sleep 3
 dbus-send --print-reply --dest="$service" "$object" "${interface}.reset"
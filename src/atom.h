@@ -38,7 +38,8 @@
 	_NET_WM_WINDOW_TYPE_DND, \
 	_NET_WM_STATE, \
 	_NET_WM_STATE_FULLSCREEN, \
-	_NET_WM_BYPASS_COMPOSITOR
+	_NET_WM_BYPASS_COMPOSITOR, \
+	_PICOM_TRANSACTION
 // clang-format on
 
 #define ATOM_DEF(x) xcb_atom_t a##x
@@ -7,8 +7,11 @@
 #include "common.h"
 #include "compiler.h"
 #include "config.h"
+#include "hud.h"
 #include "log.h"
+#include "probe.h"
 #include "region.h"
+#include "spatial.h"
 #include "types.h"
 #include "win.h"
 #include "x.h"
@@ -53,6 +56,82 @@ region_t get_damage(session_t *ps, bool all_damage) {
 	return region;
 }
 
+/// Paint the shadow of `w`, clipped to `reg_shadow`
+static void paint_shadow(session_t *ps, struct managed_win *w, const region_t *reg_shadow,
+                         const region_t *reg_visible) {
+	assert(w->shadow_image);
+	if (w->opacity == 1) {
+		ps->backend_data->ops->compose(ps->backend_data, w->shadow_image,
+		                               w->g.x + w->shadow_dx, w->g.y + w->shadow_dy,
+		                               reg_shadow, reg_visible);
+	} else {
+		auto new_img = ps->backend_data->ops->copy(ps->backend_data,
+		                                           w->shadow_image, reg_visible);
+		ps->backend_data->ops->image_op(ps->backend_data, IMAGE_OP_APPLY_ALPHA_ALL,
+		                                new_img, NULL, reg_visible,
+		                                (double[]){w->opacity});
+		ps->backend_data->ops->compose(ps->backend_data, new_img,
+		                               w->g.x + w->shadow_dx, w->g.y + w->shadow_dy,
+		                               reg_shadow, reg_visible);
+		ps->backend_data->ops->release_image(ps->backend_data, new_img);
+	}
+}
+
+/// Paint `image_data`, the (possibly processed) image of `w`, clipped to `reg_paint`.
+/// If `reg_shadow` is not NULL, the shadow of `w` is painted below it, clipped to
+/// `reg_shadow`. The backend is asked to draw both in one pass if it can, in which
+/// case the window opacity is applied to the shadow without copying it.
+static void paint_window(session_t *ps, struct managed_win *w, void *image_data,
+                         const region_t *reg_paint, const region_t *reg_shadow,
+                         const region_t *reg_visible) {
+	if (reg_shadow && ps->backend_data->ops->compose_with_shadow) {
+		assert(w->shadow_image);
+		ps->backend_data->ops->compose_with_shadow(
+		    ps->backend_data, image_data, w->g.x, w->g.y, w->shadow_image,
+		    w->g.x + w->shadow_dx, w->g.y + w->shadow_dy, w->opacity, reg_paint,
+		    reg_shadow, reg_visible);
+		return;
+	}
+	if (reg_shadow) {
+		paint_shadow(ps, w, reg_shadow, reg_visible);
+	}
+	ps->backend_data->ops->compose(ps->backend_data, image_data, w->g.x, w->g.y,
+	                               reg_paint, reg_visible);
+}
+
+/// Sort windows from bottom to top
+static int paint_order_cmp(const void *a, const void *b) {
+	auto w1 = *(struct managed_win *const *)a, w2 = *(struct managed_win *const *)b;
+	return w2->stacking_rank - w1->stacking_rank;
+}
+
+/// Find the windows to paint that touch `reg_paint`, from bottom to top. Uses the
+/// spatial index, so the cost depends on the number of windows near the damage, not
+/// on the total number of windows. Returns the number of windows found, the array
+/// has to be freed by the caller.
+static size_t find_windows_to_paint(session_t *ps, const region_t *reg_paint,
+                                    struct managed_win ***ret) {
+	size_t nnodes;
+	auto nodes = spatial_index_query(ps->spatial_index, reg_paint, &nnodes);
+	if (nnodes == 0) {
+		*ret = NULL;
+		return 0;
+	}
+
+	auto windows = ccalloc(nnodes, struct managed_win *);
+	size_t nwindows = 0;
+	for (size_t i = 0; i < nnodes; i++) {
+		auto w = list_entry(nodes[i], struct managed_win, spatial_node);
+		// Only the windows painted in this frame have a valid stacking_rank
+		if (w->to_paint) {
+			windows[nwindows++] = w;
+		}
+	}
+	qsort(windows, nwindows, sizeof(*windows), paint_order_cmp);
+	*ret = windows;
+	return nwindows;
+}
+
 /// paint all windows
 void paint_all_new(session_t *ps, struct managed_win *t, bool ignore_damage) {
 	if (ps->o.xrender_sync_fence) {
@@ -65,16 +144,26 @@ void paint_all_new(session_t *ps, struct managed_win *t, bool ignore_damage) {
 			ps->xsync_exists = false;
 		}
 	}
+	ps->render_stats.last_blur_passes = 0;
+	ps->render_stats.last_present_time_us = 0;
+	ps->render_stats.last_x_bytes = 0;
+
 	// All painting will be limited to the damage, if _some_ of
 	// the paints bleed out of the damage region, it will destroy
 	// part of the image we want to reuse
 	region_t reg_damage;
+	if (ps->hud) {
+		// The overlay changes every frame
+		hud_add_damage(ps);
+	}
 	if (!ignore_damage) {
 		reg_damage = get_damage(ps, ps->o.monitor_repaint || !ps->o.use_damage);
 	} else {
 		pixman_region32_init(&reg_damage);
 		pixman_region32_copy(&reg_damage, &ps->screen_reg);
 	}
+	// Windows unredirected on their own are drawn by the X server
+	pixman_region32_subtract(&reg_damage, &reg_damage, &ps->unredir_region);
 
 	if (!pixman_region32_not_empty(&reg_damage)) {
 		pixman_region32_fini(&reg_damage);
@@ -163,7 +252,13 @@ void paint_all_new(session_t *ps, struct managed_win *t, bool ignore_damage) {
 	// on top of that window. This is used to reduce the number of pixels painted.
 	//
 	// Whether this is beneficial is to be determined XXX
-	for (auto w = t; w; w = w->prev_trans) {
+	//
+	// Everything below is clipped to reg_paint, windows that don't touch it can be
+	// skipped.
+	struct managed_win **windows;
+	size_t nwindows = find_windows_to_paint(ps, &reg_paint, &windows);
+	for (size_t i = 0; i < nwindows; i++) {
+		auto w = windows[i];
 		pixman_region32_subtract(&reg_visible, &ps->screen_reg, w->reg_ignore);
 		assert(!(w->flags & WIN_FLAGS_IMAGE_ERROR));
 		assert(!(w->flags & WIN_FLAGS_PIXMAP_STALE));
@@ -241,6 +336,7 @@ void paint_all_new(session_t *ps, struct managed_win *t, bool ignore_damage) {
 				ps->backend_data->ops->blur(
 				    ps->backend_data, blur_opacity, ps->backend_blur_context,
 				    &reg_paint_in_bound, &reg_visible);
+				ps->render_stats.last_blur_passes++;
 			} else {
 				// Window itself is solid, we only need to blur the frame
 				// region
@@ -261,17 +357,21 @@ void paint_all_new(session_t *ps, struct managed_win *t, bool ignore_damage) {
 				ps->backend_data->ops->blur(ps->backend_data, blur_opacity,
 				                            ps->backend_blur_context,
 				                            &reg_blur, &reg_visible);
+				ps->render_stats.last_blur_passes++;
 				pixman_region32_fini(&reg_blur);
 			}
 		}
 
-		// Draw shadow on target
+		// Clip region for the shadow, the shadow is drawn together with the
+		// window below
+		// reg_shadow \in reg_paint
+		region_t reg_shadow;
+		pixman_region32_init(&reg_shadow);
 		if (w->shadow) {
 			assert(!(w->flags & WIN_FLAGS_SHADOW_NONE));
-			// Clip region for the shadow
-			// reg_shadow \in reg_paint
-			auto reg_shadow = win_extents_by_val(w);
-			pixman_region32_intersect(&reg_shadow, &reg_shadow, &reg_paint);
+			auto reg_extents = win_extents_by_val(w);
+			pixman_region32_intersect(&reg_shadow, &reg_extents, &reg_paint);
+			pixman_region32_fini(&reg_extents);
 			if (!ps->o.wintype_option[w->window_type].full_shadow) {
 				pixman_region32_subtract(&reg_shadow, &reg_shadow, &reg_bound);
 			}
@@ -301,25 +401,8 @@ void paint_all_new(session_t *ps, struct managed_win *t, bool ignore_damage) {
 				pixman_region32_intersect(&reg_shadow, &reg_shadow,
 				                          &reg_visible);
 			}
-
-			assert(w->shadow_image);
-			if (w->opacity == 1) {
-				ps->backend_data->ops->compose(
-				    ps->backend_data, w->shadow_image, w->g.x + w->shadow_dx,
-				    w->g.y + w->shadow_dy, &reg_shadow, &reg_visible);
-			} else {
-				auto new_img = ps->backend_data->ops->copy(
-				    ps->backend_data, w->shadow_image, &reg_visible);
-				ps->backend_data->ops->image_op(
-				    ps->backend_data, IMAGE_OP_APPLY_ALPHA_ALL, new_img,
-				    NULL, &reg_visible, (double[]){w->opacity});
-				ps->backend_data->ops->compose(
-				    ps->backend_data, new_img, w->g.x + w->shadow_dx,
-				    w->g.y + w->shadow_dy, &reg_shadow, &reg_visible);
-				ps->backend_data->ops->release_image(ps->backend_data, new_img);
-			}
-			pixman_region32_fini(&reg_shadow);
 		}
+		const region_t *reg_shadow_ptr = w->shadow ? &reg_shadow : NULL;
 
 		// Set max brightness
 		if (ps->o.max_brightness < 1.0) {
@@ -330,9 +413,8 @@ void paint_all_new(session_t *ps, struct managed_win *t, bool ignore_damage) {
 
 		// Draw window on target
 		if (!w->invert_color && !w->dim && w->frame_opacity == 1 && w->opacity == 1) {
-			ps->backend_data->ops->compose(ps->backend_data, w->win_image,
-			                               w->g.x, w->g.y,
-			                               &reg_paint_in_bound, &reg_visible);
+			paint_window(ps, w, w->win_image, &reg_paint_in_bound,
+			             reg_shadow_ptr, &reg_visible);
 		} else if (w->opacity * MAX_ALPHA >= 1) {
 			// We don't need to paint the window body itself if it's
 			// completely transparent.
@@ -390,16 +472,20 @@ void paint_all_new(session_t *ps, struct managed_win *t, bool ignore_damage) {
 				    ps->backend_data, IMAGE_OP_APPLY_ALPHA_ALL, new_img,
 				    NULL, &reg_visible_local, (double[]){w->opacity});
 			}
-			ps->backend_data->ops->compose(ps->backend_data, new_img, w->g.x,
-			                               w->g.y, &reg_paint_in_bound,
-			                               &reg_visible);
+			paint_window(ps, w, new_img, &reg_paint_in_bound, reg_shadow_ptr,
+			             &reg_visible);
 			ps->backend_data->ops->release_image(ps->backend_data, new_img);
 			pixman_region32_fini(&reg_visible_local);
 			pixman_region32_fini(&reg_bound_local);
+		} else if (w->shadow) {
+			// The window body is invisible, but its shadow might not be
+			paint_shadow(ps, w, &reg_shadow, &reg_visible);
 		}
+		pixman_region32_fini(&reg_shadow);
 		pixman_region32_fini(&reg_bound);
 		pixman_region32_fini(&reg_paint_in_bound);
 	}
+	free(windows);
 	pixman_region32_fini(&reg_paint);
 
 	if (ps->o.monitor_repaint) {
@@ -409,6 +495,10 @@ void paint_all_new(session_t *ps, struct managed_win *t, bool ignore_damage) {
 		pixman_region32_fini(&reg_damage_debug);
 	}
 
+	if (ps->hud) {
+		hud_draw(ps, ps->hud, &reg_damage);
+	}
+
 	// Move the head of the damage ring
 	ps->damage = ps->damage - 1;
 	if (ps->damage < ps->damage_ring) {
@@ -419,7 +509,18 @@ void paint_all_new(session_t *ps, struct managed_win *t, bool ignore_damage) {
 	if (ps->backend_data->ops->present) {
 		// Present the rendered scene
 		// Vsync is done here
+		auto present_start = get_time_timespec();
+		PROBE(present_begin, ps->render_stats.frames);
 		ps->backend_data->ops->present(ps->backend_data, &reg_damage);
+		PROBE(present_end, ps->render_stats.frames);
+		// Don't start the next frame before the backend says this one is on
+		// screen, see handle_vblank()
+		ps->frame_pending = ps->backend_data->busy;
+		struct timespec present_end = get_time_timespec(), present_time;
+		timespec_subtract(&present_time, &present_end, &present_start);
+		ps->render_stats.last_present_time_us =
+		    (uint64_t)present_time.tv_sec * 1000000UL +
+		    (uint64_t)present_time.tv_nsec / 1000UL;
 	}
 
 	pixman_region32_fini(&reg_damage);
@@ -25,7 +25,9 @@ typedef struct backend_base {
 	xcb_window_t root;
 	struct ev_loop *loop;
 
-	/// Whether the backend can accept new render request at the moment
+	/// Whether the backend can accept new render request at the moment. Backends
+	/// that report when frames reach the screen set this in `present`, and
+	/// clear it once `handle_events` sees the frame on screen.
 	bool busy;
 	// ...
 } backend_t;
@@ -129,6 +131,30 @@ struct backend_operations {
 	void (*compose)(backend_t *backend_data, void *image_data, int dst_x, int dst_y,
 	                const region_t *reg_paint, const region_t *reg_visible);
 
+	/**
+	 * Paint the content of an image and its shadow onto the rendering buffer in
+	 * one go. The result should be the same as composing `shadow_data`, with its
+	 * opacity multiplied by `shadow_opacity`, in `reg_shadow`, then composing
+	 * `image_data` in `reg_paint`.
+	 *
+	 * Optional. If NULL, the shadow and the image are composed separately.
+	 *
+	 * @param backend_data   the backend data
+	 * @param image_data     the image to paint
+	 * @param dst_x, dst_y   the top left corner of the image in the target
+	 * @param shadow_data    the shadow image to paint below the image
+	 * @param shadow_x, shadow_y the top left corner of the shadow in the target
+	 * @param shadow_opacity extra opacity applied to the shadow
+	 * @param reg_paint      the clip region of the image, in target coordinates
+	 * @param reg_shadow     the clip region of the shadow, in target coordinates
+	 * @param reg_visible    the visible region, in target coordinates
+	 */
+	void (*compose_with_shadow)(backend_t *backend_data, void *image_data, int dst_x,
+	                            int dst_y, void *shadow_data, int shadow_x,
+	                            int shadow_y, double shadow_opacity,
+	                            const region_t *reg_paint, const region_t *reg_shadow,
+	                            const region_t *reg_visible);
+
 	/// Fill rectangle of the rendering buffer, mostly for debug purposes, optional.
 	void (*fill)(backend_t *backend_data, struct color, const region_t *clip);
 
@@ -189,6 +215,13 @@ struct backend_operations {
 	/// The maximum number buffer_age might return.
 	int max_buffer_age;
 
+	/// Process the events the backend receives from the X server. Called after the
+	/// X events are handled. Returns true if the frame the backend was `busy`
+	/// presenting has reached the screen.
+	///
+	/// Optional
+	bool (*handle_events)(backend_t *backend_data);
+
 	// ===========    Post-processing   ============
 	/**
 	 * Manipulate an image
@@ -218,13 +251,22 @@ struct backend_operations {
 	/// Get how many pixels outside of the blur area is needed for blur
 	void (*get_blur_size)(void *blur_context, int *width, int *height);
 
+	/// Release the scratch buffers kept around for reuse, including those of the
+	/// blur context `blur_ctx`, which can be NULL. They are allocated again when
+	/// they are needed. Called when the compositor has been idle for a while.
+	/// Returns roughly how many bytes were released.
+	///
+	/// Optional
+	size_t (*trim_memory)(backend_t *backend_data, void *blur_ctx);
+	/// Same as `trim_memory`, for the scratch buffers attached to an image
+	///
+	/// Optional
+	size_t (*trim_image)(backend_t *backend_data, void *image_data);
+
 	// ===========         Hooks        ============
 	/// Let the backend hook into the event handling queue
 	/// Not implemented yet
 	void (*set_ready_callback)(backend_t *, backend_ready_callback_t cb);
-	/// Called right after the core has handled its events.
-	/// Not implemented yet
-	void (*handle_events)(backend_t *);
 	// ===========         Misc         ============
 	/// Return the driver that is been used by the backend
 	enum driver (*detect_driver)(backend_t *backend_data);
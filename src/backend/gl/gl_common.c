@@ -27,11 +27,23 @@
 
 static const GLuint vert_coord_loc = 0;
 static const GLuint vert_in_texcoord_loc = 1;
+static const GLuint vert_in_shadow_texcoord_loc = 2;
+static const GLuint vert_in_layers_loc = 3;
+
+/// Size of the tiles compute shader blur works on, in both directions
+#define BLUR_TILE_SIZE 16
 
 struct gl_blur_context {
 	enum blur_method method;
 	gl_blur_shader_t *blur_shader;
 
+	/// Compute shaders applying the blur kernels, one per kernel. NULL if blur is
+	/// done with the fragment shaders in `blur_shader`.
+	gl_blur_compute_shader_t *compute_shader;
+	int ncompute_passes;
+	/// Blends the result of the compute shaders into the back buffer
+	gl_blur_shader_t blend_shader;
+
 	/// Temporary textures used for blurring. They are always the same size as the
 	/// target, so they are always big enough without resizing.
 	/// Turns out calling glTexImage to resize is expensive, so we avoid that.
@@ -345,6 +357,31 @@ static GLuint gl_average_texture_color(backend_t *base, struct gl_image *img) {
 	return result_texture;
 }
 
+/// Set the uniforms of a window shader from the parameters of `img`. The shader
+/// program must be in use. The window texture is expected in texture unit 0, and its
+/// average color in texture unit 1.
+static void
+gl_set_win_shader_uniforms(const gl_win_shader_t *shader, const struct gl_image *img) {
+	if (shader->unifm_opacity >= 0) {
+		glUniform1f(shader->unifm_opacity, (float)img->opacity);
+	}
+	if (shader->unifm_invert_color >= 0) {
+		glUniform1i(shader->unifm_invert_color, img->color_inverted);
+	}
+	if (shader->unifm_tex >= 0) {
+		glUniform1i(shader->unifm_tex, 0);
+	}
+	if (shader->unifm_dim >= 0) {
+		glUniform1f(shader->unifm_dim, (float)img->dim);
+	}
+	if (shader->unifm_brightness >= 0) {
+		glUniform1i(shader->unifm_brightness, 1);
+	}
+	if (shader->unifm_max_brightness >= 0) {
+		glUniform1f(shader->unifm_max_brightness, (float)img->max_brightness);
+	}
+}
+
 /**
  * Render a region with texture data.
  *
@@ -370,24 +407,7 @@ static void _gl_compose(backend_t *base, struct gl_image *img, GLuint target,
 
 	assert(gd->win_shader.prog);
 	glUseProgram(gd->win_shader.prog);
-	if (gd->win_shader.unifm_opacity >= 0) {
-		glUniform1f(gd->win_shader.unifm_opacity, (float)img->opacity);
-	}
-	if (gd->win_shader.unifm_invert_color >= 0) {
-		glUniform1i(gd->win_shader.unifm_invert_color, img->color_inverted);
-	}
-	if (gd->win_shader.unifm_tex >= 0) {
-		glUniform1i(gd->win_shader.unifm_tex, 0);
-	}
-	if (gd->win_shader.unifm_dim >= 0) {
-		glUniform1f(gd->win_shader.unifm_dim, (float)img->dim);
-	}
-	if (gd->win_shader.unifm_brightness >= 0) {
-		glUniform1i(gd->win_shader.unifm_brightness, 1);
-	}
-	if (gd->win_shader.unifm_max_brightness >= 0) {
-		glUniform1f(gd->win_shader.unifm_max_brightness, (float)img->max_brightness);
-	}
+	gl_set_win_shader_uniforms(&gd->win_shader, img);
 
 	// log_trace("Draw: %d, %d, %d, %d -> %d, %d (%d, %d) z %d\n",
 	//          x, y, width, height, dx, dy, ptex->width, ptex->height, z);
@@ -533,6 +553,195 @@ void gl_compose(backend_t *base, void *image_data, int dst_x, int dst_y,
 	free(coord);
 }
 
+void gl_compose_with_shadow(backend_t *base, void *image_data, int dst_x, int dst_y,
+                            void *shadow_data, int shadow_x, int shadow_y,
+                            double shadow_opacity, const region_t *reg_tgt,
+                            const region_t *reg_shadow, const region_t *reg_visible) {
+	auto gd = (struct gl_data *)base;
+	struct gl_image *img = image_data;
+	struct gl_image *shadow = shadow_data;
+
+	if (!gd->shadowed_win_shader.base.prog) {
+		// The shadow image is just a reference to a texture, so applying the
+		// opacity on a copy of it is cheap.
+		struct gl_image shadow_copy = *shadow;
+		shadow_copy.opacity *= shadow_opacity;
+		gl_compose(base, &shadow_copy, shadow_x, shadow_y, reg_shadow, reg_visible);
+		gl_compose(base, img, dst_x, dst_y, reg_tgt, reg_visible);
+		return;
+	}
+
+	if (!img->inner->texture || !shadow->inner->texture) {
+		log_error("Missing texture.");
+		return;
+	}
+
+	// Split the painted area into the parts covered by both the window and the
+	// shadow, by the window only, and by the shadow only. Each vertex carries a
+	// mask telling the shader which of the two it should sample.
+	static const GLint layer_masks[3][2] = {{1, 1}, {1, 0}, {0, 1}};
+	region_t layers[3];
+	for (int i = 0; i < 3; i++) {
+		pixman_region32_init(&layers[i]);
+	}
+	pixman_region32_intersect(&layers[0], (region_t *)reg_tgt, (region_t *)reg_shadow);
+	pixman_region32_subtract(&layers[1], (region_t *)reg_tgt, (region_t *)reg_shadow);
+	pixman_region32_subtract(&layers[2], (region_t *)reg_shadow, (region_t *)reg_tgt);
+
+	int nrects = 0;
+	for (int i = 0; i < 3; i++) {
+		nrects += pixman_region32_n_rects(&layers[i]);
+	}
+	if (!nrects) {
+		// Nothing to paint
+		for (int i = 0; i < 3; i++) {
+			pixman_region32_fini(&layers[i]);
+		}
+		return;
+	}
+
+	auto rects = ccalloc(nrects, rect_t);
+	auto masks = ccalloc(nrects * 8, GLint);
+	int offset = 0;
+	for (int i = 0; i < 3; i++) {
+		int nlayer_rects;
+		const rect_t *layer_rects =
+		    pixman_region32_rectangles(&layers[i], &nlayer_rects);
+		memcpy(&rects[offset], layer_rects, sizeof(rect_t) * (size_t)nlayer_rects);
+		for (int j = offset * 4; j < (offset + nlayer_rects) * 4; j++) {
+			memcpy(&masks[j * 2], layer_masks[i], sizeof(GLint[2]));
+		}
+		offset += nlayer_rects;
+		pixman_region32_fini(&layers[i]);
+	}
+
+	// Both sets of coordinates share the same vertices, so the indices are the same
+	auto coord = ccalloc(nrects * 16, GLint);
+	auto shadow_coord = ccalloc(nrects * 16, GLint);
+	auto indices = ccalloc(nrects * 6, GLuint);
+	x_rect_to_coords(nrects, rects, dst_x, dst_y, img->inner->height, gd->height,
+	                 img->inner->y_inverted, coord, indices);
+	x_rect_to_coords(nrects, rects, shadow_x, shadow_y, shadow->inner->height,
+	                 gd->height, shadow->inner->y_inverted, shadow_coord, indices);
+
+	GLuint brightness = 0;
+	if (img->max_brightness < 1.0) {
+		brightness = gl_average_texture_color(base, img);
+	}
+
+	auto shader = &gd->shadowed_win_shader;
+	glUseProgram(shader->base.prog);
+	gl_set_win_shader_uniforms(&shader->base, img);
+	if (shader->unifm_shadow_tex >= 0) {
+		glUniform1i(shader->unifm_shadow_tex, 2);
+	}
+	if (shader->unifm_shadow_opacity >= 0) {
+		glUniform1f(shader->unifm_shadow_opacity,
+		            (float)(shadow->opacity * shadow_opacity));
+	}
+
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, shadow->inner->texture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, brightness);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, img->inner->texture);
+
+	GLuint vao;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	GLuint bo[4];
+	glGenBuffers(4, bo);
+	glBindBuffer(GL_ARRAY_BUFFER, bo[0]);
+	glBufferData(GL_ARRAY_BUFFER, (long)sizeof(*coord) * nrects * 16, coord, GL_STREAM_DRAW);
+	glEnableVertexAttribArray(vert_coord_loc);
+	glEnableVertexAttribArray(vert_in_texcoord_loc);
+	glVertexAttribPointer(vert_coord_loc, 2, GL_INT, GL_FALSE, sizeof(GLint) * 4, NULL);
+	glVertexAttribPointer(vert_in_texcoord_loc, 2, GL_INT, GL_FALSE,
+	                      sizeof(GLint) * 4, (void *)(sizeof(GLint) * 2));
+
+	glBindBuffer(GL_ARRAY_BUFFER, bo[1]);
+	glBufferData(GL_ARRAY_BUFFER, (long)sizeof(*shadow_coord) * nrects * 16,
+	             shadow_coord, GL_STREAM_DRAW);
+	glEnableVertexAttribArray(vert_in_shadow_texcoord_loc);
+	glVertexAttribPointer(vert_in_shadow_texcoord_loc, 2, GL_INT, GL_FALSE,
+	                      sizeof(GLint) * 4, (void *)(sizeof(GLint) * 2));
+
+	glBindBuffer(GL_ARRAY_BUFFER, bo[2]);
+	glBufferData(GL_ARRAY_BUFFER, (long)sizeof(*masks) * nrects * 8, masks, GL_STREAM_DRAW);
+	glEnableVertexAttribArray(vert_in_layers_loc);
+	glVertexAttribPointer(vert_in_layers_loc, 2, GL_INT, GL_FALSE, sizeof(GLint) * 2, NULL);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bo[3]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, (long)sizeof(*indices) * nrects * 6,
+	             indices, GL_STREAM_DRAW);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, gd->back_fbo);
+	glDrawElements(GL_TRIANGLES, nrects * 6, GL_UNSIGNED_INT, NULL);
+
+	glDisableVertexAttribArray(vert_coord_loc);
+	glDisableVertexAttribArray(vert_in_texcoord_loc);
+	glDisableVertexAttribArray(vert_in_shadow_texcoord_loc);
+	glDisableVertexAttribArray(vert_in_layers_loc);
+	glBindVertexArray(0);
+	glDeleteVertexArrays(1, &vao);
+
+	// Cleanup
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glDeleteBuffers(4, bo);
+
+	glUseProgram(0);
+
+	free(indices);
+	free(shadow_coord);
+	free(coord);
+	free(masks);
+	free(rects);
+
+	gl_check_err();
+}
+
+/**
+ * Apply all blur kernels with compute shaders, to the `width` x `height` area of `src`
+ * starting at (`x`, `y`). The result is stored at the origin of one of the blur
+ * textures.
+ *
+ * @return index of the blur texture holding the result
+ */
+static int gl_blur_compute(struct gl_blur_context *bctx, GLuint src, int x, int y,
+                           int width, int height) {
+	int curr = 0;
+	for (int i = 0; i < bctx->ncompute_passes; i++) {
+		const gl_blur_compute_shader_t *p = &bctx->compute_shader[i];
+		glUseProgram(p->prog);
+		glBindTexture(GL_TEXTURE_2D, i == 0 ? src : bctx->blur_texture[curr]);
+		glBindImageTexture(0, bctx->blur_texture[!curr], 0, GL_FALSE, 0,
+		                   GL_WRITE_ONLY, GL_RGBA8);
+		if (i == 0) {
+			glUniform2i(p->texorig_loc, x, y);
+		} else {
+			glUniform2i(p->texorig_loc, 0, 0);
+		}
+		glUniform2i(p->size_loc, width, height);
+		auto groups_x = (GLuint)((width + BLUR_TILE_SIZE - 1) / BLUR_TILE_SIZE),
+		     groups_y = (GLuint)((height + BLUR_TILE_SIZE - 1) / BLUR_TILE_SIZE);
+		glDispatchCompute(groups_x, groups_y, 1);
+		// Make the result visible to texelFetch in the next pass
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		curr = !curr;
+	}
+	glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+	return curr;
+}
+
 /**
  * Blur contents in a particular region.
  */
@@ -621,6 +830,26 @@ bool gl_blur(backend_t *base, double opacity, void *ctx, const region_t *reg_blu
 	                      sizeof(GLint) * 4, (void *)(sizeof(GLint) * 2));
 
 	int curr = 0;
+	if (bctx->compute_shader) {
+		curr = gl_blur_compute(bctx, gd->back_texture, extent_resized->x1,
+		                       dst_y_resized_screen_coord,
+		                       extent_resized->x2 - extent_resized->x1,
+		                       extent_resized->y2 - extent_resized->y1);
+
+		const gl_blur_shader_t *p = &bctx->blend_shader;
+		glBindTexture(GL_TEXTURE_2D, bctx->blur_texture[curr]);
+		glUseProgram(p->prog);
+		glBindVertexArray(vao[0]);
+		glBindFramebuffer(GL_FRAMEBUFFER, gd->back_fbo);
+		glUniform1f(p->unifm_opacity, (float)opacity);
+		glUniform2f(p->orig_loc, 0, 0);
+		glUniform2f(p->texorig_loc, 0, 0);
+		glDrawElements(GL_TRIANGLES, nrects * 6, GL_UNSIGNED_INT, NULL);
+
+		ret = true;
+		goto end;
+	}
+
 	for (int i = 0; i < bctx->npasses; ++i) {
 		const gl_blur_shader_t *p = &bctx->blur_shader[i];
 		assert(p->prog);
@@ -893,6 +1122,19 @@ void gl_release_image(backend_t *base, void *image_data) {
 	gl_check_err();
 }
 
+size_t gl_trim_image(backend_t *base attr_unused, void *image_data) {
+	struct gl_image *img = image_data;
+	if (!img->inner->auxiliary_texture[0]) {
+		return 0;
+	}
+
+	// Created again by gl_average_texture_color when needed
+	glDeleteTextures(2, img->inner->auxiliary_texture);
+	img->inner->auxiliary_texture[0] = img->inner->auxiliary_texture[1] = 0;
+	gl_check_err();
+	return 2 * (size_t)img->inner->width * (size_t)img->inner->height * 3;
+}
+
 void *gl_copy(backend_t *base attr_unused, const void *image_data,
               const region_t *reg_visible attr_unused) {
 	const struct gl_image *img = image_data;
@@ -910,6 +1152,167 @@ static inline void gl_free_blur_shader(gl_blur_shader_t *shader) {
 	shader->prog = 0;
 }
 
+static void gl_free_compute_blur_shaders(struct gl_blur_context *ctx) {
+	for (int i = 0; i < ctx->ncompute_passes; i++) {
+		if (ctx->compute_shader[i].prog) {
+			glDeleteProgram(ctx->compute_shader[i].prog);
+		}
+	}
+	free(ctx->compute_shader);
+	ctx->compute_shader = NULL;
+	ctx->ncompute_passes = 0;
+	gl_free_blur_shader(&ctx->blend_shader);
+}
+
+/**
+ * Build compute shaders applying `kernels`, as an alternative to the fragment shaders.
+ *
+ * Each work group loads its tile of the source, plus the apron the kernel needs
+ * around it, into shared memory once, then all its invocations convolve from there.
+ * The fragment shaders instead fetch every texel under the kernel for each pixel.
+ *
+ * @return whether the shaders are usable. They are not if the tiles of a kernel
+ *         don't fit in shared memory.
+ */
+static bool
+gl_create_compute_blur_shaders(struct gl_blur_context *ctx, struct conv **kernels,
+                               int nkernels, int max_shared_memory,
+                               const GLfloat *projection_matrix) {
+	// clang-format off
+	static const char *COMPUTE_SHADER_BLUR = GLSL(430,
+		layout(local_size_x = %d, local_size_y = %d) in;
+		uniform sampler2D tex_scr;
+		layout(rgba8) writeonly uniform image2D out_image;
+		uniform ivec2 texorig;
+		uniform ivec2 size;
+		const ivec2 apron = ivec2(%d, %d);
+		const int tile_width = %d;
+		const int tile_height = %d;
+		// Texels of the tile, packed like the blur textures to fit bigger kernels
+		shared uint tile[tile_width * tile_height];
+		void main() {
+			ivec2 tile_orig = ivec2(gl_WorkGroupID.xy * gl_WorkGroupSize.xy) -
+			                  apron + texorig;
+			ivec2 src_max = textureSize(tex_scr, 0) - 1;
+			int group_size = int(gl_WorkGroupSize.x * gl_WorkGroupSize.y);
+			for (int i = int(gl_LocalInvocationIndex); i < tile_width * tile_height;
+			     i += group_size) {
+				ivec2 src = tile_orig + ivec2(i %% tile_width, i / tile_width);
+				src = clamp(src, ivec2(0, 0), src_max);
+				tile[i] = packUnorm4x8(texelFetch(tex_scr, src, 0));
+			}
+			barrier();
+
+			ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
+			if (any(greaterThanEqual(pos, size))) {
+				return;
+			}
+			int center = (int(gl_LocalInvocationID.y) + apron.y) * tile_width +
+			             int(gl_LocalInvocationID.x) + apron.x;
+			vec4 sum = vec4(0.0, 0.0, 0.0, 0.0);
+			%s //body of the convolution
+			imageStore(out_image, pos, sum / float(%.7g));
+		}
+	);
+	static const char *COMPUTE_SHADER_BLUR_ADD = QUOTE(
+		sum += float(%.7g) * unpackUnorm4x8(tile[center + %d]);
+	);
+	static const char *FRAG_SHADER_BLUR_BLEND = GLSL(330,
+		uniform sampler2D tex_scr;
+		uniform float opacity;
+		in vec2 texcoord;
+		out vec4 out_color;
+		void main() {
+			out_color = texelFetch(tex_scr, ivec2(texcoord), 0) * opacity;
+		}
+	);
+	// clang-format on
+
+	ctx->compute_shader = ccalloc(nkernels, gl_blur_compute_shader_t);
+	ctx->ncompute_passes = nkernels;
+	for (int i = 0; i < nkernels; i++) {
+		auto kern = kernels[i];
+		int width = kern->w, height = kern->h;
+		int tile_width = BLUR_TILE_SIZE + width - 1,
+		    tile_height = BLUR_TILE_SIZE + height - 1;
+		long tile_bytes = (long)tile_width * tile_height * (long)sizeof(uint32_t);
+		if (tile_bytes > max_shared_memory) {
+			log_info("Blur kernel %d (%dx%d) is too big for compute shaders",
+			         i, width, height);
+			goto err;
+		}
+
+		size_t body_len =
+		    (strlen(COMPUTE_SHADER_BLUR_ADD) + 42) * (uint)(width * height);
+		char *shader_body = ccalloc(body_len, char);
+		char *pc = shader_body;
+
+		double sum = 0.0;
+		for (int j = 0; j < height; ++j) {
+			for (int k = 0; k < width; ++k) {
+				double val = kern->data[j * width + k];
+				if (val == 0) {
+					continue;
+				}
+				sum += val;
+				pc += snprintf(pc, body_len - (ulong)(pc - shader_body),
+				               COMPUTE_SHADER_BLUR_ADD, val,
+				               (j - height / 2) * tile_width +
+				                   (k - width / 2));
+				assert(pc < shader_body + body_len);
+			}
+		}
+
+		size_t shader_len = strlen(COMPUTE_SHADER_BLUR) + strlen(shader_body) +
+		                    6 * 12 /* integers */ + 10 /* sum */ +
+		                    1 /* null terminator */;
+		char *shader_str = ccalloc(shader_len, char);
+		auto real_shader_len = snprintf(
+		    shader_str, shader_len, COMPUTE_SHADER_BLUR, BLUR_TILE_SIZE,
+		    BLUR_TILE_SIZE, width / 2, height / 2, tile_width, tile_height,
+		    shader_body, sum);
+		CHECK(real_shader_len >= 0);
+		CHECK((size_t)real_shader_len < shader_len);
+		free(shader_body);
+
+		auto pass = &ctx->compute_shader[i];
+		GLuint shader = gl_create_shader(GL_COMPUTE_SHADER, shader_str);
+		free(shader_str);
+		if (!shader) {
+			log_error("Failed to create the blur compute shader.");
+			goto err;
+		}
+		pass->prog = gl_create_program(&shader, 1);
+		glDeleteShader(shader);
+		if (!pass->prog) {
+			log_error("Failed to create the blur compute program.");
+			goto err;
+		}
+		pass->texorig_loc = glGetUniformLocationChecked(pass->prog, "texorig");
+		pass->size_loc = glGetUniformLocationChecked(pass->prog, "size");
+	}
+
+	auto blend = &ctx->blend_shader;
+	blend->prog = gl_create_program_from_str(vertex_shader, FRAG_SHADER_BLUR_BLEND);
+	if (!blend->prog) {
+		log_error("Failed to create the blur blending program.");
+		goto err;
+	}
+	glBindFragDataLocation(blend->prog, 0, "out_color");
+	blend->unifm_opacity = glGetUniformLocationChecked(blend->prog, "opacity");
+	blend->orig_loc = glGetUniformLocationChecked(blend->prog, "orig");
+	blend->texorig_loc = glGetUniformLocationChecked(blend->prog, "texorig");
+	glUseProgram(blend->prog);
+	int pml = glGetUniformLocationChecked(blend->prog, "projection");
+	glUniformMatrix4fv(pml, 1, false, projection_matrix);
+	glUseProgram(0);
+	return true;
+
+err:
+	gl_free_compute_blur_shaders(ctx);
+	return false;
+}
+
 void gl_destroy_blur_context(backend_t *base attr_unused, void *ctx) {
 	struct gl_blur_context *bctx = ctx;
 	// Free GLSL shaders/programs
@@ -917,6 +1320,7 @@ void gl_destroy_blur_context(backend_t *base attr_unused, void *ctx) {
 		gl_free_blur_shader(&bctx->blur_shader[i]);
 	}
 	free(bctx->blur_shader);
+	gl_free_compute_blur_shaders(bctx);
 
 	glDeleteTextures(bctx->npasses > 1 ? 2 : 1, bctx->blur_texture);
 	if (bctx->npasses > 1) {
@@ -1076,6 +1480,14 @@ void *gl_create_blur_context(backend_t *base, enum blur_method method, void *arg
 		ctx->npasses = nkernels;
 	}
 
+	// The fragment shaders are kept as the fallback if compute shaders can't be used
+	if (gd->has_compute_blur &&
+	    gl_create_compute_blur_shaders(ctx, kernels, nkernels,
+	                                   gd->max_compute_shared_memory,
+	                                   projection_matrix[0])) {
+		log_debug("Blurring with compute shaders");
+	}
+
 	// Texture size will be defined by gl_blur
 	glGenTextures(2, ctx->blur_texture);
 	glBindTexture(GL_TEXTURE_2D, ctx->blur_texture[0]);
@@ -1121,32 +1533,102 @@ void gl_get_blur_size(void *blur_context, int *width, int *height) {
 	*height = ctx->resize_height;
 }
 
+size_t gl_trim_memory(backend_t *base attr_unused, void *blur_ctx) {
+	struct gl_blur_context *bctx = blur_ctx;
+	if (!bctx || !bctx->texture_width || !bctx->texture_height) {
+		return 0;
+	}
+
+	// Shrink the blur textures, gl_blur will resize them again
+	size_t released =
+	    2 * (size_t)bctx->texture_width * (size_t)bctx->texture_height * 4;
+	for (int i = 0; i < 2; i++) {
+		glBindTexture(GL_TEXTURE_2D, bctx->blur_texture[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 0, 0, 0, GL_BGRA,
+		             GL_UNSIGNED_BYTE, NULL);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	bctx->texture_width = bctx->texture_height = 0;
+	gl_check_err();
+	return released;
+}
+
 // clang-format off
-const char *win_shader_glsl = GLSL(330,
-	uniform float opacity;
-	uniform float dim;
-	uniform bool invert_color;
+// The window color computation shared by win_shader_glsl and shadowed_win_shader_glsl.
+// Ref for the brightness: https://en.wikipedia.org/wiki/Relative_luminance
+#define WIN_COLOR_GLSL QUOTE(                                                   \
+	uniform float opacity;                                                  \
+	uniform float dim;                                                      \
+	uniform bool invert_color;                                              \
+	uniform sampler2D tex;                                                  \
+	uniform sampler2D brightness;                                           \
+	uniform float max_brightness;                                           \
+                                                                                \
+	vec4 win_color(vec2 coord) {                                            \
+		vec4 c = texelFetch(tex, ivec2(coord), 0);                      \
+		if (invert_color) {                                             \
+			c = vec4(c.aaa - c.rgb, c.a);                           \
+		}                                                               \
+		c = vec4(c.rgb * (1.0 - dim), c.a) * opacity;                   \
+                                                                                \
+		vec3 rgb_brightness =                                           \
+		    texelFetch(brightness, ivec2(0, 0), 0).rgb;                 \
+		float brightness = rgb_brightness.r * 0.21 +                    \
+		                   rgb_brightness.g * 0.72 +                    \
+		                   rgb_brightness.b * 0.07;                     \
+		if (brightness > max_brightness)                                \
+			c.rgb = c.rgb * (max_brightness / brightness);          \
+		return c;                                                       \
+	}                                                                       \
+)
+
+const char *win_shader_glsl = "#version 330\n" WIN_COLOR_GLSL QUOTE(
 	in vec2 texcoord;
-	uniform sampler2D tex;
-	uniform sampler2D brightness;
-	uniform float max_brightness;
 
 	void main() {
-		vec4 c = texelFetch(tex, ivec2(texcoord), 0);
-		if (invert_color) {
-			c = vec4(c.aaa - c.rgb, c.a);
+		gl_FragColor = win_color(texcoord);
+	}
+);
+
+const char *shadowed_win_vertex_shader = GLSL(330,
+	uniform mat4 projection;
+	layout(location = 0) in vec2 coord;
+	layout(location = 1) in vec2 in_texcoord;
+	layout(location = 2) in vec2 in_shadow_texcoord;
+	layout(location = 3) in vec2 in_layers;
+	out vec2 texcoord;
+	out vec2 shadow_texcoord;
+	flat out vec2 layers;
+	void main() {
+		gl_Position = projection * vec4(coord, 0, 1);
+		texcoord = in_texcoord;
+		shadow_texcoord = in_shadow_texcoord;
+		layers = in_layers;
+	}
+);
+
+// Same as win_shader_glsl, but also paints the shadow below the window. `layers`
+// tells whether the fragment is covered by the window and/or the shadow.
+const char *shadowed_win_shader_glsl = "#version 330\n" WIN_COLOR_GLSL QUOTE(
+	in vec2 texcoord;
+	in vec2 shadow_texcoord;
+	flat in vec2 layers;
+	uniform sampler2D shadow_tex;
+	uniform float shadow_opacity;
+
+	void main() {
+		vec4 c = vec4(0.0);
+		if (layers.x > 0.5) {
+			c = win_color(texcoord);
 		}
-		c = vec4(c.rgb * (1.0 - dim), c.a) * opacity;
 
-		vec3 rgb_brightness = texelFetch(brightness, ivec2(0, 0), 0).rgb;
-		// Ref: https://en.wikipedia.org/wiki/Relative_luminance
-		float brightness = rgb_brightness.r * 0.21 +
-		                   rgb_brightness.g * 0.72 +
-		                   rgb_brightness.b * 0.07;
-		if (brightness > max_brightness)
-			c.rgb = c.rgb * (max_brightness / brightness);
+		vec4 s = vec4(0.0);
+		if (layers.y > 0.5) {
+			s = texelFetch(shadow_tex, ivec2(shadow_texcoord), 0) * shadow_opacity;
+		}
 
-		gl_FragColor = c;
+		// Premultiplied "over", same as composing the shadow then the window
+		gl_FragColor = c + s * (1.0 - c.a);
 	}
 );
 
@@ -1215,6 +1697,24 @@ bool gl_init(struct gl_data *gd, session_t *ps) {
 	glUniformMatrix4fv(pml, 1, false, projection_matrix[0]);
 	glUseProgram(0);
 
+	// Failing to build this one is not fatal, gl_compose_with_shadow falls back to
+	// composing the shadow and the window separately.
+	auto shadowed_win_shader = &gd->shadowed_win_shader;
+	if (gl_win_shader_from_string(shadowed_win_vertex_shader, shadowed_win_shader_glsl,
+	                              &shadowed_win_shader->base) > 0) {
+		shadowed_win_shader->unifm_shadow_tex =
+		    glGetUniformLocationChecked(shadowed_win_shader->base.prog, "shadow_tex");
+		shadowed_win_shader->unifm_shadow_opacity = glGetUniformLocationChecked(
+		    shadowed_win_shader->base.prog, "shadow_opacity");
+		pml = glGetUniformLocationChecked(shadowed_win_shader->base.prog,
+		                                  "projection");
+		glUseProgram(shadowed_win_shader->base.prog);
+		glUniformMatrix4fv(pml, 1, false, projection_matrix[0]);
+		glUseProgram(0);
+	} else {
+		shadowed_win_shader->base.prog = 0;
+	}
+
 	gd->fill_shader.prog = gl_create_program_from_str(fill_vert, fill_frag);
 	gd->fill_shader.color_loc = glGetUniformLocation(gd->fill_shader.prog, "color");
 	pml = glGetUniformLocationChecked(gd->fill_shader.prog, "projection");
@@ -1259,6 +1759,20 @@ bool gl_init(struct gl_data *gd, session_t *ps) {
 		log_add_target_tls(gd->logger);
 	}
 
+	// Compute shaders need OpenGL 4.3. We ask for a 3.3 core context, but drivers
+	// usually give us the newest version they support.
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	gd->has_compute_blur =
+	    !ps->o.glx_no_compute_blur && (major > 4 || (major == 4 && minor >= 3));
+	if (gd->has_compute_blur) {
+		glGetIntegerv(GL_MAX_COMPUTE_SHARED_MEMORY_SIZE,
+		              &gd->max_compute_shared_memory);
+	}
+	log_debug("OpenGL %d.%d, compute shader blur %s", major, minor,
+	          gd->has_compute_blur ? "enabled" : "disabled");
+
 	const char *vendor = (const char *)glGetString(GL_VENDOR);
 	log_debug("GL_VENDOR = %s", vendor);
 	if (strcmp(vendor, "NVIDIA Corporation") == 0) {
@@ -1273,6 +1787,7 @@ bool gl_init(struct gl_data *gd, session_t *ps) {
 
 void gl_deinit(struct gl_data *gd) {
 	gl_free_prog_main(&gd->win_shader);
+	gl_free_prog_main(&gd->shadowed_win_shader.base);
 
 	if (gd->logger) {
 		log_remove_target_tls(gd->logger);
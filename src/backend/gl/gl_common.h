@@ -24,6 +24,13 @@ typedef struct {
 	GLint unifm_max_brightness;
 } gl_win_shader_t;
 
+// Program and uniforms for the window shader that also paints the window's shadow
+typedef struct {
+	gl_win_shader_t base;
+	GLint unifm_shadow_tex;
+	GLint unifm_shadow_opacity;
+} gl_shadowed_win_shader_t;
+
 // Program and uniforms for brightness shader
 typedef struct {
 	GLuint prog;
@@ -37,6 +44,13 @@ typedef struct {
 	GLint texorig_loc;
 } gl_blur_shader_t;
 
+// Program and uniforms for compute shader blur
+typedef struct {
+	GLuint prog;
+	GLint texorig_loc;
+	GLint size_loc;
+} gl_blur_compute_shader_t;
+
 typedef struct {
 	GLuint prog;
 	GLint color_loc;
@@ -68,9 +82,14 @@ struct gl_data {
 	backend_t base;
 	// If we are using proprietary NVIDIA driver
 	bool is_nvidia;
+	// If blur can be done with compute shaders
+	bool has_compute_blur;
+	// Shared memory available to a compute shader work group, in bytes
+	int max_compute_shared_memory;
 	// Height and width of the root window
 	int height, width;
 	gl_win_shader_t win_shader;
+	gl_shadowed_win_shader_t shadowed_win_shader;
 	gl_brightness_shader_t brightness_shader;
 	gl_fill_shader_t fill_shader;
 	GLuint back_texture, back_fbo;
@@ -101,6 +120,14 @@ GLuint gl_create_program_from_str(const char *vert_shader_str, const char *frag_
 void gl_compose(backend_t *, void *ptex, int dst_x, int dst_y, const region_t *reg_tgt,
                 const region_t *reg_visible);
 
+/**
+ * @brief Render a region with texture data, and a shadow below it, in one draw.
+ */
+void gl_compose_with_shadow(backend_t *, void *ptex, int dst_x, int dst_y, void *pshadow,
+                            int shadow_x, int shadow_y, double shadow_opacity,
+                            const region_t *reg_tgt, const region_t *reg_shadow,
+                            const region_t *reg_visible);
+
 void gl_resize(struct gl_data *, int width, int height);
 
 bool gl_init(struct gl_data *gd, session_t *);
@@ -112,6 +139,7 @@ bool gl_image_op(backend_t *base, enum image_operations op, void *image_data,
                  const region_t *reg_op, const region_t *reg_visible, void *arg);
 
 void gl_release_image(backend_t *base, void *image_data);
+size_t gl_trim_image(backend_t *base, void *image_data);
 
 void *gl_copy(backend_t *base, const void *image_data, const region_t *reg_visible);
 
@@ -120,6 +148,7 @@ bool gl_blur(backend_t *base, double opacity, void *, const region_t *reg_blur,
 void *gl_create_blur_context(backend_t *base, enum blur_method, void *args);
 void gl_destroy_blur_context(backend_t *base, void *ctx);
 void gl_get_blur_size(void *blur_context, int *width, int *height);
+size_t gl_trim_memory(backend_t *base, void *blur_ctx);
 
 bool gl_is_image_transparent(backend_t *base, void *image_data);
 void gl_fill(backend_t *base, struct color, const region_t *clip);
@@ -12,12 +12,14 @@
 
 #include <X11/Xlib-xcb.h>
 #include <assert.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <pixman.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include <xcb/composite.h>
+#include <xcb/present.h>
 #include <xcb/xcb.h>
 
 #include "backend/backend.h"
@@ -40,12 +42,44 @@ struct _glx_pixmap {
 	bool owned;
 };
 
+/// Number of pixmaps frames are rendered into with --glx-present. One can be on
+/// screen, one waiting to replace it, and one being rendered into.
+#define GLX_PRESENT_NBUFFERS 3
+
+struct _glx_present_buffer {
+	xcb_pixmap_t pixmap;
+	GLXPixmap glpixmap;
+	/// Texture bound to the pixmap, and a framebuffer to render into it
+	GLuint texture, fbo;
+	/// Whether the X server might still read from the pixmap. Set when it is
+	/// presented, cleared by its PresentIdleNotify.
+	bool busy;
+	/// Frame that was last presented from the pixmap, 0 if its content is undefined
+	uint64_t frame;
+};
+
 struct _glx_data {
 	struct gl_data gl;
 	Display *display;
 	int screen;
 	xcb_window_t target_win;
 	GLXContext ctx;
+
+	// === Present, see glx_present_init() ===
+	bool use_present;
+	bool vsync;
+	struct _glx_present_buffer present_buffers[GLX_PRESENT_NBUFFERS];
+	/// Whether the first row of the pixmaps' textures is the top of the pixmap
+	bool present_y_inverted;
+	/// Pixmap the current frame is rendered into, -1 if not chosen yet
+	int present_curr;
+	/// Number of frames presented, the last one is also the serial of the last
+	/// PresentPixmap request
+	uint64_t present_count;
+	/// MSC and UST of the last frame that reached the screen
+	uint64_t present_msc, present_ust;
+	uint32_t present_eid;
+	xcb_special_event_t *present_event;
 };
 
 #define glXGetFBConfigAttribChecked(a, b, attr, c)                                       \
@@ -186,12 +220,256 @@ static void glx_release_image(backend_t *base, struct gl_texture *tex) {
 	tex->user_data = NULL;
 }
 
+static void glx_present_deinit(struct _glx_data *gd) {
+	xcb_connection_t *c = gd->gl.base.c;
+	if (gd->present_event) {
+		xcb_present_select_input(c, gd->present_eid, gd->target_win, 0);
+		xcb_unregister_for_special_event(c, gd->present_event);
+		gd->present_event = NULL;
+	}
+
+	for (int i = 0; i < GLX_PRESENT_NBUFFERS; i++) {
+		auto buf = &gd->present_buffers[i];
+		if (buf->fbo) {
+			glDeleteFramebuffers(1, &buf->fbo);
+		}
+		if (buf->texture) {
+			if (buf->glpixmap) {
+				glBindTexture(GL_TEXTURE_2D, buf->texture);
+				glXReleaseTexImageEXT(gd->display, buf->glpixmap,
+				                      GLX_FRONT_LEFT_EXT);
+				glBindTexture(GL_TEXTURE_2D, 0);
+			}
+			gl_delete_texture(buf->texture);
+		}
+		if (buf->glpixmap) {
+			glXDestroyPixmap(gd->display, buf->glpixmap);
+		}
+		if (buf->pixmap) {
+			xcb_free_pixmap(c, buf->pixmap);
+		}
+		*buf = (struct _glx_present_buffer){0};
+	}
+	gd->use_present = false;
+}
+
+/**
+ * Present frames with the Present extension, instead of glXSwapBuffers.
+ *
+ * Frames are rendered as usual, then copied into one of a few pixmaps bound to
+ * textures, which is handed to the X server with PresentPixmap. PresentCompleteNotify
+ * tells us when the frame is on screen, so the next one can be started, and
+ * PresentIdleNotify when a pixmap can be rendered into again.
+ */
+static bool glx_present_init(struct _glx_data *gd, session_t *ps) {
+	if (!ps->present_exists) {
+		log_error("The Present extension is not available.");
+		return false;
+	}
+
+	auto fbcfg = glx_find_fbconfig(gd->display, gd->screen,
+	                               x_get_visual_info(ps->c, ps->vis));
+	if (!fbcfg || !(fbcfg->texture_tgts & GLX_TEXTURE_2D_BIT_EXT)) {
+		log_error("Cannot bind pixmaps of the root visual to textures.");
+		free(fbcfg);
+		return false;
+	}
+	gd->present_y_inverted = fbcfg->y_inverted;
+
+	GLint attrs[] = {
+	    GLX_TEXTURE_FORMAT_EXT,
+	    fbcfg->texture_fmt,
+	    GLX_TEXTURE_TARGET_EXT,
+	    GLX_TEXTURE_2D_EXT,
+	    0,
+	};
+	bool success = false;
+	for (int i = 0; i < GLX_PRESENT_NBUFFERS; i++) {
+		auto buf = &gd->present_buffers[i];
+		buf->pixmap = x_create_pixmap(ps->c, (uint8_t)ps->depth, ps->root,
+		                              ps->root_width, ps->root_height);
+		if (!buf->pixmap) {
+			log_error("Failed to create a pixmap to render into.");
+			goto end;
+		}
+		buf->glpixmap =
+		    glXCreatePixmap(gd->display, fbcfg->cfg, buf->pixmap, attrs);
+		if (!buf->glpixmap) {
+			log_error("Failed to create glpixmap for pixmap %#010x",
+			          buf->pixmap);
+			goto end;
+		}
+
+		buf->texture = gl_new_texture(GL_TEXTURE_2D);
+		glBindTexture(GL_TEXTURE_2D, buf->texture);
+		glXBindTexImageEXT(gd->display, buf->glpixmap, GLX_FRONT_LEFT_EXT, NULL);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenFramebuffers(1, &buf->fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, buf->fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+		                       GL_TEXTURE_2D, buf->texture, 0);
+		auto status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if (status != GL_FRAMEBUFFER_COMPLETE) {
+			log_error("Cannot render into textures bound to pixmaps.");
+			goto end;
+		}
+	}
+	gl_check_err();
+
+	gd->present_eid = x_new_id(ps->c);
+	auto e = xcb_request_check(
+	    ps->c, xcb_present_select_input_checked(
+	               ps->c, gd->present_eid, gd->target_win,
+	               XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY |
+	                   XCB_PRESENT_EVENT_MASK_IDLE_NOTIFY));
+	if (e) {
+		log_error_x_error(e, "Cannot select present input");
+		free(e);
+		goto end;
+	}
+	gd->present_event =
+	    xcb_register_for_special_xge(ps->c, &xcb_present_id, gd->present_eid, NULL);
+	if (!gd->present_event) {
+		log_error("Cannot register for special XGE");
+		xcb_present_select_input(ps->c, gd->present_eid, gd->target_win, 0);
+		goto end;
+	}
+
+	gd->present_curr = -1;
+	gd->use_present = true;
+	success = true;
+end:
+	free(fbcfg);
+	if (!success) {
+		glx_present_deinit(gd);
+	}
+	return success;
+}
+
+/// Handle an event of the Present extension, returns whether it tells us the last
+/// presented frame is on screen.
+static bool
+glx_present_handle_event(struct _glx_data *gd, xcb_present_generic_event_t *ev) {
+	if (ev->evtype == XCB_PRESENT_IDLE_NOTIFY) {
+		auto ine = (xcb_present_idle_notify_event_t *)ev;
+		for (int i = 0; i < GLX_PRESENT_NBUFFERS; i++) {
+			if (gd->present_buffers[i].pixmap == ine->pixmap) {
+				gd->present_buffers[i].busy = false;
+			}
+		}
+		return false;
+	}
+
+	if (ev->evtype != XCB_PRESENT_COMPLETE_NOTIFY) {
+		return false;
+	}
+	auto cne = (xcb_present_complete_notify_event_t *)ev;
+	if (cne->kind != XCB_PRESENT_COMPLETE_KIND_PIXMAP ||
+	    cne->serial != (uint32_t)gd->present_count) {
+		return false;
+	}
+	if (gd->present_msc && cne->msc > gd->present_msc + 1) {
+		log_trace("Frame %" PRIu64 " reached the screen %" PRIu64
+		          " vblanks after the previous one",
+		          gd->present_count, cne->msc - gd->present_msc);
+	}
+	gd->present_msc = cne->msc;
+	gd->present_ust = cne->ust;
+	gd->gl.base.busy = false;
+	return true;
+}
+
+/// Choose the pixmap to render the current frame into, waiting for one to become
+/// idle if necessary.
+static int glx_present_acquire(struct _glx_data *gd) {
+	while (gd->present_curr < 0) {
+		// Prefer the pixmap presented last, its content is the least outdated
+		for (int i = 0; i < GLX_PRESENT_NBUFFERS; i++) {
+			auto buf = &gd->present_buffers[i];
+			if (!buf->busy &&
+			    (gd->present_curr < 0 ||
+			     buf->frame > gd->present_buffers[gd->present_curr].frame)) {
+				gd->present_curr = i;
+			}
+		}
+		if (gd->present_curr >= 0) {
+			break;
+		}
+
+		xcb_present_generic_event_t *ev =
+		    (void *)xcb_wait_for_special_event(gd->gl.base.c, gd->present_event);
+		if (!ev) {
+			// We don't know what happened, maybe X died. But forget the
+			// content of the pixmaps, so in case we do recover, we will
+			// render correctly.
+			for (int i = 0; i < GLX_PRESENT_NBUFFERS; i++) {
+				gd->present_buffers[i].busy = false;
+				gd->present_buffers[i].frame = 0;
+			}
+			continue;
+		}
+		glx_present_handle_event(gd, ev);
+		free(ev);
+	}
+	return gd->present_curr;
+}
+
+static void glx_present_pixmap(struct _glx_data *gd, const region_t *region) {
+	auto buf = &gd->present_buffers[glx_present_acquire(gd)];
+	gd->present_curr = -1;
+
+	// Copy the updated part of the frame into the pixmap. The rendered frame has
+	// its origin at the bottom left, like the screen.
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, gd->gl.back_fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, buf->fbo);
+	int nrects;
+	const rect_t *rects = pixman_region32_rectangles((region_t *)region, &nrects);
+	for (int i = 0; i < nrects; i++) {
+		GLint src_y1 = gd->gl.height - rects[i].y2,
+		      src_y2 = gd->gl.height - rects[i].y1;
+		GLint dst_y1 = gd->present_y_inverted ? rects[i].y2 : src_y1,
+		      dst_y2 = gd->present_y_inverted ? rects[i].y1 : src_y2;
+		glBlitFramebuffer(rects[i].x1, src_y1, rects[i].x2, src_y2, rects[i].x1,
+		                  dst_y1, rects[i].x2, dst_y2, GL_COLOR_BUFFER_BIT,
+		                  GL_NEAREST);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	// The X server won't read the pixmap before the rendering is done, no need to
+	// wait for it here.
+	glFlush();
+	gl_check_err();
+
+	// Make sure the request went through, otherwise we would wait forever for its
+	// completion
+	gd->present_count++;
+	xcb_connection_t *c = gd->gl.base.c;
+	auto e = xcb_request_check(
+	    c, xcb_present_pixmap_checked(
+	           c, gd->target_win, buf->pixmap, (uint32_t)gd->present_count, XCB_NONE,
+	           XCB_NONE, 0, 0, XCB_NONE, XCB_NONE, XCB_NONE,
+	           gd->vsync ? XCB_PRESENT_OPTION_NONE : XCB_PRESENT_OPTION_ASYNC, 0,
+	           0, 0, 0, NULL));
+	if (e) {
+		log_error_x_error(e, "Failed to present pixmap");
+		free(e);
+		buf->frame = 0;
+		return;
+	}
+	buf->busy = true;
+	buf->frame = gd->present_count;
+	// Until the frame is on screen, see glx_handle_events()
+	gd->gl.base.busy = true;
+}
+
 /**
  * Destroy GLX related resources.
  */
 void glx_deinit(backend_t *base) {
 	struct _glx_data *gd = (void *)base;
 
+	glx_present_deinit(gd);
 	gl_deinit(&gd->gl);
 
 	// Destroy GLX context
@@ -342,7 +620,16 @@ static backend_t *glx_init(session_t *ps) {
 	gd->gl.decouple_texture_user_data = glx_decouple_user_data;
 	gd->gl.release_user_data = glx_release_image;
 
-	if (ps->o.vsync) {
+	gd->vsync = ps->o.vsync;
+	if (ps->o.glx_present && !glx_present_init(gd, ps)) {
+		log_warn("Cannot present with the Present extension, falling back to "
+		         "glXSwapBuffers.");
+	}
+
+	if (gd->use_present) {
+		// The target window is never drawn into
+		log_info("Presenting with the Present extension");
+	} else if (ps->o.vsync) {
 		if (!glx_set_swap_interval(1, ps->dpy, tgt)) {
 			log_error("Failed to enable vsync.");
 		}
@@ -464,39 +751,67 @@ err:
 
 static void glx_present(backend_t *base, const region_t *region attr_unused) {
 	struct _glx_data *gd = (void *)base;
+	if (gd->use_present) {
+		glx_present_pixmap(gd, region);
+		return;
+	}
 	gl_present(base, region);
 	glXSwapBuffers(gd->display, gd->target_win);
 	glFinish();
 }
 
 static int glx_buffer_age(backend_t *base) {
+	struct _glx_data *gd = (void *)base;
+	if (gd->use_present) {
+		auto buf = &gd->present_buffers[glx_present_acquire(gd)];
+		return buf->frame ? (int)(gd->present_count - buf->frame + 1) : -1;
+	}
+
 	if (!glxext.has_GLX_EXT_buffer_age) {
 		return -1;
 	}
 
-	struct _glx_data *gd = (void *)base;
 	unsigned int val;
 	glXQueryDrawable(gd->display, gd->target_win, GLX_BACK_BUFFER_AGE_EXT, &val);
 	return (int)val ?: -1;
 }
 
+static bool glx_handle_events(backend_t *base) {
+	struct _glx_data *gd = (void *)base;
+	if (!gd->present_event) {
+		return false;
+	}
+
+	bool completed = false;
+	xcb_present_generic_event_t *ev;
+	while ((ev = (void *)xcb_poll_for_special_event(base->c, gd->present_event))) {
+		completed = glx_present_handle_event(gd, ev) || completed;
+		free(ev);
+	}
+	return completed;
+}
+
 struct backend_operations glx_ops = {
     .init = glx_init,
     .deinit = glx_deinit,
     .bind_pixmap = glx_bind_pixmap,
     .release_image = gl_release_image,
     .compose = gl_compose,
+    .compose_with_shadow = gl_compose_with_shadow,
     .image_op = gl_image_op,
     .copy = gl_copy,
     .blur = gl_blur,
     .is_image_transparent = gl_is_image_transparent,
     .present = glx_present,
     .buffer_age = glx_buffer_age,
+    .handle_events = glx_handle_events,
     .render_shadow = default_backend_render_shadow,
     .fill = gl_fill,
     .create_blur_context = gl_create_blur_context,
     .destroy_blur_context = gl_destroy_blur_context,
     .get_blur_size = gl_get_blur_size,
+    .trim_memory = gl_trim_memory,
+    .trim_image = gl_trim_image,
     .max_buffer_age = 5,        // Why?
 };
 
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: MPL-2.0
 // Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
 #include <assert.h>
+#include <inttypes.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
@@ -24,8 +25,22 @@
 #include "x.h"
 #include "types.h"
 
+/// The clip region the X server has for a picture, so it isn't sent again when it
+/// doesn't change. Only tracked with --low-bandwidth.
+struct xrender_clip {
+	/// Whether the clip region of the picture is known
+	bool known;
+	/// Whether the picture is clipped to `reg`, or not clipped at all
+	bool set;
+	region_t reg;
+};
+
 typedef struct _xrender_data {
 	backend_t base;
+	/// Send less to the X server, see --low-bandwidth
+	bool low_bandwidth;
+	/// Where the X traffic is counted
+	struct render_stats *stats;
 	/// If vsync is enabled and supported by the current system
 	bool vsync;
 	xcb_visualid_t default_visual;
@@ -33,7 +48,8 @@ typedef struct _xrender_data {
 	xcb_window_t target_win;
 	/// Painting target, it is either the root or the overlay
 	xcb_render_picture_t target;
-	/// Back buffers. Double buffer, with 1 for temporary render use
+	/// Back buffers. Double buffer, with 1 for temporary render use. The temporary
+	/// one is released by trim_memory, and created again by prepare.
 	xcb_render_picture_t back[3];
 	/// The back buffer that is for temporary use
 	/// Age of each back buffer.
@@ -42,6 +58,11 @@ typedef struct _xrender_data {
 	int curr_back;
 	/// The corresponding pixmap to the back buffer
 	xcb_pixmap_t back_pixmap[3];
+	/// Clip regions of the back buffers
+	struct xrender_clip back_clip[3];
+	/// Blur kernel set as the filter of back[2], NULL for the "Nearest" filter. With
+	/// --low-bandwidth, blur() leaves it set, and present() resets it.
+	const struct x_convolution_kernel *back_filter;
 	/// The original root window content, usually the wallpaper.
 	/// We save it so we don't loss the wallpaper when we paint over
 	/// it.
@@ -88,8 +109,105 @@ struct _xrender_image_data {
 	xcb_visualid_t visual;
 	uint8_t depth;
 	bool owned;
+	struct xrender_clip clip;
 };
 
+/// Size of X requests, in bytes
+#define XRENDER_COMPOSITE_SIZE 36
+#define XRENDER_CLEAR_CLIP_SIZE 16
+#define XRENDER_SET_CLIP_SIZE(nrects) (12 + 8 * (uint64_t)(nrects))
+#define XRENDER_FILL_SIZE(nrects) (20 + 8 * (uint64_t)(nrects))
+#define XRENDER_PUT_IMAGE_SIZE(stride, height)                                           \
+	(24 + (uint64_t)(stride) * (uint64_t)(height))
+
+static const char *filter0 = "Nearest";        // The "null" filter
+static const char *filter = "convolution";
+
+static inline void
+xrender_count(struct _xrender_data *xd, enum x_traffic_kind kind, uint64_t bytes) {
+	xd->stats->x_bytes[kind] += bytes;
+	xd->stats->last_x_bytes += bytes;
+}
+
+static inline void
+xrender_count_saved(struct _xrender_data *xd, enum x_traffic_kind kind, uint64_t bytes) {
+	xd->stats->x_bytes_saved[kind] += bytes;
+}
+
+static void
+xrender_composite(struct _xrender_data *xd, uint8_t op, xcb_render_picture_t src,
+                  xcb_render_picture_t mask, xcb_render_picture_t dst, int16_t src_x,
+                  int16_t src_y, int16_t mask_x, int16_t mask_y, int16_t dst_x,
+                  int16_t dst_y, uint16_t width, uint16_t height) {
+	xrender_count(xd, X_TRAFFIC_COMPOSITE, XRENDER_COMPOSITE_SIZE);
+	xcb_render_composite(xd->base.c, op, src, mask, dst, src_x, src_y, mask_x, mask_y,
+	                     dst_x, dst_y, width, height);
+}
+
+static void xrender_fill_rectangles(struct _xrender_data *xd, uint8_t op,
+                                    xcb_render_picture_t dst, xcb_render_color_t color,
+                                    uint32_t nrects, const xcb_rectangle_t *rects) {
+	xrender_count(xd, X_TRAFFIC_FILL, XRENDER_FILL_SIZE(nrects));
+	xcb_render_fill_rectangles(xd->base.c, op, dst, color, nrects, rects);
+}
+
+static void xrender_clip_init(struct xrender_clip *clip) {
+	clip->known = false;
+	clip->set = false;
+	pixman_region32_init(&clip->reg);
+}
+
+/// Clip `pict` to `reg`. With --low-bandwidth, nothing is sent if `clip` says `pict`
+/// is already clipped to `reg`. `clip` can be NULL for short-lived pictures.
+static void xrender_set_clip(struct _xrender_data *xd, xcb_render_picture_t pict,
+                             struct xrender_clip *clip, const region_t *reg) {
+	int nrects;
+	pixman_region32_rectangles((region_t *)reg, &nrects);
+	if (xd->low_bandwidth && clip) {
+		if (clip->known && clip->set &&
+		    pixman_region32_equal(&clip->reg, (region_t *)reg)) {
+			xrender_count_saved(xd, X_TRAFFIC_CLIP,
+			                    XRENDER_SET_CLIP_SIZE(nrects));
+			return;
+		}
+		clip->known = true;
+		clip->set = true;
+		pixman_region32_copy(&clip->reg, (region_t *)reg);
+	}
+	xrender_count(xd, X_TRAFFIC_CLIP, XRENDER_SET_CLIP_SIZE(nrects));
+	x_set_picture_clip_region(xd->base.c, pict, 0, 0, reg);
+}
+
+static void xrender_clear_clip(struct _xrender_data *xd, xcb_render_picture_t pict,
+                               struct xrender_clip *clip) {
+	if (xd->low_bandwidth && clip) {
+		if (clip->known && !clip->set) {
+			xrender_count_saved(xd, X_TRAFFIC_CLIP, XRENDER_CLEAR_CLIP_SIZE);
+			return;
+		}
+		clip->known = true;
+		clip->set = false;
+	}
+	xrender_count(xd, X_TRAFFIC_CLIP, XRENDER_CLEAR_CLIP_SIZE);
+	x_clear_picture_clip_region(xd->base.c, pict);
+}
+
+static uint64_t xrender_filter_size(const struct x_convolution_kernel *kernel) {
+	auto name = kernel ? filter : filter0;
+	return 8 + ((strlen(name) + 3) & ~3UL) + 4 * (uint64_t)(kernel ? kernel->size : 0);
+}
+
+/// Set the filter of `pict` to a convolution with `kernel`, or to the "Nearest"
+/// filter if `kernel` is NULL
+static void xrender_set_filter(struct _xrender_data *xd, xcb_render_picture_t pict,
+                               const struct x_convolution_kernel *kernel) {
+	auto name = kernel ? filter : filter0;
+	xrender_count(xd, X_TRAFFIC_FILTER, xrender_filter_size(kernel));
+	xcb_render_set_picture_filter(xd->base.c, pict, to_u16_checked(strlen(name)), name,
+	                              kernel ? to_u32_checked(kernel->size) : 0,
+	                              kernel ? kernel->kernel : NULL);
+}
+
 static void compose(backend_t *base, void *img_data, int dst_x, int dst_y,
                     const region_t *reg_paint, const region_t *reg_visible) {
 	struct _xrender_data *xd = (void *)base;
@@ -102,22 +220,22 @@ static void compose(backend_t *base, void *img_data, int dst_x, int dst_y,
 
 	// Clip region of rendered_pict might be set during rendering, clear it to make
 	// sure we get everything into the buffer
-	x_clear_picture_clip_region(base->c, img->pict);
+	xrender_clear_clip(xd, img->pict, &img->clip);
 
-	x_set_picture_clip_region(base->c, xd->back[2], 0, 0, &reg);
-	xcb_render_composite(base->c, op, img->pict, alpha_pict, xd->back[2], 0, 0, 0, 0,
-	                     to_i16_checked(dst_x), to_i16_checked(dst_y),
-	                     to_u16_checked(img->ewidth), to_u16_checked(img->eheight));
+	xrender_set_clip(xd, xd->back[2], &xd->back_clip[2], &reg);
+	xrender_composite(xd, op, img->pict, alpha_pict, xd->back[2], 0, 0, 0, 0,
+	                  to_i16_checked(dst_x), to_i16_checked(dst_y),
+	                  to_u16_checked(img->ewidth), to_u16_checked(img->eheight));
 	pixman_region32_fini(&reg);
 }
 
 static void fill(backend_t *base, struct color c, const region_t *clip) {
 	struct _xrender_data *xd = (void *)base;
 	const rect_t *extent = pixman_region32_extents((region_t *)clip);
-	x_set_picture_clip_region(base->c, xd->back[2], 0, 0, clip);
+	xrender_set_clip(xd, xd->back[2], &xd->back_clip[2], clip);
 	// color is in X fixed point representation
-	xcb_render_fill_rectangles(
-	    base->c, XCB_RENDER_PICT_OP_OVER, xd->back[2],
+	xrender_fill_rectangles(
+	    xd, XCB_RENDER_PICT_OP_OVER, xd->back[2],
 	    (xcb_render_color_t){.red = (uint16_t)(c.red * 0xffff),
 	                         .green = (uint16_t)(c.green * 0xffff),
 	                         .blue = (uint16_t)(c.blue * 0xffff),
@@ -152,8 +270,6 @@ static bool blur(backend_t *backend_data, double opacity, void *ctx_,
 	const pixman_box32_t *extent_resized = pixman_region32_extents(&reg_op_resized);
 	const auto height_resized = to_u16_checked(extent_resized->y2 - extent_resized->y1);
 	const auto width_resized = to_u16_checked(extent_resized->x2 - extent_resized->x1);
-	static const char *filter0 = "Nearest";        // The "null" filter
-	static const char *filter = "convolution";
 
 	// Create a buffer for storing blurred picture, make it just big enough
 	// for the blur region
@@ -173,14 +289,14 @@ static bool blur(backend_t *backend_data, double opacity, void *ctx_,
 	pixman_region32_init(&clip);
 	pixman_region32_copy(&clip, &reg_op_resized);
 	pixman_region32_translate(&clip, -extent_resized->x1, -extent_resized->y1);
-	x_set_picture_clip_region(c, tmp_picture[0], 0, 0, &clip);
-	x_set_picture_clip_region(c, tmp_picture[1], 0, 0, &clip);
+	xrender_set_clip(xd, tmp_picture[0], NULL, &clip);
+	xrender_set_clip(xd, tmp_picture[1], NULL, &clip);
 	pixman_region32_fini(&clip);
 
 	xcb_render_picture_t src_pict = xd->back[2], dst_pict = tmp_picture[0];
 	auto alpha_pict = xd->alpha_pict[(int)(opacity * MAX_ALPHA)];
 	int current = 0;
-	x_set_picture_clip_region(c, src_pict, 0, 0, &reg_op_resized);
+	xrender_set_clip(xd, src_pict, &xd->back_clip[2], &reg_op_resized);
 
 	// For more than 1 pass, we do:
 	//   back -(pass 1)-> tmp0 -(pass 2)-> tmp1 ...
@@ -192,38 +308,54 @@ static bool blur(backend_t *backend_data, double opacity, void *ctx_,
 		// Copy from source picture to destination. The filter must
 		// be applied on source picture, to get the nearby pixels outside the
 		// window.
-		xcb_render_set_picture_filter(c, src_pict, to_u16_checked(strlen(filter)),
-		                              filter,
-		                              to_u32_checked(bctx->x_blur_kernel[i]->size),
-		                              bctx->x_blur_kernel[i]->kernel);
+		if (xd->low_bandwidth && i == 0) {
+			// The back buffer keeps its filter until it's used as a source
+			// without a filter, blurring the next window with the same
+			// kernel doesn't send it again
+			if (xd->back_filter == bctx->x_blur_kernel[0]) {
+				xrender_count_saved(xd, X_TRAFFIC_FILTER,
+				                    xrender_filter_size(xd->back_filter));
+			} else {
+				xrender_set_filter(xd, src_pict, bctx->x_blur_kernel[0]);
+				xd->back_filter = bctx->x_blur_kernel[0];
+			}
+		} else {
+			xrender_set_filter(xd, src_pict, bctx->x_blur_kernel[i]);
+		}
 
 		if (i == 0) {
 			// First pass, back buffer -> tmp picture
 			// (we do this even if this is also the last pass, because we
 			// cannot do back buffer -> back buffer)
-			xcb_render_composite(c, XCB_RENDER_PICT_OP_SRC, src_pict, XCB_NONE,
-			                     dst_pict, to_i16_checked(extent_resized->x1),
-			                     to_i16_checked(extent_resized->y1), 0, 0, 0,
-			                     0, width_resized, height_resized);
+			xrender_composite(xd, XCB_RENDER_PICT_OP_SRC, src_pict, XCB_NONE,
+			                  dst_pict, to_i16_checked(extent_resized->x1),
+			                  to_i16_checked(extent_resized->y1), 0, 0, 0, 0,
+			                  width_resized, height_resized);
 		} else if (i < bctx->x_blur_kernel_count - 1) {
 			// This is not the last pass or the first pass,
 			// tmp picture 1 -> tmp picture 2
-			xcb_render_composite(c, XCB_RENDER_PICT_OP_SRC, src_pict,
-			                     XCB_NONE, dst_pict, 0, 0, 0, 0, 0, 0,
-			                     width_resized, height_resized);
+			xrender_composite(xd, XCB_RENDER_PICT_OP_SRC, src_pict, XCB_NONE,
+			                  dst_pict, 0, 0, 0, 0, 0, 0, width_resized,
+			                  height_resized);
 		} else {
-			x_set_picture_clip_region(c, xd->back[2], 0, 0, &reg_op);
+			xrender_set_clip(xd, xd->back[2], &xd->back_clip[2], &reg_op);
 			// This is the last pass, and we are doing more than 1 pass
-			xcb_render_composite(c, XCB_RENDER_PICT_OP_OVER, src_pict,
-			                     alpha_pict, xd->back[2], 0, 0, 0, 0,
-			                     to_i16_checked(extent_resized->x1),
-			                     to_i16_checked(extent_resized->y1),
-			                     width_resized, height_resized);
+			xrender_composite(xd, XCB_RENDER_PICT_OP_OVER, src_pict,
+			                  alpha_pict, xd->back[2], 0, 0, 0, 0,
+			                  to_i16_checked(extent_resized->x1),
+			                  to_i16_checked(extent_resized->y1),
+			                  width_resized, height_resized);
 		}
 
-		// reset filter
-		xcb_render_set_picture_filter(
-		    c, src_pict, to_u16_checked(strlen(filter0)), filter0, 0, NULL);
+		if (xd->low_bandwidth) {
+			// The filter of the back buffer is reset in present(), and the
+			// temporary pictures are only used as sources with a filter
+			xrender_count_saved(xd, X_TRAFFIC_FILTER,
+			                    xrender_filter_size(NULL));
+		} else {
+			// reset filter
+			xrender_set_filter(xd, src_pict, NULL);
+		}
 
 		src_pict = tmp_picture[current];
 		dst_pict = tmp_picture[!current];
@@ -232,11 +364,12 @@ static bool blur(backend_t *backend_data, double opacity, void *ctx_,
 
 	// There is only 1 pass
 	if (i == 1) {
-		x_set_picture_clip_region(c, xd->back[2], 0, 0, &reg_op);
-		xcb_render_composite(
-		    c, XCB_RENDER_PICT_OP_OVER, src_pict, alpha_pict, xd->back[2], 0, 0,
-		    0, 0, to_i16_checked(extent_resized->x1),
-		    to_i16_checked(extent_resized->y1), width_resized, height_resized);
+		xrender_set_clip(xd, xd->back[2], &xd->back_clip[2], &reg_op);
+		xrender_composite(xd, XCB_RENDER_PICT_OP_OVER, src_pict, alpha_pict,
+		                  xd->back[2], 0, 0, 0, 0,
+		                  to_i16_checked(extent_resized->x1),
+		                  to_i16_checked(extent_resized->y1), width_resized,
+		                  height_resized);
 	}
 
 	xcb_render_free_picture(c, tmp_picture[0]);
@@ -250,8 +383,8 @@ bind_pixmap(backend_t *base, xcb_pixmap_t pixmap, struct xvisual_info fmt, bool
 	xcb_generic_error_t *e;
 	auto r = xcb_get_geometry_reply(base->c, xcb_get_geometry(base->c, pixmap), &e);
 	if (!r) {
-		log_error("Invalid pixmap: %#010x", pixmap);
-		x_print_error(e->full_sequence, e->major_code, e->minor_code, e->error_code);
+		log_error_x_error(e, "Invalid pixmap: %#010x", pixmap);
+		free(e);
 		return NULL;
 	}
 
@@ -270,6 +403,7 @@ bind_pixmap(backend_t *base, xcb_pixmap_t pixmap, struct xvisual_info fmt, bool
 		free(img);
 		return NULL;
 	}
+	xrender_clip_init(&img->clip);
 	return img;
 }
 
@@ -279,19 +413,162 @@ static void release_image(backend_t *base, void *image) {
 	if (img->owned) {
 		xcb_free_pixmap(base->c, img->pixmap);
 	}
+	pixman_region32_fini(&img->clip.reg);
 	free(img);
 }
 
+/// Render the shadow on the X server, by blurring a rectangle with the shadow kernel,
+/// instead of uploading an image of it. The kernel is a gaussian, so it is applied
+/// as a horizontal and a vertical pass.
+static void *server_render_shadow(struct _xrender_data *xd, int width, int height,
+                                  const conv *kernel, double r, double g, double b,
+                                  double a) {
+	auto c = xd->base.c;
+	int d = kernel->w, radius = d / 2;
+	auto swidth = to_u16_checked(width + radius * 2);
+	auto sheight = to_u16_checked(height + radius * 2);
+
+	conv *kernels[2];
+	struct x_convolution_kernel *x_kernels[2] = {NULL, NULL};
+	for (int i = 0; i < 2; i++) {
+		kernels[i] = cvalloc(sizeof(conv) + sizeof(double) * (size_t)d);
+		kernels[i]->w = i == 0 ? d : 1;
+		kernels[i]->h = i == 0 ? 1 : d;
+		kernels[i]->rsum = NULL;
+		memset(kernels[i]->data, 0, sizeof(double) * (size_t)d);
+	}
+	for (int y = 0; y < d; y++) {
+		for (int x = 0; x < d; x++) {
+			kernels[0]->data[x] += kernel->data[y * d + x];
+			kernels[1]->data[y] += kernel->data[y * d + x];
+		}
+	}
+	for (int i = 0; i < 2; i++) {
+		x_create_convolution_kernel(kernels[i], kernels[i]->data[radius],
+		                            &x_kernels[i]);
+		free(kernels[i]);
+	}
+
+	void *ret = NULL;
+	xcb_pixmap_t pixmap[2] = {x_create_pixmap(c, 8, xd->base.root, swidth, sheight),
+	                          x_create_pixmap(c, 8, xd->base.root, swidth, sheight)};
+	xcb_pixmap_t shadow = x_create_pixmap(c, 32, xd->base.root, swidth, sheight);
+	xcb_render_picture_t pict[2] = {XCB_NONE, XCB_NONE}, shadow_pict = XCB_NONE;
+	auto shadow_pixel = solid_picture(c, xd->base.root, true, 1, r, g, b);
+	if (!pixmap[0] || !pixmap[1] || !shadow || !shadow_pixel) {
+		log_error("Failed to create shadow pixmaps");
+		goto out;
+	}
+	for (int i = 0; i < 2; i++) {
+		pict[i] = x_create_picture_with_standard_and_pixmap(
+		    c, XCB_PICT_STANDARD_A_8, pixmap[i], 0, NULL);
+	}
+	shadow_pict = x_create_picture_with_standard_and_pixmap(
+	    c, XCB_PICT_STANDARD_ARGB_32, shadow, 0, NULL);
+	if (!pict[0] || !pict[1] || !shadow_pict) {
+		goto out;
+	}
+
+	// The window body, with a transparent border as wide as the shadow radius
+	xrender_fill_rectangles(xd, XCB_RENDER_PICT_OP_SRC, pict[0],
+	                        (xcb_render_color_t){.alpha = 0}, 1,
+	                        (xcb_rectangle_t[]){{.width = swidth, .height = sheight}});
+	xrender_fill_rectangles(
+	    xd, XCB_RENDER_PICT_OP_SRC, pict[0],
+	    (xcb_render_color_t){.alpha = (uint16_t)(a * 0xffff)}, 1,
+	    (xcb_rectangle_t[]){{.x = to_i16_checked(radius),
+	                         .y = to_i16_checked(radius),
+	                         .width = to_u16_checked(width),
+	                         .height = to_u16_checked(height)}});
+
+	// Horizontal pass into pict[1], then the vertical pass is applied while pict[1]
+	// is used as the mask of the shadow color
+	xrender_set_filter(xd, pict[0], x_kernels[0]);
+	xrender_composite(xd, XCB_RENDER_PICT_OP_SRC, pict[0], XCB_NONE, pict[1], 0, 0, 0,
+	                  0, 0, 0, swidth, sheight);
+	xrender_set_filter(xd, pict[1], x_kernels[1]);
+	xrender_composite(xd, XCB_RENDER_PICT_OP_SRC, shadow_pixel, pict[1], shadow_pict,
+	                  0, 0, 0, 0, 0, 0, swidth, sheight);
+
+	auto visual = x_get_visual_for_standard(c, XCB_PICT_STANDARD_ARGB_32);
+	ret = bind_pixmap(&xd->base, shadow, x_get_visual_info(c, visual), true);
+	if (ret) {
+		// Owned by the image now
+		shadow = XCB_NONE;
+		xrender_count_saved(xd, X_TRAFFIC_IMAGE,
+		                    XRENDER_PUT_IMAGE_SIZE((swidth + 3) & ~3, sheight));
+	}
+
+out:
+	for (int i = 0; i < 2; i++) {
+		if (pict[i]) {
+			xcb_render_free_picture(c, pict[i]);
+		}
+		if (pixmap[i]) {
+			xcb_free_pixmap(c, pixmap[i]);
+		}
+		free(x_kernels[i]);
+	}
+	if (shadow_pict) {
+		xcb_render_free_picture(c, shadow_pict);
+	}
+	if (shadow) {
+		xcb_free_pixmap(c, shadow);
+	}
+	if (shadow_pixel) {
+		xcb_render_free_picture(c, shadow_pixel);
+	}
+	return ret;
+}
+
+static void *render_shadow(backend_t *base, int width, int height, const conv *kernel,
+                           double r, double g, double b, double a) {
+	struct _xrender_data *xd = (void *)base;
+	if (xd->low_bandwidth && kernel->w == kernel->h && kernel->w > 1) {
+		return server_render_shadow(xd, width, height, kernel, r, g, b, a);
+	}
+
+	// The shadow is drawn here, and uploaded as an 8-bit image
+	auto ret = default_backend_render_shadow(base, width, height, kernel, r, g, b, a);
+	if (ret) {
+		int swidth = width + kernel->w / 2 * 2;
+		int sheight = height + kernel->h / 2 * 2;
+		xrender_count(xd, X_TRAFFIC_IMAGE,
+		              XRENDER_PUT_IMAGE_SIZE((swidth + 3) & ~3, sheight));
+	}
+	return ret;
+}
+
 static void deinit(backend_t *backend_data) {
 	struct _xrender_data *xd = (void *)backend_data;
+	uint64_t sent = 0, saved = 0;
+	for (int i = 0; i < NUM_X_TRAFFIC_KINDS; i++) {
+		sent += xd->stats->x_bytes[i];
+		saved += xd->stats->x_bytes_saved[i];
+	}
+	if (xd->low_bandwidth) {
+		log_info("Sent %" PRIu64 " KiB of requests to the X server, saved %" PRIu64
+		         " KiB (%.1f%%)",
+		         sent / 1024, saved / 1024,
+		         sent + saved ? (double)saved * 100.0 / (double)(sent + saved)
+		                      : 0.0);
+	} else {
+		log_info("Sent %" PRIu64 " KiB of requests to the X server", sent / 1024);
+	}
+
 	for (int i = 0; i < 256; i++) {
 		xcb_render_free_picture(xd->base.c, xd->alpha_pict[i]);
 	}
 	xcb_render_free_picture(xd->base.c, xd->target);
 	xcb_render_free_picture(xd->base.c, xd->root_pict);
-	for (int i = 0; i < 2; i++) {
-		xcb_render_free_picture(xd->base.c, xd->back[i]);
-		xcb_free_pixmap(xd->base.c, xd->back_pixmap[i]);
+	for (int i = 0; i < 3; i++) {
+		if (xd->back[i] != XCB_NONE) {
+			xcb_render_free_picture(xd->base.c, xd->back[i]);
+		}
+		if (xd->back_pixmap[i] != XCB_NONE) {
+			xcb_free_pixmap(xd->base.c, xd->back_pixmap[i]);
+		}
+		pixman_region32_fini(&xd->back_clip[i].reg);
 	}
 	if (xd->present_event) {
 		xcb_unregister_for_special_event(xd->base.c, xd->present_event);
@@ -301,6 +578,19 @@ static void deinit(backend_t *backend_data) {
 	free(xd);
 }
 
+static void prepare(backend_t *base, const region_t *reg_damage attr_unused) {
+	struct _xrender_data *xd = (void *)base;
+	if (xd->back[2] != XCB_NONE) {
+		return;
+	}
+	// Released by trim_memory, buffer_age made sure the whole screen is painted
+	xd->back[2] = x_create_picture_with_visual(base->c, base->root, xd->target_width,
+	                                           xd->target_height, xd->default_visual,
+	                                           0, NULL);
+	xd->back_clip[2].known = false;
+	xd->back_filter = NULL;
+}
+
 static void present(backend_t *base, const region_t *region) {
 	struct _xrender_data *xd = (void *)base;
 	const rect_t *extent = pixman_region32_extents((region_t *)region);
@@ -309,16 +599,22 @@ static void present(backend_t *base, const region_t *region) {
 	         region_height = to_u16_checked(extent->y2 - extent->y1);
 
 	// compose() sets clip region on the back buffer, so clear it first
-	x_clear_picture_clip_region(base->c, xd->back[xd->curr_back]);
+	xrender_clear_clip(xd, xd->back[xd->curr_back], &xd->back_clip[xd->curr_back]);
 
 	// limit the region of update
-	x_set_picture_clip_region(base->c, xd->back[2], 0, 0, region);
+	xrender_set_clip(xd, xd->back[2], &xd->back_clip[2], region);
+
+	// blur() leaves its filter on the back buffer with --low-bandwidth
+	if (xd->back_filter) {
+		xrender_set_filter(xd, xd->back[2], NULL);
+		xd->back_filter = NULL;
+	}
 
 	if (xd->vsync) {
 		// Update the back buffer first, then present
-		xcb_render_composite(base->c, XCB_RENDER_PICT_OP_SRC, xd->back[2],
-		                     XCB_NONE, xd->back[xd->curr_back], orig_x, orig_y, 0,
-		                     0, orig_x, orig_y, region_width, region_height);
+		xrender_composite(xd, XCB_RENDER_PICT_OP_SRC, xd->back[2], XCB_NONE,
+		                  xd->back[xd->curr_back], orig_x, orig_y, 0, 0, orig_x,
+		                  orig_y, region_width, region_height);
 
 		// Make sure we got reply from PresentPixmap before waiting for events,
 		// to avoid deadlock
@@ -358,14 +654,18 @@ static void present(backend_t *base, const region_t *region) {
 		free(pev);
 	} else {
 		// No vsync needed, draw into the target picture directly
-		xcb_render_composite(base->c, XCB_RENDER_PICT_OP_SRC, xd->back[2],
-		                     XCB_NONE, xd->target, orig_x, orig_y, 0, 0, orig_x,
-		                     orig_y, region_width, region_height);
+		xrender_composite(xd, XCB_RENDER_PICT_OP_SRC, xd->back[2], XCB_NONE,
+		                  xd->target, orig_x, orig_y, 0, 0, orig_x, orig_y,
+		                  region_width, region_height);
 	}
 }
 
 static int buffer_age(backend_t *backend_data) {
 	struct _xrender_data *xd = (void *)backend_data;
+	if (xd->back[2] == XCB_NONE) {
+		// The rendering buffer has been released, nothing can be reused
+		return -1;
+	}
 	if (!xd->vsync) {
 		// Only the target picture really holds the screen content, and its
 		// content is always up to date. So buffer age is always 1.
@@ -374,6 +674,22 @@ static int buffer_age(backend_t *backend_data) {
 	return xd->buffer_age[xd->curr_back];
 }
 
+static size_t trim_memory(backend_t *backend_data, void *blur_ctx attr_unused) {
+	struct _xrender_data *xd = (void *)backend_data;
+	if (xd->back[2] == XCB_NONE) {
+		return 0;
+	}
+	// The buffer everything is rendered into, it is the size of the screen. It is
+	// the only scratch buffer kept, the blur buffers are created on every blur.
+	xcb_render_free_picture(backend_data->c, xd->back[2]);
+	xd->back[2] = XCB_NONE;
+	if (xd->back_pixmap[2] != XCB_NONE) {
+		xcb_free_pixmap(backend_data->c, xd->back_pixmap[2]);
+		xd->back_pixmap[2] = XCB_NONE;
+	}
+	return (size_t)xd->target_width * (size_t)xd->target_height * 4;
+}
+
 static bool is_image_transparent(backend_t *bd attr_unused, void *image) {
 	struct _xrender_image_data *img = image;
 	return img->has_alpha;
@@ -398,29 +714,29 @@ static bool image_op(backend_t *base, enum image_operations op, void *image,
 	const auto tmph = to_u16_checked(img->height);
 	switch (op) {
 	case IMAGE_OP_INVERT_COLOR_ALL:
-		x_set_picture_clip_region(base->c, img->pict, 0, 0, reg_visible);
+		xrender_set_clip(xd, img->pict, &img->clip, reg_visible);
 		if (img->has_alpha) {
 			auto tmp_pict =
 			    x_create_picture_with_visual(base->c, base->root, img->width,
 			                                 img->height, img->visual, 0, NULL);
-			xcb_render_composite(base->c, XCB_RENDER_PICT_OP_SRC, img->pict,
-			                     XCB_NONE, tmp_pict, 0, 0, 0, 0, 0, 0, tmpw, tmph);
-
-			xcb_render_composite(base->c, XCB_RENDER_PICT_OP_DIFFERENCE,
-			                     xd->white_pixel, XCB_NONE, img->pict, 0, 0,
-			                     0, 0, 0, 0, tmpw, tmph);
-			xcb_render_composite(base->c, XCB_RENDER_PICT_OP_IN_REVERSE,
-			                     tmp_pict, XCB_NONE, img->pict, 0, 0, 0, 0, 0,
-			                     0, tmpw, tmph);
+			xrender_composite(xd, XCB_RENDER_PICT_OP_SRC, img->pict, XCB_NONE,
+			                  tmp_pict, 0, 0, 0, 0, 0, 0, tmpw, tmph);
+
+			xrender_composite(xd, XCB_RENDER_PICT_OP_DIFFERENCE,
+			                  xd->white_pixel, XCB_NONE, img->pict, 0, 0, 0, 0,
+			                  0, 0, tmpw, tmph);
+			xrender_composite(xd, XCB_RENDER_PICT_OP_IN_REVERSE, tmp_pict,
+			                  XCB_NONE, img->pict, 0, 0, 0, 0, 0, 0, tmpw,
+			                  tmph);
 			xcb_render_free_picture(base->c, tmp_pict);
 		} else {
-			xcb_render_composite(base->c, XCB_RENDER_PICT_OP_DIFFERENCE,
-			                     xd->white_pixel, XCB_NONE, img->pict, 0, 0,
-			                     0, 0, 0, 0, tmpw, tmph);
+			xrender_composite(xd, XCB_RENDER_PICT_OP_DIFFERENCE,
+			                  xd->white_pixel, XCB_NONE, img->pict, 0, 0, 0, 0,
+			                  0, 0, tmpw, tmph);
 		}
 		break;
 	case IMAGE_OP_DIM_ALL:
-		x_set_picture_clip_region(base->c, img->pict, 0, 0, reg_visible);
+		xrender_set_clip(xd, img->pict, &img->clip, reg_visible);
 
 		xcb_render_color_t color = {
 		    .red = 0, .green = 0, .blue = 0, .alpha = (uint16_t)(0xffff * dargs[0])};
@@ -433,8 +749,8 @@ static bool image_op(backend_t *base, enum image_operations op, void *image,
 		    .height = tmph,
 		};
 
-		xcb_render_fill_rectangles(base->c, XCB_RENDER_PICT_OP_OVER, img->pict,
-		                           color, 1, &rect);
+		xrender_fill_rectangles(xd, XCB_RENDER_PICT_OP_OVER, img->pict, color, 1,
+		                        &rect);
 		break;
 	case IMAGE_OP_APPLY_ALPHA:
 		assert(reg_op);
@@ -448,9 +764,9 @@ static bool image_op(backend_t *base, enum image_operations op, void *image,
 		}
 
 		auto alpha_pict = xd->alpha_pict[(int)((1 - dargs[0]) * MAX_ALPHA)];
-		x_set_picture_clip_region(base->c, img->pict, 0, 0, &reg);
-		xcb_render_composite(base->c, XCB_RENDER_PICT_OP_OUT_REVERSE, alpha_pict,
-		                     XCB_NONE, img->pict, 0, 0, 0, 0, 0, 0, tmpw, tmph);
+		xrender_set_clip(xd, img->pict, &img->clip, &reg);
+		xrender_composite(xd, XCB_RENDER_PICT_OP_OUT_REVERSE, alpha_pict,
+		                  XCB_NONE, img->pict, 0, 0, 0, 0, 0, 0, tmpw, tmph);
 		img->has_alpha = true;
 		break;
 	case IMAGE_OP_RESIZE_TILE:
@@ -472,7 +788,7 @@ static void *copy(backend_t *base, const void *image, const region_t *reg) {
 	assert(img->visual != XCB_NONE);
 	log_trace("xrender: copying %#010x visual %#x", img->pixmap, img->visual);
 	*new_img = *img;
-	x_set_picture_clip_region(base->c, img->pict, 0, 0, reg);
+	xrender_set_clip(xd, img->pict, (struct xrender_clip *)&img->clip, reg);
 	new_img->pixmap =
 	    x_create_pixmap(base->c, img->depth, base->root, img->width, img->height);
 	new_img->opacity = 1;
@@ -493,9 +809,10 @@ static void *copy(backend_t *base, const void *image, const region_t *reg) {
 
 	xcb_render_picture_t alpha_pict =
 	    img->opacity == 1 ? XCB_NONE : xd->alpha_pict[(int)(img->opacity * MAX_ALPHA)];
-	xcb_render_composite(base->c, XCB_RENDER_PICT_OP_SRC, img->pict, alpha_pict,
-	                     new_img->pict, 0, 0, 0, 0, 0, 0, to_u16_checked(img->width),
-	                     to_u16_checked(img->height));
+	xrender_clip_init(&new_img->clip);
+	xrender_composite(xd, XCB_RENDER_PICT_OP_SRC, img->pict, alpha_pict, new_img->pict,
+	                  0, 0, 0, 0, 0, 0, to_u16_checked(img->width),
+	                  to_u16_checked(img->height));
 	return new_img;
 }
 
@@ -554,6 +871,11 @@ void get_blur_size(void *blur_context, int *width, int *height) {
 backend_t *backend_xrender_init(session_t *ps) {
 	auto xd = ccalloc(1, struct _xrender_data);
 	init_backend_base(&xd->base, ps);
+	xd->low_bandwidth = ps->o.low_bandwidth;
+	xd->stats = &ps->render_stats;
+	for (int i = 0; i < 3; i++) {
+		xrender_clip_init(&xd->back_clip[i]);
+	}
 
 	for (int i = 0; i <= MAX_ALPHA; ++i) {
 		double o = (double)i / (double)MAX_ALPHA;
@@ -638,12 +960,13 @@ struct backend_operations xrender_ops = {
     .init = backend_xrender_init,
     .deinit = deinit,
     .blur = blur,
+    .prepare = prepare,
     .present = present,
     .compose = compose,
     .fill = fill,
     .bind_pixmap = bind_pixmap,
     .release_image = release_image,
-    .render_shadow = default_backend_render_shadow,
+    .render_shadow = render_shadow,
     //.prepare_win = prepare_win,
     //.release_win = release_win,
     .is_image_transparent = is_image_transparent,
@@ -655,6 +978,7 @@ struct backend_operations xrender_ops = {
     .create_blur_context = create_blur_context,
     .destroy_blur_context = destroy_blur_context,
     .get_blur_size = get_blur_size,
+    .trim_memory = trim_memory,
 };
 
 // vim: set noet sw=8 ts=8:
@@ -12,8 +12,10 @@
 
 #include <ctype.h>
 #include <fnmatch.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 // libpcre
 #ifdef CONFIG_REGEX_PCRE
@@ -37,6 +39,7 @@
 #include "compiler.h"
 #include "config.h"
 #include "log.h"
+#include "probe.h"
 #include "string_utils.h"
 #include "utils.h"
 #include "win.h"
@@ -80,6 +83,12 @@ struct _c2_b {
 	c2_b_op_t op;
 	c2_ptr_t opr1;
 	c2_ptr_t opr2;
+	/// Cost of evaluating both operands, see c2_cost()
+	int cost;
+	/// Number of times each operand of an AND or OR branch was evaluated, and
+	/// settled the result of the branch on its own. Only counted by c2_match(),
+	/// used to put the operand that is most likely to cut evaluation short first.
+	unsigned evaluated[2], decided[2];
 };
 
 /// Initializer for c2_b_t.
@@ -211,6 +220,48 @@ static const c2_predef_t C2_PREDEFS[] = {
     [C2_L_PROLE] = {"role", C2_L_TSTRING, 0},
 };
 
+/// Value of a raw window property a leaf targets, fetched by c2_match_batch() ahead
+/// of matching.
+struct c2_prop_value {
+	/// Whether the property has a value at the index the leaf asks for
+	bool exists;
+	/// Value of integer properties
+	long i;
+	/// Value of string and atom properties
+	char *s;
+};
+
+/// Prefetched raw window properties of one window.
+struct c2_window_props {
+	/// Leaves that target raw window properties
+	const c2_l_t *const *leaves;
+	int nleaves;
+	/// Property values, in the same order as `leaves`
+	const struct c2_prop_value *values;
+};
+
+/// Rough costs of evaluating a leaf, in arbitrary units
+enum c2_cost {
+	/// Comparing an integer the window already has
+	C2_COST_INT = 1,
+	/// Comparing a string the window already has
+	C2_COST_STRING = 4,
+	/// Matching a string against a wildcard or a regular expression
+	C2_COST_PATTERN = 16,
+	/// Fetching a raw property from the X server
+	C2_COST_ROUND_TRIP = 1000,
+};
+
+/// Number of evaluations of an AND or OR branch between two reorderings of its
+/// operands.
+#define C2_REORDER_INTERVAL 64
+
+/// Windows below this count are matched on the calling thread.
+#define C2_BATCH_WINDOWS_PER_THREAD 64
+/// Maximum length of text properties fetched in a batch, same as what
+/// XGetTextProperty uses.
+#define C2_TEXT_PROP_LENGTH 1000000
+
 /**
  * Get the numeric property value from a win_prop_t.
  */
@@ -265,7 +316,7 @@ static inline void c2_ptr_reset(c2_ptr_t *pp) {
  * Combine two condition trees.
  */
 static inline c2_ptr_t c2h_comb_tree(c2_b_op_t op, c2_ptr_t p1, c2_ptr_t p2) {
-	c2_ptr_t p = {.isbranch = true, .b = cmalloc(c2_b_t)};
+	c2_ptr_t p = {.isbranch = true, .b = ccalloc(1, c2_b_t)};
 
 	p.b->opr1 = p1;
 	p.b->opr2 = p2;
@@ -331,7 +382,8 @@ static void attr_unused c2_dump(c2_ptr_t p);
 
 static xcb_atom_t c2_get_atom_type(const c2_l_t *pleaf);
 
-static bool c2_match_once(session_t *ps, const struct managed_win *w, const c2_ptr_t cond);
+static bool c2_match_once(session_t *ps, const struct managed_win *w, const c2_ptr_t cond,
+                          const struct c2_window_props *props);
 
 /**
  * Parse a condition string.
@@ -1081,13 +1133,80 @@ static bool c2_l_postprocess(session_t *ps, c2_l_t *pleaf) {
 	return true;
 }
 
+/**
+ * Get the cost of evaluating a condition tree, if all of it is evaluated.
+ */
+static int c2_cost(c2_ptr_t p) {
+	if (p.isbranch) {
+		return p.b->cost;
+	}
+
+	const c2_l_t *pleaf = p.l;
+	int cost = 0;
+	if (pleaf->predef == C2_L_PUNDEFINED) {
+		// Names of atoms take a second round trip
+		cost += pleaf->type == C2_L_TATOM ? 2 * C2_COST_ROUND_TRIP
+		                                  : C2_COST_ROUND_TRIP;
+	}
+	if (pleaf->ptntype != C2_L_PTSTRING) {
+		return cost + C2_COST_INT;
+	}
+	if (pleaf->op != C2_L_OEXISTS &&
+	    (pleaf->match == C2_L_MWILDCARD || pleaf->match == C2_L_MPCRE)) {
+		return cost + C2_COST_PATTERN;
+	}
+	return cost + C2_COST_STRING;
+}
+
+/**
+ * Put the operand of an AND or OR branch that is expected to settle its result for the
+ * least cost first. Without any statistics, that is the cheaper one.
+ */
+static void c2_b_reorder(c2_b_t *pb) {
+	if (pb->op != C2_B_OAND && pb->op != C2_B_OOR) {
+		return;
+	}
+
+	// Expected cost of evaluating each operand, over the likelihood that it
+	// settles the result, which starts out at a half
+	double key[2];
+	for (int i = 0; i < 2; i++) {
+		double decisive = (pb->decided[i] + 1.0) / (pb->evaluated[i] + 2.0);
+		key[i] = c2_cost(i ? pb->opr2 : pb->opr1) / decisive;
+	}
+	if (key[1] < key[0]) {
+		auto opr = pb->opr1;
+		pb->opr1 = pb->opr2;
+		pb->opr2 = opr;
+		unsigned evaluated = pb->evaluated[0], decided = pb->decided[0];
+		pb->evaluated[0] = pb->evaluated[1];
+		pb->decided[0] = pb->decided[1];
+		pb->evaluated[1] = evaluated;
+		pb->decided[1] = decided;
+#ifdef DEBUG_C2
+		log_trace("Reordered branch: ");
+		c2_dump((c2_ptr_t){.isbranch = true, .b = pb});
+#endif
+	}
+
+	// Let old observations fade, so the order follows changes in the windows
+	for (int i = 0; i < 2; i++) {
+		pb->evaluated[i] /= 2;
+		pb->decided[i] /= 2;
+	}
+}
+
 static bool c2_tree_postprocess(session_t *ps, c2_ptr_t node) {
 	if (!node.isbranch) {
 		return c2_l_postprocess(ps, node.l);
 	}
 	if (!c2_tree_postprocess(ps, node.b->opr1))
 		return false;
-	return c2_tree_postprocess(ps, node.b->opr2);
+	if (!c2_tree_postprocess(ps, node.b->opr2))
+		return false;
+	node.b->cost = c2_cost(node.b->opr1) + c2_cost(node.b->opr2);
+	c2_b_reorder(node.b);
+	return true;
 }
 
 bool c2_list_postprocess(session_t *ps, c2_lptr_t *list) {
@@ -1095,6 +1214,10 @@ bool c2_list_postprocess(session_t *ps, c2_lptr_t *list) {
 	while (head) {
 		if (!c2_tree_postprocess(ps, head->ptr))
 			return false;
+#ifdef DEBUG_C2
+		log_trace("Ordered condition: ");
+		c2_dump(head->ptr);
+#endif
 		head = head->next;
 	}
 	return true;
@@ -1276,13 +1399,30 @@ static xcb_atom_t c2_get_atom_type(const c2_l_t *pleaf) {
 	unreachable;
 }
 
+/**
+ * Find the prefetched value of the raw window property a leaf targets.
+ */
+static inline const struct c2_prop_value *
+c2_window_props_get(const struct c2_window_props *props, const c2_l_t *pleaf) {
+	for (int i = 0; i < props->nleaves; i++) {
+		if (props->leaves[i] == pleaf) {
+			return &props->values[i];
+		}
+	}
+	return NULL;
+}
+
 /**
  * Match a window against a single leaf window condition.
  *
  * For internal use.
+ *
+ * @param props prefetched raw window properties, if NULL they are fetched from the X
+ *              server
  */
 static inline void c2_match_once_leaf(session_t *ps, const struct managed_win *w,
-                                      const c2_l_t *pleaf, bool *pres, bool *perr) {
+                                      const c2_l_t *pleaf, bool *pres, bool *perr,
+                                      const struct c2_window_props *props) {
 	assert(pleaf);
 
 	const xcb_window_t wid = (pleaf->tgt_onframe ? w->client_win : w->base.id);
@@ -1329,6 +1469,14 @@ static inline void c2_match_once_leaf(session_t *ps, const struct managed_win *w
 				break;
 			}
 		}
+		// A prefetched raw window property
+		else if (props) {
+			auto value = c2_window_props_get(props, pleaf);
+			if (value && value->exists) {
+				*perr = false;
+				tgt = value->i;
+			}
+		}
 		// A raw window property
 		else {
 			winprop_t prop =
@@ -1375,6 +1523,12 @@ static inline void c2_match_once_leaf(session_t *ps, const struct managed_win *w
 			case C2_L_PROLE: tgt = w->role; break;
 			default: assert(0); break;
 			}
+		} else if (props) {
+			// A prefetched string or atom name, owned by the batch
+			auto value = c2_window_props_get(props, pleaf);
+			if (value && value->exists) {
+				tgt = value->s;
+			}
 		} else if (pleaf->type == C2_L_TATOM) {
 			// An atom type property, convert it to string
 			winprop_t prop =
@@ -1472,18 +1626,53 @@ static inline void c2_match_once_leaf(session_t *ps, const struct managed_win *w
 	}
 }
 
+/**
+ * Match a window against the operands of an AND or OR branch.
+ *
+ * Only stops after the first operand if it settles the result, so the order of the
+ * operands doesn't change the result. Without prefetched properties, i.e. when called
+ * from c2_match() on the main thread, also keeps the statistics of the operands, and
+ * reorders them from time to time.
+ */
+static bool c2_match_b_commutative(session_t *ps, const struct managed_win *w,
+                                   c2_b_t *pb, const struct c2_window_props *props) {
+	// The operand value that settles the result on its own
+	const bool decisive = pb->op == C2_B_OOR;
+	bool result = c2_match_once(ps, w, pb->opr1, props);
+	if (!props) {
+		pb->evaluated[0]++;
+		if (result == decisive) {
+			pb->decided[0]++;
+		}
+	}
+	if (result != decisive) {
+		result = c2_match_once(ps, w, pb->opr2, props);
+		if (!props) {
+			pb->evaluated[1]++;
+			if (result == decisive) {
+				pb->decided[1]++;
+			}
+		}
+	}
+	if (!props && pb->evaluated[0] >= C2_REORDER_INTERVAL) {
+		c2_b_reorder(pb);
+	}
+	return result;
+}
+
 /**
  * Match a window against a single window condition.
  *
  * @return true if matched, false otherwise.
  */
-static bool c2_match_once(session_t *ps, const struct managed_win *w, const c2_ptr_t cond) {
+static bool c2_match_once(session_t *ps, const struct managed_win *w, const c2_ptr_t cond,
+                          const struct c2_window_props *props) {
 	bool result = false;
 	bool error = true;
 
 	// Handle a branch
 	if (cond.isbranch) {
-		const c2_b_t *pb = cond.b;
+		c2_b_t *pb = cond.b;
 
 		if (!pb)
 			return false;
@@ -1492,16 +1681,10 @@ static bool c2_match_once(session_t *ps, const struct managed_win *w, const c2_p
 
 		switch (pb->op) {
 		case C2_B_OAND:
-			result = (c2_match_once(ps, w, pb->opr1) &&
-			          c2_match_once(ps, w, pb->opr2));
-			break;
-		case C2_B_OOR:
-			result = (c2_match_once(ps, w, pb->opr1) ||
-			          c2_match_once(ps, w, pb->opr2));
-			break;
+		case C2_B_OOR: result = c2_match_b_commutative(ps, w, pb, props); break;
 		case C2_B_OXOR:
-			result = (c2_match_once(ps, w, pb->opr1) !=
-			          c2_match_once(ps, w, pb->opr2));
+			result = (c2_match_once(ps, w, pb->opr1, props) !=
+			          c2_match_once(ps, w, pb->opr2, props));
 			break;
 		default: error = true; assert(0);
 		}
@@ -1518,7 +1701,7 @@ static bool c2_match_once(session_t *ps, const struct managed_win *w, const c2_p
 		if (!pleaf)
 			return false;
 
-		c2_match_once_leaf(ps, w, pleaf, &result, &error);
+		c2_match_once_leaf(ps, w, pleaf, &result, &error, props);
 
 		// For EXISTS operator, no errors are fatal
 		if (C2_L_OEXISTS == pleaf->op && error) {
@@ -1553,14 +1736,294 @@ static bool c2_match_once(session_t *ps, const struct managed_win *w, const c2_p
  */
 bool c2_match(session_t *ps, const struct managed_win *w, const c2_lptr_t *condlst,
               void **pdata) {
+	// Use the result of c2_match_batch() if there is one
+	for (auto r = w->c2_results; r && r->list; r++) {
+		if (r->list == condlst) {
+			if (r->matched && pdata)
+				*pdata = r->data;
+			PROBE(c2_match, w->base.id, condlst, r->matched);
+			return r->matched;
+		}
+	}
+
 	// Then go through the whole linked list
-	for (; condlst; condlst = condlst->next) {
-		if (c2_match_once(ps, w, condlst->ptr)) {
+	for (auto i = condlst; i; i = i->next) {
+		if (c2_match_once(ps, w, i->ptr, NULL)) {
+			PROBE(c2_match, w->base.id, condlst, true);
 			if (pdata)
-				*pdata = condlst->data;
+				*pdata = i->data;
 			return true;
 		}
 	}
 
+	PROBE(c2_match, w->base.id, condlst, false);
 	return false;
 }
+
+/// State shared by the threads of a c2_match_batch() call.
+struct c2_batch {
+	session_t *ps;
+	struct managed_win **ws;
+	int nws;
+	const c2_lptr_t *const *lists;
+	int nlists;
+	/// Leaves of `lists` that target raw window properties
+	const c2_l_t **leaves;
+	int nleaves;
+	/// Prefetched property values, `nleaves` for each window
+	struct c2_prop_value *values;
+};
+
+/// A range of windows of a batch matched by one thread.
+struct c2_batch_worker {
+	const struct c2_batch *batch;
+	int begin, end;
+	pthread_t thread;
+};
+
+/**
+ * Collect the leaves of a condition tree that target raw window properties.
+ */
+static void c2_batch_collect_leaves(struct c2_batch *b, int *capacity, c2_ptr_t p) {
+	if (p.isbranch) {
+		if (p.b) {
+			c2_batch_collect_leaves(b, capacity, p.b->opr1);
+			c2_batch_collect_leaves(b, capacity, p.b->opr2);
+		}
+		return;
+	}
+	if (!p.l || p.l->predef != C2_L_PUNDEFINED) {
+		return;
+	}
+	for (int i = 0; i < b->nleaves; i++) {
+		if (b->leaves[i] == p.l) {
+			return;
+		}
+	}
+	if (b->nleaves == *capacity) {
+		*capacity = *capacity ? *capacity * 2 : 8;
+		b->leaves = crealloc(b->leaves, *capacity);
+	}
+	b->leaves[b->nleaves++] = p.l;
+}
+
+/// Whether a leaf matches against the text value of its property.
+static inline bool c2_leaf_is_text(const c2_l_t *pleaf) {
+	return pleaf->ptntype == C2_L_PTSTRING && pleaf->type != C2_L_TATOM;
+}
+
+/**
+ * Fetch the raw window properties needed by a batch.
+ *
+ * All requests are sent before waiting for any reply, so the whole batch costs a
+ * couple of round trips instead of one for every window and leaf.
+ */
+static void c2_batch_prefetch(struct c2_batch *b) {
+	session_t *ps = b->ps;
+	const int n = b->nws * b->nleaves;
+	auto cookies = ccalloc(n, xcb_get_property_cookie_t);
+	auto atom_cookies = ccalloc(n, xcb_get_atom_name_cookie_t);
+
+	for (int i = 0; i < b->nws; i++) {
+		const struct managed_win *w = b->ws[i];
+		for (int j = 0; j < b->nleaves; j++) {
+			const c2_l_t *pleaf = b->leaves[j];
+			const xcb_window_t wid =
+			    (pleaf->tgt_onframe ? w->client_win : w->base.id);
+			if (!wid) {
+				continue;
+			}
+			const int idx = (pleaf->index < 0 ? 0 : pleaf->index);
+			if (c2_leaf_is_text(pleaf)) {
+				cookies[i * b->nleaves + j] = xcb_get_property(
+				    ps->c, 0, wid, pleaf->tgtatom, XCB_GET_PROPERTY_TYPE_ANY,
+				    0, C2_TEXT_PROP_LENGTH);
+			} else {
+				cookies[i * b->nleaves + j] =
+				    xcb_get_property(ps->c, 0, wid, pleaf->tgtatom,
+				                     c2_get_atom_type(pleaf), to_u32_checked(idx), 1);
+			}
+		}
+	}
+
+	// Collect the replies. Names of atom values need another round of requests,
+	// which are pipelined the same way. Each round waits for the server once.
+	bool requested = false;
+	bool atoms_requested = false;
+	for (int k = 0; k < n; k++) {
+		if (!cookies[k].sequence) {
+			continue;
+		}
+		if (!requested) {
+			x_round_trips++;
+			requested = true;
+		}
+		const c2_l_t *pleaf = b->leaves[k % b->nleaves];
+		struct c2_prop_value *value = &b->values[k];
+		if (c2_leaf_is_text(pleaf)) {
+			auto r = xcb_get_property_reply(ps->c, cookies[k], NULL);
+			char **strlst = NULL;
+			int nstr = 0;
+			const int idx = (pleaf->index < 0 ? 0 : pleaf->index);
+			if (r && x_text_prop_from_reply(ps, r, &strlst, &nstr)) {
+				if (nstr > idx) {
+					value->s = strdup(strlst[idx]);
+					value->exists = true;
+				}
+				XFreeStringList(strlst);
+			}
+			free(r);
+			continue;
+		}
+
+		winprop_t prop =
+		    x_get_prop_reply(ps, cookies[k], c2_get_atom_type(pleaf), pleaf->format);
+		if (pleaf->type == C2_L_TATOM && pleaf->ptntype == C2_L_PTSTRING) {
+			xcb_atom_t atom = (xcb_atom_t)winprop_get_int(prop);
+			if (atom) {
+				atom_cookies[k] = xcb_get_atom_name(ps->c, atom);
+				atoms_requested = true;
+			}
+		} else if (prop.nitems) {
+			value->i = winprop_get_int(prop);
+			value->exists = true;
+		}
+		free_winprop(&prop);
+	}
+
+	if (atoms_requested) {
+		x_round_trips++;
+	}
+	for (int k = 0; k < n; k++) {
+		if (!atom_cookies[k].sequence) {
+			continue;
+		}
+		auto r = xcb_get_atom_name_reply(ps->c, atom_cookies[k], NULL);
+		if (r) {
+			b->values[k].s = strndup(xcb_get_atom_name_name(r),
+			                         (size_t)xcb_get_atom_name_name_length(r));
+			b->values[k].exists = true;
+			free(r);
+		}
+	}
+
+	free(atom_cookies);
+	free(cookies);
+}
+
+/**
+ * Match a range of windows of a batch against all of its condition lists.
+ *
+ * This only reads the windows and the prefetched properties, and makes no X
+ * requests, so it can run on any thread while the main thread waits.
+ */
+static void *c2_batch_match_range(void *arg) {
+	struct c2_batch_worker *worker = arg;
+	const struct c2_batch *b = worker->batch;
+	for (int i = worker->begin; i < worker->end; i++) {
+		const struct managed_win *w = b->ws[i];
+		const struct c2_window_props props = {
+		    .leaves = b->leaves,
+		    .nleaves = b->nleaves,
+		    .values = &b->values[i * b->nleaves],
+		};
+		struct c2_result *results = w->c2_results;
+		for (int j = 0; j < b->nlists; j++) {
+			results[j].list = b->lists[j];
+			for (auto l = b->lists[j]; l; l = l->next) {
+				if (c2_match_once(b->ps, w, l->ptr, &props)) {
+					results[j].matched = true;
+					results[j].data = l->data;
+					break;
+				}
+			}
+		}
+	}
+	return NULL;
+}
+
+void c2_match_batch(session_t *ps, struct managed_win **ws, int nws,
+                    const c2_lptr_t *const *lists, int nlists) {
+	if (!nws) {
+		return;
+	}
+
+	struct c2_batch b = {.ps = ps, .ws = ws, .nws = nws};
+
+	// Empty lists never match, leave them out
+	auto nonempty = ccalloc(nlists, const c2_lptr_t *);
+	int capacity = 0;
+	for (int i = 0; i < nlists; i++) {
+		if (!lists[i]) {
+			continue;
+		}
+		nonempty[b.nlists++] = lists[i];
+		for (auto l = lists[i]; l; l = l->next) {
+			c2_batch_collect_leaves(&b, &capacity, l->ptr);
+		}
+	}
+	b.lists = nonempty;
+
+	b.values = ccalloc(nws * b.nleaves, struct c2_prop_value);
+	if (b.nleaves) {
+		c2_batch_prefetch(&b);
+	}
+
+	// One more entry to terminate the list
+	for (int i = 0; i < nws; i++) {
+		free(ws[i]->c2_results);
+		ws[i]->c2_results = ccalloc(b.nlists + 1, struct c2_result);
+	}
+
+	long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int nthreads = nws / C2_BATCH_WINDOWS_PER_THREAD;
+	if (nthreads > ncpus) {
+		nthreads = (int)ncpus;
+	}
+	if (nthreads < 1) {
+		nthreads = 1;
+	}
+	log_debug("Matching %d windows against %d rule lists, %d raw properties, on %d "
+	          "threads",
+	          nws, b.nlists, b.nleaves, nthreads);
+
+	// The last range is matched on this thread. If a thread can't be created, its
+	// range is matched here too.
+	auto workers = ccalloc(nthreads, struct c2_batch_worker);
+	for (int i = 0; i < nthreads; i++) {
+		workers[i] = (struct c2_batch_worker){
+		    .batch = &b,
+		    .begin = (int)((long)nws * i / nthreads),
+		    .end = (int)((long)nws * (i + 1) / nthreads),
+		};
+	}
+	bool *started = ccalloc(nthreads, bool);
+	for (int i = 0; i < nthreads - 1; i++) {
+		started[i] = pthread_create(&workers[i].thread, NULL,
+		                            c2_batch_match_range, &workers[i]) == 0;
+	}
+	for (int i = 0; i < nthreads; i++) {
+		if (i == nthreads - 1 || !started[i]) {
+			c2_batch_match_range(&workers[i]);
+		}
+	}
+	for (int i = 0; i < nthreads - 1; i++) {
+		if (started[i]) {
+			pthread_join(workers[i].thread, NULL);
+		}
+	}
+
+	for (int i = 0; i < nws * b.nleaves; i++) {
+		free(b.values[i].s);
+	}
+	free(started);
+	free(workers);
+	free(b.values);
+	free(b.leaves);
+	free(nonempty);
+}
+
+void c2_match_batch_clear(struct managed_win *w) {
+	free(w->c2_results);
+	w->c2_results = NULL;
+}
@@ -24,3 +24,25 @@ c2_lptr_t *c2_free_lptr(c2_lptr_t *lp);
 bool c2_match(session_t *ps, const struct managed_win *w, const c2_lptr_t *condlst, void **pdata);
 
 bool c2_list_postprocess(session_t *ps, c2_lptr_t *list);
+
+/// Result of matching a window against a condition list, see c2_match_batch().
+struct c2_result {
+	const c2_lptr_t *list;
+	/// Data of the first matching condition
+	void *data;
+	bool matched;
+};
+
+/**
+ * Match many windows against a number of condition lists at once.
+ *
+ * The raw window properties the conditions need are requested for all windows
+ * before waiting for any reply, and the matching is then spread over worker
+ * threads. The results are attached to the windows, and returned by c2_match()
+ * until c2_match_batch_clear() is called. Must be called from the main thread.
+ */
+void c2_match_batch(session_t *ps, struct managed_win **ws, int nws,
+                    const c2_lptr_t *const *lists, int nlists);
+
+/// Drop the results attached to a window by c2_match_batch().
+void c2_match_batch_clear(struct managed_win *w);
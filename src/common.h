@@ -59,6 +59,7 @@
 #include "types.h"
 #include "utils.h"
 #include "list.h"
+#include "log.h"
 #include "render.h"
 #include "win_defs.h"
 #include "x.h"
@@ -81,6 +82,7 @@
 typedef struct glx_fbconfig glx_fbconfig_t;
 struct glx_session;
 struct atom;
+struct x_worker;
 struct conv;
 
 typedef struct _ignore {
@@ -130,6 +132,65 @@ typedef struct _latom {
 	struct _latom *next;
 } latom_t;
 
+/// Things that wake up the main loop, counted in session_t::wakeups.
+enum wakeup_source {
+	WAKEUP_X_EVENT,
+	WAKEUP_DRAW,
+	WAKEUP_FADE_TIMER,
+	WAKEUP_UNREDIR_TIMER,
+	WAKEUP_DELAYED_DRAW_TIMER,
+	WAKEUP_TRANSACTION_TIMER,
+	WAKEUP_VBLANK,
+	WAKEUP_DBUS_IO,
+	WAKEUP_DBUS_TIMEOUT,
+	WAKEUP_SIGNAL,
+	WAKEUP_CONFIG_WATCH,
+	WAKEUP_X_WORKER,
+	WAKEUP_X_ERROR_TIMER,
+	WAKEUP_CONTROL,
+	WAKEUP_IDLE_TRIM_TIMER,
+	WAKEUP_HANDOFF_TIMER,
+	NUM_WAKEUP_SOURCES,
+};
+
+/// Kinds of X requests the protocol traffic of the xrender backend is broken down into
+enum x_traffic_kind {
+	X_TRAFFIC_COMPOSITE,
+	/// Setting and clearing clip regions
+	X_TRAFFIC_CLIP,
+	/// Setting picture filters, i.e. blur kernels
+	X_TRAFFIC_FILTER,
+	/// Uploading images, i.e. shadows
+	X_TRAFFIC_IMAGE,
+	X_TRAFFIC_FILL,
+	NUM_X_TRAFFIC_KINDS,
+};
+
+/// Counters of the rendered frames.
+struct render_stats {
+	/// Number of frames rendered
+	uint64_t frames;
+	/// Total time spent rendering, in microseconds
+	uint64_t render_time_us;
+	/// Time spent rendering the last frame, in microseconds
+	uint64_t last_render_time_us;
+	/// Total number of damaged pixels repainted
+	uint64_t damaged_pixels;
+	/// Number of damaged pixels repainted in the last frame
+	uint64_t last_damaged_pixels;
+	/// Number of blur operations in the last frame
+	int last_blur_passes;
+	/// Time spent presenting the last frame, in microseconds, included in
+	/// last_render_time_us
+	uint64_t last_present_time_us;
+	/// Bytes of X requests sent by the xrender backend, by kind
+	uint64_t x_bytes[NUM_X_TRAFFIC_KINDS];
+	/// Bytes of X requests --low-bandwidth didn't send, by kind
+	uint64_t x_bytes_saved[NUM_X_TRAFFIC_KINDS];
+	/// Bytes of X requests sent by the xrender backend for the last frame
+	uint64_t last_x_bytes;
+};
+
 /// Structure containing all necessary data for a session.
 typedef struct session {
 	// === Event handlers ===
@@ -139,6 +200,16 @@ typedef struct session {
 	ev_timer unredir_timer;
 	/// Timer for fading
 	ev_timer fade_timer;
+	/// Timer that commits a transaction its client never committed
+	ev_timer transaction_timer;
+	/// Timer that reports the X errors that were not logged individually
+	ev_timer x_error_timer;
+	/// Timer that releases the scratch memory after the screen has been idle for
+	/// `idle_trim_delay`, restarted on every frame.
+	ev_timer idle_trim_timer;
+	/// Timer that checks whether the compositor we are taking over from has released
+	/// the screen, see handoff_begin().
+	ev_timer handoff_timer;
 	/// Timer for delayed drawing, right now only used by
 	/// swopti
 	ev_timer delayed_draw_timer;
@@ -197,6 +268,9 @@ typedef struct session {
 	paint_t root_tile_paint;
 	/// The backend data the root pixmap bound to
 	void *root_image;
+	/// The root window background pixmap, as last read from the root window
+	/// properties. XCB_NONE if no wallpaper is set.
+	xcb_pixmap_t root_pixmap;
 	/// A region of the size of the screen.
 	region_t screen_reg;
 	/// Picture of root window. Destination of painting in no-DBE painting
@@ -220,6 +294,20 @@ typedef struct session {
 	xcb_sync_fence_t sync_fence;
 	/// Whether we are rendering the first frame after screen is redirected
 	bool first_frame;
+	/// Whether another compositor still owns the screen, and we are getting ready to
+	/// take over from it. The screen is only redirected automatically meanwhile.
+	bool handoff_pending;
+	/// When we started taking over the screen, to measure the time until our first
+	/// frame. Zero once it's measured.
+	struct timespec handoff_start;
+	/// Leave the overlay window mapped when unredirecting the screen, so it keeps
+	/// showing our last frame until the next compositor draws over it.
+	bool keep_overlay;
+	/// Whether the overlay window was left mapped at startup because it shows the
+	/// last frame of the compositor we took over from. Cleared once our first frame
+	/// is drawn, or once the overlay is unmapped because the screen stays
+	/// unredirected.
+	bool overlay_kept_mapped;
 
 	// === Operation related ===
 	/// Flags related to the root window
@@ -238,10 +326,17 @@ typedef struct session {
 	int ndamage;
 	/// Whether all windows are currently redirected.
 	bool redirected;
+	/// Region of the screen covered by windows unredirected on their own. It is
+	/// cut out of the overlay window, and never painted.
+	region_t unredir_region;
 	/// Pre-generated alpha pictures.
 	xcb_render_picture_t *alpha_picts;
 	/// Time of last fading. In milliseconds.
 	long fade_time;
+	/// Number of open transactions, rendering is held back while it's non-zero.
+	int transaction_depth;
+	/// Whether the _PICOM_TRANSACTION root property holds a transaction open.
+	bool transaction_prop_open;
 	/// Head pointer of the error ignore linked list.
 	ignore_t *ignore_head;
 	/// Pointer to the <code>next</code> member of tail element of the error
@@ -255,6 +350,9 @@ typedef struct session {
 	/// TODO use separate flags for dfferent kinds of updates so we don't
 	/// waste our time.
 	bool pending_updates:1;
+	/// Whether win_on_factor_change should only mark windows, so the rules can
+	/// later be matched against all of them in one batch.
+	bool defer_factor_change;
 
 	// === Expose event related ===
 	/// Pointer to an array of <code>XRectangle</code>-s of exposed region.
@@ -373,13 +471,54 @@ typedef struct session {
 	void *dbus_data;
 #endif
 
-	int (*vsync_wait)(session_t *);
+	/// Ask for a notification at the next vblank, used by the legacy backends.
+	/// handle_vblank() is called when it arrives. NULL if vsync is disabled or
+	/// handled by glXSwapBuffers.
+	bool (*vsync_request)(session_t *);
+	/// Private data of the vsync method in use.
+	void *vsync_data;
+	/// Whether a rendered frame is waiting for the next vblank to be put on
+	/// screen. With the new backends, whether the backend is still busy putting
+	/// it on screen.
+	bool frame_pending;
+	/// Region of the frame that is waiting to be put on screen.
+	region_t pending_frame_region;
+	/// Number of times each source has woken up the main loop. When nothing
+	/// changes on screen, none of these should increase.
+	uint64_t wakeups[NUM_WAKEUP_SOURCES];
+	/// Rendering counters, published through the statistics page.
+	struct render_stats render_stats;
+	/// Private data of the statistics page. NULL if it is disabled.
+	void *stats_page_data;
+	/// Private data of the control socket. NULL if it is disabled.
+	void *control_data;
+	/// Worker thread making slow X queries on a secondary connection. NULL if it
+	/// could not be started, in which case the queries are made synchronously.
+	struct x_worker *x_worker;
+	/// Next value for managed_win::generation.
+	uint64_t next_win_generation;
+	/// Frame time overlay. NULL if it is disabled.
+	struct hud *hud;
+	/// Index of the extents of the windows that are not unmapped, see
+	/// win_update_index().
+	struct spatial_index *spatial_index;
+	/// Shadow images of unmapped windows, kept for the windows mapped next. NULL if
+	/// the cache is disabled, or not using the experimental backends.
+	struct shadow_cache *shadow_cache;
 } session_t;
 
 /// Enumeration for window event hints.
 typedef enum { WIN_EVMODE_UNKNOWN, WIN_EVMODE_FRAME, WIN_EVMODE_CLIENT } win_evmode_t;
 
 extern const char *const WINTYPES[NUM_WINTYPES];
+extern const char *const WAKEUP_SOURCES[NUM_WAKEUP_SOURCES];
+extern const char *const X_TRAFFIC_KINDS[NUM_X_TRAFFIC_KINDS];
+
+/// Look up the X traffic counter `target` of the stats_get request: `x_bytes` in
+/// total, `last_x_bytes` for the last frame, or by kind `x_bytes_<kind>` and
+/// `x_bytes_saved_<kind>`. Returns false if there is no such counter.
+bool render_stats_lookup(const struct render_stats *stats, const char *target,
+                         uint64_t *out);
 extern session_t *ps_g;
 
 void ev_xcb_error(session_t *ps, xcb_generic_error_t *err);
@@ -445,6 +584,14 @@ static inline struct timespec get_time_timespec(void) {
 	return tm;
 }
 
+/**
+ * Record a wakeup of the main loop. Every wakeup is logged at the trace level.
+ */
+static inline void count_wakeup(session_t *ps, enum wakeup_source source) {
+	ps->wakeups[source]++;
+	log_trace("Woken up by %s", WAKEUP_SOURCES[source]);
+}
+
 /**
  * Return the painting target window.
  */
@@ -506,16 +653,12 @@ static inline bool wid_has_prop(const session_t *ps, xcb_window_t w, xcb_atom_t
 
 void force_repaint(session_t *ps);
 
-/** @name DBus handling
- */
-///@{
-#ifdef CONFIG_DBUS
-/** @name DBus hooks
+/** @name Remote control hooks
  */
 ///@{
 void opts_set_no_fading_openclose(session_t *ps, bool newval);
+void opts_set_hud(session_t *ps, bool newval);
 //!@}
-#endif
 
 /**
  * Set a <code>bool</code> array of all wintypes to true.
@@ -300,6 +300,51 @@ struct conv **parse_blur_kern_lst(const char *src, bool *hasneg, int *count) {
 	return ret;
 }
 
+/// Maximum error allowed when approximating a blur kernel with a horizontal and a
+/// vertical pass, relative to the kernel. Smaller than what 8-bit color channels can
+/// show.
+static const double BLUR_KERN_SEPARATE_TOLERANCE = 1e-3;
+
+/**
+ * Optimize a list of convolution kernels for blurring. Kernels that are (close to)
+ * separable are split into a horizontal and a vertical pass, which makes their cost
+ * O(n) instead of O(n^2) per pixel. Rows and columns of zeros are trimmed from the
+ * borders of the kernels.
+ *
+ * @param[in]     kernels  the kernels, freed by this function
+ * @param[in,out] count    number of kernels
+ * @param[in]     separate whether kernels can be split
+ * @return                 the optimized kernels
+ */
+struct conv **optimize_blur_kern_lst(struct conv **kernels, int *count, bool separate) {
+	// Each kernel becomes at most two
+	auto ret = ccalloc(*count * 2, struct conv *);
+	int n = 0;
+	for (int i = 0; i < *count; i++) {
+		struct conv *horizontal = NULL, *vertical = NULL;
+		if (separate && conv_separate(kernels[i], BLUR_KERN_SEPARATE_TOLERANCE,
+		                              &horizontal, &vertical) &&
+		    sum_kernel(horizontal, 0, 0, horizontal->w, 1) != 0 &&
+		    sum_kernel(vertical, 0, 0, 1, vertical->h) != 0) {
+			// Each pass is normalized on its own, so neither of them can sum
+			// to 0
+			log_debug("Blur kernel %d (%dx%d) split into two passes", i,
+			          kernels[i]->w, kernels[i]->h);
+			ret[n++] = conv_trim(horizontal);
+			ret[n++] = conv_trim(vertical);
+		} else {
+			ret[n++] = conv_trim(kernels[i]);
+		}
+		free(horizontal);
+		free(vertical);
+		free(kernels[i]);
+	}
+	free(kernels);
+
+	*count = n;
+	return ret;
+}
+
 /**
  * Parse a X geometry.
  *
@@ -504,9 +549,17 @@ char *parse_config(options_t *opt, const char *config_file, bool *shadow_enable,
 	    .unredir_if_possible = false,
 	    .unredir_if_possible_blacklist = NULL,
 	    .unredir_if_possible_delay = 0,
+	    .unredir_per_monitor = false,
 	    .redirected_force = UNSET,
 	    .stoppaint_force = UNSET,
 	    .dbus = false,
+	    .stats_page = false,
+	    .control_socket = false,
+	    .hud = false,
+	    .idle_trim_delay = 0,
+	    .shadow_cache_size = 64,
+	    .handoff = false,
+	    .low_bandwidth = false,
 	    .benchmark = 0,
 	    .benchmark_wid = XCB_NONE,
 	    .logpath = NULL,
@@ -87,6 +87,11 @@ typedef struct options {
 	bool glx_no_stencil;
 	/// Whether to avoid rebinding pixmap on window damage.
 	bool glx_no_rebind_pixmap;
+	/// Whether to avoid blurring with compute shaders, even if they are available.
+	bool glx_no_compute_blur;
+	/// Whether to present frames with the Present extension instead of
+	/// glXSwapBuffers, in the new GLX backend.
+	bool glx_present;
 	/// Custom fragment shader for painting windows, as a string.
 	char *glx_fshader_win_str;
 	/// Whether to detect rounded corners.
@@ -103,12 +108,33 @@ typedef struct options {
 	c2_lptr_t *unredir_if_possible_blacklist;
 	/// Delay before unredirecting screen, in milliseconds.
 	long unredir_if_possible_delay;
+	/// Whether to unredirect only the full-screen window of a single monitor,
+	/// instead of the whole screen, on multi-monitor setups.
+	bool unredir_per_monitor;
 	/// Forced redirection setting through D-Bus.
 	switch_t redirected_force;
 	/// Whether to stop painting. Controlled through D-Bus.
 	switch_t stoppaint_force;
 	/// Whether to enable D-Bus support.
 	bool dbus;
+	/// Whether to publish statistics in a shared memory page.
+	bool stats_page;
+	/// Whether to accept requests on the control socket.
+	bool control_socket;
+	/// Whether to draw the frame time overlay.
+	bool hud;
+	/// Time without any frame after which the scratch memory is released, in
+	/// milliseconds. 0 to never release it.
+	long idle_trim_delay;
+	/// Size limit of the cache of shadow images of unmapped windows, in MiB. 0 to
+	/// disable the cache.
+	int shadow_cache_size;
+	/// Take over the screen from a running compositor, or from the previous session
+	/// on reset, without a gap between their frames.
+	bool handoff;
+	/// Reduce the X protocol traffic of the xrender backend, for X servers reached
+	/// over a network.
+	bool low_bandwidth;
 	/// Path to log file.
 	char *logpath;
 	/// Number of cycles to paint in benchmark mode. 0 for disabled.
@@ -244,6 +270,8 @@ extern const char *const BACKEND_STRS[NUM_BKEND + 1];
 bool must_use parse_long(const char *, long *);
 bool must_use parse_int(const char *, int *);
 struct conv **must_use parse_blur_kern_lst(const char *, bool *hasneg, int *count);
+struct conv **must_use optimize_blur_kern_lst(struct conv **kernels, int *count,
+                                              bool separate);
 bool must_use parse_geometry(session_t *, const char *, region_t *);
 bool must_use parse_rule_opacity(c2_lptr_t **, const char *);
 enum blur_method must_use parse_blur_method(const char *src);
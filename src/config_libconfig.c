@@ -484,6 +484,34 @@ char *parse_config_libconfig(options_t *opt, const char *config_file, bool *shad
 			opt->unredir_if_possible_delay = ival;
 		}
 	}
+	// --unredir-per-monitor
+	lcfg_lookup_bool(&cfg, "unredir-per-monitor", &opt->unredir_per_monitor);
+	// --stats-page
+	lcfg_lookup_bool(&cfg, "stats-page", &opt->stats_page);
+	// --control-socket
+	lcfg_lookup_bool(&cfg, "control-socket", &opt->control_socket);
+	// --hud
+	lcfg_lookup_bool(&cfg, "hud", &opt->hud);
+	// --idle-trim-delay
+	if (config_lookup_int(&cfg, "idle-trim-delay", &ival)) {
+		if (ival < 0) {
+			log_warn("Invalid idle-trim-delay %d", ival);
+		} else {
+			opt->idle_trim_delay = ival;
+		}
+	}
+	// --handoff
+	lcfg_lookup_bool(&cfg, "handoff", &opt->handoff);
+	// --low-bandwidth
+	lcfg_lookup_bool(&cfg, "low-bandwidth", &opt->low_bandwidth);
+	// --shadow-cache-size
+	if (config_lookup_int(&cfg, "shadow-cache-size", &ival)) {
+		if (ival < 0) {
+			log_warn("Invalid shadow-cache-size %d", ival);
+		} else {
+			opt->shadow_cache_size = ival;
+		}
+	}
 	// --inactive-dim-fixed
 	lcfg_lookup_bool(&cfg, "inactive-dim-fixed", &opt->inactive_dim_fixed);
 	// --detect-transient
@@ -547,6 +575,10 @@ char *parse_config_libconfig(options_t *opt, const char *config_file, bool *shad
 	lcfg_lookup_bool(&cfg, "glx-no-stencil", &opt->glx_no_stencil);
 	// --glx-no-rebind-pixmap
 	lcfg_lookup_bool(&cfg, "glx-no-rebind-pixmap", &opt->glx_no_rebind_pixmap);
+	// --glx-no-compute-blur
+	lcfg_lookup_bool(&cfg, "glx-no-compute-blur", &opt->glx_no_compute_blur);
+	// --glx-present
+	lcfg_lookup_bool(&cfg, "glx-present", &opt->glx_present);
 	lcfg_lookup_bool(&cfg, "force-win-blend", &opt->force_win_blend);
 	// --glx-swap-method
 	if (config_lookup_string(&cfg, "glx-swap-method", &sval)) {
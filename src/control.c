@@ -0,0 +1,682 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+
+/// Server side of the control socket, see control.h for the protocol.
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <ev.h>
+
+#include "common.h"
+#include "compiler.h"
+#include "control.h"
+#include "ipc.h"
+#include "list.h"
+#include "log.h"
+#include "picom.h"
+#include "uthash_extra.h"
+#include "utils.h"
+#include "win.h"
+
+/// Most bytes buffered for a client in each direction. Requests are not read while
+/// more replies are pending, so a client that doesn't read its replies can't make us
+/// buffer without bounds.
+#define CONTROL_MAX_BUFFERED (256 * 1024)
+/// Bytes read from a client at once
+#define CONTROL_READ_SIZE 4096
+/// Longest target name accepted, NUL included
+#define CONTROL_MAX_TARGET 64
+
+struct control_buf {
+	uint8_t *data;
+	size_t len;
+	size_t cap;
+};
+
+struct control_data {
+	session_t *ps;
+	int fd;
+	char *path;
+	/// Identity of the socket file we bound, another instance might replace it
+	dev_t dev;
+	ino_t ino;
+	ev_io listen;
+	/// List of control_client
+	struct list_node clients;
+};
+
+struct control_client {
+	struct list_node siblings;
+	struct control_data *cd;
+	int fd;
+	ev_io w;
+	/// Bytes received but not processed yet, at most a partial request between
+	/// callbacks
+	struct control_buf in;
+	/// Replies not written yet
+	struct control_buf out;
+	/// The client shut down its sending side, it is freed once its replies are
+	/// written
+	bool eof;
+};
+
+/// The values of a request not read yet
+struct control_args {
+	const uint8_t *pos;
+	const uint8_t *end;
+};
+
+static void control_buf_reserve(struct control_buf *b, size_t len) {
+	if (b->len + len > b->cap) {
+		b->cap = max2(b->cap * 2, b->len + len);
+		b->data = crealloc(b->data, b->cap);
+	}
+}
+
+static void control_buf_put(struct control_buf *b, const void *data, size_t len) {
+	if (!len) {
+		return;
+	}
+	control_buf_reserve(b, len);
+	memcpy(b->data + b->len, data, len);
+	b->len += len;
+}
+
+/// Drop the first `len` bytes of `b`
+static void control_buf_consume(struct control_buf *b, size_t len) {
+	memmove(b->data, b->data + len, b->len - len);
+	b->len -= len;
+}
+
+/** @name Values
+ */
+///@{
+
+static void control_put_value(struct control_buf *b, enum picom_control_type type,
+                              const void *data, size_t len) {
+	uint8_t t = (uint8_t)type;
+	control_buf_put(b, &t, 1);
+	control_buf_put(b, data, len);
+}
+
+static void control_put_bool(struct control_buf *b, bool val) {
+	uint8_t v = val;
+	control_put_value(b, PICOM_CONTROL_BOOL, &v, sizeof(v));
+}
+
+static void control_put_int32(struct control_buf *b, int32_t val) {
+	control_put_value(b, PICOM_CONTROL_INT32, &val, sizeof(val));
+}
+
+static void control_put_uint32(struct control_buf *b, uint32_t val) {
+	control_put_value(b, PICOM_CONTROL_UINT32, &val, sizeof(val));
+}
+
+static void control_put_uint64(struct control_buf *b, uint64_t val) {
+	control_put_value(b, PICOM_CONTROL_UINT64, &val, sizeof(val));
+}
+
+static void control_put_double(struct control_buf *b, double val) {
+	control_put_value(b, PICOM_CONTROL_DOUBLE, &val, sizeof(val));
+}
+
+/// Unset strings are sent as empty strings
+static void control_put_string(struct control_buf *b, const char *str) {
+	uint32_t len = str ? (uint32_t)strlen(str) : 0;
+	control_put_value(b, PICOM_CONTROL_STRING, &len, sizeof(len));
+	control_buf_put(b, str, len);
+}
+
+static void control_put_ipc_value(struct control_buf *b, const struct ipc_value *val) {
+	switch (val->type) {
+	case IPC_BOOL: control_put_bool(b, val->b); break;
+	case IPC_INT32: control_put_int32(b, val->i32); break;
+	case IPC_UINT32: control_put_uint32(b, val->u32); break;
+	case IPC_UINT64: control_put_uint64(b, val->u64); break;
+	case IPC_DOUBLE: control_put_double(b, val->d); break;
+	case IPC_STRING: control_put_string(b, val->str); break;
+	}
+}
+
+static void control_put_wids(session_t *ps, struct control_buf *b) {
+	uint32_t count = 0;
+	HASH_ITER2(ps->windows, w) {
+		assert(!w->destroyed);
+		count++;
+	}
+	control_put_value(b, PICOM_CONTROL_UINT32_ARRAY, &count, sizeof(count));
+	HASH_ITER2(ps->windows, w) {
+		assert(!w->destroyed);
+		uint32_t wid = w->id;
+		control_buf_put(b, &wid, sizeof(wid));
+	}
+}
+
+static bool control_get_value(struct control_args *args, enum picom_control_type type,
+                              void *data, size_t len) {
+	if ((size_t)(args->end - args->pos) < 1 + len || args->pos[0] != type) {
+		return false;
+	}
+	memcpy(data, args->pos + 1, len);
+	args->pos += 1 + len;
+	return true;
+}
+
+static bool control_get_bool(struct control_args *args, bool *val) {
+	uint8_t v;
+	if (!control_get_value(args, PICOM_CONTROL_BOOL, &v, sizeof(v))) {
+		return false;
+	}
+	*val = v;
+	return true;
+}
+
+static bool control_get_int32(struct control_args *args, int32_t *val) {
+	return control_get_value(args, PICOM_CONTROL_INT32, val, sizeof(*val));
+}
+
+static bool control_get_uint32(struct control_args *args, uint32_t *val) {
+	return control_get_value(args, PICOM_CONTROL_UINT32, val, sizeof(*val));
+}
+
+static bool control_get_double(struct control_args *args, double *val) {
+	return control_get_value(args, PICOM_CONTROL_DOUBLE, val, sizeof(*val));
+}
+
+/// Read a value of any type taken by the shared setters
+static bool control_get_ipc_value(struct control_args *args, struct ipc_value *val) {
+	if (args->pos == args->end) {
+		return false;
+	}
+	switch (args->pos[0]) {
+	case PICOM_CONTROL_BOOL:
+		val->type = IPC_BOOL;
+		return control_get_bool(args, &val->b);
+	case PICOM_CONTROL_INT32:
+		val->type = IPC_INT32;
+		return control_get_int32(args, &val->i32);
+	case PICOM_CONTROL_UINT32:
+		val->type = IPC_UINT32;
+		return control_get_uint32(args, &val->u32);
+	case PICOM_CONTROL_DOUBLE:
+		val->type = IPC_DOUBLE;
+		return control_get_double(args, &val->d);
+	default: return false;
+	}
+}
+
+/// Read a string into `buf` of `size` bytes, NUL-terminated. Fails if it doesn't fit.
+static bool control_get_string(struct control_args *args, char *buf, size_t size) {
+	uint32_t len;
+	if (!control_get_value(args, PICOM_CONTROL_STRING, &len, sizeof(len)) ||
+	    len >= size || (size_t)(args->end - args->pos) < len) {
+		return false;
+	}
+	memcpy(buf, args->pos, len);
+	buf[len] = '\0';
+	args->pos += len;
+	return true;
+}
+///@}
+
+/** @name Request processing
+ */
+///@{
+
+/// Translate the status of a shared getter or setter
+static enum picom_control_status
+control_ipc_status(enum ipc_status status, const char *target) {
+	switch (status) {
+	case IPC_OK: return PICOM_CONTROL_OK;
+	case IPC_BAD_TARGET:
+		log_debug("Target \"%s\" not found.", target);
+		return PICOM_CONTROL_BAD_TARGET;
+	case IPC_BAD_VALUE: return PICOM_CONTROL_BAD_MESSAGE;
+	}
+	unreachable;
+}
+
+static enum picom_control_status
+control_win_get(session_t *ps, struct control_args *args, struct control_buf *out) {
+	uint32_t wid;
+	char target[CONTROL_MAX_TARGET];
+	if (!control_get_uint32(args, &wid) ||
+	    !control_get_string(args, target, sizeof(target))) {
+		return PICOM_CONTROL_BAD_MESSAGE;
+	}
+
+	auto w = find_managed_win(ps, wid);
+	if (!w) {
+		log_debug("Window %#010x not found.", wid);
+		return PICOM_CONTROL_BAD_WINDOW;
+	}
+
+	struct ipc_value val;
+	auto status = ipc_win_get(ps, w, target, &val);
+	if (status == IPC_OK) {
+		control_put_ipc_value(out, &val);
+	}
+	return control_ipc_status(status, target);
+}
+
+static enum picom_control_status
+control_win_set(session_t *ps, struct control_args *args, struct control_buf *out) {
+	uint32_t wid;
+	char target[CONTROL_MAX_TARGET];
+	struct ipc_value val;
+	if (!control_get_uint32(args, &wid) ||
+	    !control_get_string(args, target, sizeof(target))) {
+		return PICOM_CONTROL_BAD_MESSAGE;
+	}
+
+	auto w = find_managed_win(ps, wid);
+	if (!w) {
+		log_debug("Window %#010x not found.", wid);
+		return PICOM_CONTROL_BAD_WINDOW;
+	}
+
+	if (!control_get_ipc_value(args, &val)) {
+		return PICOM_CONTROL_BAD_MESSAGE;
+	}
+	auto status = ipc_win_set(ps, w, target, &val);
+	if (status == IPC_OK) {
+		control_put_bool(out, true);
+	}
+	return control_ipc_status(status, target);
+}
+
+static enum picom_control_status
+control_find_win(session_t *ps, struct control_args *args, struct control_buf *out) {
+	char target[CONTROL_MAX_TARGET];
+	if (!control_get_string(args, target, sizeof(target))) {
+		return PICOM_CONTROL_BAD_MESSAGE;
+	}
+
+	xcb_window_t wid = XCB_NONE;
+	if (!strcmp("client", target)) {
+		// Find window by client window
+		uint32_t client;
+		if (!control_get_uint32(args, &client)) {
+			return PICOM_CONTROL_BAD_MESSAGE;
+		}
+		auto w = find_toplevel(ps, client);
+		if (w) {
+			wid = w->base.id;
+		}
+	} else if (!strcmp("focused", target)) {
+		// Find focused window
+		if (ps->active_win && ps->active_win->state != WSTATE_UNMAPPED) {
+			wid = ps->active_win->base.id;
+		}
+	} else {
+		log_debug("Target \"%s\" not found.", target);
+		return PICOM_CONTROL_BAD_TARGET;
+	}
+
+	control_put_uint32(out, wid);
+	return PICOM_CONTROL_OK;
+}
+
+static enum picom_control_status
+control_opts_get(session_t *ps, struct control_args *args, struct control_buf *out) {
+	char target[CONTROL_MAX_TARGET];
+	if (!control_get_string(args, target, sizeof(target))) {
+		return PICOM_CONTROL_BAD_MESSAGE;
+	}
+
+	struct ipc_value val;
+	auto status = ipc_opts_get(ps, target, &val);
+	if (status == IPC_OK) {
+		control_put_ipc_value(out, &val);
+	}
+	return control_ipc_status(status, target);
+}
+
+static enum picom_control_status
+control_opts_set(session_t *ps, struct control_args *args, struct control_buf *out) {
+	char target[CONTROL_MAX_TARGET];
+	struct ipc_value val;
+	if (!control_get_string(args, target, sizeof(target)) ||
+	    !control_get_ipc_value(args, &val)) {
+		return PICOM_CONTROL_BAD_MESSAGE;
+	}
+
+	auto status = ipc_opts_set(ps, target, &val);
+	if (status == IPC_OK) {
+		control_put_bool(out, true);
+	}
+	return control_ipc_status(status, target);
+}
+
+/// Only the main loop wakeups and the X traffic, the other statistics are about D-Bus
+static enum picom_control_status
+control_stats_get(session_t *ps, struct control_args *args, struct control_buf *out) {
+	char target[CONTROL_MAX_TARGET];
+	if (!control_get_string(args, target, sizeof(target))) {
+		return PICOM_CONTROL_BAD_MESSAGE;
+	}
+
+	if (!strcmp("wakeups", target)) {
+		uint64_t total = 0;
+		for (int i = 0; i < NUM_WAKEUP_SOURCES; i++) {
+			total += ps->wakeups[i];
+		}
+		control_put_uint64(out, total);
+		return PICOM_CONTROL_OK;
+	}
+	if (!strncmp("wakeups_", target, strlen("wakeups_"))) {
+		for (int i = 0; i < NUM_WAKEUP_SOURCES; i++) {
+			if (!strcmp(target + strlen("wakeups_"), WAKEUP_SOURCES[i])) {
+				control_put_uint64(out, ps->wakeups[i]);
+				return PICOM_CONTROL_OK;
+			}
+		}
+	}
+
+	uint64_t val;
+	if (render_stats_lookup(&ps->render_stats, target, &val)) {
+		control_put_uint64(out, val);
+		return PICOM_CONTROL_OK;
+	}
+
+	log_debug("Target \"%s\" not found.", target);
+	return PICOM_CONTROL_BAD_TARGET;
+}
+
+/// Process a request, and append its reply to `out`
+static void control_process_request(session_t *ps, const struct picom_control_header *req,
+                                    const uint8_t *body, struct control_buf *out) {
+	struct control_args args = {.pos = body, .end = body + req->size - sizeof(*req)};
+	struct picom_control_header reply = {.serial = req->serial};
+	auto reply_start = out->len;
+	control_buf_put(out, &reply, sizeof(reply));
+
+	enum picom_control_status status = PICOM_CONTROL_OK;
+	switch (req->code) {
+	case PICOM_CONTROL_VERSION_GET:
+		control_put_uint32(out, PICOM_CONTROL_VERSION);
+		break;
+	case PICOM_CONTROL_RESET:
+		log_info("picom is resetting...");
+		ev_break(ps->loop, EVBREAK_ALL);
+		control_put_bool(out, true);
+		break;
+	case PICOM_CONTROL_REPAINT:
+		force_repaint(ps);
+		control_put_bool(out, true);
+		break;
+	case PICOM_CONTROL_LIST_WIN: control_put_wids(ps, out); break;
+	case PICOM_CONTROL_WIN_GET: status = control_win_get(ps, &args, out); break;
+	case PICOM_CONTROL_WIN_SET: status = control_win_set(ps, &args, out); break;
+	case PICOM_CONTROL_FIND_WIN: status = control_find_win(ps, &args, out); break;
+	case PICOM_CONTROL_OPTS_GET: status = control_opts_get(ps, &args, out); break;
+	case PICOM_CONTROL_OPTS_SET: status = control_opts_set(ps, &args, out); break;
+	case PICOM_CONTROL_STATS_GET: status = control_stats_get(ps, &args, out); break;
+	case PICOM_CONTROL_TRANSACTION_BEGIN:
+		transaction_begin(ps);
+		control_put_bool(out, true);
+		break;
+	case PICOM_CONTROL_TRANSACTION_COMMIT:
+		transaction_commit(ps);
+		control_put_bool(out, true);
+		break;
+	default:
+		log_debug("Unknown control request %d", req->code);
+		status = PICOM_CONTROL_BAD_OP;
+	}
+
+	if (req->flags & PICOM_CONTROL_NO_REPLY) {
+		out->len = reply_start;
+		return;
+	}
+	if (status != PICOM_CONTROL_OK) {
+		// Errors carry no values
+		out->len = reply_start + sizeof(reply);
+	}
+	reply.size = (uint32_t)(out->len - reply_start);
+	reply.code = (uint8_t)status;
+	memcpy(out->data + reply_start, &reply, sizeof(reply));
+}
+///@}
+
+/** @name Connections
+ */
+///@{
+
+static void control_client_free(struct control_client *cl) {
+	ev_io_stop(cl->cd->ps->loop, &cl->w);
+	close(cl->fd);
+	list_remove(&cl->siblings);
+	free(cl->in.data);
+	free(cl->out.data);
+	free(cl);
+}
+
+/// Process all complete requests received so far. Returns false if the client sent
+/// something that isn't a request.
+static bool control_client_process(struct control_client *cl) {
+	size_t pos = 0;
+	while (cl->in.len - pos >= sizeof(struct picom_control_header)) {
+		struct picom_control_header req;
+		memcpy(&req, cl->in.data + pos, sizeof(req));
+		if (req.size < sizeof(req) || req.size > PICOM_CONTROL_MAX_MESSAGE_SIZE) {
+			log_error("Invalid control request size %u, disconnecting the "
+			          "client.",
+			          req.size);
+			return false;
+		}
+		if (cl->in.len - pos < req.size) {
+			break;
+		}
+		control_process_request(cl->cd->ps, &req, cl->in.data + pos + sizeof(req),
+		                        &cl->out);
+		pos += req.size;
+	}
+	control_buf_consume(&cl->in, pos);
+	return true;
+}
+
+/// Write as much of the pending replies as the socket takes. Returns false if the
+/// client is gone.
+static bool control_client_flush(struct control_client *cl) {
+	while (cl->out.len) {
+		auto ret = send(cl->fd, cl->out.data, cl->out.len, MSG_NOSIGNAL);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return errno == EAGAIN || errno == EWOULDBLOCK;
+		}
+		control_buf_consume(&cl->out, (size_t)ret);
+	}
+	return true;
+}
+
+/// Stop reading requests while too many replies are pending, and wait for the socket
+/// to become writable while any are.
+static void control_client_update_events(struct control_client *cl) {
+	int events = 0;
+	if (cl->out.len < CONTROL_MAX_BUFFERED && !cl->eof) {
+		events |= EV_READ;
+	}
+	if (cl->out.len) {
+		events |= EV_WRITE;
+	}
+	if ((cl->w.events & (EV_READ | EV_WRITE)) != events) {
+		ev_io_stop(cl->cd->ps->loop, &cl->w);
+		ev_io_set(&cl->w, cl->fd, events);
+		ev_io_start(cl->cd->ps->loop, &cl->w);
+	}
+}
+
+static void control_client_callback(EV_P attr_unused, ev_io *w, int revents) {
+	auto cl = container_of(w, struct control_client, w);
+	count_wakeup(cl->cd->ps, WAKEUP_CONTROL);
+
+	if (revents & EV_READ) {
+		// Read everything that has arrived, so the replies of pipelined requests
+		// are written back together.
+		while (cl->in.len < CONTROL_MAX_BUFFERED) {
+			control_buf_reserve(&cl->in, CONTROL_READ_SIZE);
+			auto ret = recv(cl->fd, cl->in.data + cl->in.len,
+			                cl->in.cap - cl->in.len, 0);
+			if (ret == 0) {
+				cl->eof = true;
+				break;
+			}
+			if (ret < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				if (errno != EAGAIN && errno != EWOULDBLOCK) {
+					cl->eof = true;
+				}
+				break;
+			}
+			cl->in.len += (size_t)ret;
+		}
+		if (!control_client_process(cl)) {
+			control_client_free(cl);
+			return;
+		}
+	}
+
+	// Replies to the last requests of a client that is gone are still written, the
+	// client might have only shut down its sending side. It is kept until they are.
+	if (!control_client_flush(cl) || (cl->eof && !cl->out.len)) {
+		control_client_free(cl);
+		return;
+	}
+	control_client_update_events(cl);
+}
+
+static void control_accept_callback(EV_P_ ev_io *w, int revents attr_unused) {
+	auto cd = container_of(w, struct control_data, listen);
+	count_wakeup(cd->ps, WAKEUP_CONTROL);
+
+	while (true) {
+		int fd = accept4(cd->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				log_error("Failed to accept a control connection: %s",
+				          strerror(errno));
+			}
+			break;
+		}
+
+		auto cl = ccalloc(1, struct control_client);
+		cl->cd = cd;
+		cl->fd = fd;
+		list_insert_after(&cd->clients, &cl->siblings);
+		ev_io_init(&cl->w, control_client_callback, fd, EV_READ);
+		ev_io_start(EV_A_ & cl->w);
+	}
+}
+///@}
+
+/// Whether a server is listening on the socket at `addr`
+static bool control_socket_in_use(const struct sockaddr_un *addr) {
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		return false;
+	}
+	// EAGAIN means the server is there, but its backlog is full
+	bool in_use = connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) == 0 ||
+	              errno == EAGAIN;
+	close(fd);
+	return in_use;
+}
+
+bool control_init(session_t *ps, const char *display) {
+	auto path = runtime_file_path(display, ".sock");
+	if (!path) {
+		log_error("XDG_RUNTIME_DIR is not set, cannot create the control "
+		          "socket.");
+		return false;
+	}
+
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		log_error("The path of the control socket, %s, is too long.", path);
+		free(path);
+		return false;
+	}
+	strcpy(addr.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		log_error("Failed to create the control socket: %s", strerror(errno));
+		free(path);
+		return false;
+	}
+
+	// A socket nobody listens on was left behind by an instance that didn't exit
+	// cleanly, and can be replaced
+	if (control_socket_in_use(&addr)) {
+		log_error("Another instance is listening on the control socket %s.", path);
+		close(fd);
+		free(path);
+		return false;
+	}
+	unlink(path);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		log_error("Failed to bind the control socket %s: %s", path,
+		          strerror(errno));
+		close(fd);
+		free(path);
+		return false;
+	}
+	struct stat st;
+	if (stat(path, &st) < 0 || listen(fd, SOMAXCONN) < 0) {
+		log_error("Failed to listen on the control socket %s: %s", path,
+		          strerror(errno));
+		close(fd);
+		unlink(path);
+		free(path);
+		return false;
+	}
+
+	auto cd = ccalloc(1, struct control_data);
+	cd->ps = ps;
+	cd->fd = fd;
+	cd->path = path;
+	cd->dev = st.st_dev;
+	cd->ino = st.st_ino;
+	list_init_head(&cd->clients);
+	ev_io_init(&cd->listen, control_accept_callback, fd, EV_READ);
+	ev_io_start(ps->loop, &cd->listen);
+	ps->control_data = cd;
+	log_info("Listening for control requests on %s", path);
+	return true;
+}
+
+void control_destroy(session_t *ps) {
+	struct control_data *cd = ps->control_data;
+	if (!cd) {
+		return;
+	}
+
+	list_foreach_safe(struct control_client, cl, &cd->clients, siblings) {
+		control_client_free(cl);
+	}
+	ev_io_stop(ps->loop, &cd->listen);
+	close(cd->fd);
+	// Another instance might have replaced the socket since, only remove ours
+	struct stat st;
+	if (stat(cd->path, &st) == 0 && st.st_dev == cd->dev && st.st_ino == cd->ino) {
+		unlink(cd->path);
+	}
+	free(cd->path);
+	free(cd);
+	ps->control_data = NULL;
+}
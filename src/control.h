@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+
+/// Control socket, a binary alternative to the D-Bus interface for clients that send
+/// many requests, e.g. to drive an effect every frame. It needs no bus daemon, and is
+/// available even when picom is built without D-Bus.
+///
+/// The socket is `$XDG_RUNTIME_DIR/picom-<DISPLAY>.sock`. Clients send requests, and
+/// get replies in the same order. Requests can be pipelined: all requests that arrive
+/// together are processed together, and their replies are written back together.
+///
+/// A message is a picom_control_header, followed by its values. Each value is a
+/// picom_control_type byte followed by its data. Everything is in native byte order,
+/// and packed without any alignment.
+///
+/// The requests take the same arguments as the D-Bus methods of the same names, and
+/// successful replies carry the same values. Setters reply with a single true.
+///
+/// This header is shared with clients, keep the protocol part of it free of
+/// dependencies on the rest of the compositor.
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/// Bumped on incompatible changes, returned by the `version` request
+#define PICOM_CONTROL_VERSION 1
+/// Longest message accepted, header included
+#define PICOM_CONTROL_MAX_MESSAGE_SIZE 4096
+
+enum picom_control_op {
+	/// No arguments, replies with the protocol version as a uint32
+	PICOM_CONTROL_VERSION_GET = 1,
+	PICOM_CONTROL_RESET,
+	PICOM_CONTROL_REPAINT,
+	PICOM_CONTROL_LIST_WIN,
+	PICOM_CONTROL_WIN_GET,
+	PICOM_CONTROL_WIN_SET,
+	PICOM_CONTROL_FIND_WIN,
+	PICOM_CONTROL_OPTS_GET,
+	PICOM_CONTROL_OPTS_SET,
+	PICOM_CONTROL_STATS_GET,
+	PICOM_CONTROL_TRANSACTION_BEGIN,
+	PICOM_CONTROL_TRANSACTION_COMMIT,
+};
+
+enum picom_control_status {
+	PICOM_CONTROL_OK = 0,
+	/// The request is malformed, or its arguments have the wrong types
+	PICOM_CONTROL_BAD_MESSAGE,
+	PICOM_CONTROL_BAD_OP,
+	PICOM_CONTROL_BAD_WINDOW,
+	PICOM_CONTROL_BAD_TARGET,
+};
+
+enum picom_control_type {
+	/// uint8_t, 0 or 1
+	PICOM_CONTROL_BOOL = 1,
+	PICOM_CONTROL_INT32,
+	/// Also used for window IDs and switches (off, on, unset)
+	PICOM_CONTROL_UINT32,
+	PICOM_CONTROL_UINT64,
+	PICOM_CONTROL_DOUBLE,
+	/// uint32_t length, then as many bytes, without a terminating NUL
+	PICOM_CONTROL_STRING,
+	/// uint32_t count, then as many uint32_t
+	PICOM_CONTROL_UINT32_ARRAY,
+};
+
+/// Don't send a reply for this request, not even an error
+#define PICOM_CONTROL_NO_REPLY 0x1
+
+struct picom_control_header {
+	/// Size of the message, header included
+	uint32_t size;
+	/// Chosen by the client, copied into the reply
+	uint32_t serial;
+	/// A picom_control_op in requests, a picom_control_status in replies
+	uint8_t code;
+	/// PICOM_CONTROL_* flags in requests, 0 in replies
+	uint8_t flags;
+	uint16_t _padding;
+};
+
+typedef struct session session_t;
+
+/// Start listening on the control socket for `display`
+bool control_init(session_t *ps, const char *display);
+void control_destroy(session_t *ps);
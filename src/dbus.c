@@ -11,6 +11,7 @@
 
 #include <X11/Xlib.h>
 #include <ctype.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -30,12 +31,47 @@
 #include "win.h"
 
 #include "dbus.h"
+#include "ipc.h"
+
+/// A signal waiting to be handed to libdbus.
+struct cdbus_pending_signal {
+	/// Signal name, always a string literal.
+	const char *name;
+	/// Window ID argument.
+	xcb_window_t wid;
+};
+
+/// Statistics of the outgoing message path, exported via the `stats_get` method.
+struct cdbus_stats {
+	/// Largest number of signals queued in a single loop iteration.
+	int max_pending_signals;
+	/// Number of signals dropped because an identical one was already queued.
+	uint64_t coalesced_signals;
+	/// Largest number of bytes seen waiting in the libdbus outgoing queue.
+	long max_outgoing_size;
+	/// Total time spent writing to the bus socket, in microseconds.
+	uint64_t write_time_us;
+	/// Total time spent blocked on flushing the connection, in microseconds.
+	uint64_t blocked_time_us;
+};
 
 struct cdbus_data {
 	/// DBus connection.
 	DBusConnection *dbus_conn;
 	/// DBus service name.
 	char *dbus_service;
+	/// The session this connection belongs to.
+	session_t *ps;
+	/// Signals queued during the current loop iteration.
+	struct cdbus_pending_signal *pending_signals;
+	/// Number of queued signals.
+	int npending_signals;
+	/// Capacity of `pending_signals`.
+	int pending_signals_capacity;
+	/// Hands queued signals to libdbus before the event loop blocks.
+	ev_prepare flush_signals;
+	/// Statistics of the outgoing path.
+	struct cdbus_stats stats;
 };
 
 // Window type
@@ -86,12 +122,34 @@ static void cdbus_callback_remove_watch(DBusWatch *watch, void *data);
 
 static void cdbus_callback_watch_toggled(DBusWatch *watch, void *data);
 
+static void cdbus_flush_signals(session_t *ps);
+
+static void
+cdbus_flush_signals_callback(EV_P attr_unused, ev_prepare *w, int revents attr_unused);
+
+/// Microseconds elapsed since `start`.
+static inline uint64_t cdbus_elapsed_us(struct timespec start) {
+	struct timespec now = get_time_timespec(), diff;
+	timespec_subtract(&diff, &now, &start);
+	return (uint64_t)diff.tv_sec * 1000000UL + (uint64_t)diff.tv_nsec / 1000UL;
+}
+
+/// Record the current size of the libdbus outgoing queue.
+static inline void cdbus_update_outgoing_size(struct cdbus_data *cd) {
+	long size = dbus_connection_get_outgoing_size(cd->dbus_conn);
+	if (size > cd->stats.max_outgoing_size) {
+		cd->stats.max_outgoing_size = size;
+	}
+}
+
 /**
  * Initialize D-Bus connection.
  */
 bool cdbus_init(session_t *ps, const char *uniq) {
-	auto cd = cmalloc(struct cdbus_data);
+	auto cd = ccalloc(1, struct cdbus_data);
 	cd->dbus_service = NULL;
+	cd->ps = ps;
+	ev_prepare_init(&cd->flush_signals, cdbus_flush_signals_callback);
 
 	// Set ps->dbus_data here because add_watch functions need it
 	ps->dbus_data = cd;
@@ -193,7 +251,20 @@ fail:
  */
 void cdbus_destroy(session_t *ps) {
 	struct cdbus_data *cd = ps->dbus_data;
+	ev_prepare_stop(ps->loop, &cd->flush_signals);
 	if (cd->dbus_conn) {
+		// Deliver whatever is still queued. This is the only place we are
+		// willing to block on the bus.
+		cdbus_flush_signals(ps);
+		auto start = get_time_timespec();
+		dbus_connection_flush(cd->dbus_conn);
+		cd->stats.blocked_time_us += cdbus_elapsed_us(start);
+		log_debug("D-Bus: max %d queued signals, %" PRIu64 " coalesced, max %ld bytes "
+		          "outgoing, %" PRIu64 " us writing, %" PRIu64 " us blocked",
+		          cd->stats.max_pending_signals, cd->stats.coalesced_signals,
+		          cd->stats.max_outgoing_size, cd->stats.write_time_us,
+		          cd->stats.blocked_time_us);
+
 		// Release DBus name firstly
 		if (cd->dbus_service) {
 			DBusError err = {};
@@ -211,7 +282,9 @@ void cdbus_destroy(session_t *ps) {
 		dbus_connection_close(cd->dbus_conn);
 		dbus_connection_unref(cd->dbus_conn);
 	}
+	free(cd->pending_signals);
 	free(cd);
+	ps->dbus_data = NULL;
 }
 
 /** @name DBusTimeout handling
@@ -221,6 +294,7 @@ void cdbus_destroy(session_t *ps) {
 typedef struct ev_dbus_timer {
 	ev_timer w;
 	DBusTimeout *t;
+	session_t *ps;
 } ev_dbus_timer;
 
 /**
@@ -228,6 +302,7 @@ typedef struct ev_dbus_timer {
  */
 static void cdbus_callback_handle_timeout(EV_P attr_unused, ev_timer *w, int revents attr_unused) {
 	ev_dbus_timer *t = (void *)w;
+	count_wakeup(t->ps, WAKEUP_DBUS_TIMEOUT);
 	dbus_timeout_handle(t->t);
 }
 
@@ -241,6 +316,7 @@ static dbus_bool_t cdbus_callback_add_timeout(DBusTimeout *timeout, void *data)
 	double i = dbus_timeout_get_interval(timeout) / 1000.0;
 	ev_timer_init(&t->w, cdbus_callback_handle_timeout, i, i);
 	t->t = timeout;
+	t->ps = ps;
 	dbus_timeout_set_data(timeout, t, NULL);
 
 	if (dbus_timeout_get_enabled(timeout))
@@ -291,12 +367,20 @@ typedef struct ev_dbus_io {
 
 void cdbus_io_callback(EV_P attr_unused, ev_io *w, int revents) {
 	ev_dbus_io *dw = (void *)w;
+	count_wakeup(dw->cd->ps, WAKEUP_DBUS_IO);
 	DBusWatchFlags flags = 0;
 	if (revents & EV_READ)
 		flags |= DBUS_WATCH_READABLE;
 	if (revents & EV_WRITE)
 		flags |= DBUS_WATCH_WRITABLE;
+
+	// libdbus enables its writable watch whenever there are outgoing messages
+	// it couldn't write right away, so this is where queued messages drain.
+	auto start = get_time_timespec();
 	dbus_watch_handle(dw->dw, flags);
+	if (revents & EV_WRITE) {
+		dw->cd->stats.write_time_us += cdbus_elapsed_us(start);
+	}
 	while (dbus_connection_dispatch(dw->cd->dbus_conn) != DBUS_DISPATCH_COMPLETE)
 		;
 }
@@ -407,11 +491,11 @@ cdbus_apdarg_uint32(session_t *ps attr_unused, DBusMessage *msg, const void *dat
 }
 
 /**
- * Callback to append a double argument to a message.
+ * Callback to append an uint64 argument to a message.
  */
 static bool
-cdbus_apdarg_double(session_t *ps attr_unused, DBusMessage *msg, const void *data) {
-	if (!dbus_message_append_args(msg, DBUS_TYPE_DOUBLE, data, DBUS_TYPE_INVALID)) {
+cdbus_apdarg_uint64(session_t *ps attr_unused, DBusMessage *msg, const void *data) {
+	if (!dbus_message_append_args(msg, DBUS_TYPE_UINT64, data, DBUS_TYPE_INVALID)) {
 		log_error("Failed to append argument.");
 		return false;
 	}
@@ -420,13 +504,11 @@ cdbus_apdarg_double(session_t *ps attr_unused, DBusMessage *msg, const void *dat
 }
 
 /**
- * Callback to append a Window argument to a message.
+ * Callback to append a double argument to a message.
  */
-static bool cdbus_apdarg_wid(session_t *ps attr_unused, DBusMessage *msg, const void *data) {
-	assert(data);
-	cdbus_window_t val = *(const xcb_window_t *)data;
-
-	if (!dbus_message_append_args(msg, CDBUS_TYPE_WINDOW, &val, DBUS_TYPE_INVALID)) {
+static bool
+cdbus_apdarg_double(session_t *ps attr_unused, DBusMessage *msg, const void *data) {
+	if (!dbus_message_append_args(msg, DBUS_TYPE_DOUBLE, data, DBUS_TYPE_INVALID)) {
 		log_error("Failed to append argument.");
 		return false;
 	}
@@ -435,11 +517,13 @@ static bool cdbus_apdarg_wid(session_t *ps attr_unused, DBusMessage *msg, const
 }
 
 /**
- * Callback to append an cdbus_enum_t argument to a message.
+ * Callback to append a Window argument to a message.
  */
-static bool cdbus_apdarg_enum(session_t *ps attr_unused, DBusMessage *msg, const void *data) {
+static bool cdbus_apdarg_wid(session_t *ps attr_unused, DBusMessage *msg, const void *data) {
 	assert(data);
-	if (!dbus_message_append_args(msg, CDBUS_TYPE_ENUM, data, DBUS_TYPE_INVALID)) {
+	cdbus_window_t val = *(const xcb_window_t *)data;
+
+	if (!dbus_message_append_args(msg, CDBUS_TYPE_WINDOW, &val, DBUS_TYPE_INVALID)) {
 		log_error("Failed to append argument.");
 		return false;
 	}
@@ -533,13 +617,13 @@ static bool cdbus_signal(session_t *ps, const char *name,
 		return false;
 	}
 
-	// Send the message and flush the connection
+	// Queue the message, it is written out by the watch callbacks once the
+	// socket becomes writable.
 	if (!dbus_connection_send(cd->dbus_conn, msg, NULL)) {
 		log_error("Failed to send D-Bus signal.");
 		dbus_message_unref(msg);
 		return false;
 	}
-	dbus_connection_flush(cd->dbus_conn);
 
 	// Free the message
 	dbus_message_unref(msg);
@@ -548,10 +632,65 @@ static bool cdbus_signal(session_t *ps, const char *name,
 }
 
 /**
- * Send a signal with a Window ID as argument.
+ * Hand all queued signals to libdbus, in the order they were generated.
+ */
+static void cdbus_flush_signals(session_t *ps) {
+	struct cdbus_data *cd = ps->dbus_data;
+	if (!cd->npending_signals) {
+		return;
+	}
+
+	if (cd->npending_signals > cd->stats.max_pending_signals) {
+		cd->stats.max_pending_signals = cd->npending_signals;
+	}
+	log_trace("Sending %d queued D-Bus signals", cd->npending_signals);
+	for (int i = 0; i < cd->npending_signals; i++) {
+		cdbus_signal(ps, cd->pending_signals[i].name, cdbus_apdarg_wid,
+		             &cd->pending_signals[i].wid);
+	}
+	cd->npending_signals = 0;
+	cdbus_update_outgoing_size(cd);
+}
+
+static void
+cdbus_flush_signals_callback(EV_P attr_unused, ev_prepare *w, int revents attr_unused) {
+	struct cdbus_data *cd = container_of(w, struct cdbus_data, flush_signals);
+	ev_prepare_stop(cd->ps->loop, w);
+	cdbus_flush_signals(cd->ps);
+}
+
+/**
+ * Queue a signal with a Window ID as argument.
+ *
+ * Signals are sent right before the event loop goes back to sleep, so a burst of
+ * events, e.g. hundreds of windows being added at startup, is sent together.
+ * A signal identical to the last one queued for the same window is dropped.
  */
-static inline bool cdbus_signal_wid(session_t *ps, const char *name, xcb_window_t wid) {
-	return cdbus_signal(ps, name, cdbus_apdarg_wid, &wid);
+static bool cdbus_signal_wid(session_t *ps, const char *name, xcb_window_t wid) {
+	struct cdbus_data *cd = ps->dbus_data;
+	// Only the latest queued signal of a window decides whether this one is
+	// redundant, so e.g. mapped -> unmapped -> mapped is preserved.
+	for (int i = cd->npending_signals - 1; i >= 0; i--) {
+		if (cd->pending_signals[i].wid != wid) {
+			continue;
+		}
+		if (strcmp(cd->pending_signals[i].name, name) == 0) {
+			cd->stats.coalesced_signals++;
+			return true;
+		}
+		break;
+	}
+
+	if (cd->npending_signals == cd->pending_signals_capacity) {
+		int new_capacity =
+		    cd->pending_signals_capacity ? cd->pending_signals_capacity * 2 : 16;
+		cd->pending_signals = crealloc(cd->pending_signals, new_capacity);
+		cd->pending_signals_capacity = new_capacity;
+	}
+	cd->pending_signals[cd->npending_signals++] =
+	    (struct cdbus_pending_signal){.name = name, .wid = wid};
+	ev_prepare_start(ps->loop, &cd->flush_signals);
+	return true;
 }
 
 /**
@@ -582,13 +721,16 @@ static bool cdbus_reply(session_t *ps, DBusMessage *srcmsg,
 		return false;
 	}
 
-	// Send the message and flush the connection
+	// Keep signals generated before this reply ahead of it
+	cdbus_flush_signals(ps);
+
+	// Queue the message, it is written out by the watch callbacks
 	if (!dbus_connection_send(cd->dbus_conn, msg, NULL)) {
 		log_error("Failed to send D-Bus reply.");
 		dbus_message_unref(msg);
 		return false;
 	}
-	dbus_connection_flush(cd->dbus_conn);
+	cdbus_update_outgoing_size(cd);
 
 	// Free the message
 	dbus_message_unref(msg);
@@ -625,6 +767,13 @@ static inline bool cdbus_reply_uint32(session_t *ps, DBusMessage *srcmsg, uint32
 	return cdbus_reply(ps, srcmsg, cdbus_apdarg_uint32, &val);
 }
 
+/**
+ * Send a reply with an uint64 argument.
+ */
+static inline bool cdbus_reply_uint64(session_t *ps, DBusMessage *srcmsg, uint64_t val) {
+	return cdbus_reply(ps, srcmsg, cdbus_apdarg_uint64, &val);
+}
+
 /**
  * Send a reply with a double argument.
  */
@@ -646,13 +795,6 @@ static inline bool cdbus_reply_string(session_t *ps, DBusMessage *srcmsg, const
 	return cdbus_reply(ps, srcmsg, cdbus_apdarg_string, str);
 }
 
-/**
- * Send a reply with a enum argument.
- */
-static inline bool cdbus_reply_enum(session_t *ps, DBusMessage *srcmsg, cdbus_enum_t eval) {
-	return cdbus_reply(ps, srcmsg, cdbus_apdarg_enum, &eval);
-}
-
 /**
  * Send a D-Bus error reply.
  *
@@ -666,13 +808,16 @@ static bool cdbus_reply_errm(session_t *ps, DBusMessage *msg) {
 		return false;
 	}
 
-	// Send the message and flush the connection
+	// Keep signals generated before this reply ahead of it
+	cdbus_flush_signals(ps);
+
+	// Queue the message, it is written out by the watch callbacks
 	if (!dbus_connection_send(cd->dbus_conn, msg, NULL)) {
 		log_error("Failed to send D-Bus reply.");
 		dbus_message_unref(msg);
 		return false;
 	}
-	dbus_connection_flush(cd->dbus_conn);
+	cdbus_update_outgoing_size(cd);
 
 	// Free the message
 	dbus_message_unref(msg);
@@ -681,18 +826,15 @@ static bool cdbus_reply_errm(session_t *ps, DBusMessage *msg) {
 }
 
 /**
- * Get n-th argument of a D-Bus message.
+ * Point `iter` to the n-th argument of a D-Bus message.
  *
- * @param count the position of the argument to get, starting from 0
- * @param type libdbus type number of the type
- * @param pdest pointer to the target
+ * @param count the position of the argument, starting from 0
  * @return true if successful, false otherwise.
  */
-static bool cdbus_msg_get_arg(DBusMessage *msg, int count, const int type, void *pdest) {
+static bool cdbus_msg_iter_arg(DBusMessage *msg, int count, DBusMessageIter *iter) {
 	assert(count >= 0);
 
-	DBusMessageIter iter = {};
-	if (!dbus_message_iter_init(msg, &iter)) {
+	if (!dbus_message_iter_init(msg, iter)) {
 		log_error("Message has no argument.");
 		return false;
 	}
@@ -700,13 +842,29 @@ static bool cdbus_msg_get_arg(DBusMessage *msg, int count, const int type, void
 	{
 		const int oldcount = count;
 		while (count) {
-			if (!dbus_message_iter_next(&iter)) {
+			if (!dbus_message_iter_next(iter)) {
 				log_error("Failed to find argument %d.", oldcount);
 				return false;
 			}
 			--count;
 		}
 	}
+	return true;
+}
+
+/**
+ * Get n-th argument of a D-Bus message.
+ *
+ * @param count the position of the argument to get, starting from 0
+ * @param type libdbus type number of the type
+ * @param pdest pointer to the target
+ * @return true if successful, false otherwise.
+ */
+static bool cdbus_msg_get_arg(DBusMessage *msg, int count, const int type, void *pdest) {
+	DBusMessageIter iter = {};
+	if (!cdbus_msg_iter_arg(msg, count, &iter)) {
+		return false;
+	}
 
 	if (type != dbus_message_iter_get_arg_type(&iter)) {
 		log_error("Argument has incorrect type.");
@@ -718,6 +876,77 @@ static bool cdbus_msg_get_arg(DBusMessage *msg, int count, const int type, void
 	return true;
 }
 
+/**
+ * Get n-th argument of a D-Bus message, of any type taken by the shared setters.
+ */
+static bool cdbus_msg_get_value(DBusMessage *msg, int count, struct ipc_value *val) {
+	DBusMessageIter iter = {};
+	if (!cdbus_msg_iter_arg(msg, count, &iter)) {
+		return false;
+	}
+
+	switch (dbus_message_iter_get_arg_type(&iter)) {
+	case DBUS_TYPE_BOOLEAN: {
+		dbus_bool_t b = FALSE;
+		dbus_message_iter_get_basic(&iter, &b);
+		*val = ipc_bool(b);
+		return true;
+	}
+	case DBUS_TYPE_INT32:
+		val->type = IPC_INT32;
+		dbus_message_iter_get_basic(&iter, &val->i32);
+		return true;
+	case DBUS_TYPE_UINT32:
+		val->type = IPC_UINT32;
+		dbus_message_iter_get_basic(&iter, &val->u32);
+		return true;
+	case DBUS_TYPE_DOUBLE:
+		val->type = IPC_DOUBLE;
+		dbus_message_iter_get_basic(&iter, &val->d);
+		return true;
+	default: log_error("Argument has incorrect type."); return false;
+	}
+}
+
+/**
+ * Send a reply with the value returned by a shared getter.
+ */
+static bool
+cdbus_reply_value(session_t *ps, DBusMessage *srcmsg, const struct ipc_value *val) {
+	switch (val->type) {
+	case IPC_BOOL: return cdbus_reply_bool(ps, srcmsg, val->b);
+	case IPC_INT32: return cdbus_reply_int32(ps, srcmsg, val->i32);
+	case IPC_UINT32: return cdbus_reply_uint32(ps, srcmsg, val->u32);
+	case IPC_UINT64: return cdbus_reply_uint64(ps, srcmsg, val->u64);
+	case IPC_DOUBLE: return cdbus_reply_double(ps, srcmsg, val->d);
+	case IPC_STRING: return cdbus_reply_string(ps, srcmsg, val->str);
+	}
+	unreachable;
+}
+
+/**
+ * Reply to a request handled by a shared getter or setter. Returns false if the
+ * request was malformed.
+ */
+static bool cdbus_reply_ipc(session_t *ps, DBusMessage *msg, enum ipc_status status,
+                            const char *target, const struct ipc_value *val) {
+	switch (status) {
+	case IPC_OK:
+		if (val) {
+			cdbus_reply_value(ps, msg, val);
+		} else if (!dbus_message_get_no_reply(msg)) {
+			cdbus_reply_bool(ps, msg, true);
+		}
+		return true;
+	case IPC_BAD_TARGET:
+		log_error(CDBUS_ERROR_BADTGT_S, target);
+		cdbus_reply_err(ps, msg, CDBUS_ERROR_BADTGT, CDBUS_ERROR_BADTGT_S, target);
+		return true;
+	case IPC_BAD_VALUE: return false;
+	}
+	unreachable;
+}
+
 /** @name Message processing
  */
 ///@{
@@ -754,84 +983,9 @@ static bool cdbus_process_win_get(session_t *ps, DBusMessage *msg) {
 		return true;
 	}
 
-#define cdbus_m_win_get_do(tgt, apdarg_func)                                             \
-	if (!strcmp(#tgt, target)) {                                                     \
-		apdarg_func(ps, msg, w->tgt);                                            \
-		return true;                                                             \
-	}
-
-	cdbus_m_win_get_do(base.id, cdbus_reply_wid);
-
-	// next
-	if (!strcmp("next", target)) {
-		cdbus_reply_wid(
-		    ps, msg,
-		    (list_node_is_last(&ps->window_stack, &w->base.stack_neighbour)
-		         ? 0
-		         : list_entry(w->base.stack_neighbour.next, struct win, stack_neighbour)
-		               ->id));
-		return true;
-	}
-
-	// map_state
-	if (!strcmp("map_state", target)) {
-		cdbus_reply_bool(ps, msg, w->a.map_state);
-		return true;
-	}
-
-	cdbus_m_win_get_do(mode, cdbus_reply_enum);
-	cdbus_m_win_get_do(client_win, cdbus_reply_wid);
-	cdbus_m_win_get_do(ever_damaged, cdbus_reply_bool);
-	cdbus_m_win_get_do(window_type, cdbus_reply_enum);
-	cdbus_m_win_get_do(wmwin, cdbus_reply_bool);
-	cdbus_m_win_get_do(leader, cdbus_reply_wid);
-	if (!strcmp("focused_raw", target)) {
-		cdbus_reply_bool(ps, msg, win_is_focused_raw(ps, w));
-		return true;
-	}
-	cdbus_m_win_get_do(fade_force, cdbus_reply_enum);
-	cdbus_m_win_get_do(shadow_force, cdbus_reply_enum);
-	cdbus_m_win_get_do(focused_force, cdbus_reply_enum);
-	cdbus_m_win_get_do(invert_color_force, cdbus_reply_enum);
-	cdbus_m_win_get_do(name, cdbus_reply_string);
-	cdbus_m_win_get_do(class_instance, cdbus_reply_string);
-	cdbus_m_win_get_do(class_general, cdbus_reply_string);
-	cdbus_m_win_get_do(role, cdbus_reply_string);
-
-	cdbus_m_win_get_do(opacity, cdbus_reply_double);
-	cdbus_m_win_get_do(opacity_target, cdbus_reply_double);
-	cdbus_m_win_get_do(has_opacity_prop, cdbus_reply_bool);
-	cdbus_m_win_get_do(opacity_prop, cdbus_reply_uint32);
-	cdbus_m_win_get_do(opacity_is_set, cdbus_reply_bool);
-	cdbus_m_win_get_do(opacity_set, cdbus_reply_double);
-
-	cdbus_m_win_get_do(frame_opacity, cdbus_reply_double);
-	if (!strcmp("left_width", target)) {
-		cdbus_reply_int32(ps, msg, w->frame_extents.left);
-		return true;
-	}
-	if (!strcmp("right_width", target)) {
-		cdbus_reply_int32(ps, msg, w->frame_extents.right);
-		return true;
-	}
-	if (!strcmp("top_width", target)) {
-		cdbus_reply_int32(ps, msg, w->frame_extents.top);
-		return true;
-	}
-	if (!strcmp("bottom_width", target)) {
-		cdbus_reply_int32(ps, msg, w->frame_extents.bottom);
-		return true;
-	}
-
-	cdbus_m_win_get_do(shadow, cdbus_reply_bool);
-	cdbus_m_win_get_do(invert_color, cdbus_reply_bool);
-	cdbus_m_win_get_do(blur_background, cdbus_reply_bool);
-#undef cdbus_m_win_get_do
-
-	log_error(CDBUS_ERROR_BADTGT_S, target);
-	cdbus_reply_err(ps, msg, CDBUS_ERROR_BADTGT, CDBUS_ERROR_BADTGT_S, target);
-
-	return true;
+	struct ipc_value val;
+	auto status = ipc_win_get(ps, w, target, &val);
+	return cdbus_reply_ipc(ps, msg, status, target, &val);
 }
 
 /**
@@ -857,57 +1011,12 @@ static bool cdbus_process_win_set(session_t *ps, DBusMessage *msg) {
 		return true;
 	}
 
-#define cdbus_m_win_set_do(tgt, type, real_type)                                         \
-	if (!strcmp(MSTR(tgt), target)) {                                                \
-		real_type val;                                                           \
-		if (!cdbus_msg_get_arg(msg, 2, type, &val))                              \
-			return false;                                                    \
-		w->tgt = val;                                                            \
-		goto cdbus_process_win_set_success;                                      \
-	}
-
-	if (!strcmp("shadow_force", target)) {
-		cdbus_enum_t val = UNSET;
-		if (!cdbus_msg_get_arg(msg, 2, CDBUS_TYPE_ENUM, &val))
-			return false;
-		win_set_shadow_force(ps, w, val);
-		goto cdbus_process_win_set_success;
-	}
-
-	if (!strcmp("fade_force", target)) {
-		cdbus_enum_t val = UNSET;
-		if (!cdbus_msg_get_arg(msg, 2, CDBUS_TYPE_ENUM, &val))
-			return false;
-		win_set_fade_force(w, val);
-		goto cdbus_process_win_set_success;
-	}
-
-	if (!strcmp("focused_force", target)) {
-		cdbus_enum_t val = UNSET;
-		if (!cdbus_msg_get_arg(msg, 2, CDBUS_TYPE_ENUM, &val))
-			return false;
-		win_set_focused_force(ps, w, val);
-		goto cdbus_process_win_set_success;
-	}
-
-	if (!strcmp("invert_color_force", target)) {
-		cdbus_enum_t val = UNSET;
-		if (!cdbus_msg_get_arg(msg, 2, CDBUS_TYPE_ENUM, &val))
-			return false;
-		win_set_invert_color_force(ps, w, val);
-		goto cdbus_process_win_set_success;
+	struct ipc_value val;
+	if (!cdbus_msg_get_value(msg, 2, &val)) {
+		return false;
 	}
-#undef cdbus_m_win_set_do
-
-	log_error(CDBUS_ERROR_BADTGT_S, target);
-	cdbus_reply_err(ps, msg, CDBUS_ERROR_BADTGT, CDBUS_ERROR_BADTGT_S, target);
-
-	return true;
-
-cdbus_process_win_set_success:
-	if (!dbus_message_get_no_reply(msg))
-		cdbus_reply_bool(ps, msg, true);
-	return true;
+	auto status = ipc_win_set(ps, w, target, &val);
+	return cdbus_reply_ipc(ps, msg, status, target, NULL);
 }
 
 /**
@@ -957,97 +1066,70 @@ static bool cdbus_process_opts_get(session_t *ps, DBusMessage *msg) {
 	if (!cdbus_msg_get_arg(msg, 0, DBUS_TYPE_STRING, &target))
 		return false;
 
-#define cdbus_m_opts_get_do(tgt, apdarg_func)                                            \
-	if (!strcmp(#tgt, target)) {                                                     \
-		apdarg_func(ps, msg, ps->o.tgt);                                         \
-		return true;                                                             \
-	}
+	struct ipc_value val;
+	auto status = ipc_opts_get(ps, target, &val);
+	return cdbus_reply_ipc(ps, msg, status, target, &val);
+}
+
+/**
+ * Process a stats_get D-Bus request.
+ */
+static bool cdbus_process_stats_get(session_t *ps, DBusMessage *msg) {
+	struct cdbus_data *cd = ps->dbus_data;
+	const char *target = NULL;
+
+	if (!cdbus_msg_get_arg(msg, 0, DBUS_TYPE_STRING, &target))
+		return false;
 
-#define cdbus_m_opts_get_stub(tgt, apdarg_func, ret)                                     \
+#define cdbus_m_stats_get_do(tgt, apdarg_func)                                           \
 	if (!strcmp(#tgt, target)) {                                                     \
-		apdarg_func(ps, msg, ret);                                               \
+		apdarg_func(ps, msg, cd->stats.tgt);                                     \
 		return true;                                                             \
 	}
 
-	// version
-	if (!strcmp("version", target)) {
-		cdbus_reply_string(ps, msg, COMPTON_VERSION);
+	// Current depth of the outgoing queue, in signals and in bytes
+	if (!strcmp("pending_signals", target)) {
+		cdbus_reply_int32(ps, msg, cd->npending_signals);
 		return true;
 	}
-
-	// pid
-	if (!strcmp("pid", target)) {
-		cdbus_reply_int32(ps, msg, getpid());
+	if (!strcmp("outgoing_size", target)) {
+		cdbus_reply_int32l(ps, msg, dbus_connection_get_outgoing_size(cd->dbus_conn));
 		return true;
 	}
 
-	// display
-	if (!strcmp("display", target)) {
-		cdbus_reply_string(ps, msg, DisplayString(ps->dpy));
+	// Wakeups of the main loop, in total or by source, e.g. "wakeups_fade_timer"
+	if (!strcmp("wakeups", target)) {
+		uint64_t total = 0;
+		for (int i = 0; i < NUM_WAKEUP_SOURCES; i++) {
+			total += ps->wakeups[i];
+		}
+		cdbus_reply_uint64(ps, msg, total);
 		return true;
 	}
-
-	cdbus_m_opts_get_stub(config_file, cdbus_reply_string, "Unknown");
-	cdbus_m_opts_get_do(write_pid_path, cdbus_reply_string);
-	cdbus_m_opts_get_do(mark_wmwin_focused, cdbus_reply_bool);
-	cdbus_m_opts_get_do(mark_ovredir_focused, cdbus_reply_bool);
-	cdbus_m_opts_get_do(detect_rounded_corners, cdbus_reply_bool);
-	cdbus_m_opts_get_stub(paint_on_overlay, cdbus_reply_bool, ps->overlay != XCB_NONE);
-	// paint_on_overlay_id: Get ID of the X composite overlay window
-	if (!strcmp("paint_on_overlay_id", target)) {
-		cdbus_reply_uint32(ps, msg, ps->overlay);
-		return true;
+	if (!strncmp("wakeups_", target, strlen("wakeups_"))) {
+		for (int i = 0; i < NUM_WAKEUP_SOURCES; i++) {
+			if (!strcmp(target + strlen("wakeups_"), WAKEUP_SOURCES[i])) {
+				cdbus_reply_uint64(ps, msg, ps->wakeups[i]);
+				return true;
+			}
+		}
 	}
-	cdbus_m_opts_get_do(unredir_if_possible, cdbus_reply_bool);
-	cdbus_m_opts_get_do(unredir_if_possible_delay, cdbus_reply_int32l);
-	cdbus_m_opts_get_do(redirected_force, cdbus_reply_enum);
-	cdbus_m_opts_get_do(stoppaint_force, cdbus_reply_enum);
-	cdbus_m_opts_get_do(logpath, cdbus_reply_string);
-
-	cdbus_m_opts_get_do(refresh_rate, cdbus_reply_int32);
-	cdbus_m_opts_get_do(sw_opti, cdbus_reply_bool);
-	cdbus_m_opts_get_do(vsync, cdbus_reply_bool);
-	if (!strcmp("backend", target)) {
-		assert(ps->o.backend < sizeof(BACKEND_STRS) / sizeof(BACKEND_STRS[0]));
-		cdbus_reply_string(ps, msg, BACKEND_STRS[ps->o.backend]);
+
+	// Bytes of X requests sent by the xrender backend, in total or by kind, e.g.
+	// "x_bytes_clip", and the bytes --low-bandwidth saved, e.g. "x_bytes_saved_clip"
+	uint64_t val;
+	if (render_stats_lookup(&ps->render_stats, target, &val)) {
+		cdbus_reply_uint64(ps, msg, val);
 		return true;
 	}
 
-	cdbus_m_opts_get_do(shadow_red, cdbus_reply_double);
-	cdbus_m_opts_get_do(shadow_green, cdbus_reply_double);
-	cdbus_m_opts_get_do(shadow_blue, cdbus_reply_double);
-	cdbus_m_opts_get_do(shadow_radius, cdbus_reply_int32);
-	cdbus_m_opts_get_do(shadow_offset_x, cdbus_reply_int32);
-	cdbus_m_opts_get_do(shadow_offset_y, cdbus_reply_int32);
-	cdbus_m_opts_get_do(shadow_opacity, cdbus_reply_double);
-	cdbus_m_opts_get_do(xinerama_shadow_crop, cdbus_reply_bool);
-
-	cdbus_m_opts_get_do(fade_delta, cdbus_reply_int32);
-	cdbus_m_opts_get_do(fade_in_step, cdbus_reply_double);
-	cdbus_m_opts_get_do(fade_out_step, cdbus_reply_double);
-	cdbus_m_opts_get_do(no_fading_openclose, cdbus_reply_bool);
+	cdbus_m_stats_get_do(max_pending_signals, cdbus_reply_int32);
+	cdbus_m_stats_get_do(coalesced_signals, cdbus_reply_uint64);
+	cdbus_m_stats_get_do(max_outgoing_size, cdbus_reply_int32l);
+	cdbus_m_stats_get_do(write_time_us, cdbus_reply_uint64);
+	cdbus_m_stats_get_do(blocked_time_us, cdbus_reply_uint64);
 
-	cdbus_m_opts_get_do(blur_method, cdbus_reply_bool);
-	cdbus_m_opts_get_do(blur_background_frame, cdbus_reply_bool);
-	cdbus_m_opts_get_do(blur_background_fixed, cdbus_reply_bool);
-
-	cdbus_m_opts_get_do(inactive_dim, cdbus_reply_double);
-	cdbus_m_opts_get_do(inactive_dim_fixed, cdbus_reply_bool);
-
-	cdbus_m_opts_get_do(max_brightness, cdbus_reply_double);
-
-	cdbus_m_opts_get_do(use_ewmh_active_win, cdbus_reply_bool);
-	cdbus_m_opts_get_do(detect_transient, cdbus_reply_bool);
-	cdbus_m_opts_get_do(detect_client_leader, cdbus_reply_bool);
-	cdbus_m_opts_get_do(use_damage, cdbus_reply_bool);
-
-#ifdef CONFIG_OPENGL
-	cdbus_m_opts_get_do(glx_no_stencil, cdbus_reply_bool);
-	cdbus_m_opts_get_do(glx_no_rebind_pixmap, cdbus_reply_bool);
-#endif
-
-#undef cdbus_m_opts_get_do
-#undef cdbus_m_opts_get_stub
+#undef cdbus_m_stats_get_do
 
 	log_error(CDBUS_ERROR_BADTGT_S, target);
 	cdbus_reply_err(ps, msg, CDBUS_ERROR_BADTGT, CDBUS_ERROR_BADTGT_S, target);
@@ -1056,7 +1138,8 @@ static bool cdbus_process_opts_get(session_t *ps, DBusMessage *msg) {
 }
 
 // XXX Remove this after header clean up
-void queue_redraw(session_t *ps);
+void transaction_begin(session_t *ps);
+void transaction_commit(session_t *ps);
 
 /**
  * Process a opts_set D-Bus request.
@@ -1067,101 +1150,12 @@ static bool cdbus_process_opts_set(session_t *ps, DBusMessage *msg) {
 	if (!cdbus_msg_get_arg(msg, 0, DBUS_TYPE_STRING, &target))
 		return false;
 
-#define cdbus_m_opts_set_do(tgt, type, real_type)                                        \
-	if (!strcmp(#tgt, target)) {                                                     \
-		real_type val;                                                           \
-		if (!cdbus_msg_get_arg(msg, 1, type, &val))                              \
-			return false;                                                    \
-		ps->o.tgt = val;                                                         \
-		goto cdbus_process_opts_set_success;                                     \
-	}
-
-	// fade_delta
-	if (!strcmp("fade_delta", target)) {
-		int32_t val = 0;
-		if (!cdbus_msg_get_arg(msg, 1, DBUS_TYPE_INT32, &val)) {
-			return false;
-		}
-		if (val <= 0) {
-			return false;
-		}
-		ps->o.fade_delta = max2(val, 1);
-		goto cdbus_process_opts_set_success;
-	}
-
-	// fade_in_step
-	if (!strcmp("fade_in_step", target)) {
-		double val = 0.0;
-		if (!cdbus_msg_get_arg(msg, 1, DBUS_TYPE_DOUBLE, &val))
-			return false;
-		ps->o.fade_in_step = normalize_d(val);
-		goto cdbus_process_opts_set_success;
-	}
-
-	// fade_out_step
-	if (!strcmp("fade_out_step", target)) {
-		double val = 0.0;
-		if (!cdbus_msg_get_arg(msg, 1, DBUS_TYPE_DOUBLE, &val))
-			return false;
-		ps->o.fade_out_step = normalize_d(val);
-		goto cdbus_process_opts_set_success;
-	}
-
-	// no_fading_openclose
-	if (!strcmp("no_fading_openclose", target)) {
-		dbus_bool_t val = FALSE;
-		if (!cdbus_msg_get_arg(msg, 1, DBUS_TYPE_BOOLEAN, &val))
-			return false;
-		opts_set_no_fading_openclose(ps, val);
-		goto cdbus_process_opts_set_success;
-	}
-
-	// unredir_if_possible
-	if (!strcmp("unredir_if_possible", target)) {
-		dbus_bool_t val = FALSE;
-		if (!cdbus_msg_get_arg(msg, 1, DBUS_TYPE_BOOLEAN, &val))
-			return false;
-		if (ps->o.unredir_if_possible != val) {
-			ps->o.unredir_if_possible = val;
-			queue_redraw(ps);
-		}
-		goto cdbus_process_opts_set_success;
-	}
-
-	// clear_shadow
-	if (!strcmp("clear_shadow", target)) {
-		goto cdbus_process_opts_set_success;
-	}
-
-	// track_focus
-	if (!strcmp("track_focus", target)) {
-		goto cdbus_process_opts_set_success;
-	}
-
-	// redirected_force
-	if (!strcmp("redirected_force", target)) {
-		cdbus_enum_t val = UNSET;
-		if (!cdbus_msg_get_arg(msg, 1, CDBUS_TYPE_ENUM, &val))
-			return false;
-		ps->o.redirected_force = val;
-		force_repaint(ps);
-		goto cdbus_process_opts_set_success;
+	struct ipc_value val;
+	if (!cdbus_msg_get_value(msg, 1, &val)) {
+		return false;
 	}
-
-	// stoppaint_force
-	cdbus_m_opts_set_do(stoppaint_force, CDBUS_TYPE_ENUM, cdbus_enum_t);
-
-#undef cdbus_m_opts_set_do
-
-	log_error(CDBUS_ERROR_BADTGT_S, target);
-	cdbus_reply_err(ps, msg, CDBUS_ERROR_BADTGT, CDBUS_ERROR_BADTGT_S, target);
-
-	return true;
-
-cdbus_process_opts_set_success:
-	if (!dbus_message_get_no_reply(msg))
-		cdbus_reply_bool(ps, msg, true);
-	return true;
+	auto status = ipc_opts_set(ps, target, &val);
+	return cdbus_reply_ipc(ps, msg, status, target, NULL);
 }
 
 /**
@@ -1248,6 +1242,18 @@ cdbus_process(DBusConnection *c attr_unused, DBusMessage *msg, void *ud) {
 		handled = cdbus_process_opts_get(ps, msg);
 	} else if (cdbus_m_ismethod("opts_set")) {
 		handled = cdbus_process_opts_set(ps, msg);
+	} else if (cdbus_m_ismethod("stats_get")) {
+		handled = cdbus_process_stats_get(ps, msg);
+	} else if (cdbus_m_ismethod("transaction_begin")) {
+		transaction_begin(ps);
+		if (!dbus_message_get_no_reply(msg))
+			cdbus_reply_bool(ps, msg, true);
+		handled = true;
+	} else if (cdbus_m_ismethod("transaction_commit")) {
+		transaction_commit(ps);
+		if (!dbus_message_get_no_reply(msg))
+			cdbus_reply_bool(ps, msg, true);
+		handled = true;
 	}
 #undef cdbus_m_ismethod
 	else if (dbus_message_is_method_call(msg, "org.freedesktop.DBus.Introspectable",
@@ -15,6 +15,7 @@
 #include "event.h"
 #include "log.h"
 #include "picom.h"
+#include "probe.h"
 #include "region.h"
 #include "utils.h"
 #include "win.h"
@@ -231,6 +232,7 @@ static void configure_win(session_t *ps, xcb_configure_notify_event_t *ce) {
 			win_on_win_size_change(ps, mw);
 			win_update_bounding_shape(ps, mw);
 		}
+		win_update_index(ps, mw);
 
 		region_t new_extents;
 		pixman_region32_init(&new_extents);
@@ -459,6 +461,21 @@ static inline void ev_property_notify(session_t *ps, xcb_property_notify_event_t
 		if (ps->o.use_ewmh_active_win && ps->atoms->a_NET_ACTIVE_WINDOW == ev->atom) {
 			// to update focus
 			ps->pending_updates = true;
+		} else if (ps->atoms->a_PICOM_TRANSACTION == ev->atom) {
+			// A non-zero value opens a transaction, zero or deleting the
+			// property commits it
+			winprop_t prop = x_get_prop(ps, ps->root, ev->atom, 1L,
+			                            XCB_ATOM_CARDINAL, 32);
+			bool open = prop.nitems && *prop.c32;
+			free_winprop(&prop);
+			if (open != ps->transaction_prop_open) {
+				ps->transaction_prop_open = open;
+				if (open) {
+					transaction_begin(ps);
+				} else {
+					transaction_commit(ps);
+				}
+			}
 		} else {
 			// Destroy the root "image" if the wallpaper probably changed
 			if (x_is_root_back_pixmap_atom(ps, ev->atom)) {
@@ -526,8 +543,8 @@ static inline void ev_property_notify(session_t *ps, xcb_property_notify_event_t
 	// If name changes
 	if (ps->atoms->aWM_NAME == ev->atom || ps->atoms->a_NET_WM_NAME == ev->atom) {
 		auto w = find_toplevel(ps, ev->window);
-		if (w && win_update_name(ps, w) == 1) {
-			win_on_factor_change(ps, w);
+		if (w) {
+			win_queue_update_name(ps, w);
 		}
 	}
 
@@ -535,16 +552,15 @@ static inline void ev_property_notify(session_t *ps, xcb_property_notify_event_t
 	if (ps->atoms->aWM_CLASS == ev->atom) {
 		auto w = find_toplevel(ps, ev->window);
 		if (w) {
-			win_get_class(ps, w);
-			win_on_factor_change(ps, w);
+			win_queue_update_class(ps, w);
 		}
 	}
 
 	// If role changes
 	if (ps->atoms->aWM_WINDOW_ROLE == ev->atom) {
 		auto w = find_toplevel(ps, ev->window);
-		if (w && 1 == win_get_role(ps, w)) {
-			win_on_factor_change(ps, w);
+		if (w) {
+			win_queue_update_role(ps, w);
 		}
 	}
 
@@ -604,7 +620,8 @@ static inline void repair_win(session_t *ps, struct managed_win *w) {
 
 	// Why care about damage when screen is unredirected?
 	// We will force full-screen repaint on redirection.
-	if (!ps->redirected) {
+	// Same goes for a window unredirected on its own, the X server draws it.
+	if (!ps->redirected || w->unredirected) {
 		pixman_region32_fini(&parts);
 		return;
 	}
@@ -666,6 +683,10 @@ ev_selection_clear(session_t *ps, xcb_selection_clear_event_t attr_unused *ev) {
 	// If we lose that one, we should exit.
 	log_fatal("Another composite manager started and took the _NET_WM_CM_Sn "
 	          "selection.");
+	// If it's taking over with --handoff, it holds the overlay window too, and draws
+	// over our last frame once we are gone. Otherwise the overlay window goes away
+	// with our connection anyway.
+	ps->keep_overlay = true;
 	quit(ps);
 }
 
@@ -675,6 +696,7 @@ void ev_handle(session_t *ps, xcb_generic_event_t *ev) {
 	}
 
 	xcb_window_t wid = ev_window(ps, ev);
+	PROBE(event, ev->response_type, wid, ev->full_sequence);
 	if (ev->response_type != ps->damage_event + XCB_DAMAGE_NOTIFY) {
 		log_debug("event %10.10s serial %#010x window %#010x \"%s\"",
 		          ev_name(ps, ev), ev->full_sequence, wid, ev_window_name(ps, wid));
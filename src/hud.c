@@ -0,0 +1,197 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+#include <inttypes.h>
+#include <stdio.h>
+#include <xcb/randr.h>
+
+#include "backend/backend.h"
+#include "common.h"
+#include "hud.h"
+#include "region.h"
+#include "utils.h"
+
+/// Number of frames in the graph
+#define HUD_NFRAMES 120
+/// Width of the bar of one frame in the graph
+#define HUD_BAR_WIDTH 2
+#define HUD_GRAPH_HEIGHT 60
+/// Size of a pixel of the font
+#define HUD_FONT_SCALE 2
+#define HUD_CHAR_WIDTH (4 * HUD_FONT_SCALE)
+#define HUD_CHAR_HEIGHT (5 * HUD_FONT_SCALE)
+#define HUD_PADDING 4
+#define HUD_X 8
+#define HUD_Y 8
+#define HUD_WIDTH (HUD_NFRAMES * HUD_BAR_WIDTH + 2 * HUD_PADDING)
+#define HUD_HEIGHT (HUD_GRAPH_HEIGHT + HUD_CHAR_HEIGHT + 3 * HUD_PADDING)
+
+/// Refresh rate the graph is scaled to, if the real one is unknown
+#define HUD_DEFAULT_REFRESH_RATE 60
+
+struct hud_frame {
+	uint64_t preprocess_us;
+	uint64_t render_us;
+	uint64_t present_us;
+};
+
+struct hud {
+	/// Ring buffer of the recent frames, `next` is the oldest one
+	struct hud_frame frames[HUD_NFRAMES];
+	int next;
+	/// Refresh rate of the screen, 0 if unknown
+	int refresh_rate;
+	/// Number of frames that took longer than a refresh interval
+	uint64_t missed_vblanks;
+};
+
+// Colors are premultiplied, like the fill operation expects
+static const struct color hud_background = {0, 0, 0, 0.7};
+static const struct color hud_preprocess_color = {0.2, 0.4, 0.9, 1};
+static const struct color hud_render_color = {0.2, 0.8, 0.3, 1};
+static const struct color hud_present_color = {0.9, 0.6, 0.1, 1};
+static const struct color hud_text_color = {0.9, 0.9, 0.9, 0.9};
+
+/// A 3x5 font with just the characters the overlay needs. Each row is 3 bits, the
+/// most significant bit is the leftmost pixel.
+static const uint8_t *hud_glyph(char c) {
+	static const uint8_t digits[10][5] = {
+	    {7, 5, 5, 5, 7}, {2, 6, 2, 2, 7}, {7, 1, 7, 4, 7}, {7, 1, 7, 1, 7},
+	    {5, 5, 7, 1, 1}, {7, 4, 7, 1, 7}, {7, 4, 7, 5, 7}, {7, 1, 1, 1, 1},
+	    {7, 5, 7, 5, 7}, {7, 5, 7, 1, 7},
+	};
+	static const uint8_t letter_b[5] = {6, 5, 6, 5, 6}, letter_d[5] = {6, 5, 5, 5, 6},
+	                     letter_k[5] = {5, 5, 6, 5, 5}, letter_m[5] = {5, 7, 7, 5, 5};
+	switch (c) {
+	case 'B': return letter_b;
+	case 'D': return letter_d;
+	case 'K': return letter_k;
+	case 'M': return letter_m;
+	}
+	if (c >= '0' && c <= '9') {
+		return digits[c - '0'];
+	}
+	return NULL;
+}
+
+static void hud_add_text(region_t *reg, int x, int y, const char *text) {
+	for (; *text; text++, x += HUD_CHAR_WIDTH) {
+		auto glyph = hud_glyph(*text);
+		if (!glyph) {
+			continue;
+		}
+		for (int row = 0; row < 5; row++) {
+			for (int col = 0; col < 3; col++) {
+				if (!(glyph[row] & (4 >> col))) {
+					continue;
+				}
+				int px = x + col * HUD_FONT_SCALE;
+				int py = y + row * HUD_FONT_SCALE;
+				pixman_region32_union_rect(
+				    reg, reg, px, py, HUD_FONT_SCALE, HUD_FONT_SCALE);
+			}
+		}
+	}
+}
+
+struct hud *hud_new(session_t *ps) {
+	auto hud = ccalloc(1, struct hud);
+	hud->refresh_rate = ps->o.refresh_rate;
+	if (!hud->refresh_rate && ps->randr_exists) {
+		auto r = xcb_randr_get_screen_info_reply(
+		    ps->c, xcb_randr_get_screen_info(ps->c, ps->root), NULL);
+		if (r) {
+			hud->refresh_rate = r->rate;
+			free(r);
+		}
+	}
+	return hud;
+}
+
+void hud_free(struct hud *hud) {
+	free(hud);
+}
+
+void hud_record_frame(struct hud *hud, uint64_t preprocess_us, uint64_t render_us,
+                      uint64_t present_us) {
+	hud->frames[hud->next] = (struct hud_frame){
+	    .preprocess_us = preprocess_us,
+	    .render_us = render_us,
+	    .present_us = present_us,
+	};
+	hud->next = (hud->next + 1) % HUD_NFRAMES;
+
+	uint64_t frame_us = preprocess_us + render_us + present_us;
+	if (hud->refresh_rate && frame_us > US_PER_SEC / (uint64_t)hud->refresh_rate) {
+		hud->missed_vblanks++;
+	}
+}
+
+void hud_add_damage(session_t *ps) {
+	pixman_region32_union_rect(ps->damage, ps->damage, HUD_X, HUD_Y, HUD_WIDTH,
+	                           HUD_HEIGHT);
+}
+
+/// Clip `reg` to `reg_damage` and fill it with `color`
+static void hud_fill(session_t *ps, struct color color, region_t *reg,
+                     const region_t *reg_damage) {
+	pixman_region32_intersect(reg, reg, (region_t *)reg_damage);
+	if (pixman_region32_not_empty(reg)) {
+		ps->backend_data->ops->fill(ps->backend_data, color, reg);
+	}
+	pixman_region32_clear(reg);
+}
+
+void hud_draw(session_t *ps, const struct hud *hud, const region_t *reg_damage) {
+	region_t reg;
+	pixman_region32_init_rect(&reg, HUD_X, HUD_Y, HUD_WIDTH, HUD_HEIGHT);
+	hud_fill(ps, hud_background, &reg, reg_damage);
+
+	// The full height of the graph is two refresh intervals
+	int refresh_rate =
+	    hud->refresh_rate ? hud->refresh_rate : HUD_DEFAULT_REFRESH_RATE;
+	double px_per_us = HUD_GRAPH_HEIGHT * refresh_rate / (2.0 * US_PER_SEC);
+	int graph_x = HUD_X + HUD_PADDING,
+	    graph_bottom = HUD_Y + HUD_PADDING + HUD_GRAPH_HEIGHT;
+
+	// Each bar stacks the preprocess, render and present times, from the bottom
+	region_t reg_phases[3];
+	for (int i = 0; i < 3; i++) {
+		pixman_region32_init(&reg_phases[i]);
+	}
+	for (int i = 0; i < HUD_NFRAMES; i++) {
+		auto frame = &hud->frames[(hud->next + i) % HUD_NFRAMES];
+		const uint64_t phases[3] = {frame->preprocess_us, frame->render_us,
+		                            frame->present_us};
+		int top = graph_bottom;
+		for (int j = 0; j < 3; j++) {
+			int height = min2((int)((double)phases[j] * px_per_us + 0.5),
+			                  top - (graph_bottom - HUD_GRAPH_HEIGHT));
+			if (height <= 0) {
+				continue;
+			}
+			top -= height;
+			pixman_region32_union_rect(&reg_phases[j], &reg_phases[j],
+			                           graph_x + i * HUD_BAR_WIDTH, top,
+			                           HUD_BAR_WIDTH, (uint)height);
+		}
+	}
+	hud_fill(ps, hud_preprocess_color, &reg_phases[0], reg_damage);
+	hud_fill(ps, hud_render_color, &reg_phases[1], reg_damage);
+	hud_fill(ps, hud_present_color, &reg_phases[2], reg_damage);
+	for (int i = 0; i < 3; i++) {
+		pixman_region32_fini(&reg_phases[i]);
+	}
+
+	// Mark one refresh interval, and print the damage of the last frame in
+	// kilopixels, its number of blur passes, and the number of missed vblanks
+	pixman_region32_union_rect(&reg, &reg, graph_x,
+	                           graph_bottom - HUD_GRAPH_HEIGHT / 2,
+	                           HUD_NFRAMES * HUD_BAR_WIDTH, 1);
+	char text[64];
+	snprintf(text, sizeof(text), "D%" PRIu64 "K B%d M%" PRIu64,
+	         ps->render_stats.last_damaged_pixels / 1000,
+	         ps->render_stats.last_blur_passes, hud->missed_vblanks);
+	hud_add_text(&reg, graph_x, graph_bottom + HUD_PADDING, text);
+	hud_fill(ps, hud_text_color, &reg, reg_damage);
+	pixman_region32_fini(&reg);
+}
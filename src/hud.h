@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+
+/// Frame time overlay. When the `hud` option is enabled, a graph of the time spent on
+/// recent frames, and a few counters of the last frame, are drawn over the top left
+/// corner of the screen. It is drawn with the backend's fill operation, so it works
+/// with all the new backends, but not with the legacy ones.
+#pragma once
+#include <stdint.h>
+
+#include "region.h"
+
+typedef struct session session_t;
+struct hud;
+
+/// Create the overlay. Looks up the refresh rate of the screen, which the graph is
+/// scaled to.
+struct hud *hud_new(session_t *ps);
+void hud_free(struct hud *hud);
+
+/// Record the time spent on a rendered frame, in microseconds
+void hud_record_frame(struct hud *hud, uint64_t preprocess_us, uint64_t render_us,
+                      uint64_t present_us);
+
+/// Add the area of the overlay to the damage of the frame about to be rendered, it
+/// changes every frame.
+void hud_add_damage(session_t *ps);
+
+/// Draw the overlay onto the rendering buffer, clipped to `reg_damage`
+void hud_draw(session_t *ps, const struct hud *hud, const region_t *reg_damage);
@@ -0,0 +1,209 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+
+#include <X11/Xlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "compiler.h"
+#include "config.h"
+#include "ipc.h"
+#include "list.h"
+#include "picom.h"
+#include "utils.h"
+#include "win.h"
+
+#define ipc_m_get(tgt, value)                                                            \
+	if (!strcmp(tgt, target)) {                                                      \
+		*val = (value);                                                          \
+		return IPC_OK;                                                           \
+	}
+
+/// Fails the setter if `val` is not of type `t`
+#define ipc_m_check_type(t)                                                              \
+	if (val->type != (t)) {                                                          \
+		return IPC_BAD_VALUE;                                                    \
+	}
+
+enum ipc_status ipc_win_get(session_t *ps, const struct managed_win *w,
+                            const char *target, struct ipc_value *val) {
+	ipc_m_get("base.id", ipc_uint32(w->base.id));
+	ipc_m_get("next", ipc_uint32(list_node_is_last(&ps->window_stack,
+	                                               &w->base.stack_neighbour)
+	                                 ? 0
+	                                 : list_entry(w->base.stack_neighbour.next,
+	                                              struct win, stack_neighbour)
+	                                       ->id));
+	ipc_m_get("map_state", ipc_bool(w->a.map_state));
+	ipc_m_get("mode", ipc_uint32(w->mode));
+	ipc_m_get("client_win", ipc_uint32(w->client_win));
+	ipc_m_get("ever_damaged", ipc_bool(w->ever_damaged));
+	ipc_m_get("window_type", ipc_uint32(w->window_type));
+	ipc_m_get("wmwin", ipc_bool(w->wmwin));
+	ipc_m_get("leader", ipc_uint32(w->leader));
+	ipc_m_get("focused_raw", ipc_bool(win_is_focused_raw(ps, w)));
+	ipc_m_get("fade_force", ipc_uint32(w->fade_force));
+	ipc_m_get("shadow_force", ipc_uint32(w->shadow_force));
+	ipc_m_get("focused_force", ipc_uint32(w->focused_force));
+	ipc_m_get("invert_color_force", ipc_uint32(w->invert_color_force));
+	ipc_m_get("name", ipc_string(w->name));
+	ipc_m_get("class_instance", ipc_string(w->class_instance));
+	ipc_m_get("class_general", ipc_string(w->class_general));
+	ipc_m_get("role", ipc_string(w->role));
+
+	ipc_m_get("opacity", ipc_double(w->opacity));
+	ipc_m_get("opacity_target", ipc_double(w->opacity_target));
+	ipc_m_get("has_opacity_prop", ipc_bool(w->has_opacity_prop));
+	ipc_m_get("opacity_prop", ipc_uint32(w->opacity_prop));
+	ipc_m_get("opacity_is_set", ipc_bool(w->opacity_is_set));
+	ipc_m_get("opacity_set", ipc_double(w->opacity_set));
+
+	ipc_m_get("frame_opacity", ipc_double(w->frame_opacity));
+	ipc_m_get("left_width", ipc_int32(w->frame_extents.left));
+	ipc_m_get("right_width", ipc_int32(w->frame_extents.right));
+	ipc_m_get("top_width", ipc_int32(w->frame_extents.top));
+	ipc_m_get("bottom_width", ipc_int32(w->frame_extents.bottom));
+
+	ipc_m_get("shadow", ipc_bool(w->shadow));
+	ipc_m_get("invert_color", ipc_bool(w->invert_color));
+	ipc_m_get("blur_background", ipc_bool(w->blur_background));
+
+	return IPC_BAD_TARGET;
+}
+
+enum ipc_status ipc_win_set(session_t *ps, struct managed_win *w, const char *target,
+                            const struct ipc_value *val) {
+	// All settable properties are switches
+	if (!strcmp("shadow_force", target)) {
+		ipc_m_check_type(IPC_UINT32);
+		win_set_shadow_force(ps, w, val->u32);
+	} else if (!strcmp("fade_force", target)) {
+		ipc_m_check_type(IPC_UINT32);
+		win_set_fade_force(w, val->u32);
+	} else if (!strcmp("focused_force", target)) {
+		ipc_m_check_type(IPC_UINT32);
+		win_set_focused_force(ps, w, val->u32);
+	} else if (!strcmp("invert_color_force", target)) {
+		ipc_m_check_type(IPC_UINT32);
+		win_set_invert_color_force(ps, w, val->u32);
+	} else {
+		return IPC_BAD_TARGET;
+	}
+	return IPC_OK;
+}
+
+enum ipc_status ipc_opts_get(session_t *ps, const char *target, struct ipc_value *val) {
+	ipc_m_get("version", ipc_string(COMPTON_VERSION));
+	ipc_m_get("pid", ipc_int32(getpid()));
+	ipc_m_get("display", ipc_string(DisplayString(ps->dpy)));
+	ipc_m_get("config_file", ipc_string("Unknown"));
+	ipc_m_get("write_pid_path", ipc_string(ps->o.write_pid_path));
+	ipc_m_get("mark_wmwin_focused", ipc_bool(ps->o.mark_wmwin_focused));
+	ipc_m_get("mark_ovredir_focused", ipc_bool(ps->o.mark_ovredir_focused));
+	ipc_m_get("detect_rounded_corners", ipc_bool(ps->o.detect_rounded_corners));
+	ipc_m_get("paint_on_overlay", ipc_bool(ps->overlay != XCB_NONE));
+	ipc_m_get("paint_on_overlay_id", ipc_uint32(ps->overlay));
+	ipc_m_get("unredir_if_possible", ipc_bool(ps->o.unredir_if_possible));
+	ipc_m_get("unredir_if_possible_delay",
+	          ipc_int32((int32_t)ps->o.unredir_if_possible_delay));
+	ipc_m_get("unredir_per_monitor", ipc_bool(ps->o.unredir_per_monitor));
+	ipc_m_get("redirected_force", ipc_uint32(ps->o.redirected_force));
+	ipc_m_get("stoppaint_force", ipc_uint32(ps->o.stoppaint_force));
+	ipc_m_get("logpath", ipc_string(ps->o.logpath));
+	ipc_m_get("stats_page", ipc_bool(ps->o.stats_page));
+	ipc_m_get("control_socket", ipc_bool(ps->o.control_socket));
+	ipc_m_get("hud", ipc_bool(ps->o.hud));
+	ipc_m_get("idle_trim_delay", ipc_int32((int32_t)ps->o.idle_trim_delay));
+	ipc_m_get("shadow_cache_size", ipc_int32(ps->o.shadow_cache_size));
+	ipc_m_get("handoff", ipc_bool(ps->o.handoff));
+	ipc_m_get("low_bandwidth", ipc_bool(ps->o.low_bandwidth));
+
+	ipc_m_get("refresh_rate", ipc_int32(ps->o.refresh_rate));
+	ipc_m_get("sw_opti", ipc_bool(ps->o.sw_opti));
+	ipc_m_get("vsync", ipc_bool(ps->o.vsync));
+	if (!strcmp("backend", target)) {
+		assert(ps->o.backend < sizeof(BACKEND_STRS) / sizeof(BACKEND_STRS[0]));
+		*val = ipc_string(BACKEND_STRS[ps->o.backend]);
+		return IPC_OK;
+	}
+
+	ipc_m_get("shadow_red", ipc_double(ps->o.shadow_red));
+	ipc_m_get("shadow_green", ipc_double(ps->o.shadow_green));
+	ipc_m_get("shadow_blue", ipc_double(ps->o.shadow_blue));
+	ipc_m_get("shadow_radius", ipc_int32(ps->o.shadow_radius));
+	ipc_m_get("shadow_offset_x", ipc_int32(ps->o.shadow_offset_x));
+	ipc_m_get("shadow_offset_y", ipc_int32(ps->o.shadow_offset_y));
+	ipc_m_get("shadow_opacity", ipc_double(ps->o.shadow_opacity));
+	ipc_m_get("xinerama_shadow_crop", ipc_bool(ps->o.xinerama_shadow_crop));
+
+	ipc_m_get("fade_delta", ipc_int32(ps->o.fade_delta));
+	ipc_m_get("fade_in_step", ipc_double(ps->o.fade_in_step));
+	ipc_m_get("fade_out_step", ipc_double(ps->o.fade_out_step));
+	ipc_m_get("no_fading_openclose", ipc_bool(ps->o.no_fading_openclose));
+
+	ipc_m_get("blur_method", ipc_uint32(ps->o.blur_method));
+	ipc_m_get("blur_background_frame", ipc_bool(ps->o.blur_background_frame));
+	ipc_m_get("blur_background_fixed", ipc_bool(ps->o.blur_background_fixed));
+
+	ipc_m_get("inactive_dim", ipc_double(ps->o.inactive_dim));
+	ipc_m_get("inactive_dim_fixed", ipc_bool(ps->o.inactive_dim_fixed));
+
+	ipc_m_get("max_brightness", ipc_double(ps->o.max_brightness));
+
+	ipc_m_get("use_ewmh_active_win", ipc_bool(ps->o.use_ewmh_active_win));
+	ipc_m_get("detect_transient", ipc_bool(ps->o.detect_transient));
+	ipc_m_get("detect_client_leader", ipc_bool(ps->o.detect_client_leader));
+	ipc_m_get("use_damage", ipc_bool(ps->o.use_damage));
+
+#ifdef CONFIG_OPENGL
+	ipc_m_get("glx_no_stencil", ipc_bool(ps->o.glx_no_stencil));
+	ipc_m_get("glx_no_rebind_pixmap", ipc_bool(ps->o.glx_no_rebind_pixmap));
+	ipc_m_get("glx_no_compute_blur", ipc_bool(ps->o.glx_no_compute_blur));
+	ipc_m_get("glx_present", ipc_bool(ps->o.glx_present));
+#endif
+
+	return IPC_BAD_TARGET;
+}
+
+enum ipc_status
+ipc_opts_set(session_t *ps, const char *target, const struct ipc_value *val) {
+	if (!strcmp("fade_delta", target)) {
+		ipc_m_check_type(IPC_INT32);
+		if (val->i32 <= 0) {
+			return IPC_BAD_VALUE;
+		}
+		ps->o.fade_delta = val->i32;
+	} else if (!strcmp("fade_in_step", target)) {
+		ipc_m_check_type(IPC_DOUBLE);
+		ps->o.fade_in_step = normalize_d(val->d);
+	} else if (!strcmp("fade_out_step", target)) {
+		ipc_m_check_type(IPC_DOUBLE);
+		ps->o.fade_out_step = normalize_d(val->d);
+	} else if (!strcmp("no_fading_openclose", target)) {
+		ipc_m_check_type(IPC_BOOL);
+		opts_set_no_fading_openclose(ps, val->b);
+	} else if (!strcmp("unredir_if_possible", target)) {
+		ipc_m_check_type(IPC_BOOL);
+		if (ps->o.unredir_if_possible != val->b) {
+			ps->o.unredir_if_possible = val->b;
+			queue_redraw(ps);
+		}
+	} else if (!strcmp("hud", target)) {
+		ipc_m_check_type(IPC_BOOL);
+		opts_set_hud(ps, val->b);
+	} else if (!strcmp("clear_shadow", target) || !strcmp("track_focus", target)) {
+		// Obsolete, accepted for compatibility
+	} else if (!strcmp("redirected_force", target)) {
+		ipc_m_check_type(IPC_UINT32);
+		ps->o.redirected_force = val->u32;
+		force_repaint(ps);
+	} else if (!strcmp("stoppaint_force", target)) {
+		ipc_m_check_type(IPC_UINT32);
+		ps->o.stoppaint_force = val->u32;
+	} else {
+		return IPC_BAD_TARGET;
+	}
+	return IPC_OK;
+}
@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+
+/// The window properties and options clients can read and change, shared by the D-Bus
+/// interface and the control socket. The front ends only translate the values from
+/// and to their own message formats.
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct session session_t;
+struct managed_win;
+
+enum ipc_type {
+	IPC_BOOL,
+	IPC_INT32,
+	/// Also used for window IDs and switches (off, on, unset)
+	IPC_UINT32,
+	IPC_UINT64,
+	IPC_DOUBLE,
+	/// Unset strings are NULL
+	IPC_STRING,
+};
+
+struct ipc_value {
+	enum ipc_type type;
+	union {
+		bool b;
+		int32_t i32;
+		uint32_t u32;
+		uint64_t u64;
+		double d;
+		const char *str;
+	};
+};
+
+static inline struct ipc_value ipc_bool(bool v) {
+	return (struct ipc_value){.type = IPC_BOOL, .b = v};
+}
+
+static inline struct ipc_value ipc_int32(int32_t v) {
+	return (struct ipc_value){.type = IPC_INT32, .i32 = v};
+}
+
+static inline struct ipc_value ipc_uint32(uint32_t v) {
+	return (struct ipc_value){.type = IPC_UINT32, .u32 = v};
+}
+
+static inline struct ipc_value ipc_uint64(uint64_t v) {
+	return (struct ipc_value){.type = IPC_UINT64, .u64 = v};
+}
+
+static inline struct ipc_value ipc_double(double v) {
+	return (struct ipc_value){.type = IPC_DOUBLE, .d = v};
+}
+
+static inline struct ipc_value ipc_string(const char *v) {
+	return (struct ipc_value){.type = IPC_STRING, .str = v};
+}
+
+enum ipc_status {
+	IPC_OK,
+	/// No such property or option
+	IPC_BAD_TARGET,
+	/// The value has the wrong type, or is out of range
+	IPC_BAD_VALUE,
+};
+
+/// Read the property `target` of `w`. String values point into the window, and are
+/// only valid until the next event is handled.
+enum ipc_status ipc_win_get(session_t *ps, const struct managed_win *w,
+                            const char *target, struct ipc_value *val);
+enum ipc_status ipc_win_set(session_t *ps, struct managed_win *w, const char *target,
+                            const struct ipc_value *val);
+/// Read the option `target`
+enum ipc_status ipc_opts_get(session_t *ps, const char *target, struct ipc_value *val);
+enum ipc_status
+ipc_opts_set(session_t *ps, const char *target, const struct ipc_value *val);
@@ -4,6 +4,8 @@
 #include <assert.h>
 #include <math.h>
 
+#include <test.h>
+
 #include "compiler.h"
 #include "kernel.h"
 #include "log.h"
@@ -157,4 +159,169 @@ void sum_kernel_preprocess(conv *map) {
 	}
 }
 
+static const int CONV_SEPARATE_MAX_ITERATIONS = 100;
+
+bool conv_separate(const conv *map, double tolerance, conv **horizontal, conv **vertical) {
+	const int w = map->w, h = map->h;
+	if (w == 1 || h == 1) {
+		// Already one dimensional
+		return false;
+	}
+
+	double norm = 0;
+	for (int i = 0; i < w * h; i++) {
+		norm += map->data[i] * map->data[i];
+	}
+	if (norm == 0) {
+		return false;
+	}
+
+	// Find the best rank-1 approximation u * v^T of the kernel, using power iteration
+	// on (K^T K). Start from the center row, which has to be non-zero anyway for the
+	// kernel to be split.
+	bool ret = false;
+	auto u = ccalloc(h, double);
+	auto v = ccalloc(w, double);
+	double vnorm = 0;
+	for (int x = 0; x < w; x++) {
+		v[x] = map->data[h / 2 * w + x];
+		vnorm += v[x] * v[x];
+	}
+	for (int i = 0; i < CONV_SEPARATE_MAX_ITERATIONS && vnorm != 0; i++) {
+		// u = K v
+		for (int y = 0; y < h; y++) {
+			u[y] = 0;
+			for (int x = 0; x < w; x++) {
+				u[y] += map->data[y * w + x] * v[x];
+			}
+		}
+		// v = K^T u, normalized
+		double delta = 0;
+		vnorm = 0;
+		for (int x = 0; x < w; x++) {
+			double tmp = 0;
+			for (int y = 0; y < h; y++) {
+				tmp += map->data[y * w + x] * u[y];
+			}
+			vnorm += tmp * tmp;
+			delta += fabs(tmp - v[x]);
+			v[x] = tmp;
+		}
+		vnorm = sqrt(vnorm);
+		for (int x = 0; x < w && vnorm != 0; x++) {
+			v[x] /= vnorm;
+		}
+		if (delta < 1e-12) {
+			break;
+		}
+	}
+	if (vnorm == 0 || v[w / 2] == 0) {
+		goto out;
+	}
+
+	double err = 0;
+	for (int y = 0; y < h; y++) {
+		u[y] = 0;
+		for (int x = 0; x < w; x++) {
+			u[y] += map->data[y * w + x] * v[x];
+		}
+	}
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			double diff = map->data[y * w + x] - u[y] * v[x];
+			err += diff * diff;
+		}
+	}
+	if (err > tolerance * tolerance * norm || u[h / 2] == 0) {
+		goto out;
+	}
+
+	*horizontal = cvalloc(sizeof(conv) + (size_t)w * sizeof(double));
+	(*horizontal)->w = w;
+	(*horizontal)->h = 1;
+	(*horizontal)->rsum = NULL;
+	*vertical = cvalloc(sizeof(conv) + (size_t)h * sizeof(double));
+	(*vertical)->w = 1;
+	(*vertical)->h = h;
+	(*vertical)->rsum = NULL;
+	for (int x = 0; x < w; x++) {
+		(*horizontal)->data[x] = v[x] / v[w / 2];
+	}
+	for (int y = 0; y < h; y++) {
+		(*vertical)->data[y] = u[y] * v[w / 2];
+	}
+	ret = true;
+
+out:
+	free(u);
+	free(v);
+	return ret;
+}
+
+TEST_CASE(conv_separate) {
+	conv *horizontal = NULL, *vertical = NULL;
+	conv *map = cvalloc(sizeof(conv) + 9 * sizeof(double));
+	map->w = map->h = 3;
+	map->rsum = NULL;
+
+	// Box kernel is separable
+	for (int i = 0; i < 9; i++) {
+		map->data[i] = 1;
+	}
+	TEST_TRUE(conv_separate(map, 1e-6, &horizontal, &vertical));
+	TEST_EQUAL(horizontal->w, 3);
+	TEST_EQUAL(horizontal->h, 1);
+	TEST_EQUAL(vertical->w, 1);
+	TEST_EQUAL(vertical->h, 3);
+	for (int i = 0; i < 3; i++) {
+		TEST_TRUE(fabs(horizontal->data[i] - 1) < 1e-9);
+		TEST_TRUE(fabs(vertical->data[i] - 1) < 1e-9);
+	}
+	free(horizontal);
+	free(vertical);
+
+	// Diagonal kernel is not
+	for (int i = 0; i < 9; i++) {
+		map->data[i] = i % 4 == 0 ? 1 : 0;
+	}
+	TEST_TRUE(!conv_separate(map, 1e-2, &horizontal, &vertical));
+	free(map);
+}
+
+conv *conv_trim(const conv *map) {
+	int dx = 0, dy = 0;
+	for (; dx < map->w / 2; dx++) {
+		bool zero = true;
+		for (int y = 0; y < map->h && zero; y++) {
+			zero = map->data[y * map->w + dx] == 0 &&
+			       map->data[y * map->w + map->w - 1 - dx] == 0;
+		}
+		if (!zero) {
+			break;
+		}
+	}
+	for (; dy < map->h / 2; dy++) {
+		bool zero = true;
+		for (int x = 0; x < map->w && zero; x++) {
+			zero = map->data[dy * map->w + x] == 0 &&
+			       map->data[(map->h - 1 - dy) * map->w + x] == 0;
+		}
+		if (!zero) {
+			break;
+		}
+	}
+
+	int w = map->w - dx * 2, h = map->h - dy * 2;
+	conv *ret = cvalloc(sizeof(conv) + (size_t)(w * h) * sizeof(double));
+	ret->w = w;
+	ret->h = h;
+	ret->rsum = NULL;
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			ret->data[y * w + x] = map->data[(y + dy) * map->w + x + dx];
+		}
+	}
+	return ret;
+}
+
 // vim: set noet sw=8 ts=8 :
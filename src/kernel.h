@@ -2,6 +2,7 @@
 // Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
 
 #pragma once
+#include <stdbool.h>
 #include <stdlib.h>
 #include "compiler.h"
 
@@ -33,6 +34,19 @@ conv *gaussian_kernel_autodetect_deviation(int shadow_radius);
 /// shadow_sum[x*d+y] is the sum of the kernel from (0, 0) to (x, y), inclusive
 void sum_kernel_preprocess(conv *map);
 
+/// Try to split a convolution kernel into a horizontal (w x 1) and a vertical (1 x h)
+/// kernel, so that convolving with both in sequence is the same as convolving with
+/// `map`, give or take `tolerance`. The error is the Frobenius norm of the difference,
+/// relative to the norm of `map`. The center of the horizontal kernel is always 1.
+///
+/// @return whether the kernel could be split
+bool conv_separate(const conv *map, double tolerance, conv **horizontal, conv **vertical);
+
+/// Copy a convolution kernel, leaving out the outer rows and columns that only contain
+/// zeros. The same number of rows (columns) are removed from both sides, so the kernel
+/// stays centered.
+conv *conv_trim(const conv *map);
+
 static inline void free_conv(conv *k) {
 	free(k->rsum);
 	free(k);
@@ -179,6 +179,11 @@ static void usage(const char *argv0, int ret) {
 	    "  Conditions of windows that shouldn't be considered full-screen\n"
 	    "  for unredirecting screen.\n"
 	    "\n"
+	    "--unredir-per-monitor\n"
+	    "  With --unredir-if-possible, on multi-monitor setups, only unredirect\n"
+	    "  the opaque window covering a whole Xinerama screen, and keep\n"
+	    "  compositing the other screens.\n"
+	    "\n"
 	    "--focus-exclude condition\n"
 	    "  Specify a list of conditions of windows that should always be\n"
 	    "  considered focused.\n"
@@ -295,6 +300,15 @@ static void usage(const char *argv0, int ret) {
 	    "  known to break things on some drivers (LLVMpipe, xf86-video-intel,\n"
 	    "  etc.).\n"
 	    "\n"
+	    "--glx-no-compute-blur\n"
+	    "  GLX backend: Blur with fragment shaders even if compute shaders are\n"
+	    "  available.\n"
+	    "\n"
+	    "--glx-present\n"
+	    "  GLX backend: Render into X pixmaps and present them with the Present\n"
+	    "  extension, instead of using glXSwapBuffers. Only works with\n"
+	    "  --experimental-backends.\n"
+	    "\n"
 	    "--no-use-damage\n"
 	    "  Disable the use of damage information. This cause the whole screen to\n"
 	    "  be redrawn everytime, instead of the part of the screen that has\n"
@@ -316,6 +330,38 @@ static void usage(const char *argv0, int ret) {
 	    WARNING_DISABLED
 #endif
 	    "\n\n"
+	    "--stats-page\n"
+	    "  Publish statistics in $XDG_RUNTIME_DIR/picom-<DISPLAY>.stats, a\n"
+	    "  shared memory page that can be read with picom-stats.\n"
+	    "\n"
+	    "--control-socket\n"
+	    "  Accept requests on $XDG_RUNTIME_DIR/picom-<DISPLAY>.sock, a faster\n"
+	    "  alternative to the D-Bus interface.\n"
+	    "\n"
+	    "--hud\n"
+	    "  Draw a graph of recent frame times, and counters of the last frame,\n"
+	    "  over the top left corner of the screen. Only works with the\n"
+	    "  experimental backends.\n"
+	    "\n"
+	    "--idle-trim-delay ms\n"
+	    "  Release the memory kept for reuse after this many milliseconds\n"
+	    "  without rendering. Defaults to 0, which never releases it.\n"
+	    "\n"
+	    "--shadow-cache-size mib\n"
+	    "  Keep up to this many MiB of shadows of unmapped windows, to reuse\n"
+	    "  them when windows are mapped again. Only works with the experimental\n"
+	    "  backends. Defaults to 64, 0 disables the cache.\n"
+	    "\n"
+	    "--handoff\n"
+	    "  If another compositor is running, prepare the first frame while it\n"
+	    "  keeps running, then take over from it. On reset, keep the last frame\n"
+	    "  on screen until the new one is drawn.\n"
+	    "\n"
+	    "--low-bandwidth\n"
+	    "  Send less to the X server with the xrender backend of the\n"
+	    "  experimental backends, for X servers reached over a network.\n"
+	    "  Shadows are generated by the X server, instead of being uploaded.\n"
+	    "\n"
 	    "--benchmark cycles\n"
 	    "  Benchmark mode. Repeatedly paint until reaching the specified cycles.\n"
 	    "\n"
@@ -435,6 +481,16 @@ static const struct option longopts[] = {
     {"blur-method", required_argument, NULL, 328},
     {"blur-size", required_argument, NULL, 329},
     {"blur-deviation", required_argument, NULL, 330},
+    {"unredir-per-monitor", no_argument, NULL, 331},
+    {"stats-page", no_argument, NULL, 332},
+    {"glx-no-compute-blur", no_argument, NULL, 333},
+    {"hud", no_argument, NULL, 334},
+    {"control-socket", no_argument, NULL, 335},
+    {"glx-present", no_argument, NULL, 336},
+    {"idle-trim-delay", required_argument, NULL, 337},
+    {"shadow-cache-size", required_argument, NULL, 338},
+    {"handoff", no_argument, NULL, 339},
+    {"low-bandwidth", no_argument, NULL, 340},
     {"experimental-backends", no_argument, NULL, 733},
     {"monitor-repaint", no_argument, NULL, 800},
     {"diagnostics", no_argument, NULL, 801},
@@ -835,6 +891,16 @@ bool get_cfg(options_t *opt, int argc, char *const *argv, bool shadow_enable,
 			// --blur-deviation
 			opt->blur_deviation = atof(optarg);
 			break;
+		P_CASEBOOL(331, unredir_per_monitor);
+		P_CASEBOOL(332, stats_page);
+		P_CASEBOOL(333, glx_no_compute_blur);
+		P_CASEBOOL(334, hud);
+		P_CASEBOOL(335, control_socket);
+		P_CASEBOOL(336, glx_present);
+		P_CASELONG(337, idle_trim_delay);
+		P_CASEINT(338, shadow_cache_size);
+		P_CASEBOOL(339, handoff);
+		P_CASEBOOL(340, low_bandwidth);
 
 		P_CASEBOOL(733, experimental_backends);
 		P_CASEBOOL(800, monitor_repaint);
@@ -924,6 +990,15 @@ bool get_cfg(options_t *opt, int argc, char *const *argv, bool shadow_enable,
 		CHECK(opt->blur_kernel_count);
 	}
 
+	if (opt->blur_method == BLUR_METHOD_KERNEL) {
+		// The old backends replace the center of the kernels with a value
+		// depending on the window opacity, unless --blur-background-fixed is set.
+		// A kernel changed like that is no longer separable.
+		opt->blur_kerns = optimize_blur_kern_lst(
+		    opt->blur_kerns, &opt->blur_kernel_count,
+		    opt->experimental_backends || opt->blur_background_fixed);
+	}
+
 	if (opt->resize_damage < 0) {
 		log_warn("Negative --resize-damage will not work correctly.");
 	}
@@ -15,6 +15,9 @@
 #include <X11/extensions/sync.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#ifdef HAS_MALLOC_TRIM
+#include <malloc.h>
+#endif
 #include <stdio.h>
 #include <string.h>
 #include <xcb/composite.h>
@@ -54,11 +57,19 @@
 #include "dbus.h"
 #endif
 #include "atom.h"
+#include "control.h"
 #include "event.h"
 #include "file_watch.h"
+#include "hud.h"
 #include "list.h"
 #include "options.h"
+#include "probe.h"
+#include "shadow_cache.h"
+#include "spatial.h"
+#include "stats.h"
 #include "uthash_extra.h"
+#include "vsync.h"
+#include "x_worker.h"
 
 /// Get session_t pointer from a pointer to a member of session_t
 #define session_ptr(ptr, member)                                                         \
@@ -69,10 +80,32 @@
 
 static const long SWOPTI_TOLERANCE = 3000;
 
+/// Longest a transaction can hold back rendering, in seconds, in case its client
+/// never commits it.
+static const double TRANSACTION_TIMEOUT = 1.0;
+
+/// Longest handle_new_windows() may take in a frame, in microseconds. When many
+/// windows appear at once, the ones it doesn't get to are left unpainted, and
+/// handled in the next frames.
+static const uint64_t NEW_WINDOWS_BUDGET_US = 4000;
+
+/// How often we check whether the compositor we are taking over from has released
+/// the screen, and how long we wait for it at most, in seconds.
+static const double HANDOFF_POLL_INTERVAL = 0.005;
+static const double HANDOFF_TIMEOUT = 5.0;
+
+/// How often counts of X errors that were not logged individually are reported, in
+/// seconds.
+static const double X_ERROR_REPORT_INTERVAL = 1.0;
+
 static bool must_use redirect_start(session_t *ps);
 
 static void unredirect(session_t *ps);
 
+static void resize_root_image(session_t *ps);
+
+static void bind_root_image(session_t *ps);
+
 // === Global constants ===
 
 /// Name strings for window types.
@@ -82,6 +115,66 @@ const char *const WINTYPES[NUM_WINTYPES] = {
     "popup_menu", "tooltip", "notification", "combo",   "dnd",
 };
 
+/// Names of wakeup sources.
+const char *const WAKEUP_SOURCES[NUM_WAKEUP_SOURCES] = {
+    [WAKEUP_X_EVENT] = "x_event",
+    [WAKEUP_DRAW] = "draw",
+    [WAKEUP_FADE_TIMER] = "fade_timer",
+    [WAKEUP_UNREDIR_TIMER] = "unredir_timer",
+    [WAKEUP_DELAYED_DRAW_TIMER] = "delayed_draw_timer",
+    [WAKEUP_TRANSACTION_TIMER] = "transaction_timer",
+    [WAKEUP_VBLANK] = "vblank",
+    [WAKEUP_DBUS_IO] = "dbus_io",
+    [WAKEUP_DBUS_TIMEOUT] = "dbus_timeout",
+    [WAKEUP_SIGNAL] = "signal",
+    [WAKEUP_CONFIG_WATCH] = "config_watch",
+    [WAKEUP_X_WORKER] = "x_worker",
+    [WAKEUP_X_ERROR_TIMER] = "x_error_timer",
+    [WAKEUP_CONTROL] = "control",
+    [WAKEUP_IDLE_TRIM_TIMER] = "idle_trim_timer",
+    [WAKEUP_HANDOFF_TIMER] = "handoff_timer",
+};
+
+/// Names of the kinds of X requests in the traffic statistics.
+const char *const X_TRAFFIC_KINDS[NUM_X_TRAFFIC_KINDS] = {
+    [X_TRAFFIC_COMPOSITE] = "composite", [X_TRAFFIC_CLIP] = "clip",
+    [X_TRAFFIC_FILTER] = "filter",       [X_TRAFFIC_IMAGE] = "image",
+    [X_TRAFFIC_FILL] = "fill",
+};
+
+bool render_stats_lookup(const struct render_stats *stats, const char *target,
+                         uint64_t *out) {
+	if (!strcmp("x_bytes", target)) {
+		*out = 0;
+		for (int i = 0; i < NUM_X_TRAFFIC_KINDS; i++) {
+			*out += stats->x_bytes[i];
+		}
+		return true;
+	}
+	if (!strcmp("last_x_bytes", target)) {
+		*out = stats->last_x_bytes;
+		return true;
+	}
+
+	const uint64_t *counters = stats->x_bytes;
+	const char *kind = NULL;
+	if (!strncmp("x_bytes_saved_", target, strlen("x_bytes_saved_"))) {
+		counters = stats->x_bytes_saved;
+		kind = target + strlen("x_bytes_saved_");
+	} else if (!strncmp("x_bytes_", target, strlen("x_bytes_"))) {
+		kind = target + strlen("x_bytes_");
+	} else {
+		return false;
+	}
+	for (int i = 0; i < NUM_X_TRAFFIC_KINDS; i++) {
+		if (!strcmp(kind, X_TRAFFIC_KINDS[i])) {
+			*out = counters[i];
+			return true;
+		}
+	}
+	return false;
+}
+
 // clang-format off
 /// Names of backends.
 const char *const BACKEND_STRS[] = {[BKEND_XRENDER] = "xrender",
@@ -137,7 +230,8 @@ void cxinerama_upd_scrs(session_t *ps) {
 	// XXX Consider deprecating Xinerama, switch to RandR when necessary
 	free_xinerama_info(ps);
 
-	if (!ps->o.xinerama_shadow_crop || !ps->xinerama_exists)
+	if ((!ps->o.xinerama_shadow_crop && !ps->o.unredir_per_monitor) ||
+	    !ps->xinerama_exists)
 		return;
 
 	xcb_xinerama_is_active_reply_t *active =
@@ -417,6 +511,10 @@ static void destroy_backend(session_t *ps) {
 
 	if (ps->backend_data) {
 		// deinit backend
+		if (ps->shadow_cache) {
+			shadow_cache_free(ps->shadow_cache, ps->backend_data);
+			ps->shadow_cache = NULL;
+		}
 		if (ps->backend_blur_context) {
 			ps->backend_data->ops->destroy_blur_context(
 			    ps->backend_data, ps->backend_blur_context);
@@ -424,6 +522,8 @@ static void destroy_backend(session_t *ps) {
 		}
 		ps->backend_data->ops->deinit(ps->backend_data);
 		ps->backend_data = NULL;
+		// The frame in flight, if any, won't be reported anymore
+		ps->frame_pending = false;
 	}
 }
 
@@ -478,6 +578,11 @@ static bool initialize_backend(session_t *ps) {
 			return false;
 		}
 
+		if (ps->o.shadow_cache_size > 0) {
+			auto max_size = (size_t)ps->o.shadow_cache_size * 1024 * 1024;
+			ps->shadow_cache = shadow_cache_new(max_size);
+		}
+
 		// window_stack shouldn't include window that's
 		// not in the hash table at this point. Since
 		// there cannot be any fading windows.
@@ -515,7 +620,7 @@ static bool initialize_backend(session_t *ps) {
 
 /// Handle configure event of the root window
 static void configure_root(session_t *ps) {
-	auto r = XCB_AWAIT(xcb_get_geometry, ps->c, ps->root);
+	auto r = XCB_AWAIT(xcb_get_geometry, ps, ps->root);
 	if (!r) {
 		log_fatal("Failed to fetch root geometry");
 		abort();
@@ -543,6 +648,7 @@ static void configure_root(session_t *ps) {
 
 	ps->root_width = r->width;
 	ps->root_height = r->height;
+	spatial_index_resize(ps->spatial_index, ps->root_width, ps->root_height);
 
 	rebuild_screen_reg(ps);
 	rebuild_shadow_exclude_reg(ps);
@@ -568,6 +674,9 @@ static void configure_root(session_t *ps) {
 		if (has_root_change) {
 			if (ps->backend_data != NULL) {
 				ps->backend_data->ops->root_change(ps->backend_data, ps);
+				// The root background pixmap can stay the same when the
+				// root window is resized, so tile it to the new size here.
+				resize_root_image(ps);
 			}
 			// Old backend's root_change is not a specific function
 		} else {
@@ -583,7 +692,7 @@ static void configure_root(session_t *ps) {
 			}
 
 			// Re-acquire the root pixmap.
-			root_damaged(ps);
+			bind_root_image(ps);
 		}
 		force_repaint(ps);
 	}
@@ -592,7 +701,7 @@ static void configure_root(session_t *ps) {
 
 static void handle_root_flags(session_t *ps) {
 	if ((ps->root_flags & ROOT_FLAGS_SCREEN_CHANGE) != 0) {
-		if (ps->o.xinerama_shadow_crop) {
+		if (ps->o.xinerama_shadow_crop || ps->o.unredir_per_monitor) {
 			cxinerama_upd_scrs(ps);
 		}
 
@@ -612,6 +721,92 @@ static void handle_root_flags(session_t *ps) {
 	}
 }
 
+/**
+ * Cut the region covered by individually unredirected windows out of the overlay
+ * window, so these windows, which are drawn by the X server, are not hidden by it.
+ */
+static void update_overlay_shape(session_t *ps) {
+	if (!pixman_region32_not_empty(&ps->unredir_region)) {
+		xcb_shape_mask(ps->c, XCB_SHAPE_SO_SET, XCB_SHAPE_SK_BOUNDING, ps->overlay,
+		               0, 0, XCB_NONE);
+		return;
+	}
+
+	region_t reg;
+	pixman_region32_init(&reg);
+	pixman_region32_subtract(&reg, &ps->screen_reg, &ps->unredir_region);
+
+	int nrects;
+	const rect_t *rects = pixman_region32_rectangles(&reg, &nrects);
+	auto xrects = ccalloc(nrects, xcb_rectangle_t);
+	for (int i = 0; i < nrects; i++) {
+		xrects[i] = (xcb_rectangle_t){
+		    .x = to_i16_checked(rects[i].x1),
+		    .y = to_i16_checked(rects[i].y1),
+		    .width = to_u16_checked(rects[i].x2 - rects[i].x1),
+		    .height = to_u16_checked(rects[i].y2 - rects[i].y1),
+		};
+	}
+	xcb_shape_rectangles(ps->c, XCB_SHAPE_SO_SET, XCB_SHAPE_SK_BOUNDING,
+	                     XCB_CLIP_ORDERING_UNSORTED, ps->overlay, 0, 0,
+	                     to_u32_checked(nrects), xrects);
+	free(xrects);
+	pixman_region32_fini(&reg);
+}
+
+/**
+ * Unredirect the topmost window of each Xinerama screen, if it is opaque and covers
+ * the whole screen, while the other screens stay composited. Windows that no longer
+ * qualify are redirected again.
+ *
+ * @param enabled whether windows are allowed to be unredirected at all
+ */
+static void update_unredirected_windows(session_t *ps, bool enabled) {
+	// Extents of the windows painted above the current one
+	region_t reg_above, reg_unredir, tmp;
+	pixman_region32_init(&reg_above);
+	pixman_region32_init(&reg_unredir);
+	pixman_region32_init(&tmp);
+
+	win_stack_foreach_managed(w, &ps->window_stack) {
+		bool unredir = false;
+		if (enabled && w->to_paint) {
+			unredir = w->mode == WMODE_SOLID && !ps->o.force_win_blend &&
+			          !w->unredir_if_possible_excluded &&
+			          win_is_fullscreen_on_screen(ps, w);
+			if (unredir) {
+				// Windows above it would be hidden by the window, since
+				// we can't paint over an unredirected window.
+				pixman_region32_intersect_rect(&tmp, &reg_above, w->g.x,
+				                               w->g.y, (uint)w->widthb,
+				                               (uint)w->heightb);
+				unredir = !pixman_region32_not_empty(&tmp);
+			}
+			win_extents(w, &tmp);
+			pixman_region32_union(&reg_above, &reg_above, &tmp);
+		}
+
+		win_set_unredirected(ps, w, unredir);
+		if (w->unredirected) {
+			pixman_region32_union_rect(&reg_unredir, &reg_unredir, w->g.x, w->g.y,
+			                           (uint)w->widthb, (uint)w->heightb);
+		}
+	}
+
+	if (!pixman_region32_equal(&reg_unredir, &ps->unredir_region)) {
+		// The screens we stop bypassing have to be fully repainted
+		pixman_region32_subtract(&tmp, &ps->unredir_region, &reg_unredir);
+		add_damage(ps, &tmp);
+
+		pixman_region32_copy(&ps->unredir_region, &reg_unredir);
+		update_overlay_shape(ps);
+	}
+
+	pixman_region32_fini(&tmp);
+	pixman_region32_fini(&reg_unredir);
+	pixman_region32_fini(&reg_above);
+}
+
 static struct managed_win *paint_preprocess(session_t *ps, bool *fade_running) {
 	// XXX need better, more general name for `fade_running`. It really
 	// means if fade is still ongoing after the current frame is rendered
@@ -639,7 +834,7 @@ static struct managed_win *paint_preprocess(session_t *ps, bool *fade_running) {
 
 		if (win_should_dim(ps, w) != w->dim) {
 			w->dim = win_should_dim(ps, w);
-			add_damage_from_win(ps, w);
+			w->appearance_changed = true;
 		}
 
 		// Run fading
@@ -647,12 +842,14 @@ static struct managed_win *paint_preprocess(session_t *ps, bool *fade_running) {
 			*fade_running = true;
 		}
 
-		// Add window to damaged area if its opacity changes
+		// Mark the window to be damaged if its opacity changes, damage is added
+		// in the loop below, where the region covered by the windows above is
+		// known.
 		// If was_painted == false, and to_paint is also false, we don't care
-		// If was_painted == false, but to_paint is true, damage will be added in
-		// the loop below
+		// If was_painted == false, but to_paint is true, the whole window is
+		// damaged in the loop below
 		if (was_painted && w->opacity != opacity_old) {
-			add_damage_from_win(ps, w);
+			w->appearance_changed = true;
 		}
 
 		if (win_check_fade_finished(ps, w)) {
@@ -680,6 +877,10 @@ static struct managed_win *paint_preprocess(session_t *ps, bool *fade_running) {
 	rc_region_t *last_reg_ignore = rc_region_new();
 
 	bool unredir_possible = false;
+	// Whether fullscreen windows only covering one of the Xinerama screens should be
+	// unredirected on their own, instead of unredirecting the whole screen
+	const bool unredir_per_monitor = ps->o.unredir_if_possible &&
+	                                 ps->o.unredir_per_monitor && ps->xinerama_nscrs > 1;
 	// Track whether it's the highest window to paint
 	bool is_highest = true;
 	bool reg_ignore_valid = true;
@@ -720,11 +921,16 @@ static struct managed_win *paint_preprocess(session_t *ps, bool *fade_running) {
 		// log_trace("%s %d %d %d", w->name, to_paint, w->opacity,
 		// w->paint_excluded);
 
-		// Add window to damaged area if its painting status changes
-		// or opacity changes
+		// Add window to damaged area if its painting status changes, or if it
+		// looks different. Only the part not covered by the windows above
+		// changes on screen. That is only known if the windows above covered
+		// the same region in the last frame, otherwise damage the whole window.
 		if (to_paint != was_painted) {
 			w->reg_ignore_valid = false;
-			add_damage_from_win(ps, w);
+		}
+		if (to_paint != was_painted || (to_paint && w->appearance_changed)) {
+			add_damage_from_win_visible(
+			    ps, w, reg_ignore_valid ? last_reg_ignore : NULL);
 		}
 
 		// to_paint will never change after this point
@@ -768,7 +974,8 @@ static struct managed_win *paint_preprocess(session_t *ps, bool *fade_running) {
 		// is not correctly set.
 		if (ps->o.unredir_if_possible && is_highest) {
 			if (w->mode == WMODE_SOLID && !ps->o.force_win_blend &&
-			    win_is_fullscreen(ps, w) && !w->unredir_if_possible_excluded) {
+			    win_is_fullscreen(ps, w) && !w->unredir_if_possible_excluded &&
+			    !(unredir_per_monitor && w->xinerama_scr >= 0)) {
 				unredir_possible = true;
 			}
 		}
@@ -801,6 +1008,7 @@ static struct managed_win *paint_preprocess(session_t *ps, bool *fade_running) {
 	skip_window:
 		reg_ignore_valid = reg_ignore_valid && w->reg_ignore_valid;
 		w->reg_ignore_valid = true;
+		w->appearance_changed = false;
 
 		// Avoid setting w->to_paint if w is freed
 		if (w) {
@@ -838,42 +1046,83 @@ static struct managed_win *paint_preprocess(session_t *ps, bool *fade_running) {
 		}
 	}
 
+	if (ps->o.unredir_per_monitor && ps->redirected) {
+		update_unredirected_windows(
+		    ps, unredir_per_monitor && ps->o.redirected_force == UNSET);
+	}
+
 	return bottom;
 }
 
-void root_damaged(session_t *ps) {
-	if (ps->root_tile_paint.pixmap) {
-		free_root_tile(ps);
+/// Tile the bound root window background to the current size of the root window.
+static void resize_root_image(session_t *ps) {
+	if (!ps->backend_data || !ps->root_image) {
+		return;
 	}
+	ps->backend_data->ops->image_op(ps->backend_data, IMAGE_OP_RESIZE_TILE,
+	                                ps->root_image, NULL, NULL,
+	                                (int[]){ps->root_width, ps->root_height});
+}
 
-	if (!ps->redirected) {
+/// Bind the root window background to the backend, unless it is already bound or
+/// no wallpaper is set, in which case the backend fills the background with a solid
+/// color instead. Uses the cached pixmap ID, so no round trip is needed on backend
+/// reinitialization.
+static void bind_root_image(session_t *ps) {
+	if (!ps->backend_data || ps->root_image || ps->root_pixmap == XCB_NONE) {
 		return;
 	}
+	ps->root_image = ps->backend_data->ops->bind_pixmap(
+	    ps->backend_data, ps->root_pixmap, x_get_visual_info(ps->c, ps->vis), false);
+	resize_root_image(ps);
+}
 
-	if (ps->backend_data) {
-		if (ps->root_image) {
+void root_damaged(session_t *ps) {
+	// Bound images refer to the pixmap itself, so if the wallpaper setter just
+	// drew into the same pixmap, a repaint is enough. Wallpaper setters that
+	// create a new pixmap kill the old one only after setting the new one, so
+	// the ID always changes in that case.
+	auto pixmap = x_get_root_back_pixmap(ps);
+	if (pixmap != ps->root_pixmap) {
+		log_debug("Root background pixmap changed: %#010x -> %#010x",
+		          ps->root_pixmap, pixmap);
+		ps->root_pixmap = pixmap;
+		if (ps->root_tile_paint.pixmap) {
+			free_root_tile(ps);
+		}
+		if (ps->backend_data && ps->root_image) {
 			ps->backend_data->ops->release_image(ps->backend_data, ps->root_image);
-		}
-		auto pixmap = x_get_root_back_pixmap(ps);
-		if (pixmap != XCB_NONE) {
-			ps->root_image = ps->backend_data->ops->bind_pixmap(
-			    ps->backend_data, pixmap, x_get_visual_info(ps->c, ps->vis), false);
-			ps->backend_data->ops->image_op(
-			    ps->backend_data, IMAGE_OP_RESIZE_TILE, ps->root_image, NULL,
-			    NULL, (int[]){ps->root_width, ps->root_height});
+			ps->root_image = NULL;
 		}
 	}
 
+	if (!ps->redirected) {
+		return;
+	}
+
+	bind_root_image(ps);
+
 	// Mark screen damaged
 	force_repaint(ps);
 }
 
 /**
  * Xlib error handler function.
+ *
+ * It is process-wide, so it also gets the errors of the connection of the vsync
+ * thread. Those are only logged, on the thread they happened on: their serials mean
+ * nothing to should_ignore(), and the error records are only for the main thread.
  */
-static int xerror(Display attr_unused *dpy, XErrorEvent *ev) {
+static int xerror(Display *dpy, XErrorEvent *ev) {
+	if (dpy != ps_g->dpy) {
+		log_debug("X error %d on a secondary connection, request %d/%d, "
+		          "serial %lu",
+		          ev->error_code, ev->request_code, ev->minor_code, ev->serial);
+		return 0;
+	}
 	if (!should_ignore(ps_g, ev->serial))
-		x_print_error(ev->serial, ev->request_code, ev->minor_code, ev->error_code);
+		x_print_error(ps_g, ev->serial, ev->request_code, ev->minor_code,
+		              ev->error_code);
 	return 0;
 }
 
@@ -882,7 +1131,8 @@ static int xerror(Display attr_unused *dpy, XErrorEvent *ev) {
  */
 void ev_xcb_error(session_t *ps, xcb_generic_error_t *err) {
 	if (!should_ignore(ps, err->sequence))
-		x_print_error(err->sequence, err->major_code, err->minor_code, err->error_code);
+		x_print_error(ps, err->sequence, err->major_code, err->minor_code,
+		              err->error_code);
 }
 
 /**
@@ -894,8 +1144,7 @@ void force_repaint(session_t *ps) {
 	add_damage(ps, &ps->screen_reg);
 }
 
-#ifdef CONFIG_DBUS
-/** @name DBus hooks
+/** @name Remote control hooks
  */
 ///@{
 
@@ -908,8 +1157,35 @@ void opts_set_no_fading_openclose(session_t *ps, bool newval) {
 	ps->o.no_fading_openclose = newval;
 }
 
+/**
+ * Show or hide the frame time overlay.
+ */
+void opts_set_hud(session_t *ps, bool newval) {
+	ps->o.hud = newval;
+	if (newval && !ps->hud) {
+		ps->hud = hud_new(ps);
+	} else if (!newval && ps->hud) {
+		hud_free(ps->hud);
+		ps->hud = NULL;
+	}
+	force_repaint(ps);
+}
+
 //!@}
-#endif
+
+/// Get the compositor selection (_NET_WM_CM_S) of our screen. Returns XCB_NONE if
+/// out of memory.
+static xcb_atom_t get_cm_selection(session_t *ps) {
+	const char register_prop[] = "_NET_WM_CM_S";
+	char *buf = NULL;
+	if (asprintf(&buf, "%s%d", register_prop, ps->scr) < 0) {
+		log_fatal("Failed to allocate memory");
+		return XCB_NONE;
+	}
+	auto atom = get_atom(ps->atoms, buf);
+	free(buf);
+	return atom;
+}
 
 /**
  * Register us with the compositor selection (_NET_WM_CM_S)
@@ -956,16 +1232,10 @@ static int register_cm(session_t *ps) {
 
 	// Acquire X Selection _NET_WM_CM_S?
 	if (!ps->o.no_x_selection) {
-		const char register_prop[] = "_NET_WM_CM_S";
-		xcb_atom_t atom;
-
-		char *buf = NULL;
-		if (asprintf(&buf, "%s%d", register_prop, ps->scr) < 0) {
-			log_fatal("Failed to allocate memory");
+		auto atom = get_cm_selection(ps);
+		if (atom == XCB_NONE) {
 			return -1;
 		}
-		atom = get_atom(ps->atoms, buf);
-		free(buf);
 
 		xcb_get_selection_owner_reply_t *reply = xcb_get_selection_owner_reply(
 		    ps->c, xcb_get_selection_owner(ps->c, atom), NULL);
@@ -1074,8 +1344,11 @@ static double swopti_handle_timeout(session_t *ps) {
 
 /**
  * Initialize X composite overlay window.
+ *
+ * @param keep_mapped whether to leave the overlay mapped, because it shows the frames
+ *                    of the compositor we are taking over from
  */
-static bool init_overlay(session_t *ps) {
+static bool init_overlay(session_t *ps, bool keep_mapped) {
 	xcb_composite_get_overlay_window_reply_t *reply =
 	    xcb_composite_get_overlay_window_reply(
 	        ps->c, xcb_composite_get_overlay_window(ps->c, ps->root), NULL);
@@ -1088,13 +1361,13 @@ static bool init_overlay(session_t *ps) {
 	if (ps->overlay) {
 		// Set window region of the overlay window, code stolen from
 		// compiz-0.8.8
-		if (!XCB_AWAIT_VOID(xcb_shape_mask, ps->c, XCB_SHAPE_SO_SET,
+		if (!XCB_AWAIT_VOID(xcb_shape_mask, ps, XCB_SHAPE_SO_SET,
 		                    XCB_SHAPE_SK_BOUNDING, ps->overlay, 0, 0, 0)) {
 			log_fatal("Failed to set the bounding shape of overlay, giving "
 			          "up.");
 			return false;
 		}
-		if (!XCB_AWAIT_VOID(xcb_shape_rectangles, ps->c, XCB_SHAPE_SO_SET,
+		if (!XCB_AWAIT_VOID(xcb_shape_rectangles, ps, XCB_SHAPE_SO_SET,
 		                    XCB_SHAPE_SK_INPUT, XCB_CLIP_ORDERING_UNSORTED,
 		                    ps->overlay, 0, 0, 0, NULL)) {
 			log_fatal("Failed to set the input shape of overlay, giving up.");
@@ -1110,7 +1383,10 @@ static bool init_overlay(session_t *ps) {
 		// root_damage = XDamageCreate(ps->dpy, root, XDamageReportNonEmpty);
 
 		// Unmap the overlay, we will map it when needed in redirect_start
-		XCB_AWAIT_VOID(xcb_unmap_window, ps->c, ps->overlay);
+		if (!keep_mapped) {
+			XCB_AWAIT_VOID(xcb_unmap_window, ps, ps->overlay);
+		}
+		ps->overlay_kept_mapped = keep_mapped;
 	} else {
 		log_error("Cannot get X Composite overlay window. Falling "
 		          "back to painting on root window.");
@@ -1166,6 +1442,11 @@ uint8_t session_redirection_mode(session_t *ps) {
 		assert(ps->o.experimental_backends);
 		return XCB_COMPOSITE_REDIRECT_AUTOMATIC;
 	}
+	if (ps->handoff_pending) {
+		// The compositor we are taking over from holds the manual redirection.
+		// Redirecting automatically still lets us name the window pixmaps.
+		return XCB_COMPOSITE_REDIRECT_AUTOMATIC;
+	}
 	if (ps->o.experimental_backends && !backend_list[ps->o.backend]->present) {
 		// if the backend doesn't render anything, we don't need to take over the
 		// screen.
@@ -1185,11 +1466,13 @@ static bool redirect_start(session_t *ps) {
 
 	// Map overlay window. Done firstly according to this:
 	// https://bugzilla.gnome.org/show_bug.cgi?id=597014
-	if (ps->overlay) {
+	// When taking over, the other compositor is still drawing on it, it's mapped
+	// once the screen is ours.
+	if (ps->overlay && !ps->handoff_pending) {
 		xcb_map_window(ps->c, ps->overlay);
 	}
 
-	bool success = XCB_AWAIT_VOID(xcb_composite_redirect_subwindows, ps->c, ps->root,
+	bool success = XCB_AWAIT_VOID(xcb_composite_redirect_subwindows, ps, ps->root,
 	                              session_redirection_mode(ps));
 	if (!success) {
 		log_fatal("Another composite manager is already running "
@@ -1226,7 +1509,9 @@ static bool redirect_start(session_t *ps) {
 	ps->drivers = detect_driver(ps->c, ps->backend_data, ps->root);
 	apply_driver_workarounds(ps, ps->drivers);
 
-	root_damaged(ps);
+	// The root tile of the legacy backends survives unredirection, only the new
+	// backends need to bind it again.
+	bind_root_image(ps);
 
 	// Repaint the whole screen
 	force_repaint(ps);
@@ -1244,8 +1529,17 @@ static void unredirect(session_t *ps) {
 	destroy_backend(ps);
 
 	xcb_composite_unredirect_subwindows(ps->c, ps->root, session_redirection_mode(ps));
+	// Windows unredirected on their own are redirected again along with the others
+	// in redirect_start()
+	if (pixman_region32_not_empty(&ps->unredir_region)) {
+		win_stack_foreach_managed(w, &ps->window_stack) {
+			w->unredirected = false;
+		}
+		pixman_region32_clear(&ps->unredir_region);
+		update_overlay_shape(ps);
+	}
 	// Unmap overlay window
-	if (ps->overlay)
+	if (ps->overlay && !ps->keep_overlay && !ps->handoff_pending)
 		xcb_unmap_window(ps->c, ps->overlay);
 
 	// Free the damage ring
@@ -1278,6 +1572,17 @@ static void handle_queued_x_events(EV_P attr_unused, ev_prepare *w, int revents
 	// because OpenGL.
 	XFlush(ps->dpy);
 	xcb_flush(ps->c);
+	// Present notifications are read from the X socket alongside the events
+	vsync_handle_x_events(ps);
+	if (ps->backend_data && ps->backend_data->ops->handle_events &&
+	    ps->backend_data->ops->handle_events(ps->backend_data)) {
+		handle_vblank(ps);
+	}
+	// Errors are reported from all over the place, so this is where we notice them
+	if (x_has_unflushed_errors() && !ev_is_active(&ps->x_error_timer)) {
+		ev_timer_set(&ps->x_error_timer, X_ERROR_REPORT_INTERVAL, 0);
+		ev_timer_start(ps->loop, &ps->x_error_timer);
+	}
 	int err = xcb_connection_has_error(ps->c);
 	if (err) {
 		log_fatal("X11 server connection broke (error %d)", err);
@@ -1285,9 +1590,29 @@ static void handle_queued_x_events(EV_P attr_unused, ev_prepare *w, int revents
 	}
 }
 
-static void handle_new_windows(session_t *ps) {
+/// Call fill_win on the new windows, from the top of the stack down. Stops once
+/// `budget_us` microseconds have passed, unless it is 0. Returns whether all new
+/// windows have been handled.
+static bool handle_new_windows(session_t *ps, uint64_t budget_us) {
+	auto start = get_time_timespec();
+	bool done = true;
+	int handled = 0;
+	// At startup every window is new. Match the rules against all of them in one
+	// batch, instead of one window at a time.
+	ps->defer_factor_change = true;
 	list_foreach_safe(struct win, w, &ps->window_stack, stack_neighbour) {
 		if (w->is_new) {
+			if (budget_us && handled) {
+				struct timespec now = get_time_timespec(), elapsed;
+				timespec_subtract(&elapsed, &now, &start);
+				if ((uint64_t)elapsed.tv_sec * 1000000UL +
+				        (uint64_t)elapsed.tv_nsec / 1000UL >=
+				    budget_us) {
+					done = false;
+					break;
+				}
+			}
+			handled++;
 			auto new_w = fill_win(ps, w);
 			if (!new_w->managed) {
 				continue;
@@ -1307,6 +1632,13 @@ static void handle_new_windows(session_t *ps) {
 			}
 		}
 	}
+	ps->defer_factor_change = false;
+	win_flush_factor_changes(ps);
+	if (!done) {
+		log_debug("Handled %d new windows, leaving the rest to the next frame",
+		          handled);
+	}
+	return done;
 }
 
 static void refresh_windows(session_t *ps) {
@@ -1320,22 +1652,243 @@ static void refresh_windows(session_t *ps) {
  */
 static void tmout_unredir_callback(EV_P attr_unused, ev_timer *w, int revents attr_unused) {
 	session_t *ps = session_ptr(w, unredir_timer);
+	count_wakeup(ps, WAKEUP_UNREDIR_TIMER);
 	ps->tmout_unredir_hit = true;
 	queue_redraw(ps);
 }
 
+/**
+ * Called when the vblank requested after rendering a frame arrives, or, with the new
+ * backends, when the backend has put the last frame on screen.
+ */
+void handle_vblank(session_t *ps) {
+	if (!ps->frame_pending) {
+		return;
+	}
+	ps->frame_pending = false;
+	// The frame waiting for the vblank was the last one rendered
+	PROBE(present_complete, ps->render_stats.frames - 1);
+	if (ps->redirected && !ps->o.experimental_backends) {
+		paint_present_pending(ps);
+	}
+	// Redraws requested while we were waiting have been held back
+	if (ps->redraw_needed) {
+		ev_idle_start(ps->loop, &ps->draw_idle);
+	}
+}
+
 static void fade_timer_callback(EV_P attr_unused, ev_timer *w, int revents attr_unused) {
 	session_t *ps = session_ptr(w, fade_timer);
+	count_wakeup(ps, WAKEUP_FADE_TIMER);
 	queue_redraw(ps);
 }
 
-static void handle_pending_updates(EV_P_ struct session *ps) {
+/**
+ * Start a transaction.
+ *
+ * Until the transaction is committed nothing is rendered, so the damage and fades of
+ * all changes made in the meantime land in a single frame. Transactions nest,
+ * rendering resumes when the outermost one is committed.
+ */
+void transaction_begin(session_t *ps) {
+	if (ps->transaction_depth++) {
+		return;
+	}
+	log_debug("Transaction started");
+	ev_timer_set(&ps->transaction_timer, TRANSACTION_TIMEOUT, 0);
+	ev_timer_start(ps->loop, &ps->transaction_timer);
+}
+
+/**
+ * Commit a transaction started with transaction_begin().
+ */
+void transaction_commit(session_t *ps) {
+	if (!ps->transaction_depth) {
+		log_warn("Trying to commit a transaction that wasn't started");
+		return;
+	}
+	if (--ps->transaction_depth) {
+		return;
+	}
+	log_debug("Transaction committed");
+	ev_timer_stop(ps->loop, &ps->transaction_timer);
+
+	// Start the fades from now, instead of catching up on the time we spent
+	// waiting for the commit.
+	ps->fade_time = 0L;
+
+	// Redraws requested during the transaction have been held back
+	if (ps->redraw_needed) {
+		ev_idle_start(ps->loop, &ps->draw_idle);
+	}
+}
+
+static void x_error_timer_callback(EV_P attr_unused, ev_timer *w, int revents attr_unused) {
+	session_t *ps = session_ptr(w, x_error_timer);
+	count_wakeup(ps, WAKEUP_X_ERROR_TIMER);
+	x_flush_errors(ps);
+}
+
+/// Release the memory kept for reuse, the screen has been idle for a while
+static void
+idle_trim_timer_callback(EV_P attr_unused, ev_timer *w, int revents attr_unused) {
+	session_t *ps = session_ptr(w, idle_trim_timer);
+	count_wakeup(ps, WAKEUP_IDLE_TRIM_TIMER);
+	// Only once per idle period, the next frame restarts the timer
+	ev_timer_stop(EV_A_ w);
+
+	size_t released = 0;
+	if (ps->backend_data) {
+		auto ops = ps->backend_data->ops;
+		if (ops->trim_memory) {
+			released +=
+			    ops->trim_memory(ps->backend_data, ps->backend_blur_context);
+		}
+		if (ops->trim_image) {
+			win_stack_foreach_managed(mw, &ps->window_stack) {
+				if (mw->win_image) {
+					released += ops->trim_image(ps->backend_data,
+					                            mw->win_image);
+				}
+			}
+		}
+	}
+
+	// All the Expose events received have been handled
+	if (!ps->n_expose && ps->expose_rects) {
+		released += (size_t)ps->size_expose * sizeof(rect_t);
+		free(ps->expose_rects);
+		ps->expose_rects = NULL;
+		ps->size_expose = 0;
+	}
+
+	for (int i = 0; i < ps->ndamage; i++) {
+		released += region_compact(&ps->damage_ring[i]);
+	}
+
+	bool heap_trimmed = false;
+#ifdef HAS_MALLOC_TRIM
+	heap_trimmed = malloc_trim(0);
+#endif
+	log_info("Idle for %ld ms, released %zu KiB of scratch memory%s",
+	         ps->o.idle_trim_delay, released / 1024,
+	         heap_trimmed ? ", and returned free heap memory to the system" : "");
+}
+
+/// Set up D-Bus, the statistics page and the control socket. With --handoff, this
+/// waits until the compositor we take over from has released the screen, because it
+/// holds the same D-Bus name and paths as ours until then.
+static void session_init_ipc(session_t *ps) {
+#ifdef CONFIG_DBUS
+	if (ps->o.dbus) {
+		cdbus_init(ps, DisplayString(ps->dpy));
+		if (!ps->dbus_data) {
+			ps->o.dbus = false;
+		}
+	}
+#endif
+
+	if (ps->o.stats_page && !stats_page_init(ps, DisplayString(ps->dpy))) {
+		ps->o.stats_page = false;
+	}
+
+	if (ps->o.control_socket && !control_init(ps, DisplayString(ps->dpy))) {
+		ps->o.control_socket = false;
+	}
+}
+
+/// Unmap the overlay window if it still shows the last frame of the compositor we took
+/// over from, because we leave the screen unredirected and won't draw over it.
+static void unmap_kept_overlay(session_t *ps) {
+	if (ps->overlay_kept_mapped) {
+		xcb_unmap_window(ps->c, ps->overlay);
+		ps->overlay_kept_mapped = false;
+	}
+}
+
+/// Our first frame is ready, take the compositor selection from the other compositor,
+/// which makes it exit. It keeps its last frame on screen until we draw ours, if it
+/// supports --handoff too.
+static void handoff_begin(session_t *ps) {
+	log_info("Ready to draw, taking over from the running compositor.");
+	auto atom = get_cm_selection(ps);
+	if (atom == XCB_NONE) {
+		quit(ps);
+		return;
+	}
+	xcb_set_selection_owner(ps->c, ps->reg_win, atom, XCB_CURRENT_TIME);
+	ps->handoff_start = get_time_timespec();
+	ev_timer_set(&ps->handoff_timer, 0, HANDOFF_POLL_INTERVAL);
+	ev_timer_start(ps->loop, &ps->handoff_timer);
+}
+
+/// Check whether the compositor we are taking over from has released the screen,
+/// by trying to get the manual redirection it holds.
+static void
+handoff_timer_callback(EV_P attr_unused, ev_timer *w, int revents attr_unused) {
+	session_t *ps = session_ptr(w, handoff_timer);
+	count_wakeup(ps, WAKEUP_HANDOFF_TIMER);
+	auto e = xcb_request_check(
+	    ps->c, xcb_composite_redirect_subwindows_checked(
+	               ps->c, ps->root, XCB_COMPOSITE_REDIRECT_MANUAL));
+	if (e) {
+		// Still there
+		free(e);
+		struct timespec now = get_time_timespec(), elapsed;
+		timespec_subtract(&elapsed, &now, &ps->handoff_start);
+		if ((double)elapsed.tv_sec + (double)elapsed.tv_nsec / 1e9 >
+		    HANDOFF_TIMEOUT) {
+			log_fatal("The running compositor didn't release the screen "
+			          "after %.1f seconds, giving up.",
+			          HANDOFF_TIMEOUT);
+			quit(ps);
+		}
+		return;
+	}
+
+	ev_timer_stop(EV_A_ w);
+	ps->handoff_pending = false;
+	if (ps->redirected) {
+		// The window pixmaps we named are kept by the manual redirection, the
+		// automatic one isn't needed anymore
+		xcb_composite_unredirect_subwindows(ps->c, ps->root,
+		                                    XCB_COMPOSITE_REDIRECT_AUTOMATIC);
+		if (ps->overlay) {
+			xcb_map_window(ps->c, ps->overlay);
+		}
+	} else {
+		// Nothing to paint, paint_preprocess() redirects the screen when needed
+		xcb_composite_unredirect_subwindows(ps->c, ps->root,
+		                                    XCB_COMPOSITE_REDIRECT_MANUAL);
+		unmap_kept_overlay(ps);
+	}
+	log_debug("The screen is ours.");
+	session_init_ipc(ps);
+	force_repaint(ps);
+	queue_redraw(ps);
+}
+
+static void
+transaction_timer_callback(EV_P attr_unused, ev_timer *w, int revents attr_unused) {
+	session_t *ps = session_ptr(w, transaction_timer);
+	count_wakeup(ps, WAKEUP_TRANSACTION_TIMER);
+	log_warn("Transaction not committed after %.1f seconds, committing it.",
+	         TRANSACTION_TIMEOUT);
+	ps->transaction_depth = 1;
+	ps->transaction_prop_open = false;
+	transaction_commit(ps);
+}
+
+/// Returns whether some of the updates were left for the next frame.
+static bool handle_pending_updates(EV_P_ struct session *ps) {
+	bool new_windows_done = true;
 	if (ps->pending_updates) {
 		log_debug("Delayed handling of events, entering critical section");
 		auto e = xcb_request_check(ps->c, xcb_grab_server_checked(ps->c));
 		if (e) {
 			log_fatal_x_error(e, "failed to grab x server");
-			return quit(ps);
+			quit(ps);
+			return false;
 		}
 
 		ps->server_grabbed = true;
@@ -1343,8 +1896,12 @@ static void handle_pending_updates(EV_P_ struct session *ps) {
 		// Catching up with X server
 		handle_queued_x_events(EV_A_ & ps->event_check, 0);
 
-		// Call fill_win on new windows
-		handle_new_windows(ps);
+		// Call fill_win on new windows. The first frame waits for all of them,
+		// so the screen isn't redirected with windows missing. Later on, a
+		// burst of new windows is spread over several frames, so they don't
+		// freeze the screen.
+		new_windows_done =
+		    handle_new_windows(ps, ps->first_frame ? 0 : NEW_WINDOWS_BUDGET_US);
 
 		// Handle screen changes
 		// This HAS TO be called before refresh_windows, as handle_root_flags
@@ -1367,17 +1924,34 @@ static void handle_pending_updates(EV_P_ struct session *ps) {
 		e = xcb_request_check(ps->c, xcb_ungrab_server_checked(ps->c));
 		if (e) {
 			log_fatal_x_error(e, "failed to ungrab x server");
-			return quit(ps);
+			quit(ps);
+			return false;
 		}
 
 		ps->server_grabbed = false;
-		ps->pending_updates = false;
+		ps->pending_updates = !new_windows_done;
 		log_debug("Exited critical section");
 	}
+	return !new_windows_done;
 }
 
 static void _draw_callback(EV_P_ session_t *ps, int revents attr_unused) {
-	handle_pending_updates(EV_A_ ps);
+	if (ps->frame_pending) {
+		// The previous frame is still waiting for vblank, handle_vblank will
+		// restart drawing once it is on screen.
+		return;
+	}
+	if (ps->transaction_depth) {
+		// transaction_commit will restart drawing
+		return;
+	}
+
+	// Index of the frame, if it ends up being rendered
+	uint64_t frame attr_unused = ps->render_stats.frames;
+	PROBE(frame_begin, frame);
+	PROBE(pending_updates_begin);
+	bool updates_left = handle_pending_updates(EV_A_ ps);
+	PROBE(pending_updates_end);
 
 	if (ps->first_frame) {
 		// If we are still rendering the first frame, if some of the windows are
@@ -1411,7 +1985,12 @@ static void _draw_callback(EV_P_ session_t *ps, int revents attr_unused) {
 	// should be redirected.
 	bool fade_running = false;
 	bool was_redirected = ps->redirected;
+	auto preprocess_start = get_time_timespec();
+	PROBE(preprocess_begin);
 	auto bottom = paint_preprocess(ps, &fade_running);
+	PROBE(preprocess_end, bottom ? bottom->base.id : XCB_NONE);
+	struct timespec preprocess_end = get_time_timespec(), preprocess_time;
+	timespec_subtract(&preprocess_time, &preprocess_end, &preprocess_start);
 	ps->tmout_unredir_hit = false;
 
 	if (!was_redirected && ps->redirected) {
@@ -1423,6 +2002,7 @@ static void _draw_callback(EV_P_ session_t *ps, int revents attr_unused) {
 		// TODO This is not ideal, we should try to avoid setting window flags in
 		// paint_preprocess.
 		log_debug("Re-run _draw_callback");
+		PROBE(frame_end, frame);
 		return _draw_callback(EV_A_ ps, revents);
 	}
 
@@ -1435,21 +2015,71 @@ static void _draw_callback(EV_P_ session_t *ps, int revents attr_unused) {
 	}
 
 	// If the screen is unredirected, free all_damage to stop painting
-	if (ps->redirected && ps->o.stoppaint_force != ON) {
+	if (ps->handoff_pending) {
+		// The window images are bound, and the damage kept for our first frame.
+		// It's drawn once the other compositor has released the screen.
+		if (!ev_is_active(&ps->handoff_timer)) {
+			handoff_begin(ps);
+		}
+	} else if (ps->redirected && ps->o.stoppaint_force != ON) {
 		static int paint = 0;
 
 		log_trace("Render start, frame %d", paint);
+		auto render_start = get_time_timespec();
+		auto damaged_pixels = region_area(ps->damage);
+		PROBE(render_begin, frame, damaged_pixels);
 		if (ps->o.experimental_backends) {
 			paint_all_new(ps, bottom, false);
 		} else {
 			paint_all(ps, bottom, false);
 		}
+		PROBE(render_end, frame);
 		log_trace("Render end");
 
+		struct timespec render_end = get_time_timespec(), render_time;
+		timespec_subtract(&render_time, &render_end, &render_start);
+		auto render_time_us = (uint64_t)render_time.tv_sec * 1000000UL +
+		                      (uint64_t)render_time.tv_nsec / 1000UL;
+		ps->render_stats.frames++;
+		ps->render_stats.render_time_us += render_time_us;
+		ps->render_stats.last_render_time_us = render_time_us;
+		ps->render_stats.damaged_pixels += damaged_pixels;
+		ps->render_stats.last_damaged_pixels = damaged_pixels;
+		stats_page_update(ps);
+		if (ps->hud) {
+			auto preprocess_time_us =
+			    (uint64_t)preprocess_time.tv_sec * 1000000UL +
+			    (uint64_t)preprocess_time.tv_nsec / 1000UL;
+			auto present_time_us = ps->render_stats.last_present_time_us;
+			hud_record_frame(ps->hud, preprocess_time_us,
+			                 render_time_us - present_time_us,
+			                 present_time_us);
+		}
+
+		if (ps->handoff_start.tv_sec || ps->handoff_start.tv_nsec) {
+			struct timespec handoff_time;
+			timespec_subtract(&handoff_time, &render_end, &ps->handoff_start);
+			log_info("First frame drawn %ld ms after starting to take over.",
+			         handoff_time.tv_sec * 1000 +
+			             handoff_time.tv_nsec / 1000000);
+			ps->handoff_start = (struct timespec){0};
+		}
+		// Our frame is on the overlay now
+		ps->overlay_kept_mapped = false;
+
+		if (ps->o.idle_trim_delay) {
+			// Not idle, start counting again
+			ps->idle_trim_timer.repeat =
+			    (double)ps->o.idle_trim_delay / 1000.0;
+			ev_timer_again(EV_A_ & ps->idle_trim_timer);
+		}
+
 		ps->first_frame = false;
 		paint++;
 		if (ps->o.benchmark && paint >= ps->o.benchmark)
 			exit(0);
+	} else if (!ps->redirected) {
+		unmap_kept_overlay(ps);
 	}
 
 	if (!fade_running)
@@ -1458,22 +2088,30 @@ static void _draw_callback(EV_P_ session_t *ps, int revents attr_unused) {
 	// TODO xcb_ungrab_server
 
 	ps->redraw_needed = false;
+	if (updates_left) {
+		// handle_pending_updates() ran out of time, carry on in the next frame
+		queue_redraw(ps);
+	}
+	PROBE(frame_end, frame);
 }
 
 static void draw_callback(EV_P_ ev_idle *w, int revents) {
 	// This function is not used if we are using --swopti
 	session_t *ps = session_ptr(w, draw_idle);
+	count_wakeup(ps, WAKEUP_DRAW);
 
-	_draw_callback(EV_A_ ps, revents);
-
-	// Don't do painting non-stop unless we are in benchmark mode
+	// Don't do painting non-stop unless we are in benchmark mode. Stop before
+	// drawing, so _draw_callback can queue the next frame.
 	if (!ps->o.benchmark) {
 		ev_idle_stop(EV_A_ & ps->draw_idle);
 	}
+
+	_draw_callback(EV_A_ ps, revents);
 }
 
 static void delayed_draw_timer_callback(EV_P_ ev_timer *w, int revents) {
 	session_t *ps = session_ptr(w, delayed_draw_timer);
+	count_wakeup(ps, WAKEUP_DELAYED_DRAW_TIMER);
 	_draw_callback(EV_A_ ps, revents);
 
 	// We might have stopped the ev_idle in delayed_draw_callback,
@@ -1485,6 +2123,7 @@ static void delayed_draw_timer_callback(EV_P_ ev_timer *w, int revents) {
 static void delayed_draw_callback(EV_P_ ev_idle *w, int revents) {
 	// This function is only used if we are using --swopti
 	session_t *ps = session_ptr(w, draw_idle);
+	count_wakeup(ps, WAKEUP_DRAW);
 	assert(ps->redraw_needed);
 	assert(!ev_is_active(&ps->delayed_draw_timer));
 
@@ -1514,6 +2153,7 @@ static void delayed_draw_callback(EV_P_ ev_idle *w, int revents) {
 
 static void x_event_callback(EV_P attr_unused, ev_io *w, int revents attr_unused) {
 	session_t *ps = (session_t *)w;
+	count_wakeup(ps, WAKEUP_X_EVENT);
 	xcb_generic_event_t *ev = xcb_poll_for_event(ps->c);
 	if (ev) {
 		ev_handle(ps, ev);
@@ -1526,19 +2166,26 @@ static void x_event_callback(EV_P attr_unused, ev_io *w, int revents attr_unused
  *
  * This will result in the compostior resetting itself after next paint.
  */
-static void reset_enable(EV_P_ ev_signal *w attr_unused, int revents attr_unused) {
+static void reset_enable(EV_P_ ev_signal *w, int revents attr_unused) {
+	// w is NULL when the reset is requested by a config file change, which
+	// counted its own wakeup
+	if (w) {
+		count_wakeup(session_ptr(w, usr1_signal), WAKEUP_SIGNAL);
+	}
 	log_info("picom is resetting...");
 	ev_break(EV_A_ EVBREAK_ALL);
 }
 
 static void exit_enable(EV_P attr_unused, ev_signal *w, int revents attr_unused) {
 	session_t *ps = session_ptr(w, int_signal);
+	count_wakeup(ps, WAKEUP_SIGNAL);
 	log_info("picom is quitting...");
 	quit(ps);
 }
 
 static void config_file_change_cb(void *_ps) {
 	auto ps = (struct session *)_ps;
+	count_wakeup(ps, WAKEUP_CONFIG_WATCH);
 	reset_enable(ps->loop, NULL, 0);
 }
 
@@ -1551,9 +2198,12 @@ static void config_file_change_cb(void *_ps) {
  * @param config_file the path to the config file
  * @param all_xerros whether we should report all X errors
  * @param fork whether we will fork after initialization
+ * @param handed_over whether the previous session left its last frame on screen for
+ *                    this one, see --handoff
  */
 static session_t *session_init(int argc, char **argv, Display *dpy,
-                               const char *config_file, bool all_xerrors, bool fork) {
+                               const char *config_file, bool all_xerrors, bool fork,
+                               bool handed_over) {
 	static const session_t s_def = {
 	    .backend_data = NULL,
 	    .dpy = NULL,
@@ -1628,6 +2278,10 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 #ifdef CONFIG_DBUS
 	    .dbus_data = NULL,
 #endif
+	    .stats_page_data = NULL,
+	    .control_data = NULL,
+	    .x_worker = NULL,
+	    .hud = NULL,
 	};
 
 	auto stderr_logger = stderr_logger_new();
@@ -1643,6 +2297,8 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 	list_init_head(&ps->window_stack);
 	ps->loop = EV_DEFAULT;
 	pixman_region32_init(&ps->screen_reg);
+	pixman_region32_init(&ps->pending_frame_region);
+	pixman_region32_init(&ps->unredir_region);
 
 	ps->ignore_tail = &ps->ignore_head;
 
@@ -1664,6 +2320,7 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 	ps->root = screen->root;
 	ps->root_width = screen->width_in_pixels;
 	ps->root_height = screen->height_in_pixels;
+	ps->spatial_index = spatial_index_new(ps->root_width, ps->root_height);
 
 	// Start listening to events on root earlier to catch all possible
 	// root geometry changes
@@ -1808,6 +2465,9 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 	SET_WM_TYPE_ATOM(DND);
 #undef SET_WM_TYPE_ATOM
 
+	// Root events are already selected, so changes after this point will be seen
+	ps->root_pixmap = x_get_root_back_pixmap(ps);
+
 	// Get needed atoms for c2 condition lists
 	if (!(c2_list_postprocess(ps, ps->o.unredir_if_possible_blacklist) &&
 	      c2_list_postprocess(ps, ps->o.paint_blacklist) &&
@@ -1903,7 +2563,7 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 	}
 
 	// Query X Xinerama extension
-	if (ps->o.xinerama_shadow_crop) {
+	if (ps->o.xinerama_shadow_crop || ps->o.unredir_per_monitor) {
 		ext_info = xcb_get_extension_data(ps->c, &xcb_xinerama_id);
 		ps->xinerama_exists = ext_info && ext_info->present;
 	}
@@ -1925,7 +2585,16 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 		}
 
 		compositor_running = ret == 1;
-		if (compositor_running) {
+		if (compositor_running && ps->o.handoff && !ps->o.print_diagnostics) {
+			// Get ready while it keeps drawing, then take over, see
+			// handoff_begin()
+			log_info("Another composite manager is running, taking over from "
+			         "it once we are ready to draw.");
+			ps->handoff_pending = true;
+			if (!init_overlay(ps, true)) {
+				goto err;
+			}
+		} else if (compositor_running) {
 			// Don't take the overlay when there is another compositor
 			// running, so we don't disrupt it.
 
@@ -1936,9 +2605,20 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 				exit(1);
 			}
 		} else {
-			if (!init_overlay(ps)) {
+			if (!init_overlay(ps, handed_over)) {
 				goto err;
 			}
+			if (handed_over) {
+				ps->handoff_start = get_time_timespec();
+			}
+		}
+
+		// Individually unredirected windows show through a hole we cut in the
+		// overlay window
+		if (ps->o.unredir_per_monitor && (!ps->overlay || !ps->shape_exists)) {
+			log_warn("unredir-per-monitor requires the composite overlay "
+			         "window and the X Shape extension, disabling it.");
+			ps->o.unredir_per_monitor = false;
 		}
 	} else {
 		// We are here if we don't really function as a compositor, so we are not
@@ -2005,8 +2685,8 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 
 	// Monitor screen changes if vsync_sw is enabled and we are using
 	// an auto-detected refresh rate, or when Xinerama features are enabled
-	if (ps->randr_exists &&
-	    ((ps->o.sw_opti && !ps->o.refresh_rate) || ps->o.xinerama_shadow_crop))
+	if (ps->randr_exists && ((ps->o.sw_opti && !ps->o.refresh_rate) ||
+	                         ps->o.xinerama_shadow_crop || ps->o.unredir_per_monitor))
 		xcb_randr_select_input(ps->c, ps->root, XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE);
 
 	cxinerama_upd_scrs(ps);
@@ -2034,6 +2714,10 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 		ev_idle_init(&ps->draw_idle, draw_callback);
 
 	ev_init(&ps->fade_timer, fade_timer_callback);
+	ev_init(&ps->transaction_timer, transaction_timer_callback);
+	ev_init(&ps->x_error_timer, x_error_timer_callback);
+	ev_init(&ps->idle_trim_timer, idle_trim_timer_callback);
+	ev_init(&ps->handoff_timer, handoff_timer_callback);
 	ev_init(&ps->delayed_draw_timer, delayed_draw_timer_callback);
 
 	// Set up SIGUSR1 signal handler to reset program
@@ -2062,18 +2746,26 @@ static session_t *session_init(int argc, char **argv, Display *dpy,
 	ev_set_priority(&ps->event_check, EV_MINPRI);
 	ev_prepare_start(ps->loop, &ps->event_check);
 
-	// Initialize DBus. We need to do this early, because add_win might call dbus
-	// functions
+#ifndef CONFIG_DBUS
 	if (ps->o.dbus) {
-#ifdef CONFIG_DBUS
-		cdbus_init(ps, DisplayString(ps->dpy));
-		if (!ps->dbus_data) {
-			ps->o.dbus = false;
-		}
-#else
 		log_fatal("DBus support not compiled in!");
 		exit(1);
+	}
 #endif
+
+	// Initialize DBus early, so it announces the windows added from now on
+	if (!ps->handoff_pending) {
+		session_init_ipc(ps);
+	}
+
+	ps->x_worker = x_worker_new(ps, DisplayString(ps->dpy));
+
+	if (ps->o.hud) {
+		if (!ps->o.experimental_backends) {
+			log_warn("The frame time overlay only works with the experimental "
+			         "backends.");
+		}
+		ps->hud = hud_new(ps);
 	}
 
 	e = xcb_request_check(ps->c, xcb_grab_server_checked(ps->c));
@@ -2144,10 +2836,27 @@ err:
  * @param ps session to destroy
  */
 static void session_destroy(session_t *ps) {
+	// A compositor taking over from us sets these up as soon as it gets the screen,
+	// which can happen as soon as we unredirect, so release them first.
+#ifdef CONFIG_DBUS
+	// Kill DBus connection
+	if (ps->dbus_data) {
+		cdbus_destroy(ps);
+	}
+#endif
+
+	stats_page_destroy(ps);
+	control_destroy(ps);
+
 	if (ps->redirected) {
 		unredirect(ps);
 	}
 
+	log_debug("Main loop wakeups:");
+	for (int i = 0; i < NUM_WAKEUP_SOURCES; i++) {
+		log_debug("    %s: %" PRIu64, WAKEUP_SOURCES[i], ps->wakeups[i]);
+	}
+
 	file_watch_destroy(ps->loop, ps->file_watch_handle);
 	ps->file_watch_handle = NULL;
 
@@ -2155,13 +2864,15 @@ static void session_destroy(session_t *ps) {
 	xcb_change_window_attributes(ps->c, ps->root, XCB_CW_EVENT_MASK,
 	                             (const uint32_t[]){0});
 
-#ifdef CONFIG_DBUS
-	// Kill DBus connection
-	if (ps->o.dbus) {
-		assert(ps->dbus_data);
-		cdbus_destroy(ps);
+	if (ps->x_worker) {
+		x_worker_destroy(ps->x_worker);
+		ps->x_worker = NULL;
+	}
+
+	if (ps->hud) {
+		hud_free(ps->hud);
+		ps->hud = NULL;
 	}
-#endif
 
 	// Free window linked list
 
@@ -2178,6 +2889,8 @@ static void session_destroy(session_t *ps) {
 		free(w);
 	}
 	list_init_head(&ps->window_stack);
+	spatial_index_free(ps->spatial_index);
+	ps->spatial_index = NULL;
 
 	// Free blacklists
 	free_wincondlst(&ps->o.shadow_blacklist);
@@ -2227,6 +2940,8 @@ static void session_destroy(session_t *ps) {
 	free_paint(ps, &ps->tgt_buffer);
 
 	pixman_region32_fini(&ps->screen_reg);
+	pixman_region32_fini(&ps->pending_frame_region);
+	pixman_region32_fini(&ps->unredir_region);
 	free(ps->expose_rects);
 
 	free(ps->o.write_pid_path);
@@ -2246,9 +2961,12 @@ static void session_destroy(session_t *ps) {
 	}
 #endif
 
-	// Release overlay window
+	// Release overlay window. If we keep it, it goes away with our connection, unless
+	// the next compositor holds it too.
 	if (ps->overlay) {
-		xcb_composite_release_overlay_window(ps->c, ps->overlay);
+		if (!ps->keep_overlay) {
+			xcb_composite_release_overlay_window(ps->c, ps->overlay);
+		}
 		ps->overlay = XCB_NONE;
 	}
 
@@ -2298,10 +3016,17 @@ static void session_destroy(session_t *ps) {
 	// Stop libev event handlers
 	ev_timer_stop(ps->loop, &ps->unredir_timer);
 	ev_timer_stop(ps->loop, &ps->fade_timer);
+	ev_timer_stop(ps->loop, &ps->transaction_timer);
+	ev_timer_stop(ps->loop, &ps->x_error_timer);
+	ev_timer_stop(ps->loop, &ps->idle_trim_timer);
+	ev_timer_stop(ps->loop, &ps->handoff_timer);
 	ev_idle_stop(ps->loop, &ps->draw_idle);
 	ev_prepare_stop(ps->loop, &ps->event_check);
 	ev_signal_stop(ps->loop, &ps->usr1_signal);
 	ev_signal_stop(ps->loop, &ps->int_signal);
+
+	// Report the X errors still being counted
+	x_flush_errors(ps);
 }
 
 /**
@@ -2331,6 +3056,10 @@ int main(int argc, char **argv) {
 	// correctly
 	setlocale(LC_ALL, "");
 
+	// The vsync helper thread of the legacy backends uses its own Xlib
+	// connection, this has to be the first Xlib call.
+	XInitThreads();
+
 	// Initialize logging system for early logging
 	log_init_tls();
 
@@ -2381,6 +3110,8 @@ int main(int argc, char **argv) {
 	// Main loop
 	bool quit = false;
 	int ret_code = 0;
+	// Connection of the previous session, see session_init()
+	Display *prev_dpy = NULL;
 
 	do {
 		Display *dpy = XOpenDisplay(NULL);
@@ -2396,7 +3127,13 @@ int main(int argc, char **argv) {
 		log_deinit_tls();
 		log_init_tls();
 
-		ps_g = session_init(argc, argv, dpy, config_file, all_xerrors, need_fork);
+		ps_g = session_init(argc, argv, dpy, config_file, all_xerrors, need_fork,
+		                    prev_dpy != NULL);
+		if (prev_dpy) {
+			// The new session holds the overlay window now
+			XCloseDisplay(prev_dpy);
+			prev_dpy = NULL;
+		}
 		if (!ps_g) {
 			log_fatal("Failed to create new session.");
 			ret_code = 1;
@@ -2423,10 +3160,18 @@ int main(int argc, char **argv) {
 		}
 		session_run(ps_g);
 		quit = ps_g->quit;
+		// On reset, keep our last frame on screen until the next session draws.
+		// The overlay window stays mapped as long as our connection holds it, so
+		// the connection is closed once the next session holds it too.
+		bool handoff =
+		    !quit && ps_g->o.handoff && ps_g->redirected && ps_g->overlay;
+		ps_g->keep_overlay = ps_g->keep_overlay || handoff;
 		session_destroy(ps_g);
 		free(ps_g);
 		ps_g = NULL;
-		if (dpy) {
+		if (handoff) {
+			prev_dpy = dpy;
+		} else if (dpy) {
 			XCloseDisplay(dpy);
 		}
 	} while (!quit);
@@ -52,6 +52,12 @@ void cxinerama_upd_scrs(session_t *ps);
 
 void queue_redraw(session_t *ps);
 
+void handle_vblank(session_t *ps);
+
+void transaction_begin(session_t *ps);
+
+void transaction_commit(session_t *ps);
+
 void discard_ignore(session_t *ps, unsigned long sequence);
 
 void set_root_flags(session_t *ps, uint64_t flags);
@@ -0,0 +1,23 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+
+/// USDT static tracepoints, for bpftrace, perf or systemtap.
+///
+/// When built with the `usdt` option, a probe is a single nop, plus a note telling
+/// the tracer where to find its arguments, so it costs nothing until a tracer is
+/// attached. The arguments are still evaluated, so they must be cheap and have no side
+/// effects. Without the option, probes compile to nothing.
+///
+/// The probes are listed in the TRACING section of the man page.
+#pragma once
+
+#ifdef CONFIG_USDT
+#include <sys/sdt.h>
+
+/// Fire the probe `picom:name`, with up to 12 integer or pointer arguments
+#define PROBE(name, ...) STAP_PROBEV(picom, name, ##__VA_ARGS__)
+#else
+#define PROBE(name, ...)                                                                 \
+	do {                                                                             \
+	} while (0)
+#endif
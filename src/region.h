@@ -28,6 +28,35 @@ static inline void dump_region(const region_t *x) {
 		          rects[i].y2);
 }
 
+/// Number of pixels covered by a region
+static inline uint64_t region_area(const region_t *x) {
+	int nrects;
+	const rect_t *rects = pixman_region32_rectangles((region_t *)x, &nrects);
+	uint64_t area = 0;
+	for (int i = 0; i < nrects; i++) {
+		area += (uint64_t)(rects[i].x2 - rects[i].x1) *
+		        (uint64_t)(rects[i].y2 - rects[i].y1);
+	}
+	return area;
+}
+
+/// The storage of a region only ever grows, shrink it to what the region needs.
+/// Returns the number of bytes released.
+static inline size_t region_compact(region_t *region) {
+	if (!region->data || region->data->size <= region->data->numRects) {
+		return 0;
+	}
+	auto released =
+	    (size_t)(region->data->size - region->data->numRects) * sizeof(rect_t);
+	// A copy is allocated with just the room it needs
+	region_t tmp;
+	pixman_region32_init(&tmp);
+	pixman_region32_copy(&tmp, region);
+	pixman_region32_fini(region);
+	*region = tmp;
+	return released;
+}
+
 /// Convert one xcb rectangle to our rectangle type
 static inline rect_t from_x_rect(const xcb_rectangle_t *rect) {
 	return (rect_t){
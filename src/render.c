@@ -464,7 +464,7 @@ static bool get_root_tile(session_t *ps) {
 	ps->root_tile_fill = false;
 
 	bool fill = false;
-	xcb_pixmap_t pixmap = x_get_root_back_pixmap(ps);
+	xcb_pixmap_t pixmap = ps->root_pixmap;
 
 	// Make sure the pixmap we got is valid
 	if (pixmap && !x_validate_pixmap(ps->c, pixmap))
@@ -758,6 +758,46 @@ win_blur_background(session_t *ps, struct managed_win *w, xcb_render_picture_t t
 #endif
 }
 
+/**
+ * Copy the content of the back buffer to the screen, xrender backend only.
+ */
+static void xr_present(session_t *ps, const region_t *region) {
+	auto rwidth = to_u16_checked(ps->root_width);
+	auto rheight = to_u16_checked(ps->root_height);
+	if (ps->o.monitor_repaint) {
+		// Copy the screen content to a new picture, and highlight the
+		// paint region. This is not very efficient, but since it's for
+		// debug only, we don't really care
+
+		// First we create a new picture, and copy content from the buffer
+		// to it
+		auto pictfmt = x_get_pictform_for_visual(ps->c, ps->vis);
+		xcb_render_picture_t new_pict = x_create_picture_with_pictfmt(
+		    ps->c, ps->root, rwidth, rheight, pictfmt, 0, NULL);
+		xcb_render_composite(ps->c, XCB_RENDER_PICT_OP_SRC,
+		                     ps->tgt_buffer.pict, XCB_NONE, new_pict, 0,
+		                     0, 0, 0, 0, 0, rwidth, rheight);
+
+		// Next, we set the region of paint and highlight it
+		x_set_picture_clip_region(ps->c, new_pict, 0, 0, region);
+		xcb_render_composite(ps->c, XCB_RENDER_PICT_OP_OVER, ps->white_picture,
+		                     ps->alpha_picts[MAX_ALPHA / 2], new_pict, 0,
+		                     0, 0, 0, 0, 0, rwidth, rheight);
+
+		// Finally, clear clip regions of new_pict and the screen, and put
+		// the whole thing on screen
+		x_set_picture_clip_region(ps->c, new_pict, 0, 0, &ps->screen_reg);
+		x_set_picture_clip_region(ps->c, ps->tgt_picture, 0, 0, &ps->screen_reg);
+		xcb_render_composite(ps->c, XCB_RENDER_PICT_OP_SRC, new_pict,
+		                     XCB_NONE, ps->tgt_picture, 0, 0, 0, 0, 0, 0,
+		                     rwidth, rheight);
+		xcb_render_free_picture(ps->c, new_pict);
+	} else
+		xcb_render_composite(ps->c, XCB_RENDER_PICT_OP_SRC,
+		                     ps->tgt_buffer.pict, XCB_NONE, ps->tgt_picture,
+		                     0, 0, 0, 0, 0, 0, rwidth, rheight);
+}
+
 /// paint all windows
 /// region = ??
 /// region_real = the damage region
@@ -797,8 +837,10 @@ void paint_all(session_t *ps, struct managed_win *t, bool ignore_damage) {
 		resize_region_in_place(&region, ps->o.resize_damage, ps->o.resize_damage);
 	}
 
-	// Remove the damaged area out of screen
+	// Remove the damaged area out of screen, and the area the X server draws for
+	// the windows unredirected on their own
 	pixman_region32_intersect(&region, &region, &ps->screen_reg);
+	pixman_region32_subtract(&region, &region, &ps->unredir_region);
 
 	if (!paint_isvalid(ps, &ps->tgt_buffer)) {
 		if (!ps->tgt_buffer.pixmap) {
@@ -951,47 +993,20 @@ void paint_all(session_t *ps, struct managed_win *t, bool ignore_damage) {
 #endif
 	}
 
-	if (ps->vsync_wait) {
-		ps->vsync_wait(ps);
+	if (ps->vsync_request) {
+		// Don't block waiting for the vblank, the frame is put on screen by
+		// paint_present_pending() once the vblank arrives.
+		assert(ps->o.backend == BKEND_XRENDER);
+		if (ps->vsync_request(ps)) {
+			pixman_region32_copy(&ps->pending_frame_region, &region);
+			ps->frame_pending = true;
+			pixman_region32_fini(&region);
+			return;
+		}
 	}
 
-	auto rwidth = to_u16_checked(ps->root_width);
-	auto rheight = to_u16_checked(ps->root_height);
 	switch (ps->o.backend) {
-	case BKEND_XRENDER:
-		if (ps->o.monitor_repaint) {
-			// Copy the screen content to a new picture, and highlight the
-			// paint region. This is not very efficient, but since it's for
-			// debug only, we don't really care
-
-			// First we create a new picture, and copy content from the buffer
-			// to it
-			auto pictfmt = x_get_pictform_for_visual(ps->c, ps->vis);
-			xcb_render_picture_t new_pict = x_create_picture_with_pictfmt(
-			    ps->c, ps->root, rwidth, rheight, pictfmt, 0, NULL);
-			xcb_render_composite(ps->c, XCB_RENDER_PICT_OP_SRC,
-			                     ps->tgt_buffer.pict, XCB_NONE, new_pict, 0,
-			                     0, 0, 0, 0, 0, rwidth, rheight);
-
-			// Next, we set the region of paint and highlight it
-			x_set_picture_clip_region(ps->c, new_pict, 0, 0, &region);
-			xcb_render_composite(ps->c, XCB_RENDER_PICT_OP_OVER, ps->white_picture,
-			                     ps->alpha_picts[MAX_ALPHA / 2], new_pict, 0,
-			                     0, 0, 0, 0, 0, rwidth, rheight);
-
-			// Finally, clear clip regions of new_pict and the screen, and put
-			// the whole thing on screen
-			x_set_picture_clip_region(ps->c, new_pict, 0, 0, &ps->screen_reg);
-			x_set_picture_clip_region(ps->c, ps->tgt_picture, 0, 0, &ps->screen_reg);
-			xcb_render_composite(ps->c, XCB_RENDER_PICT_OP_SRC, new_pict,
-			                     XCB_NONE, ps->tgt_picture, 0, 0, 0, 0, 0, 0,
-			                     rwidth, rheight);
-			xcb_render_free_picture(ps->c, new_pict);
-		} else
-			xcb_render_composite(ps->c, XCB_RENDER_PICT_OP_SRC,
-			                     ps->tgt_buffer.pict, XCB_NONE, ps->tgt_picture,
-			                     0, 0, 0, 0, 0, 0, rwidth, rheight);
-		break;
+	case BKEND_XRENDER: xr_present(ps, &region); break;
 #ifdef CONFIG_OPENGL
 	case BKEND_XR_GLX_HYBRID:
 		x_sync(ps->c);
@@ -1040,6 +1055,16 @@ void paint_all(session_t *ps, struct managed_win *t, bool ignore_damage) {
 	pixman_region32_fini(&region);
 }
 
+/**
+ * Put the frame that was waiting for vblank on screen.
+ */
+void paint_present_pending(session_t *ps) {
+	assert(ps->o.backend == BKEND_XRENDER);
+	xr_present(ps, &ps->pending_frame_region);
+	x_sync(ps->c);
+	pixman_region32_clear(&ps->pending_frame_region);
+}
+
 /**
  * Query needed X Render / OpenGL filters to check for their existence.
  */
@@ -1195,6 +1220,8 @@ void free_root_tile(session_t *ps) {
 }
 
 void deinit_render(session_t *ps) {
+	vsync_deinit(ps);
+
 	// Free alpha_picts
 	for (int i = 0; i <= MAX_ALPHA; ++i)
 		free_picture(ps->c, &ps->alpha_picts[i]);
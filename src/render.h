@@ -31,6 +31,7 @@ void render(session_t *ps, int x, int y, int dx, int dy, int w, int h, double op
 void paint_one(session_t *ps, struct managed_win *w, const region_t *reg_paint);
 
 void paint_all(session_t *ps, struct managed_win *const t, bool ignore_damage);
+void paint_present_pending(session_t *ps);
 
 void free_picture(xcb_connection_t *c, xcb_render_picture_t *p);
 
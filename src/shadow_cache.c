@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+#include <assert.h>
+#include <stdlib.h>
+
+#include <test.h>
+
+#include "backend/backend.h"
+#include "compiler.h"
+#include "list.h"
+#include "log.h"
+#include "shadow_cache.h"
+#include "utils.h"
+
+struct shadow_cache_entry {
+	struct list_node siblings;
+	int width, height;
+	void *image;
+	size_t size;
+};
+
+struct shadow_cache {
+	/// Entries, the most recently cached first. There are only as many entries as
+	/// fit in the size limit, so they are looked up linearly.
+	struct list_node entries;
+	size_t size, max_size;
+};
+
+struct shadow_cache *shadow_cache_new(size_t max_size) {
+	auto cache = ccalloc(1, struct shadow_cache);
+	list_init_head(&cache->entries);
+	cache->max_size = max_size;
+	return cache;
+}
+
+static void shadow_cache_evict(struct shadow_cache *cache, backend_t *backend,
+                               struct shadow_cache_entry *entry) {
+	backend->ops->release_image(backend, entry->image);
+	cache->size -= entry->size;
+	list_remove(&entry->siblings);
+	free(entry);
+}
+
+void *shadow_cache_take(struct shadow_cache *cache, int width, int height) {
+	list_foreach(struct shadow_cache_entry, i, &cache->entries, siblings) {
+		if (i->width == width && i->height == height) {
+			auto image = i->image;
+			cache->size -= i->size;
+			list_remove(&i->siblings);
+			free(i);
+			return image;
+		}
+	}
+	return NULL;
+}
+
+void shadow_cache_put(struct shadow_cache *cache, backend_t *backend, void *image,
+                      int width, int height, size_t size) {
+	if (size > cache->max_size) {
+		backend->ops->release_image(backend, image);
+		return;
+	}
+
+	while (cache->size + size > cache->max_size) {
+		auto oldest =
+		    list_entry(cache->entries.prev, struct shadow_cache_entry, siblings);
+		log_trace("Evicting cached %dx%d shadow", oldest->width, oldest->height);
+		shadow_cache_evict(cache, backend, oldest);
+	}
+
+	auto entry = ccalloc(1, struct shadow_cache_entry);
+	entry->width = width;
+	entry->height = height;
+	entry->image = image;
+	entry->size = size;
+	list_insert_after(&cache->entries, &entry->siblings);
+	cache->size += size;
+}
+
+void shadow_cache_free(struct shadow_cache *cache, backend_t *backend) {
+	list_foreach_safe(struct shadow_cache_entry, i, &cache->entries, siblings) {
+		shadow_cache_evict(cache, backend, i);
+	}
+	assert(cache->size == 0);
+	free(cache);
+}
+
+static int shadow_cache_test_released;
+static void attr_unused shadow_cache_test_release(backend_t *backend attr_unused,
+                                                  void *image attr_unused) {
+	shadow_cache_test_released++;
+}
+
+TEST_CASE(shadow_cache) {
+	struct backend_operations ops = {.release_image = shadow_cache_test_release};
+	backend_t backend = {.ops = &ops};
+	int images[4];
+	auto cache = shadow_cache_new(100);
+	shadow_cache_put(cache, &backend, &images[0], 10, 10, 40);
+	shadow_cache_put(cache, &backend, &images[1], 20, 20, 40);
+	TEST_TRUE(shadow_cache_take(cache, 10, 10) == &images[0]);
+	TEST_TRUE(shadow_cache_take(cache, 10, 10) == NULL);
+
+	// The 20x20 image is now the least recently cached, and is evicted first
+	shadow_cache_put(cache, &backend, &images[0], 10, 10, 40);
+	shadow_cache_put(cache, &backend, &images[2], 30, 30, 40);
+	TEST_EQUAL(shadow_cache_test_released, 1);
+	TEST_TRUE(shadow_cache_take(cache, 20, 20) == NULL);
+
+	// Images bigger than the cache are released right away
+	shadow_cache_put(cache, &backend, &images[3], 40, 40, 200);
+	TEST_EQUAL(shadow_cache_test_released, 2);
+
+	shadow_cache_free(cache, &backend);
+	TEST_EQUAL(shadow_cache_test_released, 4);
+}
@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+
+/// Cache of the shadow images of unmapped windows.
+///
+/// Rendering a shadow means blurring an image the size of the window, which adds up
+/// when many windows are mapped at once, e.g. on a workspace switch. Shadows only
+/// depend on the size of the window and on the shadow options, which are the same for
+/// all windows. So instead of releasing the shadow of a window when it's unmapped, it
+/// is put in this cache, and taken back by the next window of the same size that needs
+/// a shadow.
+///
+/// The least recently cached images are released once the cache is over its size limit.
+#pragma once
+#include <stddef.h>
+
+#include "backend/backend.h"
+
+struct shadow_cache;
+
+/// Create a cache holding at most `max_size` bytes of images
+struct shadow_cache *shadow_cache_new(size_t max_size);
+/// Release all the images and free the cache, e.g. before the backend goes away
+void shadow_cache_free(struct shadow_cache *cache, backend_t *backend);
+
+/// Take out the shadow image of a `width` x `height` window, the caller owns the
+/// returned image. Returns NULL if there is none.
+void *shadow_cache_take(struct shadow_cache *cache, int width, int height);
+
+/// Put the shadow image of a `width` x `height` window in the cache, `size` is the
+/// estimated size of the image in bytes. The cache owns the image afterwards, and
+/// releases it with `backend` when it's evicted.
+void shadow_cache_put(struct shadow_cache *cache, backend_t *backend, void *image,
+                      int width, int height, size_t size);
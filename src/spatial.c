@@ -0,0 +1,248 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+#include <stdlib.h>
+
+#include <test.h>
+
+#include "compiler.h"
+#include "region.h"
+#include "spatial.h"
+#include "utils.h"
+
+/// Width and height of a cell, in pixels. Most windows touch only a few cells, and a
+/// small damage region only a single one.
+#define SPATIAL_CELL_SIZE 256
+
+struct spatial_cell {
+	struct spatial_node **nodes;
+	size_t count, capacity;
+};
+
+struct spatial_index {
+	int columns, rows;
+	struct spatial_cell *cells;
+	/// Stamp of the current query
+	unsigned int stamp;
+	/// Results of the last query
+	struct spatial_node **result;
+	size_t result_count, result_capacity;
+};
+
+/// Append `node` to an array of nodes, growing it if needed
+static void spatial_push(struct spatial_node ***nodes, size_t *count, size_t *capacity,
+                         struct spatial_node *node) {
+	if (*count == *capacity) {
+		*capacity = *capacity ? *capacity * 2 : 8;
+		*nodes = crealloc(*nodes, *capacity);
+	}
+	(*nodes)[(*count)++] = node;
+}
+
+/// Get the range of cells a box touches, boxes outside of the grid are clamped to it
+static void spatial_cell_range(const struct spatial_index *index, const rect_t *box,
+                               int *column1, int *row1, int *column2, int *row2) {
+	*column1 = normalize_i_range(box->x1 / SPATIAL_CELL_SIZE, 0, index->columns - 1);
+	*row1 = normalize_i_range(box->y1 / SPATIAL_CELL_SIZE, 0, index->rows - 1);
+	*column2 =
+	    normalize_i_range((box->x2 - 1) / SPATIAL_CELL_SIZE, 0, index->columns - 1);
+	*row2 = normalize_i_range((box->y2 - 1) / SPATIAL_CELL_SIZE, 0, index->rows - 1);
+}
+
+static inline bool spatial_box_intersects(const rect_t *a, const rect_t *b) {
+	return a->x1 < b->x2 && b->x1 < a->x2 && a->y1 < b->y2 && b->y1 < a->y2;
+}
+
+static void spatial_insert(struct spatial_index *index, struct spatial_node *node) {
+	int column1, row1, column2, row2;
+	spatial_cell_range(index, &node->box, &column1, &row1, &column2, &row2);
+	for (int row = row1; row <= row2; row++) {
+		for (int column = column1; column <= column2; column++) {
+			auto cell = &index->cells[row * index->columns + column];
+			spatial_push(&cell->nodes, &cell->count, &cell->capacity, node);
+		}
+	}
+	node->indexed = true;
+}
+
+static void spatial_remove(struct spatial_index *index, struct spatial_node *node) {
+	int column1, row1, column2, row2;
+	spatial_cell_range(index, &node->box, &column1, &row1, &column2, &row2);
+	for (int row = row1; row <= row2; row++) {
+		for (int column = column1; column <= column2; column++) {
+			auto cell = &index->cells[row * index->columns + column];
+			for (size_t i = 0; i < cell->count; i++) {
+				if (cell->nodes[i] == node) {
+					cell->nodes[i] = cell->nodes[--cell->count];
+					break;
+				}
+			}
+		}
+	}
+	node->indexed = false;
+}
+
+static void spatial_init_cells(struct spatial_index *index, int width, int height) {
+	index->columns = max2((width + SPATIAL_CELL_SIZE - 1) / SPATIAL_CELL_SIZE, 1);
+	index->rows = max2((height + SPATIAL_CELL_SIZE - 1) / SPATIAL_CELL_SIZE, 1);
+	index->cells = ccalloc(index->columns * index->rows, struct spatial_cell);
+}
+
+static void spatial_free_cells(struct spatial_index *index) {
+	for (int i = 0; i < index->columns * index->rows; i++) {
+		free(index->cells[i].nodes);
+	}
+	free(index->cells);
+	index->cells = NULL;
+}
+
+/// Start a new query, after which no node carries the current stamp
+static void spatial_next_stamp(struct spatial_index *index) {
+	index->stamp++;
+	if (index->stamp == 0) {
+		// Wrapped around, old stamps could be mistaken for the current one
+		for (int i = 0; i < index->columns * index->rows; i++) {
+			auto cell = &index->cells[i];
+			for (size_t j = 0; j < cell->count; j++) {
+				cell->nodes[j]->stamp = 0;
+			}
+		}
+		index->stamp = 1;
+	}
+	index->result_count = 0;
+}
+
+struct spatial_index *spatial_index_new(int width, int height) {
+	auto index = ccalloc(1, struct spatial_index);
+	spatial_init_cells(index, width, height);
+	return index;
+}
+
+void spatial_index_free(struct spatial_index *index) {
+	spatial_free_cells(index);
+	free(index->result);
+	free(index);
+}
+
+void spatial_index_resize(struct spatial_index *index, int width, int height) {
+	// Collect all the nodes, then index them again in the new grid
+	spatial_next_stamp(index);
+	for (int i = 0; i < index->columns * index->rows; i++) {
+		auto cell = &index->cells[i];
+		for (size_t j = 0; j < cell->count; j++) {
+			auto node = cell->nodes[j];
+			if (node->stamp != index->stamp) {
+				node->stamp = index->stamp;
+				spatial_push(&index->result, &index->result_count,
+				             &index->result_capacity, node);
+			}
+		}
+	}
+
+	spatial_free_cells(index);
+	spatial_init_cells(index, width, height);
+	for (size_t i = 0; i < index->result_count; i++) {
+		spatial_insert(index, index->result[i]);
+	}
+	index->result_count = 0;
+}
+
+void spatial_index_update(struct spatial_index *index, struct spatial_node *node,
+                          const rect_t *box) {
+	if (node->indexed) {
+		if (box && box->x1 == node->box.x1 && box->y1 == node->box.y1 &&
+		    box->x2 == node->box.x2 && box->y2 == node->box.y2) {
+			return;
+		}
+		spatial_remove(index, node);
+	}
+	if (box) {
+		node->box = *box;
+		spatial_insert(index, node);
+	}
+}
+
+struct spatial_node **
+spatial_index_query(struct spatial_index *index, const region_t *reg, size_t *count) {
+	spatial_next_stamp(index);
+
+	int nrects;
+	const rect_t *rects = pixman_region32_rectangles((region_t *)reg, &nrects);
+	for (int i = 0; i < nrects; i++) {
+		auto r = &rects[i];
+		int column1, row1, column2, row2;
+		spatial_cell_range(index, r, &column1, &row1, &column2, &row2);
+		for (int row = row1; row <= row2; row++) {
+			for (int column = column1; column <= column2; column++) {
+				auto cell = &index->cells[row * index->columns + column];
+				for (size_t j = 0; j < cell->count; j++) {
+					auto node = cell->nodes[j];
+					if (node->stamp == index->stamp ||
+					    !spatial_box_intersects(&node->box, r)) {
+						continue;
+					}
+					node->stamp = index->stamp;
+					spatial_push(&index->result, &index->result_count,
+					             &index->result_capacity, node);
+				}
+			}
+		}
+	}
+
+	*count = index->result_count;
+	return index->result;
+}
+
+TEST_CASE(spatial_index) {
+	auto index = spatial_index_new(1000, 600);
+	struct spatial_node nodes[3] = {0};
+	const rect_t boxes[3] = {
+	    {0, 0, 100, 100},
+	    {50, 50, 700, 500},
+	    // Outside of the screen
+	    {-300, 800, -100, 900},
+	};
+	for (int i = 0; i < 3; i++) {
+		spatial_index_update(index, &nodes[i], &boxes[i]);
+	}
+
+	region_t reg;
+	pixman_region32_init_rect(&reg, 60, 60, 10, 10);
+	size_t count;
+	auto result = spatial_index_query(index, &reg, &count);
+	TEST_EQUAL(count, 2);
+
+	// A region made of several rectangles in the same cell, each node is
+	// returned once
+	pixman_region32_union_rect(&reg, &reg, 90, 90, 5, 5);
+	result = spatial_index_query(index, &reg, &count);
+	TEST_EQUAL(count, 2);
+
+	pixman_region32_reset(&reg, &(rect_t){800, 0, 900, 100});
+	result = spatial_index_query(index, &reg, &count);
+	TEST_EQUAL(count, 0);
+
+	pixman_region32_reset(&reg, &(rect_t){-250, 850, -200, 860});
+	result = spatial_index_query(index, &reg, &count);
+	TEST_EQUAL(count, 1);
+	TEST_TRUE(result[0] == &nodes[2]);
+
+	// Move the second node away from the first one
+	spatial_index_update(index, &nodes[1], &(rect_t){800, 0, 900, 100});
+	pixman_region32_reset(&reg, &(rect_t){0, 0, 200, 200});
+	result = spatial_index_query(index, &reg, &count);
+	TEST_EQUAL(count, 1);
+	TEST_TRUE(result[0] == &nodes[0]);
+
+	spatial_index_update(index, &nodes[0], NULL);
+	result = spatial_index_query(index, &reg, &count);
+	TEST_EQUAL(count, 0);
+
+	spatial_index_resize(index, 2000, 2000);
+	pixman_region32_reset(&reg, &(rect_t){0, 0, 2000, 2000});
+	result = spatial_index_query(index, &reg, &count);
+	TEST_EQUAL(count, 1);
+	TEST_TRUE(result[0] == &nodes[1]);
+
+	pixman_region32_fini(&reg);
+	spatial_index_free(index);
+}
@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+
+/// Spatial index, answers "what intersects this region" without looking at everything.
+///
+/// The screen is divided into a uniform grid of cells, and each node is listed in all
+/// the cells its box touches. A query only looks at the nodes listed in the cells the
+/// region touches. Boxes are clamped to the grid, so nodes outside of the screen are
+/// still indexed, in the cells at the border.
+///
+/// Nodes are embedded in the indexed objects, like list_node, use list_entry() to get
+/// the object back.
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "region.h"
+
+struct spatial_node {
+	/// The box this node is indexed under
+	rect_t box;
+	/// Stamp of the last query that returned this node
+	unsigned int stamp;
+	bool indexed;
+};
+
+struct spatial_index;
+
+/// Create an index covering a `width` x `height` screen
+struct spatial_index *spatial_index_new(int width, int height);
+void spatial_index_free(struct spatial_index *index);
+
+/// Change the size of the screen covered by the index, the nodes stay indexed
+void spatial_index_resize(struct spatial_index *index, int width, int height);
+
+/// Index `node` under `box`, or stop indexing it if `box` is NULL. Nothing is done if
+/// the node is already indexed under the same box.
+void spatial_index_update(struct spatial_index *index, struct spatial_node *node,
+                          const rect_t *box);
+
+/// Find the nodes whose box intersects `reg`, each is returned only once, in no
+/// particular order. The returned array is owned by the index, and valid until the
+/// next call to any function of the index.
+struct spatial_node **
+spatial_index_query(struct spatial_index *index, const region_t *reg, size_t *count);
@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "log.h"
+#include "stats.h"
+#include "string_utils.h"
+#include "utils.h"
+#include "uthash_extra.h"
+#include "win.h"
+#include "x.h"
+
+static_assert(NUM_WAKEUP_SOURCES <= PICOM_STATS_MAX_WAKEUP_SOURCES,
+              "Not enough room for all wakeup sources in the stats page");
+
+struct stats_page_data {
+	int fd;
+	char *path;
+	struct picom_stats_page *page;
+};
+
+bool stats_page_init(session_t *ps, const char *display) {
+	auto path = runtime_file_path(display, ".stats");
+	if (!path) {
+		log_error("XDG_RUNTIME_DIR is not set, cannot create the statistics "
+		          "page.");
+		return false;
+	}
+
+	// The page is set up in a new file, then renamed into place. A page another
+	// instance still has mapped is replaced, not overwritten.
+	auto tmp_path = mstrjoin(path, ".XXXXXX");
+	int fd = mkostemp(tmp_path, O_CLOEXEC);
+	if (fd < 0) {
+		log_error("Failed to create the statistics page %s: %s", path,
+		          strerror(errno));
+		free(tmp_path);
+		free(path);
+		return false;
+	}
+
+	auto size = sizeof(struct picom_stats_page);
+	if (fchmod(fd, 0644) < 0 || ftruncate(fd, (off_t)size) < 0) {
+		log_error("Failed to set up the statistics page %s: %s", path,
+		          strerror(errno));
+		goto err;
+	}
+
+	struct picom_stats_page *page =
+	    mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (page == MAP_FAILED) {
+		log_error("Failed to map the statistics page %s: %s", path, strerror(errno));
+		goto err;
+	}
+
+	page->version = PICOM_STATS_VERSION;
+	page->size = (uint32_t)size;
+	page->pid = getpid();
+	page->nwakeup_sources = NUM_WAKEUP_SOURCES;
+	for (int i = 0; i < NUM_WAKEUP_SOURCES; i++) {
+		strncpy(page->wakeup_source_names[i], WAKEUP_SOURCES[i],
+		        PICOM_STATS_NAME_LEN - 1);
+	}
+	// Readers ignore the page until they see the magic
+	__atomic_store_n(&page->magic, PICOM_STATS_MAGIC, __ATOMIC_RELEASE);
+
+	if (rename(tmp_path, path) < 0) {
+		log_error("Failed to create the statistics page %s: %s", path,
+		          strerror(errno));
+		munmap(page, size);
+		goto err;
+	}
+	free(tmp_path);
+
+	auto sd = ccalloc(1, struct stats_page_data);
+	sd->fd = fd;
+	sd->path = path;
+	sd->page = page;
+	ps->stats_page_data = sd;
+	log_info("Publishing statistics in %s", path);
+	return true;
+
+err:
+	close(fd);
+	unlink(tmp_path);
+	free(tmp_path);
+	free(path);
+	return false;
+}
+
+void stats_page_update(session_t *ps) {
+	struct stats_page_data *sd = ps->stats_page_data;
+	if (!sd) {
+		return;
+	}
+
+	uint64_t windows = 0, managed_windows = 0, mapped_windows = 0;
+	HASH_ITER2(ps->windows, w) {
+		windows++;
+		if (!w->managed) {
+			continue;
+		}
+		managed_windows++;
+		if (((struct managed_win *)w)->state == WSTATE_MAPPED) {
+			mapped_windows++;
+		}
+	}
+	auto now = get_time_timespec();
+
+	auto page = sd->page;
+	uint32_t seq = page->seq;
+	__atomic_store_n(&page->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	page->update_time_us =
+	    (uint64_t)now.tv_sec * 1000000UL + (uint64_t)now.tv_nsec / 1000UL;
+	page->frames = ps->render_stats.frames;
+	page->render_time_us = ps->render_stats.render_time_us;
+	page->last_render_time_us = ps->render_stats.last_render_time_us;
+	page->damaged_pixels = ps->render_stats.damaged_pixels;
+	page->last_damaged_pixels = ps->render_stats.last_damaged_pixels;
+	page->x_round_trips = x_round_trips;
+	page->windows = windows;
+	page->managed_windows = managed_windows;
+	page->mapped_windows = mapped_windows;
+	memcpy(page->wakeups, ps->wakeups, sizeof(ps->wakeups));
+
+	__atomic_store_n(&page->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void stats_page_destroy(session_t *ps) {
+	struct stats_page_data *sd = ps->stats_page_data;
+	if (!sd) {
+		return;
+	}
+
+	// Another instance might have replaced the page since, only remove ours
+	struct stat ours, current;
+	if (fstat(sd->fd, &ours) == 0 && stat(sd->path, &current) == 0 &&
+	    ours.st_dev == current.st_dev && ours.st_ino == current.st_ino) {
+		unlink(sd->path);
+	}
+	munmap(sd->page, sizeof(struct picom_stats_page));
+	close(sd->fd);
+	free(sd->path);
+	free(sd);
+	ps->stats_page_data = NULL;
+}
@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+
+/// Statistics page, a small shared memory file the compositor publishes its counters
+/// in. External monitors can mmap it and read it at any rate, without waking up the
+/// compositor.
+///
+/// The page is protected by a sequence lock: `seq` is odd while the compositor is
+/// updating it. A reader copies the page, and retries if `seq` was odd, or changed
+/// during the copy. See tools/picom-stats.c for an example.
+///
+/// This header is shared with the reader, keep the layout part of it free of
+/// dependencies on the rest of the compositor.
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PICOM_STATS_MAGIC 0x7374706dU        // "mpts"
+/// Bumped on incompatible changes. Compatible changes only append fields, readers
+/// should check `size` before reading fields newer than they know about.
+#define PICOM_STATS_VERSION 1
+#define PICOM_STATS_MAX_WAKEUP_SOURCES 16
+#define PICOM_STATS_NAME_LEN 24
+
+struct picom_stats_page {
+	/// Always PICOM_STATS_MAGIC, written last when the page is set up
+	uint32_t magic;
+	uint32_t version;
+	/// Size of this structure as written by the compositor
+	uint32_t size;
+	/// Sequence lock, odd while the page is being updated
+	uint32_t seq;
+	/// PID of the compositor
+	int64_t pid;
+	/// Time of the last update, CLOCK_MONOTONIC in microseconds
+	uint64_t update_time_us;
+
+	// === Frames ===
+	/// Number of frames rendered
+	uint64_t frames;
+	/// Total time spent rendering frames, in microseconds. This is the time it
+	/// takes to submit the rendering commands, not the time the GPU spends.
+	uint64_t render_time_us;
+	/// Time spent rendering the last frame, in microseconds
+	uint64_t last_render_time_us;
+
+	// === Damage ===
+	/// Total number of damaged pixels over all rendered frames
+	uint64_t damaged_pixels;
+	/// Number of damaged pixels in the last frame
+	uint64_t last_damaged_pixels;
+
+	// === X ===
+	/// Number of blocking round trips to the X server
+	uint64_t x_round_trips;
+
+	// === Resources ===
+	/// Number of windows known to the compositor
+	uint64_t windows;
+	/// Number of managed windows
+	uint64_t managed_windows;
+	/// Number of mapped managed windows
+	uint64_t mapped_windows;
+
+	// === Main loop ===
+	/// Number of valid entries in `wakeups` and `wakeup_source_names`
+	uint32_t nwakeup_sources;
+	uint32_t _padding;
+	/// Number of times each source has woken up the main loop
+	uint64_t wakeups[PICOM_STATS_MAX_WAKEUP_SOURCES];
+	/// NUL-terminated names of the wakeup sources
+	char wakeup_source_names[PICOM_STATS_MAX_WAKEUP_SOURCES][PICOM_STATS_NAME_LEN];
+};
+
+typedef struct session session_t;
+
+/// Create the statistics page in $XDG_RUNTIME_DIR for `display`
+bool stats_page_init(session_t *ps, const char *display);
+/// Publish the current counters
+void stats_page_update(session_t *ps);
+/// Unmap and remove the statistics page
+void stats_page_destroy(session_t *ps);
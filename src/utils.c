@@ -48,4 +48,24 @@ int next_power_of_two(int n)
 	return n;
 }
 
+char *runtime_file_path(const char *display, const char *suffix) {
+	const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+	if (!runtime_dir || !*runtime_dir) {
+		return NULL;
+	}
+
+	auto path_len = strlen(runtime_dir) + strlen("/picom-") + strlen(display) +
+	                strlen(suffix) + 1;
+	auto path = ccalloc(path_len, char);
+	snprintf(path, path_len, "%s/picom-%s%s", runtime_dir, display, suffix);
+
+	char *name = path + strlen(runtime_dir) + strlen("/picom-");
+	for (size_t i = 0; i < strlen(display); i++) {
+		if (!isalnum((unsigned char)name[i])) {
+			name[i] = '_';
+		}
+	}
+	return path;
+}
+
 // vim: set noet sw=8 ts=8 :
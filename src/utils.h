@@ -265,5 +265,11 @@ allocchk_(const char *func_name, const char *file, unsigned int line, void *ptr)
 ///
 int next_power_of_two(int n);
 
+/// Build the path of a file for `display` in the runtime directory,
+/// `$XDG_RUNTIME_DIR/picom-<display><suffix>`. Non-alphanumeric characters in the
+/// display name are replaced with underscores. Returns NULL if XDG_RUNTIME_DIR is not
+/// set.
+char *runtime_file_path(const char *display, const char *suffix);
+
 
 // vim: set noet sw=8 ts=8 :
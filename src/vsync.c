@@ -1,10 +1,23 @@
 // SPDX-License-Identifier: MPL-2.0
 // Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
 
-/// Function pointers to init VSync modes.
+/// VSync for the legacy backends.
+///
+/// None of the methods here block the main loop. The blocking vblank waits run on a
+/// helper thread, which wakes up the main loop through an eventfd. The Present
+/// method is event driven, its notifications arrive on the X connection.
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <xcb/present.h>
+#include <xcb/xcb.h>
 
 #include "common.h"
 #include "log.h"
+#include "picom.h"
 
 #ifdef CONFIG_OPENGL
 #include "backend/gl/glx.h"
@@ -13,7 +26,6 @@
 
 #ifdef CONFIG_VSYNC_DRM
 #include <drm.h>
-#include <errno.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
@@ -23,21 +35,61 @@
 #include "config.h"
 #include "vsync.h"
 
+enum vsync_kind {
+	/// Blocking wait on a helper thread
+	VSYNC_THREAD,
+	/// Present MSC notification
+	VSYNC_PRESENT,
+};
+
+struct vsync {
+	session_t *ps;
+	enum vsync_kind kind;
+
+	// === Helper thread ===
+	/// Wait for the next vblank, called on the helper thread
+	int (*wait)(struct vsync *);
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	/// Whether the main loop is waiting for a vblank, protected by `lock`
+	bool requested;
+	/// Whether the helper thread should exit, protected by `lock`
+	bool quit;
+	/// eventfd the helper thread signals when the vblank arrives
+	int event_fd;
+	ev_io event_io;
+	/// Log level of the helper thread's logger
+	int log_level;
 #ifdef CONFIG_VSYNC_DRM
-/**
- * Wait for next VSync, DRM method.
- *
- * Stolen from:
- * https://github.com/MythTV/mythtv/blob/master/mythtv/libs/libmythtv/vsync.cpp
- */
-static int vsync_drm_wait(session_t *ps) {
+	int drm_fd;
+#endif
+#ifdef CONFIG_OPENGL
+	/// X connection private to the helper thread, Xlib connections can't be
+	/// shared between threads.
+	Display *dpy;
+	GLXContext ctx;
+	GLXPbuffer pbuffer;
+	/// Drawable used by the OML method
+	xcb_window_t drawable;
+#endif
+
+	// === Present ===
+	xcb_special_event_t *present_event;
+	uint32_t present_eid;
+	xcb_window_t present_window;
+	uint32_t present_serial;
+};
+
+#ifdef CONFIG_VSYNC_DRM
+static int drm_wait_vblank(int fd) {
 	int ret = -1;
 	drm_wait_vblank_t vbl;
 
 	vbl.request.type = _DRM_VBLANK_RELATIVE, vbl.request.sequence = 1;
 
 	do {
-		ret = ioctl(ps->drm_fd, DRM_IOCTL_WAIT_VBLANK, &vbl);
+		ret = ioctl(fd, DRM_IOCTL_WAIT_VBLANK, &vbl);
 		vbl.request.type &= ~(uint)_DRM_VBLANK_RELATIVE;
 	} while (ret && errno == EINTR);
 
@@ -47,6 +99,16 @@ static int vsync_drm_wait(session_t *ps) {
 	return ret;
 }
 
+/**
+ * Wait for next VSync, DRM method.
+ *
+ * Stolen from:
+ * https://github.com/MythTV/mythtv/blob/master/mythtv/libs/libmythtv/vsync.cpp
+ */
+static int vsync_drm_wait(struct vsync *vs) {
+	return drm_wait_vblank(vs->drm_fd);
+}
+
 /**
  * Initialize DRM VSync.
  *
@@ -59,7 +121,7 @@ static bool vsync_drm_init(session_t *ps) {
 		return false;
 	}
 
-	if (vsync_drm_wait(ps))
+	if (drm_wait_vblank(ps->drm_fd))
 		return false;
 
 	return true;
@@ -76,17 +138,11 @@ static bool vsync_drm_init(session_t *ps) {
  *
  * @return true for success, false otherwise
  */
-static bool vsync_opengl_init(session_t *ps) {
-	if (!ensure_glx_context(ps))
-		return false;
-
+static bool vsync_opengl_init(session_t *ps attr_unused) {
 	return glxext.has_GLX_SGI_video_sync;
 }
 
-static bool vsync_opengl_oml_init(session_t *ps) {
-	if (!ensure_glx_context(ps))
-		return false;
-
+static bool vsync_opengl_oml_init(session_t *ps attr_unused) {
 	return glxext.has_GLX_OML_sync_control;
 }
 
@@ -124,7 +180,7 @@ static bool vsync_opengl_swc_init(session_t *ps) {
 /**
  * Wait for next VSync, OpenGL method.
  */
-static int vsync_opengl_wait(session_t *ps attr_unused) {
+static int vsync_opengl_wait(struct vsync *vs attr_unused) {
 	unsigned vblank_count = 0;
 
 	glXGetVideoSyncSGI(&vblank_count);
@@ -137,15 +193,248 @@ static int vsync_opengl_wait(session_t *ps attr_unused) {
  *
  * https://mail.gnome.org/archives/clutter-list/2012-November/msg00031.html
  */
-static int vsync_opengl_oml_wait(session_t *ps) {
+static int vsync_opengl_oml_wait(struct vsync *vs) {
 	int64_t ust = 0, msc = 0, sbc = 0;
 
-	glXGetSyncValuesOML(ps->dpy, ps->reg_win, &ust, &msc, &sbc);
-	glXWaitForMscOML(ps->dpy, ps->reg_win, 0, 2, (msc + 1) % 2, &ust, &msc, &sbc);
+	glXGetSyncValuesOML(vs->dpy, vs->drawable, &ust, &msc, &sbc);
+	glXWaitForMscOML(vs->dpy, vs->drawable, 0, 2, (msc + 1) % 2, &ust, &msc, &sbc);
 	return 0;
 }
+
+static void vsync_opengl_thread_deinit(struct vsync *vs) {
+	if (!vs->dpy) {
+		return;
+	}
+	if (vs->ctx) {
+		glXDestroyContext(vs->dpy, vs->ctx);
+		vs->ctx = NULL;
+	}
+	if (vs->pbuffer) {
+		glXDestroyPbuffer(vs->dpy, vs->pbuffer);
+		vs->pbuffer = None;
+	}
+	XCloseDisplay(vs->dpy);
+	vs->dpy = NULL;
+}
+
+/**
+ * Create the X connection and GLX context used by the helper thread.
+ *
+ * The context is made current on the helper thread when it starts.
+ */
+static bool vsync_opengl_thread_init(struct vsync *vs) {
+	session_t *ps = vs->ps;
+	vs->dpy = XOpenDisplay(DisplayString(ps->dpy));
+	if (!vs->dpy) {
+		log_error("Failed to open X connection for the vsync thread.");
+		return false;
+	}
+
+	int nconfigs = 0;
+	GLXFBConfig *cfgs = glXChooseFBConfig(
+	    vs->dpy, ps->scr,
+	    (int[]){GLX_DRAWABLE_TYPE, GLX_PBUFFER_BIT, GLX_RENDER_TYPE, GLX_RGBA_BIT, None},
+	    &nconfigs);
+	if (!cfgs || !nconfigs) {
+		log_error("No usable FBConfig for the vsync thread.");
+		goto err;
+	}
+
+	vs->pbuffer = glXCreatePbuffer(
+	    vs->dpy, cfgs[0], (int[]){GLX_PBUFFER_WIDTH, 1, GLX_PBUFFER_HEIGHT, 1, None});
+	vs->ctx = glXCreateNewContext(vs->dpy, cfgs[0], GLX_RGBA_TYPE, NULL, True);
+	XFree(cfgs);
+	if (!vs->pbuffer || !vs->ctx) {
+		log_error("Failed to create GLX context for the vsync thread.");
+		goto err;
+	}
+	vs->drawable = ps->reg_win;
+	return true;
+
+err:
+	vsync_opengl_thread_deinit(vs);
+	return false;
+}
 #endif
 
+static void *vsync_thread_main(void *arg) {
+	struct vsync *vs = arg;
+	// Loggers are thread local
+	log_init_tls();
+	log_set_level_tls(vs->log_level);
+	auto stderr_logger = stderr_logger_new();
+	if (stderr_logger) {
+		log_add_target_tls(stderr_logger);
+	}
+
+#ifdef CONFIG_OPENGL
+	if (vs->dpy && !glXMakeContextCurrent(vs->dpy, vs->pbuffer, vs->pbuffer, vs->ctx)) {
+		log_error("Failed to make GLX context current in the vsync thread.");
+	}
+#endif
+
+	pthread_mutex_lock(&vs->lock);
+	while (true) {
+		while (!vs->requested && !vs->quit) {
+			pthread_cond_wait(&vs->cond, &vs->lock);
+		}
+		if (vs->quit) {
+			break;
+		}
+		pthread_mutex_unlock(&vs->lock);
+
+		vs->wait(vs);
+
+		pthread_mutex_lock(&vs->lock);
+		vs->requested = false;
+		uint64_t one = 1;
+		if (write(vs->event_fd, &one, sizeof(one)) != sizeof(one)) {
+			log_error("Failed to signal vblank to the main loop: %s",
+			          strerror(errno));
+		}
+	}
+	pthread_mutex_unlock(&vs->lock);
+
+#ifdef CONFIG_OPENGL
+	if (vs->dpy) {
+		glXMakeContextCurrent(vs->dpy, None, None, NULL);
+	}
+#endif
+	log_deinit_tls();
+	return NULL;
+}
+
+static void vsync_event_fd_callback(EV_P attr_unused, ev_io *w, int revents attr_unused) {
+	struct vsync *vs = (void *)((char *)w - offsetof(struct vsync, event_io));
+	count_wakeup(vs->ps, WAKEUP_VBLANK);
+	uint64_t val;
+	if (read(vs->event_fd, &val, sizeof(val)) != sizeof(val)) {
+		return;
+	}
+	handle_vblank(vs->ps);
+}
+
+static bool vsync_thread_request(session_t *ps) {
+	struct vsync *vs = ps->vsync_data;
+	pthread_mutex_lock(&vs->lock);
+	vs->requested = true;
+	pthread_cond_signal(&vs->cond);
+	pthread_mutex_unlock(&vs->lock);
+	return true;
+}
+
+/**
+ * Start the helper thread that runs the blocking `wait` function.
+ */
+static bool vsync_thread_start(struct vsync *vs, int (*wait)(struct vsync *)) {
+	vs->kind = VSYNC_THREAD;
+	vs->wait = wait;
+	vs->log_level = log_get_level_tls();
+	vs->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (vs->event_fd < 0) {
+		log_error("Failed to create eventfd: %s", strerror(errno));
+		return false;
+	}
+
+	pthread_mutex_init(&vs->lock, NULL);
+	pthread_cond_init(&vs->cond, NULL);
+	if (pthread_create(&vs->thread, NULL, vsync_thread_main, vs) != 0) {
+		log_error("Failed to create the vsync thread.");
+		pthread_cond_destroy(&vs->cond);
+		pthread_mutex_destroy(&vs->lock);
+		close(vs->event_fd);
+		vs->event_fd = -1;
+		return false;
+	}
+
+	ev_io_init(&vs->event_io, vsync_event_fd_callback, vs->event_fd, EV_READ);
+	ev_io_start(vs->ps->loop, &vs->event_io);
+	vs->ps->vsync_request = vsync_thread_request;
+	return true;
+}
+
+static void vsync_thread_stop(struct vsync *vs) {
+	ev_io_stop(vs->ps->loop, &vs->event_io);
+
+	pthread_mutex_lock(&vs->lock);
+	vs->quit = true;
+	pthread_cond_signal(&vs->cond);
+	pthread_mutex_unlock(&vs->lock);
+	pthread_join(vs->thread, NULL);
+
+	pthread_cond_destroy(&vs->cond);
+	pthread_mutex_destroy(&vs->lock);
+	close(vs->event_fd);
+	vs->event_fd = -1;
+}
+
+static bool vsync_present_request(session_t *ps) {
+	struct vsync *vs = ps->vsync_data;
+	// With a non-zero divisor and a target MSC in the past, the notification is
+	// sent at the next MSC, i.e. the next vblank.
+	xcb_present_notify_msc(ps->c, vs->present_window, ++vs->present_serial, 0, 1, 0);
+	xcb_flush(ps->c);
+	return true;
+}
+
+/**
+ * Initialize Present MSC notifications for the legacy xrender backend.
+ */
+static bool vsync_present_init(struct vsync *vs) {
+	session_t *ps = vs->ps;
+	if (!ps->present_exists) {
+		return false;
+	}
+
+	vs->present_window = get_tgt_window(ps);
+	vs->present_eid = x_new_id(ps->c);
+	auto e = xcb_request_check(
+	    ps->c, xcb_present_select_input_checked(ps->c, vs->present_eid, vs->present_window,
+	                                            XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY));
+	if (e) {
+		log_error_x_error(e, "Cannot select present input");
+		free(e);
+		return false;
+	}
+
+	vs->present_event =
+	    xcb_register_for_special_xge(ps->c, &xcb_present_id, vs->present_eid, NULL);
+	if (!vs->present_event) {
+		log_error("Cannot register for special XGE");
+		xcb_present_select_input(ps->c, vs->present_eid, vs->present_window, 0);
+		return false;
+	}
+
+	vs->kind = VSYNC_PRESENT;
+	ps->vsync_request = vsync_present_request;
+	return true;
+}
+
+static void vsync_present_deinit(struct vsync *vs) {
+	xcb_present_select_input(vs->ps->c, vs->present_eid, vs->present_window, 0);
+	xcb_unregister_for_special_event(vs->ps->c, vs->present_event);
+	vs->present_event = NULL;
+}
+
+void vsync_handle_x_events(session_t *ps) {
+	struct vsync *vs = ps->vsync_data;
+	if (!vs || vs->kind != VSYNC_PRESENT) {
+		return;
+	}
+
+	xcb_present_generic_event_t *ev;
+	while ((ev = (void *)xcb_poll_for_special_event(ps->c, vs->present_event))) {
+		if (ev->evtype == XCB_PRESENT_COMPLETE_NOTIFY) {
+			auto cne = (xcb_present_complete_notify_event_t *)ev;
+			if (cne->kind == XCB_PRESENT_COMPLETE_KIND_NOTIFY_MSC &&
+			    cne->serial == vs->present_serial) {
+				handle_vblank(ps);
+			}
+		}
+		free(ev);
+	}
+}
+
 /**
  * Initialize current VSync method.
  */
@@ -169,36 +458,83 @@ bool vsync_init(session_t *ps) {
 		if (!vsync_opengl_swc_init(ps)) {
 			return false;
 		}
-		ps->vsync_wait = NULL;        // glXSwapBuffers will automatically wait
-		                              // for vsync, we don't need to do anything.
+		ps->vsync_request = NULL;        // glXSwapBuffers will automatically
+		                                 // wait for vsync, we don't need to do
+		                                 // anything.
 		return true;
 	}
 #endif
 
 	// Oh no, we are not using glx backend.
 	// Throwing things at wall.
+	auto vs = ccalloc(1, struct vsync);
+	vs->ps = ps;
+	vs->event_fd = -1;
+	ps->vsync_data = vs;
+
 #ifdef CONFIG_OPENGL
+	int (*gl_wait)(struct vsync *) = NULL;
+	const char *gl_method = NULL;
 	if (vsync_opengl_oml_init(ps)) {
-		log_info("Using the opengl-oml vsync method");
-		ps->vsync_wait = vsync_opengl_oml_wait;
-		return true;
+		gl_wait = vsync_opengl_oml_wait;
+		gl_method = "opengl-oml";
+	} else if (vsync_opengl_init(ps)) {
+		gl_wait = vsync_opengl_wait;
+		gl_method = "opengl";
 	}
-
-	if (vsync_opengl_init(ps)) {
-		log_info("Using the opengl vsync method");
-		ps->vsync_wait = vsync_opengl_wait;
-		return true;
+	if (gl_wait && vsync_opengl_thread_init(vs)) {
+		if (vsync_thread_start(vs, gl_wait)) {
+			log_info("Using the %s vsync method", gl_method);
+			return true;
+		}
+		vsync_opengl_thread_deinit(vs);
 	}
 #endif
 
 #ifdef CONFIG_VSYNC_DRM
 	if (vsync_drm_init(ps)) {
-		log_info("Using the drm vsync method");
-		ps->vsync_wait = vsync_drm_wait;
-		return true;
+		vs->drm_fd = ps->drm_fd;
+		if (vsync_thread_start(vs, vsync_drm_wait)) {
+			log_info("Using the drm vsync method");
+			return true;
+		}
 	}
 #endif
 
+	if (vsync_present_init(vs)) {
+		log_info("Using the present vsync method");
+		return true;
+	}
+
+	free(vs);
+	ps->vsync_data = NULL;
 	log_error("No supported vsync method found for this backend");
 	return false;
 }
+
+/**
+ * Stop the current VSync method, and free its resources.
+ */
+void vsync_deinit(session_t *ps) {
+	struct vsync *vs = ps->vsync_data;
+	if (!vs) {
+		return;
+	}
+
+	if (vs->kind == VSYNC_PRESENT) {
+		if (vs->present_event) {
+			vsync_present_deinit(vs);
+		}
+	} else if (vs->event_fd >= 0) {
+		vsync_thread_stop(vs);
+	}
+
+#ifdef CONFIG_OPENGL
+	vsync_opengl_thread_deinit(vs);
+#endif
+
+	free(vs);
+	ps->vsync_data = NULL;
+	ps->vsync_request = NULL;
+	ps->frame_pending = false;
+}
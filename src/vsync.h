@@ -5,3 +5,6 @@
 typedef struct session session_t;
 
 bool vsync_init(session_t *ps);
+void vsync_deinit(session_t *ps);
+/// Dispatch vblank notifications that were delivered through the X connection
+void vsync_handle_x_events(session_t *ps);
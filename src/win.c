@@ -24,13 +24,16 @@
 #include "list.h"
 #include "log.h"
 #include "picom.h"
+#include "probe.h"
 #include "region.h"
 #include "render.h"
+#include "shadow_cache.h"
 #include "string_utils.h"
 #include "types.h"
 #include "uthash_extra.h"
 #include "utils.h"
 #include "x.h"
+#include "x_worker.h"
 
 #ifdef CONFIG_DBUS
 #include "dbus.h"
@@ -237,12 +240,25 @@ void add_damage_from_win(session_t *ps, const struct managed_win *w) {
 	pixman_region32_fini(&extents);
 }
 
+/// Add the part of a window not covered by `reg_covered` to damaged area. A NULL
+/// `reg_covered` damages the whole window.
+void add_damage_from_win_visible(session_t *ps, const struct managed_win *w,
+                                 const region_t *reg_covered) {
+	auto extents = win_extents_by_val(w);
+	if (reg_covered) {
+		pixman_region32_subtract(&extents, &extents, (region_t *)reg_covered);
+	}
+	add_damage(ps, &extents);
+	pixman_region32_fini(&extents);
+}
+
 /// Release the images attached to this window
 static inline void win_release_pixmap(backend_t *base, struct managed_win *w) {
 	log_debug("Releasing pixmap of window %#010x (%s)", w->base.id, w->name);
 	assert(w->win_image);
 	if (w->win_image) {
 		base->ops->release_image(base, w->win_image);
+		PROBE(image_release, w->base.id);
 		w->win_image = NULL;
 		// Bypassing win_set_flags, because `w` might have been destroyed
 		w->flags |= WIN_FLAGS_PIXMAP_NONE;
@@ -278,6 +294,7 @@ static inline bool win_bind_pixmap(struct backend_base *b, struct managed_win *w
 		win_set_flags(w, WIN_FLAGS_IMAGE_ERROR);
 		return false;
 	}
+	PROBE(image_bind, w->base.id, pixmap);
 
 	win_clear_flags(w, WIN_FLAGS_PIXMAP_NONE);
 	return true;
@@ -303,6 +320,38 @@ bool win_bind_shadow(struct backend_base *b, struct managed_win *w, struct color
 	return true;
 }
 
+/// Estimated size of the shadow image of `w`, in bytes
+static size_t win_shadow_image_size(session_t *ps, const struct managed_win *w) {
+	return (size_t)(w->widthb + ps->gaussian_map->w) *
+	       (size_t)(w->heightb + ps->gaussian_map->h) * 4;
+}
+
+/// Hand the shadow image of `w` over to the shadow cache, instead of releasing it
+static void win_cache_shadow(session_t *ps, struct managed_win *w) {
+	log_debug("Caching shadow of window %#010x (%s)", w->base.id, w->name);
+	assert(w->shadow_image);
+	shadow_cache_put(ps->shadow_cache, ps->backend_data, w->shadow_image, w->widthb,
+	                 w->heightb, win_shadow_image_size(ps, w));
+	w->shadow_image = NULL;
+	w->flags |= WIN_FLAGS_SHADOW_NONE;
+}
+
+/// Reuse a cached shadow image for `w`, if there is one of the right size
+static bool win_bind_cached_shadow(session_t *ps, struct managed_win *w) {
+	assert(!w->shadow_image);
+	if (!ps->shadow_cache) {
+		return false;
+	}
+	w->shadow_image = shadow_cache_take(ps->shadow_cache, w->widthb, w->heightb);
+	if (!w->shadow_image) {
+		return false;
+	}
+
+	log_debug("Reusing cached shadow for %#010x (%s)", w->base.id, w->name);
+	win_clear_flags(w, WIN_FLAGS_SHADOW_NONE);
+	return true;
+}
+
 void win_release_images(struct backend_base *backend, struct managed_win *w) {
 	// We don't want to decide what we should do if the image we want to release is
 	// stale (do we clear the stale flags or not?)
@@ -321,6 +370,7 @@ void win_release_images(struct backend_base *backend, struct managed_win *w) {
 }
 
 void win_process_flags(session_t *ps, struct managed_win *w) {
+	PROBE(win_process_flags, w->base.id, w->flags);
 	if (win_check_flags_all(w, WIN_FLAGS_MAPPED)) {
 		map_win_start(ps, w);
 		win_clear_flags(w, WIN_FLAGS_MAPPED);
@@ -352,7 +402,7 @@ void win_process_flags(session_t *ps, struct managed_win *w) {
 			if (!win_check_flags_all(w, WIN_FLAGS_SHADOW_NONE)) {
 				win_release_shadow(ps->backend_data, w);
 			}
-			if (w->shadow) {
+			if (w->shadow && !win_bind_cached_shadow(ps, w)) {
 				win_bind_shadow(ps->backend_data, w,
 				                (struct color){.red = ps->o.shadow_red,
 				                               .green = ps->o.shadow_green,
@@ -414,6 +464,36 @@ static bool attr_pure win_has_rounded_corners(const struct managed_win *w) {
 	return false;
 }
 
+/// Set the name of a window, returns 1 if it changed, 0 otherwise.
+static int win_set_name(struct managed_win *w, const char *name) {
+	int ret = 0;
+	if (!w->name || strcmp(w->name, name) != 0) {
+		ret = 1;
+		free(w->name);
+		w->name = strdup(name);
+	}
+
+	log_trace("(%#010x): client = %#010x, name = \"%s\", "
+	          "ret = %d",
+	          w->base.id, w->client_win, w->name, ret);
+	return ret;
+}
+
+/// Set the role of a window, returns 1 if it changed, 0 otherwise.
+static int win_set_role(struct managed_win *w, const char *role) {
+	int ret = 0;
+	if (!w->role || strcmp(w->role, role) != 0) {
+		ret = 1;
+		free(w->role);
+		w->role = strdup(role);
+	}
+
+	log_trace("(%#010x): client = %#010x, role = \"%s\", "
+	          "ret = %d",
+	          w->base.id, w->client_win, w->role, ret);
+	return ret;
+}
+
 int win_update_name(session_t *ps, struct managed_win *w) {
 	XTextProperty text_prop = {NULL, XCB_NONE, 0, 0};
 	char **strlst = NULL;
@@ -439,18 +519,8 @@ int win_update_name(session_t *ps, struct managed_win *w) {
 		XFree(text_prop.value);
 	}
 
-	int ret = 0;
-	if (!w->name || strcmp(w->name, strlst[0]) != 0) {
-		ret = 1;
-		free(w->name);
-		w->name = strdup(strlst[0]);
-	}
-
+	int ret = win_set_name(w, strlst[0]);
 	XFreeStringList(strlst);
-
-	log_trace("(%#010x): client = %#010x, name = \"%s\", "
-	          "ret = %d",
-	          w->base.id, w->client_win, w->name, ret);
 	return ret;
 }
 
@@ -461,19 +531,59 @@ int win_get_role(session_t *ps, struct managed_win *w) {
 	if (!wid_get_text_prop(ps, w->client_win, ps->atoms->aWM_WINDOW_ROLE, &strlst, &nstr))
 		return -1;
 
-	int ret = 0;
-	if (!w->role || strcmp(w->role, strlst[0]) != 0) {
-		ret = 1;
-		free(w->role);
-		w->role = strdup(strlst[0]);
+	int ret = win_set_role(w, strlst[0]);
+	XFreeStringList(strlst);
+	return ret;
+}
+
+static void win_update_name_cb(session_t *ps, struct managed_win *w,
+                               const xcb_get_property_reply_t *r) {
+	char **strlst = NULL;
+	int nstr = 0;
+	if (!r || !x_text_prop_from_reply(ps, r, &strlst, &nstr)) {
+		return;
 	}
+	if (win_set_name(w, strlst[0]) == 1) {
+		win_on_factor_change(ps, w);
+	}
+	XFreeStringList(strlst);
+}
 
+static void win_update_role_cb(session_t *ps, struct managed_win *w,
+                               const xcb_get_property_reply_t *r) {
+	char **strlst = NULL;
+	int nstr = 0;
+	if (!r || !x_text_prop_from_reply(ps, r, &strlst, &nstr)) {
+		return;
+	}
+	if (win_set_role(w, strlst[0]) == 1) {
+		win_on_factor_change(ps, w);
+	}
 	XFreeStringList(strlst);
+}
 
-	log_trace("(%#010x): client = %#010x, role = \"%s\", "
-	          "ret = %d",
-	          w->base.id, w->client_win, w->role, ret);
-	return ret;
+void win_queue_update_name(session_t *ps, struct managed_win *w) {
+	if (!ps->x_worker || !w->client_win) {
+		if (win_update_name(ps, w) == 1) {
+			win_on_factor_change(ps, w);
+		}
+		return;
+	}
+	const xcb_atom_t atoms[] = {ps->atoms->a_NET_WM_NAME, ps->atoms->aWM_NAME};
+	x_worker_get_prop(ps->x_worker, w, w->client_win, atoms, (int)ARR_SIZE(atoms),
+	                  win_update_name_cb);
+}
+
+void win_queue_update_role(session_t *ps, struct managed_win *w) {
+	if (!ps->x_worker || !w->client_win) {
+		if (win_get_role(ps, w) == 1) {
+			win_on_factor_change(ps, w);
+		}
+		return;
+	}
+	const xcb_atom_t atoms[] = {ps->atoms->aWM_WINDOW_ROLE};
+	x_worker_get_prop(ps->x_worker, w, w->client_win, atoms, (int)ARR_SIZE(atoms),
+	                  win_update_role_cb);
 }
 
 /**
@@ -709,6 +819,7 @@ static void win_set_shadow(session_t *ps, struct managed_win *w, bool shadow_new
 
 	// Apply the shadow change
 	w->shadow = shadow_new;
+	win_update_index(ps, w);
 
 	// Add damage for shadow change
 
@@ -904,6 +1015,11 @@ void win_update_opacity_rule(session_t *ps, struct managed_win *w) {
  * TODO need better name
  */
 void win_on_factor_change(session_t *ps, struct managed_win *w) {
+	if (ps->defer_factor_change) {
+		win_set_flags(w, WIN_FLAGS_FACTOR_CHANGED);
+		return;
+	}
+
 	log_debug("Window %#010x (%s) factor change", w->base.id, w->name);
 	// Focus needs to be updated first, as other rules might depend on the focused
 	// state of the window
@@ -926,6 +1042,48 @@ void win_on_factor_change(session_t *ps, struct managed_win *w) {
 	w->reg_ignore_valid = false;
 }
 
+/**
+ * Run the factor changes deferred while ps->defer_factor_change was set.
+ *
+ * The rules are matched against all the affected windows at once, with
+ * c2_match_batch(), and the results are then applied one window at a time.
+ */
+void win_flush_factor_changes(session_t *ps) {
+	int n = 0;
+	win_stack_foreach_managed(w, &ps->window_stack) {
+		if (win_check_flags_all(w, WIN_FLAGS_FACTOR_CHANGED)) {
+			n++;
+		}
+	}
+	if (!n) {
+		return;
+	}
+
+	auto ws = ccalloc(n, struct managed_win *);
+	n = 0;
+	win_stack_foreach_managed(w, &ps->window_stack) {
+		if (win_check_flags_all(w, WIN_FLAGS_FACTOR_CHANGED)) {
+			ws[n++] = w;
+		}
+	}
+
+	// All the lists consulted by win_on_factor_change
+	const c2_lptr_t *lists[] = {
+	    ps->o.focus_blacklist,       ps->o.shadow_blacklist,
+	    ps->o.invert_color_list,     ps->o.blur_background_blacklist,
+	    ps->o.opacity_rules,         ps->o.paint_blacklist,
+	    ps->o.unredir_if_possible_blacklist,
+	};
+	c2_match_batch(ps, ws, n, lists, (int)ARR_SIZE(lists));
+
+	for (int i = 0; i < n; i++) {
+		win_clear_flags(ws[i], WIN_FLAGS_FACTOR_CHANGED);
+		win_on_factor_change(ps, ws[i]);
+		c2_match_batch_clear(ws[i]);
+	}
+	free(ws);
+}
+
 /**
  * Update cache data in struct _win that depends on window size.
  */
@@ -936,6 +1094,7 @@ void win_on_win_size_change(session_t *ps, struct managed_win *w) {
 	w->shadow_dy = ps->o.shadow_offset_y;
 	w->shadow_width = w->widthb + ps->o.shadow_radius * 2;
 	w->shadow_height = w->heightb + ps->o.shadow_radius * 2;
+	win_update_index(ps, w);
 
 	// Invalidate the shadow we built
 	if (w->state == WSTATE_MAPPED || w->state == WSTATE_MAPPING ||
@@ -981,6 +1140,7 @@ void win_update_wintype(session_t *ps, struct managed_win *w) {
  */
 void win_mark_client(session_t *ps, struct managed_win *w, xcb_window_t client) {
 	w->client_win = client;
+	w->generation = ++ps->next_win_generation;
 
 	// If the window isn't mapped yet, stop here, as the function will be
 	// called in map_win()
@@ -1036,6 +1196,7 @@ void win_unmark_client(session_t *ps, struct managed_win *w) {
 	          w->base.id, w->name);
 
 	w->client_win = XCB_NONE;
+	w->generation = ++ps->next_win_generation;
 
 	// Recheck event mask
 	xcb_change_window_attributes(
@@ -1186,6 +1347,7 @@ struct win *fill_win(session_t *ps, struct win *w) {
 	    // The following ones are updated during paint or paint preprocess
 	    .shadow_opacity = 0.0,
 	    .to_paint = false,
+	    .appearance_changed = false,
 	    .frame_opacity = 1.0,
 	    .dim = false,
 	    .invert_color = false,
@@ -1246,6 +1408,7 @@ struct win *fill_win(session_t *ps, struct win *w) {
 	    .rounded_corners = false,
 	    .paint_excluded = false,
 	    .unredir_if_possible_excluded = false,
+	    .unredirected = false,
 	    .prop_shadow = -1,
 	    // following 4 are set in win_mark_client
 	    .name = NULL,
@@ -1276,6 +1439,7 @@ struct win *fill_win(session_t *ps, struct win *w) {
 	}
 
 	log_debug("Managing window %#010x", w->id);
+	PROBE(fill_win, w->id);
 	xcb_get_window_attributes_cookie_t acookie = xcb_get_window_attributes(ps->c, w->id);
 	xcb_get_window_attributes_reply_t *a =
 	    xcb_get_window_attributes_reply(ps->c, acookie, NULL);
@@ -1307,6 +1471,7 @@ struct win *fill_win(session_t *ps, struct win *w) {
 	new->base = *w;
 	new->base.managed = true;
 	new->a = *a;
+	new->generation = ++ps->next_win_generation;
 	pixman_region32_init(&new->bounding_shape);
 
 	free(a);
@@ -1333,7 +1498,7 @@ struct win *fill_win(session_t *ps, struct win *w) {
 
 #ifdef CONFIG_DBUS
 	// Send D-Bus signal
-	if (ps->o.dbus) {
+	if (ps->dbus_data) {
 		cdbus_ev_win_added(ps, &new->base);
 	}
 #endif
@@ -1414,6 +1579,25 @@ static xcb_window_t win_get_leader_raw(session_t *ps, struct managed_win *w, int
 	return w->cache_leader;
 }
 
+/// Replace the class of a window with the first two strings of `strlst`. The class is
+/// cleared if `nstr` is 0.
+static void win_set_class(struct managed_win *w, char **strlst, int nstr) {
+	// Free and reset old strings
+	free(w->class_instance);
+	free(w->class_general);
+	w->class_instance = NULL;
+	w->class_general = NULL;
+
+	if (nstr > 0)
+		w->class_instance = strdup(strlst[0]);
+	if (nstr > 1)
+		w->class_general = strdup(strlst[1]);
+
+	log_trace("(%#010x): client = %#010x, "
+	          "instance = \"%s\", general = \"%s\"",
+	          w->base.id, w->client_win, w->class_instance, w->class_general);
+}
+
 /**
  * Retrieve the <code>WM_CLASS</code> of a window and update its
  * <code>win</code> structure.
@@ -1426,29 +1610,39 @@ bool win_get_class(session_t *ps, struct managed_win *w) {
 	if (!w->client_win)
 		return false;
 
-	// Free and reset old strings
-	free(w->class_instance);
-	free(w->class_general);
-	w->class_instance = NULL;
-	w->class_general = NULL;
-
 	// Retrieve the property string list
-	if (!wid_get_text_prop(ps, w->client_win, ps->atoms->aWM_CLASS, &strlst, &nstr))
+	if (!wid_get_text_prop(ps, w->client_win, ps->atoms->aWM_CLASS, &strlst, &nstr)) {
+		win_set_class(w, NULL, 0);
 		return false;
+	}
 
-	// Copy the strings if successful
-	w->class_instance = strdup(strlst[0]);
-
-	if (nstr > 1)
-		w->class_general = strdup(strlst[1]);
-
+	win_set_class(w, strlst, nstr);
 	XFreeStringList(strlst);
+	return true;
+}
 
-	log_trace("(%#010x): client = %#010x, "
-	          "instance = \"%s\", general = \"%s\"",
-	          w->base.id, w->client_win, w->class_instance, w->class_general);
+static void win_update_class_cb(session_t *ps, struct managed_win *w,
+                                const xcb_get_property_reply_t *r) {
+	char **strlst = NULL;
+	int nstr = 0;
+	if (r && x_text_prop_from_reply(ps, r, &strlst, &nstr)) {
+		win_set_class(w, strlst, nstr);
+		XFreeStringList(strlst);
+	} else {
+		win_set_class(w, NULL, 0);
+	}
+	win_on_factor_change(ps, w);
+}
 
-	return true;
+void win_queue_update_class(session_t *ps, struct managed_win *w) {
+	if (!ps->x_worker || !w->client_win) {
+		win_get_class(ps, w);
+		win_on_factor_change(ps, w);
+		return;
+	}
+	const xcb_atom_t atoms[] = {ps->atoms->aWM_CLASS};
+	x_worker_get_prop(ps->x_worker, w, w->client_win, atoms, (int)ARR_SIZE(atoms),
+	                  win_update_class_cb);
 }
 
 /**
@@ -1481,7 +1675,7 @@ static void win_on_focus_change(session_t *ps, struct managed_win *w) {
 
 #ifdef CONFIG_DBUS
 	// Send D-Bus signal
-	if (ps->o.dbus) {
+	if (ps->dbus_data) {
 		if (win_is_focused_raw(ps, w))
 			cdbus_ev_win_focusin(ps, &w->base);
 		else
@@ -1697,9 +1891,15 @@ static void unmap_win_finish(session_t *ps, struct managed_win *w) {
 	w->ever_damaged = false;
 	w->reg_ignore_valid = false;
 	w->state = WSTATE_UNMAPPED;
+	win_update_index(ps, w);
 
 	// We are in unmap_win, this window definitely was viewable
 	if (ps->backend_data) {
+		// The window pixmap has to be released, the next map gives the window a
+		// new one. But its shadow can be reused by the next window of this size.
+		if (ps->shadow_cache && !win_check_flags_all(w, WIN_FLAGS_SHADOW_NONE)) {
+			win_cache_shadow(ps, w);
+		}
 		win_release_images(ps->backend_data, w);
 	} else {
 		assert(!w->win_image);
@@ -1782,6 +1982,39 @@ static inline void restack_win(session_t *ps, struct win *w, struct list_node *n
 		mw = (struct managed_win *)w;
 	}
 
+	// The window only looks different where it overlaps the windows it moves past.
+	// Windows that were not painted are skipped, if they are painted now, their
+	// whole extents are damaged anyway.
+	region_t damage;
+	pixman_region32_init(&damage);
+	if (mw && mw->to_paint) {
+		// Windows passed are the ones between the old and the new position
+		struct list_node *passed_begin = w->stack_neighbour.next,
+		                 *passed_end = passed_begin;
+		while (passed_end != next && passed_end != &ps->window_stack) {
+			passed_end = passed_end->next;
+		}
+		if (passed_end != next) {
+			// `next` is above `w`, so `w` is moving up
+			passed_begin = next;
+			passed_end = &w->stack_neighbour;
+		}
+
+		auto extents = win_extents_by_val(mw);
+		for (auto i = passed_begin; i != passed_end; i = i->next) {
+			auto passed = list_entry(i, struct win, stack_neighbour);
+			auto passed_mw = (struct managed_win *)passed;
+			if (!passed->managed || !passed_mw->to_paint) {
+				continue;
+			}
+			auto overlap = win_extents_by_val(passed_mw);
+			pixman_region32_intersect(&overlap, &overlap, &extents);
+			pixman_region32_union(&damage, &damage, &overlap);
+			pixman_region32_fini(&overlap);
+		}
+		pixman_region32_fini(&extents);
+	}
+
 	if (mw) {
 		// This invalidates all reg_ignore below the new stack position of `w`
 		mw->reg_ignore_valid = false;
@@ -1797,10 +2030,8 @@ static inline void restack_win(session_t *ps, struct win *w, struct list_node *n
 
 	list_move_before(&w->stack_neighbour, next);
 
-	// add damage for this window
-	if (mw) {
-		add_damage_from_win(ps, mw);
-	}
+	add_damage(ps, &damage);
+	pixman_region32_fini(&damage);
 
 #ifdef DEBUG_RESTACK
 	log_trace("Window stack modified. Current stack:");
@@ -1876,6 +2107,11 @@ bool destroy_win_start(session_t *ps, struct win *w) {
 	// will be removed from the stack when it finishes destroying.
 	HASH_DEL(ps->windows, w);
 
+	if (w->managed) {
+		// Drop answers to queries still in flight for this window
+		mw->generation = ++ps->next_win_generation;
+	}
+
 	if (!w->managed || mw->state == WSTATE_UNMAPPED) {
 		// Window is already unmapped, or is an unmanged window, just destroy it
 		destroy_win_finish(ps, w);
@@ -1897,7 +2133,7 @@ bool destroy_win_start(session_t *ps, struct win *w) {
 	// don't need win_ev_stop because the window is gone anyway
 #ifdef CONFIG_DBUS
 	// Send D-Bus signal
-	if (ps->o.dbus) {
+	if (ps->dbus_data) {
 		cdbus_ev_win_destroyed(ps, w);
 	}
 #endif
@@ -1952,7 +2188,7 @@ void unmap_win_start(session_t *ps, struct managed_win *w) {
 
 #ifdef CONFIG_DBUS
 	// Send D-Bus signal
-	if (ps->o.dbus) {
+	if (ps->dbus_data) {
 		cdbus_ev_win_unmapped(ps, &w->base);
 	}
 #endif
@@ -2021,6 +2257,17 @@ void win_update_screen(session_t *ps, struct managed_win *w) {
 	}
 }
 
+void win_update_index(session_t *ps, struct managed_win *w) {
+	if (w->state == WSTATE_UNMAPPED) {
+		spatial_index_update(ps->spatial_index, &w->spatial_node, NULL);
+		return;
+	}
+	auto extents = win_extents_by_val(w);
+	spatial_index_update(ps->spatial_index, &w->spatial_node,
+	                     pixman_region32_extents(&extents));
+	pixman_region32_fini(&extents);
+}
+
 /// Map an already registered window
 void map_win_start(session_t *ps, struct managed_win *w) {
 	assert(ps->server_grabbed);
@@ -2110,28 +2357,37 @@ void map_win_start(session_t *ps, struct managed_win *w) {
 
 	// TODO can we just replace calls below with win_on_factor_change?
 
-	// Update window focus state
-	win_update_focused(ps, w);
-
 	// Update opacity and dim state
 	win_update_opacity_prop(ps, w);
 
 	// Check for _COMPTON_SHADOW
 	win_update_prop_shadow_raw(ps, w);
 
-	// Many things above could affect shadow
-	win_determine_shadow(ps, w);
+	if (ps->defer_factor_change) {
+		// Focus, shadow and blur are updated when the deferred factor change
+		// runs, together with the other new windows.
+		win_set_flags(w, WIN_FLAGS_FACTOR_CHANGED);
+	} else {
+		// Update window focus state
+		win_update_focused(ps, w);
+
+		// Many things above could affect shadow
+		win_determine_shadow(ps, w);
+	}
 
 	// XXX We need to make sure that win_data is available
 	// iff `state` is MAPPED
 	w->state = WSTATE_MAPPING;
+	win_update_index(ps, w);
 	w->opacity_target_old = 0;
 	w->opacity_target = win_calc_opacity_target(ps, w);
 
 	log_debug("Window %#010x has opacity %f, opacity target is %f", w->base.id,
 	          w->opacity, w->opacity_target);
 
-	win_determine_blur_background(ps, w);
+	if (!ps->defer_factor_change) {
+		win_determine_blur_background(ps, w);
+	}
 
 	// Cannot set w->ever_damaged = false here, since window mapping could be
 	// delayed, so a damage event might have already arrived before this function
@@ -2151,7 +2407,7 @@ void map_win_start(session_t *ps, struct managed_win *w) {
 
 #ifdef CONFIG_DBUS
 	// Send D-Bus signal
-	if (ps->o.dbus) {
+	if (ps->dbus_data) {
 		cdbus_ev_win_mapped(ps, &w->base);
 	}
 #endif
@@ -2380,6 +2636,49 @@ bool win_is_fullscreen(const session_t *ps, const struct managed_win *w) {
 	       (!w->bounding_shaped || w->rounded_corners);
 }
 
+bool win_is_fullscreen_on_screen(const session_t *ps, const struct managed_win *w) {
+	// xinerama_scr could be stale if the screens changed since the window was mapped
+	if (w->xinerama_scr < 0 || w->xinerama_scr >= ps->xinerama_nscrs) {
+		return false;
+	}
+	auto e = pixman_region32_extents(&ps->xinerama_scr_regs[w->xinerama_scr]);
+	return e->x1 == w->g.x && e->y1 == w->g.y && e->x2 == w->g.x + w->widthb &&
+	       e->y2 == w->g.y + w->heightb && (!w->bounding_shaped || w->rounded_corners);
+}
+
+void win_set_unredirected(session_t *ps, struct managed_win *w, bool unredirected) {
+	if (w->unredirected == unredirected) {
+		return;
+	}
+	log_debug("%s window %#010x (%s)", unredirected ? "Unredirecting" : "Redirecting",
+	          w->base.id, w->name);
+	w->unredirected = unredirected;
+
+	if (w->state == WSTATE_DESTROYING) {
+		// The X window is gone, together with its redirection state
+		return;
+	}
+
+	// BadWindow/BadValue may be thrown if the window is destroyed
+	if (unredirected) {
+		set_ignore_cookie(ps, xcb_composite_unredirect_window(
+		                          ps->c, w->base.id, XCB_COMPOSITE_REDIRECT_MANUAL));
+		return;
+	}
+	set_ignore_cookie(ps, xcb_composite_redirect_window(ps->c, w->base.id,
+	                                                   XCB_COMPOSITE_REDIRECT_MANUAL));
+
+	// The window got a new pixmap when it was redirected again, the one we hold
+	// stopped receiving updates while the window was unredirected.
+	free_paint(ps, &w->paint);
+	if (w->state == WSTATE_MAPPED || w->state == WSTATE_MAPPING ||
+	    w->state == WSTATE_FADING) {
+		win_set_flags(w, WIN_FLAGS_PIXMAP_STALE);
+		ps->pending_updates = true;
+	}
+	add_damage_from_win(ps, w);
+}
+
 /**
  * Check if a window has BYPASS_COMPOSITOR property set
  *
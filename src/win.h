@@ -19,6 +19,7 @@
 #include "list.h"
 #include "region.h"
 #include "render.h"
+#include "spatial.h"
 #include "types.h"
 #include "utils.h"
 #include "win_defs.h"
@@ -99,6 +100,9 @@ struct managed_win {
 	struct managed_win *prev_trans;
 	/// Number of windows above this window
 	int stacking_rank;
+	/// Entry in ps->spatial_index, under the extents of the window. Windows are
+	/// indexed unless they are unmapped.
+	struct spatial_node spatial_node;
 	// TODO rethink reg_ignore
 
 	// Core members
@@ -150,16 +154,28 @@ struct managed_win {
 	bool rounded_corners;
 	/// Whether this window is to be painted.
 	bool to_paint;
+	/// Whether the opacity or dimming of the window changed during this paint
+	/// preprocess, so its visible part has to be damaged.
+	bool appearance_changed;
 	/// Whether the window is painting excluded.
 	bool paint_excluded;
 	/// Whether the window is unredirect-if-possible excluded.
 	bool unredir_if_possible_excluded;
+	/// Whether the window has been unredirected on its own, while the rest of the
+	/// screen stays redirected. See --unredir-per-monitor.
+	bool unredirected;
 	/// Whether this window is in open/close state.
 	bool in_openclose;
+	/// Results of matching the window against the rules in a batch, only set while
+	/// a batch is being applied. See c2_match_batch().
+	struct c2_result *c2_results;
 
 	// Client window related members
 	/// ID of the top-level client window of the window.
 	xcb_window_t client_win;
+	/// Changed whenever the client window changes, or the window is destroyed.
+	/// Asynchronous queries made for an older generation are dropped.
+	uint64_t generation;
 	/// Type of the window.
 	wintype_t window_type;
 	/// Whether it looks like a WM window. We consider a window WM window if
@@ -291,6 +307,7 @@ void win_update_prop_shadow_raw(session_t *ps, struct managed_win *w);
 void win_update_prop_shadow(session_t *ps, struct managed_win *w);
 void win_update_opacity_target(session_t *ps, struct managed_win *w);
 void win_on_factor_change(session_t *ps, struct managed_win *w);
+void win_flush_factor_changes(session_t *ps);
 /**
  * Update cache data in struct _win that depends on window size.
  */
@@ -300,6 +317,12 @@ void win_mark_client(session_t *ps, struct managed_win *w, xcb_window_t client);
 void win_unmark_client(session_t *ps, struct managed_win *w);
 void win_recheck_client(session_t *ps, struct managed_win *w);
 bool win_get_class(session_t *ps, struct managed_win *w);
+/// Update the name, class or role of a window, calling win_on_factor_change() if it
+/// changed. The property is fetched on the X worker thread if there is one, so the
+/// update happens later.
+void win_queue_update_name(session_t *ps, struct managed_win *w);
+void win_queue_update_class(session_t *ps, struct managed_win *w);
+void win_queue_update_role(session_t *ps, struct managed_win *w);
 
 /**
  * Calculate and return the opacity target of a window.
@@ -317,6 +340,9 @@ bool win_get_class(session_t *ps, struct managed_win *w);
 double attr_pure win_calc_opacity_target(session_t *ps, const struct managed_win *w);
 bool attr_pure win_should_dim(session_t *ps, const struct managed_win *w);
 void win_update_screen(session_t *, struct managed_win *);
+/// Index the window under its current extents in ps->spatial_index, or remove it
+/// from the index if it is unmapped. Must be called whenever the extents change.
+void win_update_index(session_t *ps, struct managed_win *w);
 /**
  * Reread opacity property of a window.
  */
@@ -350,6 +376,8 @@ region_t win_extents_by_val(const struct managed_win *w);
  * @param w struct _win element representing the window
  */
 void add_damage_from_win(session_t *ps, const struct managed_win *w);
+void add_damage_from_win_visible(session_t *ps, const struct managed_win *w,
+                                 const region_t *reg_covered);
 /**
  * Get a rectangular region a window occupies, excluding frame and shadow.
  *
@@ -415,6 +443,15 @@ struct managed_win *find_managed_window_or_parent(session_t *ps, xcb_window_t wi
  */
 bool attr_pure win_is_fullscreen(const session_t *ps, const struct managed_win *w);
 
+/**
+ * Check if a window exactly covers the Xinerama screen it is on.
+ */
+bool attr_pure win_is_fullscreen_on_screen(const session_t *ps, const struct managed_win *w);
+
+/// Unredirect a single window, or redirect it back. The window is then drawn by the X
+/// server directly, and its pixmap must be rebound once it is redirected again.
+void win_set_unredirected(session_t *ps, struct managed_win *w, bool unredirected);
+
 /**
  * Check if a window is focused, without using any focus rules or forced focus settings
  */
@@ -85,6 +85,8 @@ enum win_flags {
 	WIN_FLAGS_CLIENT_STALE = 32,
 	/// the window is mapped by X, we need to call map_win_start for it
 	WIN_FLAGS_MAPPED = 64,
+	/// win_on_factor_change was deferred, will be run by win_flush_factor_changes
+	WIN_FLAGS_FACTOR_CHANGED = 128,
 };
 
 static const uint64_t WIN_FLAGS_IMAGES_STALE =
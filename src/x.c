@@ -2,6 +2,7 @@
 // Copyright (c) 2018 Yuxuan Shui <yshuiv7@gmail.com>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <X11/Xutil.h>
 #include <pixman.h>
@@ -43,11 +44,18 @@
  */
 winprop_t x_get_prop_with_offset(const session_t *ps, xcb_window_t w, xcb_atom_t atom,
                                  int offset, int length, xcb_atom_t rtype, int rformat) {
-	xcb_get_property_reply_t *r = xcb_get_property_reply(
-	    ps->c,
-	    xcb_get_property(ps->c, 0, w, atom, rtype, to_u32_checked(offset),
-	                     to_u32_checked(length)),
-	    NULL);
+	x_round_trips++;
+	return x_get_prop_reply(ps,
+	                        xcb_get_property(ps->c, 0, w, atom, rtype,
+	                                         to_u32_checked(offset), to_u32_checked(length)),
+	                        rtype, rformat);
+}
+
+uint64_t x_round_trips = 0;
+
+winprop_t x_get_prop_reply(const session_t *ps, xcb_get_property_cookie_t cookie,
+                           xcb_atom_t rtype, int rformat) {
+	xcb_get_property_reply_t *r = xcb_get_property_reply(ps->c, cookie, NULL);
 
 	if (r && xcb_get_property_value_length(r) &&
 	    (rtype == XCB_GET_PROPERTY_TYPE_ANY || r->type == rtype) &&
@@ -111,6 +119,37 @@ bool wid_get_text_prop(session_t *ps, xcb_window_t wid, xcb_atom_t prop, char **
 	return true;
 }
 
+bool x_text_prop_from_reply(session_t *ps, const xcb_get_property_reply_t *r,
+                            char ***pstrlst, int *pnstr) {
+	int len = xcb_get_property_value_length(r);
+	if (!len || (r->format != 8 && r->format != 16 && r->format != 32)) {
+		return false;
+	}
+
+	// Xlib expects the value to be null terminated, like XGetTextProperty does
+	auto value = ccalloc(len + 1, unsigned char);
+	memcpy(value, xcb_get_property_value(r), (size_t)len);
+	XTextProperty text_prop = {
+	    .value = value,
+	    .encoding = r->type,
+	    .format = r->format,
+	    .nitems = (unsigned long)(len / (r->format / 8)),
+	};
+
+	*pstrlst = NULL;
+	bool ret = true;
+	if (Success != XmbTextPropertyToTextList(ps->dpy, &text_prop, pstrlst, pnstr) ||
+	    !*pnstr) {
+		*pnstr = 0;
+		if (*pstrlst)
+			XFreeStringList(*pstrlst);
+		ret = false;
+	}
+
+	free(value);
+	return ret;
+}
+
 // A cache of pict formats. We assume they don't change during the lifetime
 // of this program
 static thread_local xcb_render_query_pict_formats_reply_t *g_pictfmts = NULL;
@@ -331,10 +370,8 @@ enum { XSyncBadCounter = 0,
  * @return a pointer to a string. this pointer shouldn NOT be freed, same buffer is used
  *         for multiple calls to this function,
  */
-static const char *
-_x_strerror(unsigned long serial, uint8_t major, uint16_t minor, uint8_t error_code) {
-	session_t *const ps = ps_g;
-
+static const char *_x_strerror(const session_t *ps, unsigned long serial, uint8_t major,
+                               uint16_t minor, uint8_t error_code) {
 	int o = 0;
 	const char *name = "Unknown";
 
@@ -420,11 +457,127 @@ _x_strerror(unsigned long serial, uint8_t major, uint16_t minor, uint8_t error_c
 	return buffer;
 }
 
-/**
- * Log a X11 error
- */
-void x_print_error(unsigned long serial, uint8_t major, uint16_t minor, uint8_t error_code) {
-	log_debug("%s", _x_strerror(serial, major, minor, error_code));
+/// Kinds of X errors, each with its own limit on how many are logged individually
+/// per period.
+enum x_error_class {
+	/// The resource a request refers to is gone. These are expected, since clients
+	/// can destroy their windows at any time, and come in bursts.
+	X_ERROR_CLASS_GONE,
+	X_ERROR_CLASS_OTHER,
+	NUM_X_ERROR_CLASSES,
+};
+
+static const unsigned int x_error_class_limits[NUM_X_ERROR_CLASSES] = {
+    [X_ERROR_CLASS_GONE] = 1,
+    [X_ERROR_CLASS_OTHER] = 10,
+};
+
+/// X errors of one kind reported from one place, since the last x_flush_errors()
+struct x_error_record {
+	const char *func;
+	uint8_t major;
+	uint16_t minor;
+	uint8_t error_code;
+	unsigned long last_serial;
+	/// Number of errors reported
+	unsigned int count;
+	/// Number of errors logged individually
+	unsigned int logged;
+};
+
+#define X_ERROR_MAX_RECORDS 32
+
+// Only used from the main thread, like x_round_trips. Errors on the connections of
+// other threads are not reported here, see xerror().
+static struct x_error_record x_error_records[X_ERROR_MAX_RECORDS];
+static int x_nerror_records = 0;
+/// Errors not recorded because there were too many different ones
+static unsigned int x_errors_unrecorded = 0;
+/// Errors logged individually in each class
+static unsigned int x_errors_logged[NUM_X_ERROR_CLASSES];
+
+static enum x_error_class x_error_classify(const session_t *ps, uint8_t error_code) {
+	switch (error_code) {
+	case XCB_WINDOW:
+	case XCB_PIXMAP:
+	case XCB_DRAWABLE: return X_ERROR_CLASS_GONE;
+	}
+	if (error_code == ps->damage_error + XCB_DAMAGE_BAD_DAMAGE ||
+	    error_code == ps->render_error + XCB_RENDER_PICTURE ||
+	    error_code == ps->xfixes_error + XCB_XFIXES_BAD_REGION) {
+		return X_ERROR_CLASS_GONE;
+	}
+	if (ps->glx_exists && (error_code == ps->glx_error + XCB_GLX_BAD_DRAWABLE ||
+	                       error_code == ps->glx_error + XCB_GLX_BAD_PIXMAP ||
+	                       error_code == ps->glx_error + XCB_GLX_BAD_WINDOW)) {
+		return X_ERROR_CLASS_GONE;
+	}
+	return X_ERROR_CLASS_OTHER;
+}
+
+void x_print_error_(const session_t *ps, const char *func, unsigned long serial,
+                    uint8_t major, uint16_t minor, uint8_t error_code) {
+	struct x_error_record *record = NULL;
+	for (int i = 0; i < x_nerror_records; i++) {
+		auto r = &x_error_records[i];
+		if (r->func == func && r->major == major && r->minor == minor &&
+		    r->error_code == error_code) {
+			record = r;
+			break;
+		}
+	}
+	if (!record) {
+		if (x_nerror_records == X_ERROR_MAX_RECORDS) {
+			x_errors_unrecorded++;
+			return;
+		}
+		record = &x_error_records[x_nerror_records++];
+		*record = (struct x_error_record){
+		    .func = func,
+		    .major = major,
+		    .minor = minor,
+		    .error_code = error_code,
+		};
+	}
+	record->count++;
+	record->last_serial = serial;
+
+	auto error_class = x_error_classify(ps, error_code);
+	if (x_errors_logged[error_class] >= x_error_class_limits[error_class]) {
+		return;
+	}
+	x_errors_logged[error_class]++;
+	record->logged++;
+	if (LOG_LEVEL_DEBUG >= log_get_level_tls()) {
+		log_printf(tls_logger, LOG_LEVEL_DEBUG, func, "%s",
+		           _x_strerror(ps, serial, major, minor, error_code));
+	}
+}
+
+bool x_has_unflushed_errors(void) {
+	return x_nerror_records > 0 || x_errors_unrecorded > 0;
+}
+
+void x_flush_errors(const session_t *ps) {
+	if (LOG_LEVEL_DEBUG >= log_get_level_tls()) {
+		for (int i = 0; i < x_nerror_records; i++) {
+			auto r = &x_error_records[i];
+			if (r->count == r->logged) {
+				continue;
+			}
+			log_printf(tls_logger, LOG_LEVEL_DEBUG, r->func,
+			           "%s, %u more times since the last report",
+			           _x_strerror(ps, r->last_serial, r->major, r->minor,
+			                       r->error_code),
+			           r->count - r->logged);
+		}
+		if (x_errors_unrecorded) {
+			log_debug("%u other X errors since the last report", x_errors_unrecorded);
+		}
+	}
+	x_nerror_records = 0;
+	x_errors_unrecorded = 0;
+	memset(x_errors_logged, 0, sizeof(x_errors_logged));
 }
 
 /*
@@ -437,7 +590,8 @@ const char *x_strerror(xcb_generic_error_t *e) {
 	if (!e) {
 		return "No error";
 	}
-	return _x_strerror(e->full_sequence, e->major_code, e->minor_code, e->error_code);
+	return _x_strerror(ps_g, e->full_sequence, e->major_code, e->minor_code,
+	                   e->error_code);
 }
 
 /**
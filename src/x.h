@@ -48,26 +48,34 @@ struct xvisual_info {
 	xcb_visualid_t visual;
 };
 
-#define XCB_AWAIT_VOID(func, c, ...)                                                     \
+/// Number of blocking round trips made to the X server through the helpers here.
+/// Only updated from the main thread.
+extern uint64_t x_round_trips;
+
+#define XCB_AWAIT_VOID(func, ps, ...)                                                    \
 	({                                                                               \
 		bool __success = true;                                                   \
-		__auto_type __e = xcb_request_check(c, func##_checked(c, __VA_ARGS__));  \
+		x_round_trips++;                                                         \
+		__auto_type __e =                                                        \
+		    xcb_request_check((ps)->c, func##_checked((ps)->c, __VA_ARGS__));    \
 		if (__e) {                                                               \
-			x_print_error(__e->sequence, __e->major_code, __e->minor_code,   \
-			              __e->error_code);                                  \
+			x_print_error(ps, __e->sequence, __e->major_code,                \
+			              __e->minor_code, __e->error_code);                 \
 			free(__e);                                                       \
 			__success = false;                                               \
 		}                                                                        \
 		__success;                                                               \
 	})
 
-#define XCB_AWAIT(func, c, ...)                                                          \
+#define XCB_AWAIT(func, ps, ...)                                                         \
 	({                                                                               \
 		xcb_generic_error_t *__e = NULL;                                         \
-		__auto_type __r = func##_reply(c, func(c, __VA_ARGS__), &__e);           \
+		x_round_trips++;                                                         \
+		__auto_type __r =                                                        \
+		    func##_reply((ps)->c, func((ps)->c, __VA_ARGS__), &__e);             \
 		if (__e) {                                                               \
-			x_print_error(__e->sequence, __e->major_code, __e->minor_code,   \
-			              __e->error_code);                                  \
+			x_print_error(ps, __e->sequence, __e->major_code,                \
+			              __e->minor_code, __e->error_code);                 \
 			free(__e);                                                       \
 		}                                                                        \
 		__r;                                                                     \
@@ -98,6 +106,7 @@ static inline uint32_t x_new_id(xcb_connection_t *c) {
  * libX11
  */
 static inline void x_sync(xcb_connection_t *c) {
+	x_round_trips++;
 	free(xcb_get_input_focus_reply(c, xcb_get_input_focus(c), NULL));
 }
 
@@ -119,6 +128,14 @@ static inline void x_sync(xcb_connection_t *c) {
 winprop_t x_get_prop_with_offset(const session_t *ps, xcb_window_t w, xcb_atom_t atom,
                                  int offset, int length, xcb_atom_t rtype, int rformat);
 
+/**
+ * Wait for the reply of a property request sent earlier, and check it the same way
+ * x_get_prop_with_offset() does. Used to pipeline property requests, so it doesn't
+ * count a round trip, the caller counts one for each batch of requests.
+ */
+winprop_t x_get_prop_reply(const session_t *ps, xcb_get_property_cookie_t cookie,
+                           xcb_atom_t rtype, int rformat);
+
 /**
  * Wrapper of wid_get_prop_adv().
  */
@@ -149,6 +166,13 @@ xcb_window_t wid_get_prop_window(session_t *ps, xcb_window_t wid, xcb_atom_t apr
 bool wid_get_text_prop(session_t *ps, xcb_window_t wid, xcb_atom_t prop, char ***pstrlst,
                        int *pnstr);
 
+/**
+ * Convert the reply of a text property request to a list of strings, like
+ * wid_get_text_prop() does. Doesn't free the reply.
+ */
+bool x_text_prop_from_reply(session_t *ps, const xcb_get_property_reply_t *r,
+                            char ***pstrlst, int *pnstr);
+
 const xcb_render_pictforminfo_t *
 x_get_pictform_for_visual(xcb_connection_t *, xcb_visualid_t);
 int x_get_visual_depth(xcb_connection_t *, xcb_visualid_t);
@@ -196,9 +220,24 @@ void x_set_picture_clip_region(xcb_connection_t *, xcb_render_picture_t, int16_t
 void x_clear_picture_clip_region(xcb_connection_t *, xcb_render_picture_t pict);
 
 /**
- * Log a X11 error
+ * Log a X11 error, reported from `func`.
+ *
+ * Errors are aggregated by kind and by where they were reported. Only the first few
+ * of each class are logged individually, the others are counted, and the counts are
+ * logged by x_flush_errors(). This keeps error storms, e.g. from a client destroying
+ * many windows at once, cheap.
  */
-void x_print_error(unsigned long serial, uint8_t major, uint16_t minor, uint8_t error_code);
+void x_print_error_(const session_t *ps, const char *func, unsigned long serial,
+                    uint8_t major, uint16_t minor, uint8_t error_code);
+#define x_print_error(ps, serial, major, minor, error_code)                              \
+	x_print_error_(ps, __func__, serial, major, minor, error_code)
+
+/// Whether there are X errors not yet reported by x_flush_errors()
+bool x_has_unflushed_errors(void);
+
+/// Log the number of X errors not logged individually, and reset the rate limits.
+/// Should be called periodically while x_has_unflushed_errors() is true.
+void x_flush_errors(const session_t *ps);
 
 /*
  * Convert a xcb_generic_error_t to a string that describes the error
@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+
+/// Read-only X queries on a secondary connection.
+///
+/// A worker thread owns its own X connection, so waiting for the replies never blocks
+/// event processing on the main connection. Queries queued together are pipelined.
+/// Answers are handed back to the main loop through an ev_async, tagged with the
+/// generation of the window they were made for, and dropped if the window changed in
+/// the meantime.
+///
+/// The worker thread has no logger, so it doesn't log anything.
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <xcb/xcb.h>
+
+#include <ev.h>
+
+#include "common.h"
+#include "list.h"
+#include "log.h"
+#include "utils.h"
+#include "win.h"
+#include "x_worker.h"
+
+/// Longest property value fetched, in 32-bit units
+#define X_WORKER_MAX_PROP_LENGTH 0x10000
+
+struct x_worker_query {
+	/// The window the query is made for, and its generation at the time
+	xcb_window_t owner;
+	uint64_t generation;
+
+	/// The window to query
+	xcb_window_t wid;
+	xcb_atom_t atoms[X_WORKER_MAX_ATOMS];
+	int natoms;
+	x_worker_prop_cb_t cb;
+
+	/// Filled in by the worker thread
+	xcb_get_property_reply_t *reply;
+};
+
+/// A list of queries, either waiting for the worker or waiting for the main loop.
+struct x_worker_queue {
+	struct x_worker_query *queries;
+	int nqueries;
+	int capacity;
+};
+
+struct x_worker {
+	session_t *ps;
+	xcb_connection_t *c;
+	pthread_t thread;
+
+	/// Protects everything below
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	/// Queries not yet picked up by the worker thread
+	struct x_worker_queue pending;
+	/// Answered queries not yet handed to their callbacks
+	struct x_worker_queue done;
+	bool quit;
+
+	/// Wakes up the main loop when queries are answered
+	ev_async answered;
+};
+
+static void x_worker_queue_push(struct x_worker_queue *q, const struct x_worker_query *query) {
+	if (q->nqueries == q->capacity) {
+		q->capacity = q->capacity ? q->capacity * 2 : 8;
+		q->queries = crealloc(q->queries, q->capacity);
+	}
+	q->queries[q->nqueries++] = *query;
+}
+
+/// Append all queries in `from` to `to`, leaving `from` empty
+static void x_worker_queue_move(struct x_worker_queue *to, struct x_worker_queue *from) {
+	for (int i = 0; i < from->nqueries; i++) {
+		x_worker_queue_push(to, &from->queries[i]);
+	}
+	from->nqueries = 0;
+}
+
+static void x_worker_queue_free(struct x_worker_queue *q) {
+	for (int i = 0; i < q->nqueries; i++) {
+		free(q->queries[i].reply);
+	}
+	free(q->queries);
+	*q = (struct x_worker_queue){0};
+}
+
+/// Answer a batch of queries. All requests are sent before waiting for any reply.
+static void x_worker_answer(xcb_connection_t *c, struct x_worker_queue *batch) {
+	auto cookies = ccalloc(batch->nqueries * X_WORKER_MAX_ATOMS, xcb_get_property_cookie_t);
+	for (int i = 0; i < batch->nqueries; i++) {
+		auto query = &batch->queries[i];
+		for (int j = 0; j < query->natoms; j++) {
+			cookies[i * X_WORKER_MAX_ATOMS + j] = xcb_get_property(
+			    c, 0, query->wid, query->atoms[j], XCB_GET_PROPERTY_TYPE_ANY, 0,
+			    X_WORKER_MAX_PROP_LENGTH);
+		}
+	}
+	xcb_flush(c);
+
+	for (int i = 0; i < batch->nqueries; i++) {
+		auto query = &batch->queries[i];
+		for (int j = 0; j < query->natoms; j++) {
+			// Errors, e.g. for windows destroyed in the meantime, are
+			// returned here and just mean the property is not set.
+			auto r = xcb_get_property_reply(
+			    c, cookies[i * X_WORKER_MAX_ATOMS + j], NULL);
+			if (!query->reply && r && xcb_get_property_value_length(r)) {
+				query->reply = r;
+			} else {
+				free(r);
+			}
+		}
+	}
+	free(cookies);
+}
+
+static void *x_worker_main(void *arg) {
+	struct x_worker *xw = arg;
+	struct x_worker_queue batch = {0};
+
+	pthread_mutex_lock(&xw->lock);
+	while (true) {
+		while (!xw->quit && xw->pending.nqueries == 0) {
+			pthread_cond_wait(&xw->cond, &xw->lock);
+		}
+		if (xw->quit) {
+			break;
+		}
+
+		// Swap the pending queue with our empty one, so the main thread can
+		// keep queueing while we wait for the replies.
+		struct x_worker_queue tmp = xw->pending;
+		xw->pending = batch;
+		batch = tmp;
+		pthread_mutex_unlock(&xw->lock);
+
+		x_worker_answer(xw->c, &batch);
+
+		pthread_mutex_lock(&xw->lock);
+		x_worker_queue_move(&xw->done, &batch);
+		ev_async_send(xw->ps->loop, &xw->answered);
+	}
+	pthread_mutex_unlock(&xw->lock);
+
+	x_worker_queue_free(&batch);
+	return NULL;
+}
+
+static void x_worker_answered_callback(EV_P attr_unused, ev_async *w, int revents attr_unused) {
+	auto xw = container_of(w, struct x_worker, answered);
+	auto ps = xw->ps;
+	count_wakeup(ps, WAKEUP_X_WORKER);
+
+	pthread_mutex_lock(&xw->lock);
+	struct x_worker_queue done = xw->done;
+	xw->done = (struct x_worker_queue){0};
+	pthread_mutex_unlock(&xw->lock);
+
+	for (int i = 0; i < done.nqueries; i++) {
+		auto query = &done.queries[i];
+		auto mw = find_managed_win(ps, query->owner);
+		if (!mw || mw->generation != query->generation) {
+			log_trace("Dropping stale answer for window %#010x", query->owner);
+			continue;
+		}
+		query->cb(ps, mw, query->reply);
+	}
+	x_worker_queue_free(&done);
+}
+
+struct x_worker *x_worker_new(session_t *ps, const char *display) {
+	auto c = xcb_connect(display, NULL);
+	if (xcb_connection_has_error(c)) {
+		log_warn("Failed to open the secondary X connection, slow X queries will "
+		         "block the main loop.");
+		xcb_disconnect(c);
+		return NULL;
+	}
+
+	auto xw = ccalloc(1, struct x_worker);
+	xw->ps = ps;
+	xw->c = c;
+	pthread_mutex_init(&xw->lock, NULL);
+	pthread_cond_init(&xw->cond, NULL);
+	ev_async_init(&xw->answered, x_worker_answered_callback);
+	ev_async_start(ps->loop, &xw->answered);
+
+	if (pthread_create(&xw->thread, NULL, x_worker_main, xw) != 0) {
+		log_warn("Failed to start the X worker thread, slow X queries will block "
+		         "the main loop.");
+		ev_async_stop(ps->loop, &xw->answered);
+		pthread_cond_destroy(&xw->cond);
+		pthread_mutex_destroy(&xw->lock);
+		xcb_disconnect(c);
+		free(xw);
+		return NULL;
+	}
+	return xw;
+}
+
+bool x_worker_get_prop(struct x_worker *xw, const struct managed_win *w, xcb_window_t wid,
+                       const xcb_atom_t *atoms, int natoms, x_worker_prop_cb_t cb) {
+	assert(natoms > 0 && natoms <= X_WORKER_MAX_ATOMS);
+	struct x_worker_query query = {
+	    .owner = w->base.id,
+	    .generation = w->generation,
+	    .wid = wid,
+	    .natoms = natoms,
+	    .cb = cb,
+	};
+	memcpy(query.atoms, atoms, sizeof(xcb_atom_t) * (size_t)natoms);
+
+	pthread_mutex_lock(&xw->lock);
+	x_worker_queue_push(&xw->pending, &query);
+	pthread_cond_signal(&xw->cond);
+	pthread_mutex_unlock(&xw->lock);
+	return true;
+}
+
+void x_worker_destroy(struct x_worker *xw) {
+	pthread_mutex_lock(&xw->lock);
+	xw->quit = true;
+	pthread_cond_signal(&xw->cond);
+	pthread_mutex_unlock(&xw->lock);
+	pthread_join(xw->thread, NULL);
+
+	ev_async_stop(xw->ps->loop, &xw->answered);
+	x_worker_queue_free(&xw->pending);
+	x_worker_queue_free(&xw->done);
+	pthread_cond_destroy(&xw->cond);
+	pthread_mutex_destroy(&xw->lock);
+	xcb_disconnect(xw->c);
+	free(xw);
+}
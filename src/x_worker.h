@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+#pragma once
+#include <stdbool.h>
+#include <xcb/xcb.h>
+
+typedef struct session session_t;
+struct managed_win;
+struct x_worker;
+
+/// Most properties a single query can try
+#define X_WORKER_MAX_ATOMS 2
+
+/// Called on the main thread with the reply of a property query. `reply` is the first
+/// of the requested properties that is set, or NULL if none is. The reply is freed
+/// after the callback returns.
+typedef void (*x_worker_prop_cb_t)(session_t *ps, struct managed_win *w,
+                                   const xcb_get_property_reply_t *reply);
+
+/// Start a worker thread with its own connection to `display`, that serves read-only
+/// queries without blocking the main loop. Returns NULL on failure, in which case
+/// the caller should make the queries synchronously.
+struct x_worker *x_worker_new(session_t *ps, const char *display);
+
+/// Fetch the first of `atoms` that is set on `wid`, on behalf of `w`. The answer is
+/// dropped if `w` is destroyed, or its client window changes, before it arrives.
+bool x_worker_get_prop(struct x_worker *xw, const struct managed_win *w, xcb_window_t wid,
+                       const xcb_atom_t *atoms, int natoms, x_worker_prop_cb_t cb);
+
+void x_worker_destroy(struct x_worker *xw);
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+
+# Compare the compute shader and the fragment shader blur of the glx backend, at
+# several blur sizes and screen resolutions. Each run starts its own Xvfb, covers the
+# screen with a translucent window, and times how long picom takes to render a fixed
+# number of frames with --benchmark.
+#
+# This is not part of the test suite, since the timings depend on the machine.
+#
+# Usage: bench_blur.py path/to/picom [frames]
+
+import os
+import subprocess
+import sys
+import time
+import xcffib
+import xcffib.xproto as xproto
+from common import to_atom
+
+RESOLUTIONS = [(1280, 720), (1920, 1080), (3840, 2160)]
+BLUR_SIZES = [3, 9, 21, 41]
+MODES = {"compute": [], "fragment": ["--glx-no-compute-blur"]}
+
+exe = os.path.realpath(sys.argv[1])
+frames = int(sys.argv[2]) if len(sys.argv) > 2 else 200
+
+def start_xvfb(width, height):
+    read_fd, write_fd = os.pipe()
+    xvfb = subprocess.Popen(["Xvfb", "-displayfd", str(write_fd), "-screen", "0",
+                             "{}x{}x24".format(width, height), "+extension", "composite",
+                             "+extension", "GLX"], pass_fds=[write_fd])
+    os.close(write_fd)
+    with os.fdopen(read_fd) as f:
+        display = ":" + f.readline().strip()
+    return xvfb, display
+
+def cover_screen(display, width, height):
+    conn = xcffib.connect(display=display)
+    setup = conn.get_setup()
+    root = setup.roots[0].root
+    visual = setup.roots[0].root_visual
+    depth = setup.roots[0].root_depth
+
+    wid = conn.generate_id()
+    conn.core.CreateWindowChecked(depth, wid, root, 0, 0, width, height, 0,
+                                  xproto.WindowClass.InputOutput, visual,
+                                  xproto.CW.BackPixel, [0x336699]).check()
+    opacity = to_atom(conn, "_NET_WM_WINDOW_OPACITY")
+    conn.core.ChangePropertyChecked(xproto.PropMode.Replace, wid, opacity,
+                                    xproto.Atom.CARDINAL, 32, 1, [0x7fffffff]).check()
+    conn.core.MapWindowChecked(wid).check()
+    return conn
+
+def run(display, size, mode_args):
+    args = [exe, "--config=/dev/null", "--experimental-backends", "--backend", "glx",
+            "--blur-background", "--blur-method", "gaussian", "--blur-size", str(size),
+            "--blur-deviation", str(size / 3), "--benchmark", str(frames)] + mode_args
+    start = time.monotonic()
+    subprocess.run(args, env=dict(os.environ, DISPLAY=display), check=True,
+                   stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    return (time.monotonic() - start) * 1000 / frames
+
+print("{:>10} {:>5} {:>12} {:>12}".format("resolution", "size", *MODES.keys()))
+for width, height in RESOLUTIONS:
+    xvfb, display = start_xvfb(width, height)
+    try:
+        conn = cover_screen(display, width, height)
+        for size in BLUR_SIZES:
+            times = [run(display, size, args) for args in MODES.values()]
+            print("{:>10} {:>5} {:>9.2f} ms {:>9.2f} ms".format(
+                "{}x{}".format(width, height), size, *times), flush=True)
+        conn.disconnect()
+    finally:
+        xvfb.terminate()
+        xvfb.wait()
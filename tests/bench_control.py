@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+
+# Compare the request throughput of the control socket and the D-Bus interface. Starts
+# its own Xvfb and picom, then sends the same opts_get request through both, one round
+# trip at a time, and pipelined.
+#
+# This is not part of the test suite, since the numbers depend on the machine. It needs
+# a D-Bus session bus and XDG_RUNTIME_DIR.
+#
+# Usage: dbus-run-session bench_control.py path/to/picom [requests]
+
+import asyncio
+import os
+import subprocess
+import sys
+import time
+from dbus_next.aio import MessageBus
+from dbus_next.message import Message
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.realpath(__file__)), "testcases"))
+from common import ControlClient, control_socket_path
+
+exe = os.path.realpath(sys.argv[1])
+requests = int(sys.argv[2]) if len(sys.argv) > 2 else 10000
+
+def start_xvfb():
+    read_fd, write_fd = os.pipe()
+    xvfb = subprocess.Popen(["Xvfb", "-displayfd", str(write_fd), "+extension", "composite"],
+                            pass_fds=[write_fd])
+    os.close(write_fd)
+    with os.fdopen(read_fd) as f:
+        display = ":" + f.readline().strip()
+    return xvfb, display
+
+def dbus_message():
+    display = os.environ["DISPLAY"].replace(":", "_").replace(".", "_")
+    return Message(destination="com.github.chjj.compton." + display, path="/",
+                   interface="com.github.chjj.compton", member="opts_get", signature="s",
+                   body=["fade_delta"])
+
+async def dbus_sequential(bus):
+    for _ in range(requests):
+        await bus.call(dbus_message())
+
+async def dbus_pipelined(bus):
+    await asyncio.gather(*[bus.call(dbus_message()) for _ in range(requests)])
+
+def control_sequential(client):
+    for _ in range(requests):
+        client.call("opts_get", "fade_delta")
+
+def control_pipelined(client):
+    for _ in range(requests):
+        client.send("opts_get", "fade_delta")
+    client.flush()
+    for _ in range(requests):
+        client.recv()
+
+def measure(name, func):
+    start = time.monotonic()
+    func()
+    elapsed = time.monotonic() - start
+    print("{:>26} {:>12.0f} requests/s".format(name, requests / elapsed), flush=True)
+
+xvfb, display = start_xvfb()
+os.environ["DISPLAY"] = display
+picom = subprocess.Popen([exe, "--config=/dev/null", "--experimental-backends", "--backend",
+                          "dummy", "--dbus", "--control-socket"],
+                         stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+try:
+    for _ in range(50):
+        if os.path.exists(control_socket_path()):
+            break
+        time.sleep(0.1)
+    # Give picom time to claim its D-Bus name too
+    time.sleep(1)
+
+    loop = asyncio.get_event_loop()
+    bus = loop.run_until_complete(MessageBus().connect())
+    client = ControlClient()
+
+    measure("D-Bus, sequential", lambda: loop.run_until_complete(dbus_sequential(bus)))
+    measure("D-Bus, pipelined", lambda: loop.run_until_complete(dbus_pipelined(bus)))
+    measure("control socket, sequential", lambda: control_sequential(client))
+    measure("control socket, pipelined", lambda: control_pipelined(client))
+finally:
+    picom.terminate()
+    picom.wait()
+    xvfb.terminate()
+    xvfb.wait()
@@ -5,6 +5,11 @@ cd $(dirname $0)
 
 eval `dbus-launch --sh-syntax`
 
+# The control socket is created in the runtime directory
+if [ -z "$XDG_RUNTIME_DIR" ]; then
+	export XDG_RUNTIME_DIR=$(mktemp -d)
+fi
+
 ./run_one_test.sh $exe configs/empty.conf testcases/basic.py
 ./run_one_test.sh $exe configs/issue357.conf testcases/issue357.py
 ./run_one_test.sh $exe configs/issue239.conf testcases/issue239.py
@@ -15,3 +20,7 @@ eval `dbus-launch --sh-syntax`
 ./run_one_test.sh $exe configs/issue314.conf testcases/issue314_2.py
 ./run_one_test.sh $exe configs/issue314.conf testcases/issue314_3.py
 ./run_one_test.sh $exe /dev/null testcases/issue299.py
+./run_one_test.sh $exe configs/empty.conf testcases/idle_wakeups.py
+./run_one_test.sh $exe configs/idle_trim.conf testcases/idle_trim.py
+./run_one_test.sh $exe configs/control_socket.conf testcases/control_socket.py
+./run_one_test.sh $exe configs/window_storm.conf testcases/window_storm.py
@@ -4,6 +4,9 @@ import xcffib
 import time
 import random
 import string
+import os
+import socket
+import struct
 
 def to_atom(conn, string):
     return conn.core.InternAtom(False, len(string), string).reply().atom
@@ -74,3 +77,112 @@ def find_32bit_visual(conn):
             for pv in depth.visuals:
                 if pv.format in pictfmt_ids:
                     return pv.visual
+
+# Client of the control socket, see src/control.h for the protocol
+CONTROL_OPS = {"version_get": 1, "reset": 2, "repaint": 3, "list_win": 4, "win_get": 5,
+               "win_set": 6, "find_win": 7, "opts_get": 8, "opts_set": 9, "stats_get": 10,
+               "transaction_begin": 11, "transaction_commit": 12}
+CONTROL_STATUS = ["ok", "bad_message", "bad_op", "bad_window", "bad_target"]
+CONTROL_HEADER = struct.Struct("=IIBBH")
+CONTROL_NO_REPLY = 1
+
+class Int32(int):
+    """Sent as a signed 32-bit integer, other ints are sent unsigned"""
+
+def runtime_file_path(suffix):
+    display = "".join(c if c.isalnum() else "_" for c in os.environ["DISPLAY"])
+    return os.path.join(os.environ["XDG_RUNTIME_DIR"], "picom-" + display + suffix)
+
+def control_socket_path():
+    return runtime_file_path(".sock")
+
+def control_encode_value(value):
+    if isinstance(value, bool):
+        return struct.pack("=BB", 1, value)
+    if isinstance(value, Int32):
+        return struct.pack("=Bi", 2, value)
+    if isinstance(value, int):
+        return struct.pack("=BI", 3, value)
+    if isinstance(value, float):
+        return struct.pack("=Bd", 5, value)
+    value = value.encode()
+    return struct.pack("=BI", 6, len(value)) + value
+
+def control_decode_values(body):
+    values = []
+    pos = 0
+    while pos < len(body):
+        kind = body[pos]
+        pos += 1
+        fmt = {1: "=B", 2: "=i", 3: "=I", 4: "=Q", 5: "=d", 6: "=I", 7: "=I"}[kind]
+        value, = struct.unpack_from(fmt, body, pos)
+        pos += struct.calcsize(fmt)
+        if kind == 1:
+            value = bool(value)
+        elif kind == 6:
+            value, pos = body[pos:pos + value].decode(), pos + value
+        elif kind == 7:
+            value, pos = list(struct.unpack_from("=%dI" % value, body, pos)), pos + 4 * value
+        values.append(value)
+    return values
+
+class ControlError(Exception):
+    pass
+
+# Start of the statistics page, up to `frames`, see src/stats.h for the layout
+STATS_HEADER = struct.Struct("=IIIIqQQ")
+
+def stats_page_frames():
+    """Number of frames rendered, read from the statistics page"""
+    with open(runtime_file_path(".stats"), "rb") as f:
+        while True:
+            f.seek(0)
+            _, _, _, seq, _, _, frames = STATS_HEADER.unpack(f.read(STATS_HEADER.size))
+            f.seek(0)
+            _, _, _, seq_after, _, _, _ = STATS_HEADER.unpack(f.read(STATS_HEADER.size))
+            # Otherwise the page was being updated, try again
+            if seq % 2 == 0 and seq == seq_after:
+                return frames
+
+class ControlClient:
+    def __init__(self, path=None):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(path or control_socket_path())
+        self.serial = 0
+        self.outgoing = []
+        self.incoming = b""
+
+    def send(self, op, *args, no_reply=False):
+        """Queue a request, returns its serial"""
+        self.serial += 1
+        body = b"".join(control_encode_value(arg) for arg in args)
+        flags = CONTROL_NO_REPLY if no_reply else 0
+        self.outgoing.append(CONTROL_HEADER.pack(CONTROL_HEADER.size + len(body), self.serial,
+                                                 CONTROL_OPS[op], flags, 0) + body)
+        return self.serial
+
+    def flush(self):
+        self.sock.sendall(b"".join(self.outgoing))
+        self.outgoing = []
+
+    def recv(self):
+        """Read the next reply, returns its serial, status and values"""
+        while True:
+            if len(self.incoming) >= CONTROL_HEADER.size:
+                size, serial, status, _, _ = CONTROL_HEADER.unpack_from(self.incoming)
+                if len(self.incoming) >= size:
+                    body, self.incoming = self.incoming[CONTROL_HEADER.size:size], self.incoming[size:]
+                    return serial, CONTROL_STATUS[status], control_decode_values(body)
+            data = self.sock.recv(65536)
+            if not data:
+                raise ControlError("connection closed")
+            self.incoming += data
+
+    def call(self, op, *args):
+        serial = self.send(op, *args)
+        self.flush()
+        reply_serial, status, values = self.recv()
+        assert reply_serial == serial
+        if status != "ok":
+            raise ControlError(status)
+        return values
@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+
+# Check requests on the control socket, pipelined and not
+
+import xcffib.xproto as xproto
+import xcffib
+import os
+import time
+from common import ControlClient, ControlError, Int32, control_socket_path, set_window_name
+
+conn = xcffib.connect()
+setup = conn.get_setup()
+root = setup.roots[0].root
+visual = setup.roots[0].root_visual
+depth = setup.roots[0].root_depth
+
+# Wait for picom to create the socket
+for _ in range(50):
+    if os.path.exists(control_socket_path()):
+        break
+    time.sleep(0.1)
+client = ControlClient()
+
+wid = conn.generate_id()
+conn.core.CreateWindowChecked(depth, wid, root, 0, 0, 100, 100, 0, xproto.WindowClass.InputOutput, visual, 0, []).check()
+set_window_name(conn, wid, "Test window")
+conn.core.MapWindowChecked(wid).check()
+time.sleep(0.5)
+
+assert client.call("version_get") == [1]
+assert wid in client.call("list_win")[0]
+assert client.call("win_get", wid, "name") == ["Test window"]
+assert client.call("win_set", wid, "shadow_force", 1) == [True]
+assert client.call("win_get", wid, "shadow_force") == [1]
+assert client.call("opts_set", "fade_delta", Int32(7)) == [True]
+assert client.call("opts_get", "fade_delta") == [7]
+
+for op, args, error in [("win_get", [0, "name"], "bad_window"),
+                        ("opts_get", ["no_such_option"], "bad_target"),
+                        ("opts_set", ["fade_delta", "not a number"], "bad_message")]:
+    try:
+        client.call(op, *args)
+        assert False, op
+    except ControlError as e:
+        assert str(e) == error, (op, e)
+
+# Replies to pipelined requests come back in order, requests without replies are
+# still processed
+serials = [client.send("opts_get", "fade_delta") for _ in range(1000)]
+client.send("opts_set", "fade_delta", Int32(9), no_reply=True)
+serials.append(client.send("opts_get", "fade_delta"))
+client.flush()
+replies = [client.recv() for _ in serials]
+assert [serial for serial, _, _ in replies] == serials
+assert all(values == [7] for _, _, values in replies[:-1])
+assert replies[-1][2] == [9]
+
+conn.core.DestroyWindowChecked(wid).check()
@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+
+# Check that the memory is trimmed once per idle period, and that picom keeps
+# rendering afterwards
+
+import xcffib.xproto as xproto
+import xcffib
+import time
+import os
+import sys
+import asyncio
+from dbus_next.aio import MessageBus
+from dbus_next.message import Message
+from common import set_window_name
+
+display = os.environ["DISPLAY"].replace(":", "_")
+conn = xcffib.connect()
+setup = conn.get_setup()
+root = setup.roots[0].root
+visual = setup.roots[0].root_visual
+depth = setup.roots[0].root_depth
+
+async def get_trims_async():
+    message = await bus.call(Message(destination='com.github.chjj.compton.'+display,
+        path='/',
+        interface='com.github.chjj.compton',
+        member='stats_get',
+        signature='s',
+        body=['wakeups_idle_trim_timer']))
+    return message.body[0]
+
+def get_trims():
+    return loop.run_until_complete(get_trims_async())
+
+def create_window(name):
+    wid = conn.generate_id()
+    conn.core.CreateWindowChecked(depth, wid, root, 0, 0, 100, 100, 0, xproto.WindowClass.InputOutput, visual, 0, []).check()
+    set_window_name(conn, wid, name)
+    conn.core.MapWindowChecked(wid).check()
+    return wid
+
+loop = asyncio.get_event_loop()
+bus = loop.run_until_complete(MessageBus().connect())
+
+# The delay is 500ms, stay idle for much longer than that
+wid1 = create_window("Test window 1")
+time.sleep(2)
+trims = get_trims()
+print("Trims after the first idle period: ", trims)
+if trims != 1:
+    sys.exit(1)
+
+# A new frame restarts the countdown
+wid2 = create_window("Test window 2")
+time.sleep(2)
+trims = get_trims()
+print("Trims after the second idle period: ", trims)
+
+conn.core.DestroyWindowChecked(wid1).check()
+conn.core.DestroyWindowChecked(wid2).check()
+
+if trims != 2:
+    sys.exit(1)
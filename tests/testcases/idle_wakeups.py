@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+
+# Check that picom doesn't wake up when nothing on screen changes
+
+import xcffib.xproto as xproto
+import xcffib
+import time
+import os
+import sys
+import asyncio
+from dbus_next.aio import MessageBus
+from dbus_next.message import Message
+from common import set_window_name
+
+# D-Bus traffic is excluded, since reading the counters causes it
+SOURCES = ["x_event", "draw", "fade_timer", "unredir_timer", "delayed_draw_timer",
+           "transaction_timer", "vblank", "dbus_timeout", "signal", "config_watch",
+           "x_worker", "x_error_timer", "control", "idle_trim_timer",
+           "handoff_timer"]
+
+display = os.environ["DISPLAY"].replace(":", "_")
+conn = xcffib.connect()
+setup = conn.get_setup()
+root = setup.roots[0].root
+visual = setup.roots[0].root_visual
+depth = setup.roots[0].root_depth
+
+async def get_wakeups_async(source):
+    message = await bus.call(Message(destination='com.github.chjj.compton.'+display,
+        path='/',
+        interface='com.github.chjj.compton',
+        member='stats_get',
+        signature='s',
+        body=['wakeups_'+source]))
+    return message.body[0]
+
+def get_wakeups():
+    return {source: loop.run_until_complete(get_wakeups_async(source)) for source in SOURCES}
+
+loop = asyncio.get_event_loop()
+bus = loop.run_until_complete(MessageBus().connect())
+
+# Give picom something to composite, then let it settle
+wid = conn.generate_id()
+conn.core.CreateWindowChecked(depth, wid, root, 0, 0, 100, 100, 0, xproto.WindowClass.InputOutput, visual, 0, []).check()
+set_window_name(conn, wid, "Test window")
+conn.core.MapWindowChecked(wid).check()
+time.sleep(2)
+
+before = get_wakeups()
+time.sleep(10)
+after = get_wakeups()
+print("Wakeups before: ", before)
+print("Wakeups after: ", after)
+
+conn.core.DestroyWindowChecked(wid).check()
+
+woken = [source for source in SOURCES if after[source] != before[source]]
+if woken:
+    print("Woken up while idle by: ", woken)
+    sys.exit(1)
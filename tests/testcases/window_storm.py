@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+
+# Map many windows at once. They are handled over several frames, check they all end
+# up managed, and picom keeps drawing frames and answering requests in the meantime.
+
+import xcffib.xproto as xproto
+import xcffib
+import os
+import time
+from common import ControlClient, control_socket_path, runtime_file_path, stats_page_frames
+
+NWINDOWS = 500
+
+conn = xcffib.connect()
+setup = conn.get_setup()
+root = setup.roots[0].root
+visual = setup.roots[0].root_visual
+depth = setup.roots[0].root_depth
+
+# Wait for picom to create the socket and the statistics page
+for _ in range(50):
+    if os.path.exists(control_socket_path()) and os.path.exists(runtime_file_path(".stats")):
+        break
+    time.sleep(0.1)
+client = ControlClient()
+# Let picom draw its first frame
+time.sleep(0.5)
+
+wids = []
+for i in range(NWINDOWS):
+    wid = conn.generate_id()
+    conn.core.CreateWindow(depth, wid, root, i % 100, i // 100, 100, 100, 0,
+                           xproto.WindowClass.InputOutput, visual, 0, [])
+    conn.core.MapWindow(wid)
+    wids.append(wid)
+conn.flush()
+
+def all_managed():
+    # Windows picom hasn't got to yet are not managed, win_get fails on them
+    for wid in wids:
+        client.send("win_get", wid, "map_state")
+    client.flush()
+    replies = [client.recv() for _ in wids]
+    return all(status == "ok" and values == [True] for _, status, values in replies)
+
+# A frame counter read before one check that found unmanaged windows, and lower than
+# the one read before the next such check, means a frame was drawn during the storm
+last_frames = None
+drew_during_storm = False
+for _ in range(1000):
+    frames = stats_page_frames()
+    if all_managed():
+        break
+    if last_frames is not None and frames > last_frames:
+        drew_during_storm = True
+    last_frames = frames
+    time.sleep(0.01)
+else:
+    assert False, "Not all windows are managed"
+assert drew_during_storm, "No frame was drawn while windows were still unmanaged"
+
+for wid in wids:
+    conn.core.DestroyWindow(wid)
+conn.flush()
+client.call("version_get")
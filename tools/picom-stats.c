@@ -0,0 +1,190 @@
+// SPDX-License-Identifier: MPL-2.0
+// Copyright (c) Yuxuan Shui <yshuiv7@gmail.com>
+
+/// picom-stats: print the content of the statistics page picom publishes with
+/// --stats-page. Reading the page never wakes up picom.
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stats.h"
+
+/// How many times to retry when the page is being updated while we read it
+#define MAX_TRIES 1000
+
+static void usage(const char *argv0, FILE *f) {
+	fprintf(f,
+	        "Usage: %s [-i SECONDS] [FILE]\n"
+	        "\n"
+	        "Print the statistics published by picom --stats-page.\n"
+	        "\n"
+	        "  -i SECONDS  Print the statistics every SECONDS seconds.\n"
+	        "  FILE        The statistics page. Defaults to\n"
+	        "              $XDG_RUNTIME_DIR/picom-<DISPLAY>.stats.\n",
+	        argv0);
+}
+
+/// Path of the statistics page of the current display, same as the one picom uses.
+static char *default_path(void) {
+	const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+	const char *display = getenv("DISPLAY");
+	if (!runtime_dir || !*runtime_dir || !display) {
+		fprintf(stderr, "XDG_RUNTIME_DIR or DISPLAY is not set, please specify "
+		                "the statistics page.\n");
+		return NULL;
+	}
+
+	size_t path_len = strlen(runtime_dir) + strlen(display) + strlen("/picom-.stats") + 1;
+	char *path = calloc(path_len, 1);
+	if (!path) {
+		return NULL;
+	}
+	snprintf(path, path_len, "%s/picom-%s.stats", runtime_dir, display);
+
+	char *name = path + strlen(runtime_dir) + strlen("/picom-");
+	for (size_t i = 0; i < strlen(display); i++) {
+		if (!isalnum((unsigned char)name[i])) {
+			name[i] = '_';
+		}
+	}
+	return path;
+}
+
+/// Take a consistent snapshot of the page. Fields the compositor doesn't know about
+/// are left zeroed.
+static bool read_page(const struct picom_stats_page *page, size_t map_size,
+                      struct picom_stats_page *out) {
+	if (map_size < offsetof(struct picom_stats_page, frames) ||
+	    __atomic_load_n(&page->magic, __ATOMIC_ACQUIRE) != PICOM_STATS_MAGIC) {
+		fprintf(stderr, "The statistics page is not ready.\n");
+		return false;
+	}
+	if (page->version != PICOM_STATS_VERSION) {
+		fprintf(stderr, "Unsupported statistics page version %" PRIu32 ".\n",
+		        page->version);
+		return false;
+	}
+
+	size_t size = page->size;
+	if (size > map_size) {
+		size = map_size;
+	}
+	if (size > sizeof(*out)) {
+		size = sizeof(*out);
+	}
+	for (int i = 0; i < MAX_TRIES; i++) {
+		uint32_t seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			// An update is in progress
+			sched_yield();
+			continue;
+		}
+		memset(out, 0, sizeof(*out));
+		memcpy(out, page, size);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq) {
+			return true;
+		}
+	}
+	fprintf(stderr, "Could not get a consistent snapshot of the statistics page.\n");
+	return false;
+}
+
+static void print_page(const struct picom_stats_page *p) {
+	printf("pid: %" PRId64 "\n", p->pid);
+	printf("update_time_us: %" PRIu64 "\n", p->update_time_us);
+	printf("frames: %" PRIu64 "\n", p->frames);
+	printf("render_time_us: %" PRIu64 "\n", p->render_time_us);
+	printf("last_render_time_us: %" PRIu64 "\n", p->last_render_time_us);
+	printf("damaged_pixels: %" PRIu64 "\n", p->damaged_pixels);
+	printf("last_damaged_pixels: %" PRIu64 "\n", p->last_damaged_pixels);
+	printf("x_round_trips: %" PRIu64 "\n", p->x_round_trips);
+	printf("windows: %" PRIu64 "\n", p->windows);
+	printf("managed_windows: %" PRIu64 "\n", p->managed_windows);
+	printf("mapped_windows: %" PRIu64 "\n", p->mapped_windows);
+	uint32_t nsources = p->nwakeup_sources;
+	if (nsources > PICOM_STATS_MAX_WAKEUP_SOURCES) {
+		nsources = PICOM_STATS_MAX_WAKEUP_SOURCES;
+	}
+	for (uint32_t i = 0; i < nsources; i++) {
+		printf("wakeups_%.*s: %" PRIu64 "\n", PICOM_STATS_NAME_LEN,
+		       p->wakeup_source_names[i], p->wakeups[i]);
+	}
+}
+
+int main(int argc, char **argv) {
+	double interval = 0;
+	int o;
+	while ((o = getopt(argc, argv, "i:h")) != -1) {
+		switch (o) {
+		case 'i': interval = atof(optarg); break;
+		case 'h': usage(argv[0], stdout); return 0;
+		default: usage(argv[0], stderr); return 1;
+		}
+	}
+
+	char *path = optind < argc ? strdup(argv[optind]) : default_path();
+	if (!path) {
+		return 1;
+	}
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+		free(path);
+		return 1;
+	}
+	free(path);
+
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+		fprintf(stderr, "The statistics page is empty.\n");
+		close(fd);
+		return 1;
+	}
+	size_t map_size = (size_t)st.st_size;
+	const struct picom_stats_page *page =
+	    mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (page == MAP_FAILED) {
+		fprintf(stderr, "Failed to map the statistics page: %s\n", strerror(errno));
+		return 1;
+	}
+
+	int ret = 0;
+	struct picom_stats_page snapshot;
+	while (true) {
+		if (!read_page(page, map_size, &snapshot)) {
+			ret = 1;
+			break;
+		}
+		print_page(&snapshot);
+		if (interval <= 0) {
+			break;
+		}
+		printf("\n");
+		fflush(stdout);
+
+		struct timespec ts = {
+		    .tv_sec = (time_t)interval,
+		    .tv_nsec = (long)((interval - (double)(time_t)interval) * 1e9),
+		};
+		nanosleep(&ts, NULL);
+	}
+
+	munmap((void *)page, map_size);
+	return ret;
+}